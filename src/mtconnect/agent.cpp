@@ -51,6 +51,8 @@
 #include "mtconnect/entity/xml_parser.hpp"
 #include "mtconnect/logging.hpp"
 #include "mtconnect/observation/observation.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
+#include "mtconnect/printer/cbor_printer.hpp"
 #include "mtconnect/printer/json_printer.hpp"
 #include "mtconnect/printer/xml_printer.hpp"
 #include "mtconnect/sink/rest_sink/file_cache.hpp"
@@ -99,6 +101,12 @@ namespace mtconnect {
         GetOption<int>(options, mtconnect::configuration::MaxAssets).value_or(1024));
     m_versionDeviceXml = IsOptionSet(options, mtconnect::configuration::VersionDeviceXml);
     m_createUniqueIds = IsOptionSet(options, config::CreateUniqueIds);
+    observation::FragmentCache::setBudget(
+        ConvertFileSize(options, config::ObservationCacheSize, 64 * 1024 * 1024));
+    AssetFragmentCache::setBudget(
+        ConvertFileSize(options, config::AssetCacheSize, 16 * 1024 * 1024));
+    printer::BufferPool::global().setBudget(
+        ConvertFileSize(options, config::OutputBufferPoolSize, 8 * 1024 * 1024));
 
     auto jsonVersion =
         uint32_t(GetOption<int>(options, mtconnect::configuration::JsonVersion).value_or(2));
@@ -106,6 +114,7 @@ namespace mtconnect {
     // Create the Printers
     m_printers["xml"] = make_unique<printer::XmlPrinter>(m_pretty);
     m_printers["json"] = make_unique<printer::JsonPrinter>(jsonVersion, m_pretty);
+    m_printers["cbor"] = make_unique<printer::CborPrinter>();
 
     if (m_schemaVersion)
     {
@@ -552,6 +561,7 @@ namespace mtconnect {
         }
 
         initializeDataItems(device, skip);
+        orderDataItems();
 
         LOG(info) << "Device " << *uuid << " updating circular buffer";
         m_circularBuffer.updateDataItems(m_dataItemMap);
@@ -937,10 +947,44 @@ namespace mtconnect {
     if (m_intSchemaVersion >= SCHEMA_VERSION(2, 2))
       device->addHash();
 
+    orderDataItems();
+
     for (auto &printer : m_printers)
       printer.second->setModelChangeTime(getCurrentTime(GMT_UV_SEC));
   }
 
+  // Number the data items in the order of the streams documents so the printers can group
+  // observations without comparing ids.
+  void Agent::orderDataItems()
+  {
+    NAMED_SCOPE("Agent::orderDataItems");
+
+    vector<DataItemPtr> dataItems;
+    for (auto &device : m_deviceIndex)
+    {
+      for (auto &di : device->getDeviceDataItems())
+      {
+        if (auto dataItem = di.lock())
+          dataItems.emplace_back(dataItem);
+      }
+    }
+
+    sort(dataItems.begin(), dataItems.end(),
+         [](const DataItemPtr &a, const DataItemPtr &b) { return *a < *b; });
+
+    std::unique_lock lock(DataItem::getOrdinalMutex());
+    uint32_t ordinal = 0, group = 0;
+    const DataItem *last = nullptr;
+    for (auto &dataItem : dataItems)
+    {
+      if (last == nullptr || last->getComponent() != dataItem->getComponent() ||
+          last->getCategory() != dataItem->getCategory())
+        group++;
+      dataItem->setOrdinal(++ordinal, group);
+      last = dataItem.get();
+    }
+  }
+
   void Agent::deviceChanged(DevicePtr device, const std::string &oldUuid,
                             const std::string &oldName)
   {
@@ -967,6 +1011,7 @@ namespace mtconnect {
     if (changed)
     {
       createUniqueIds(device);
+      orderDataItems();
       if (m_intSchemaVersion >= SCHEMA_VERSION(2, 2))
         device->addHash();
 
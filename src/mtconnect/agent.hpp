@@ -441,6 +441,7 @@ namespace mtconnect {
     void verifyDevice(DevicePtr device);
     void initializeDataItems(DevicePtr device,
                              std::optional<std::set<std::string>> skip = std::nullopt);
+    void orderDataItems();
     void loadCachedProbe();
     void versionDeviceXml();
 
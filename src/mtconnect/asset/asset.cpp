@@ -25,6 +25,59 @@ using namespace std;
 namespace mtconnect {
   using namespace entity;
   namespace asset {
+    atomic<size_t> AssetFragmentCache::s_budget {16 * 1024 * 1024};
+    atomic<size_t> AssetFragmentCache::s_size {0};
+
+    bool AssetFragmentCache::put(Format format, uint64_t key, std::string_view text,
+                                 uint64_t generation) const
+    {
+      auto current = atomic_load(&m_fragments[format]);
+      if ((current && current->m_key == key) || this->generation() != generation)
+        return false;
+
+      auto fragment = make_shared<const Fragment>(Fragment {key, string(text)});
+      auto size = sizeOf(*fragment);
+      if (s_size.fetch_add(size, memory_order_relaxed) + size >
+          s_budget.load(memory_order_relaxed))
+      {
+        s_size.fetch_sub(size, memory_order_relaxed);
+        return false;
+      }
+
+      // Another request may have rendered the asset at the same time
+      if (!atomic_compare_exchange_strong(&m_fragments[format], &current, fragment))
+      {
+        s_size.fetch_sub(size, memory_order_relaxed);
+        return false;
+      }
+
+      if (current)
+        s_size.fetch_sub(sizeOf(*current), memory_order_relaxed);
+
+      // The asset changed while it was rendered. clear() advances the generation before it
+      // empties the slots, so either it removes the fragment or the fragment is removed here.
+      if (this->generation() != generation)
+      {
+        FragmentPtr installed = fragment;
+        if (atomic_compare_exchange_strong(&m_fragments[format], &installed, FragmentPtr()))
+          s_size.fetch_sub(size, memory_order_relaxed);
+        return false;
+      }
+
+      return true;
+    }
+
+    void AssetFragmentCache::clear() const
+    {
+      m_generation.fetch_add(1, memory_order_acq_rel);
+      for (auto &slot : m_fragments)
+      {
+        if (auto old = atomic_exchange(&slot, FragmentPtr()))
+          s_size.fetch_sub(sizeOf(*old), memory_order_relaxed);
+      }
+      atomic_store(&m_hash, std::shared_ptr<const std::string>());
+    }
+
     FactoryPtr Asset::getFactory()
     {
       static auto asset = make_shared<Factory>(
@@ -17,13 +17,18 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <list>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 
 #include "mtconnect/config.hpp"
 #include "mtconnect/entity/entity.hpp"
 #include "mtconnect/entity/factory.hpp"
+#include "mtconnect/observation/fragment_cache.hpp"
 #include "mtconnect/utilities.hpp"
 
 namespace mtconnect {
@@ -33,6 +38,104 @@ namespace mtconnect {
     using AssetPtr = std::shared_ptr<Asset>;
     using AssetList = std::list<AssetPtr>;
 
+    /// @brief Serialized forms of an asset shared by all asset requests
+    ///
+    /// Assets are read far more often than they change. Each format is rendered the first time
+    /// the asset is printed and dropped when a property of the asset changes, such as when it is
+    /// removed. Readers hold a reference to the fragment so it can be dropped while it is being
+    /// written. The total size of all fragments is limited by a global budget.
+    ///
+    /// Every change advances the generation of the cache. A fragment or hash is only kept if the
+    /// generation is the same as when rendering started, so a render that races a change cannot
+    /// leave stale content behind.
+    class AGENT_LIB_API AssetFragmentCache
+    {
+    public:
+      using Format = observation::FragmentCache::Format;
+      using Fragment = observation::FragmentCache::Fragment;
+      using FragmentPtr = std::shared_ptr<const Fragment>;
+
+      AssetFragmentCache() = default;
+      AssetFragmentCache(const AssetFragmentCache &) {}
+      ~AssetFragmentCache() { clear(); }
+      AssetFragmentCache &operator=(const AssetFragmentCache &)
+      {
+        clear();
+        return *this;
+      }
+
+      /// @brief get the fragment for a format if it was rendered with the same key
+      /// @param[in] format the format
+      /// @param[in] key the key of the printer
+      /// @return the fragment or `nullptr` if it has not been cached
+      FragmentPtr get(Format format, uint64_t key) const
+      {
+        auto fragment = std::atomic_load(&m_fragments[format]);
+        if (fragment && fragment->m_key == key)
+          return fragment;
+        else
+          return nullptr;
+      }
+
+      /// @brief get the generation, taken before rendering a fragment
+      uint64_t generation() const { return m_generation.load(std::memory_order_acquire); }
+
+      /// @brief cache a fragment if there is room in the budget, replaces a fragment rendered
+      /// with a different key
+      /// @param[in] format the format
+      /// @param[in] key the key of the printer
+      /// @param[in] text the rendered asset
+      /// @param[in] generation the generation when rendering started
+      /// @return `true` if the fragment was cached
+      bool put(Format format, uint64_t key, std::string_view text, uint64_t generation) const;
+
+      /// @brief drop all the fragments and the content hash and advance the generation
+      void clear() const;
+
+      /// @brief get the hash of the asset content, computing and caching it if necessary
+      /// @param[in] compute function that computes the hash
+      /// @return the hash
+      template <typename F>
+      std::string hash(F compute) const
+      {
+        if (auto hash = std::atomic_load(&m_hash))
+          return *hash;
+
+        auto generation = this->generation();
+        auto hash = std::make_shared<const std::string>(compute());
+        std::shared_ptr<const std::string> empty;
+        if (std::atomic_compare_exchange_strong(&m_hash, &empty, hash) &&
+            this->generation() != generation)
+        {
+          // The asset changed while the hash was computed
+          std::atomic_compare_exchange_strong(&m_hash, &hash, empty);
+        }
+        return *hash;
+      }
+
+      /// @brief set the maximum number of bytes for all fragments, 0 disables the cache
+      /// @param budget the budget in bytes
+      static void setBudget(size_t budget) { s_budget.store(budget, std::memory_order_relaxed); }
+      /// @brief get the maximum number of bytes for all fragments
+      static size_t getBudget() { return s_budget.load(std::memory_order_relaxed); }
+      /// @brief get the number of bytes currently used by all fragments
+      static size_t getSize() { return s_size.load(std::memory_order_relaxed); }
+
+    protected:
+      static size_t sizeOf(const Fragment &fragment)
+      {
+        return sizeof(Fragment) + fragment.m_text.capacity();
+      }
+
+    protected:
+      mutable std::array<FragmentPtr, Format::FORMAT_COUNT> m_fragments;
+      mutable std::shared_ptr<const std::string> m_hash;
+      mutable std::atomic<uint64_t> m_generation {0};
+
+      static std::atomic<size_t> s_budget;
+      static std::atomic<size_t> s_size;
+    };
+
     /// @brief An abstract MTConnect Asset
     ///
     /// The asset provides a common factory to create all known asset types. It can
@@ -66,7 +169,8 @@ namespace mtconnect {
 
       /// @brief Sets a property of the asset
       ///
-      /// Special handling of `removed`. If `true` sets the asset state to removed.
+      /// Special handling of `removed`. If `true` sets the asset state to removed. Any change
+      /// drops the cached serializations of the asset.
       /// @param key property `key`
       /// @param v property value
       void setProperty(const std::string &key, const entity::Value &v) override
@@ -81,6 +185,9 @@ namespace mtconnect {
         }
 
         m_properties.insert_or_assign(key, r);
+
+        // Cleared after the change so a render that sees the new generation sees the new value
+        m_fragments.clear();
       }
       /// @brief Set a property
       /// @param property the property
@@ -137,11 +244,25 @@ namespace mtconnect {
           return std::nullopt;
       }
       bool isRemoved() const { return m_removed; }
+      /// @brief get the cached serializations of the asset
+      const AssetFragmentCache &getFragments() const { return m_fragments; }
+      /// @brief get the hash of the asset content
+      ///
+      /// Uses the `hash` property if the agent added one, otherwise the hash is computed once
+      /// and cached until the asset changes.
+      /// @return the hash
+      std::string getContentHash() const
+      {
+        if (auto hash = maybeGet<std::string>("hash"))
+          return *hash;
+        return m_fragments.hash([this]() { return entity::Entity::hash(); });
+      }
       /// @brief sets the removed state of the asset
       void setRemoved()
       {
-        setProperty("removed", true);
+        m_properties.insert_or_assign("removed", true);
         m_removed = true;
+        m_fragments.clear();
       }
       /// @brief register the factory for an asset type
       /// @param t the type or name of the asset
@@ -169,6 +290,7 @@ namespace mtconnect {
     protected:
       std::string m_assetId;
       bool m_removed;
+      AssetFragmentCache m_fragments;
     };
 
     /// @brief A simple `RAW` asset that just carries the data associated
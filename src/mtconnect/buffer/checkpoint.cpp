@@ -36,7 +36,11 @@ namespace mtconnect {
       copy(checkpoint, filter);
     }
 
-    void Checkpoint::clear() { m_observations.clear(); }
+    void Checkpoint::clear()
+    {
+      m_observations.clear();
+      m_conditionChanged.clear();
+    }
 
     Checkpoint::~Checkpoint() { clear(); }
 
@@ -133,6 +137,9 @@ namespace mtconnect {
       const auto &id = item->getId();
       auto old = m_observations.find(id);
 
+      if (item->isCondition())
+        m_conditionChanged[id] = obs->getSequence();
+
       if (old != m_observations.end())
       {
         if (item->isCondition())
@@ -172,15 +179,32 @@ namespace mtconnect {
         if (!m_filter || m_filter->count(event.first) > 0)
           m_observations[event.first] = dynamic_pointer_cast<Observation>(event.second->getptr());
       }
+
+      for (const auto &changed : checkpoint.m_conditionChanged)
+      {
+        if (!m_filter || m_filter->count(changed.first) > 0)
+          m_conditionChanged.insert(changed);
+      }
     }
 
-    void Checkpoint::getObservations(ObservationList &list, const FilterSetOpt &filterSet) const
+    void Checkpoint::getObservations(ObservationList &list, const FilterSetOpt &filterSet,
+                                     const std::optional<SequenceNumber_t> &since) const
     {
+      list.reserve(list.size() + m_observations.size());
       for (const auto &obs : m_observations)
       {
         auto e = obs.second;
         if (!e->isOrphan())
         {
+          if (since && e->getSequence() <= *since)
+          {
+            // The active list of a condition can change without changing the latest
+            // condition, report the whole list if any of it changed
+            auto changed = m_conditionChanged.find(obs.first);
+            if (changed == m_conditionChanged.end() || changed->second <= *since)
+              continue;
+          }
+
           if (!filterSet || (e && filterSet->count(e->getDataItem()->getId()) > 0))
           {
             if (e->getDataItem()->isCondition())
@@ -206,23 +230,28 @@ namespace mtconnect {
       if (m_filter->empty())
         return;
 
-      auto it = m_observations.begin();
-      while (it != m_observations.end())
-      {
-        if (!m_filter->count(it->first))
+      auto prune = [this](auto &map) {
+        auto it = map.begin();
+        while (it != map.end())
         {
+          if (!m_filter->count(it->first))
+          {
 #ifdef _WINDOWS
-          it = m_observations.erase(it);
+            it = map.erase(it);
 #else
-          auto pos = it++;
-          m_observations.erase(pos);
+            auto pos = it++;
+            map.erase(pos);
 #endif
+          }
+          else
+          {
+            ++it;
+          }
         }
-        else
-        {
-          ++it;
-        }
-      }
+      };
+
+      prune(m_observations);
+      prune(m_conditionChanged);
     }
 
     ObservationPtr Checkpoint::dataSetDifference(const ObservationPtr &obs,
@@ -183,8 +183,11 @@ namespace mtconnect::buffer {
     /// @brief Get a list of observations from the checkpoint
     /// @param[in,out] list the list to add the observations to
     /// @param[in] filter an optional filter for the observations
+    /// @param[in] since only include observations with a sequence number greater than `since`.
+    ///            A condition's active list is included if it changed after `since`.
     void getObservations(observation::ObservationList &list,
-                         const FilterSetOpt &filter = std::nullopt) const;
+                         const FilterSetOpt &filter = std::nullopt,
+                         const std::optional<SequenceNumber_t> &since = std::nullopt) const;
 
     /// @brief Get an observation for a data item id
     /// @param[in] id the data item id
@@ -204,6 +207,9 @@ namespace mtconnect::buffer {
 
   protected:
     std::unordered_map<std::string, observation::ObservationPtr> m_observations;
+    // The sequence of the last observation that changed each condition's active list. Clearing
+    // one of several active conditions keeps the sequences of the ones that remain.
+    std::unordered_map<std::string, SequenceNumber_t> m_conditionChanged;
     FilterSetOpt m_filter;
   };
 }  // namespace mtconnect::buffer
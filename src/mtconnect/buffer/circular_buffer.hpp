@@ -273,6 +273,7 @@ namespace mtconnect::buffer {
 
       size_t min = firstSeq - m_firstSequence;
       size_t i = first - m_firstSequence;
+      results->reserve(std::min(size_t(limit), max));
       for (int added = 0; added < limit && i < max && i >= min; i += inc)
       {
         // Filter out according to if it exists in the list
@@ -301,6 +302,25 @@ namespace mtconnect::buffer {
       return results;
     }
 
+    /// @brief count the observations of a set of data items from a sequence to the end of the
+    /// buffer
+    /// @param[in] filterSet the data item ids
+    /// @param[in] start the first sequence, the first sequence in the buffer if it is earlier
+    /// @return the number of observations
+    SequenceNumber_t countObservations(const FilterSet &filterSet, SequenceNumber_t start) const
+    {
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      SequenceNumber_t count = 0;
+      for (auto i = std::max(start, m_firstSequence) - m_firstSequence;
+           i < m_sequence - m_firstSequence; i++)
+      {
+        auto &event = m_slidingBuffer[i];
+        if (!event->isOrphan() && filterSet.count(event->getDataItem()->getId()) > 0)
+          count++;
+      }
+      return count;
+    }
+
     /// @name Mutex lock  management
     ///@{
 
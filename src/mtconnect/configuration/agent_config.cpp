@@ -667,6 +667,10 @@ namespace mtconnect::configuration {
                 {configuration::Port, 5000},
                 {configuration::MaxCachedFileSize, "20k"s},
                 {configuration::MinCompressFileSize, "100k"s},
+                {configuration::ObservationCacheSize, "64m"s},
+                {configuration::AssetCacheSize, "16m"s},
+                {configuration::OutputBufferPoolSize, "8m"s},
+                {configuration::ParallelRenderThreshold, 10000},
                 {configuration::ServiceName, "MTConnect Agent"s},
                 {configuration::SchemaVersion, ""s},
                 {configuration::LogStreams, false},
@@ -43,6 +43,7 @@ namespace mtconnect {
     DECLARE_CONFIGURATION(DisableAgentDevice);
     DECLARE_CONFIGURATION(AllowPut);
     DECLARE_CONFIGURATION(AllowPutFrom);
+    DECLARE_CONFIGURATION(AssetCacheSize);
     DECLARE_CONFIGURATION(BufferSize);
     DECLARE_CONFIGURATION(CheckpointFrequency);
     DECLARE_CONFIGURATION(Devices);
@@ -55,6 +56,9 @@ namespace mtconnect {
     DECLARE_CONFIGURATION(MinimumConfigReloadAge);
     DECLARE_CONFIGURATION(MonitorConfigFiles);
     DECLARE_CONFIGURATION(MonitorInterval);
+    DECLARE_CONFIGURATION(ObservationCacheSize);
+    DECLARE_CONFIGURATION(OutputBufferPoolSize);
+    DECLARE_CONFIGURATION(ParallelRenderThreshold);
     DECLARE_CONFIGURATION(PidFile);
     DECLARE_CONFIGURATION(Port);
     DECLARE_CONFIGURATION(Pretty);
@@ -79,6 +83,23 @@ namespace mtconnect {
     DECLARE_CONFIGURATION(DeviceTopic);
     DECLARE_CONFIGURATION(AssetTopic);
     DECLARE_CONFIGURATION(ObservationTopic);
+    DECLARE_CONFIGURATION(DeviceQoS);
+    DECLARE_CONFIGURATION(AssetQoS);
+    DECLARE_CONFIGURATION(ObservationQoS);
+    DECLARE_CONFIGURATION(DeviceRetain);
+    DECLARE_CONFIGURATION(AssetRetain);
+    DECLARE_CONFIGURATION(ObservationRetain);
+    DECLARE_CONFIGURATION(DeviceMaxInflight);
+    DECLARE_CONFIGURATION(AssetMaxInflight);
+    DECLARE_CONFIGURATION(ObservationMaxInflight);
+    DECLARE_CONFIGURATION(ObservationMaxPending);
+    DECLARE_CONFIGURATION(ObservationBatchInterval);
+    DECLARE_CONFIGURATION(ObservationBatchTopic);
+    DECLARE_CONFIGURATION(ObservationShardBy);
+    DECLARE_CONFIGURATION(ObservationExpiry);
+    DECLARE_CONFIGURATION(SnapshotPublishRate);
+    DECLARE_CONFIGURATION(SparkplugGroupId);
+    DECLARE_CONFIGURATION(SparkplugNodeId);
     DECLARE_CONFIGURATION(MqttCaCert);
     DECLARE_CONFIGURATION(MqttCert);
     DECLARE_CONFIGURATION(MqttPrivateKey);
@@ -89,6 +110,14 @@ namespace mtconnect {
     DECLARE_CONFIGURATION(MqttConnectInterval);
     DECLARE_CONFIGURATION(MqttUserName);
     DECLARE_CONFIGURATION(MqttPassword);
+    DECLARE_CONFIGURATION(MqttFormat);
+    DECLARE_CONFIGURATION(MqttProtocolVersion);
+    DECLARE_CONFIGURATION(MqttTopicAliasMaximum);
+    DECLARE_CONFIGURATION(MqttSpoolDirectory);
+    DECLARE_CONFIGURATION(MqttSpoolSize);
+    DECLARE_CONFIGURATION(MqttSpoolReplayRate);
+    DECLARE_CONFIGURATION(MqttConnections);
+    DECLARE_CONFIGURATION(MqttEmbeddedBroker);
     ///@}
 
     /// @name Adapter Configuration
@@ -169,6 +169,11 @@ namespace mtconnect {
       m_discrete =
           m_representation == DISCRETE || (hasProperty("discrete") && get<bool>("discrete"));
 
+      // Only honor the digits a double can represent
+      if (auto digits = maybeGet<int64_t>("significantDigits");
+          digits && *digits > 0 && *digits <= std::numeric_limits<double>::max_digits10)
+        m_significantDigits = int(*digits);
+
       m_observatonProperties.insert_or_assign("dataItemId", m_id);
       if (m_name)
         m_observatonProperties.insert_or_assign("name", *m_name);
@@ -248,6 +253,12 @@ namespace mtconnect {
     }
 
     // Sort by: Device, Component, Category, DataItem
+    std::shared_mutex &DataItem::getOrdinalMutex()
+    {
+      static std::shared_mutex mutex;
+      return mutex;
+    }
+
     bool DataItem::operator<(const DataItem &another) const
     {
       auto component = m_component.lock();
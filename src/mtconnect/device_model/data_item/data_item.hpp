@@ -18,6 +18,7 @@
 #pragma once
 
 #include <map>
+#include <shared_mutex>
 
 #include "constraints.hpp"
 #include "definition.hpp"
@@ -116,6 +117,8 @@ namespace mtconnect {
         const auto &getPreferredName() const { return m_preferredName; }
         const auto &getMinimumDelta() const { return m_minimumDelta; }
         const auto &getMinimumPeriod() const { return m_minimumPeriod; }
+        /// @brief get the number of significant digits used to format values
+        const auto &getSignificantDigits() const { return m_significantDigits; }
         /// @brief get a key related to the data item for creating observations
         /// @return a key
         const auto &getKey() const { return m_key; }
@@ -222,6 +225,33 @@ namespace mtconnect {
         bool operator<(const DataItem &another) const;
         bool operator==(const DataItem &another) const { return m_id == another.m_id; }
 
+        /// @brief set the position of the data item in the order used by the streams documents
+        ///
+        /// The ordinals are assigned by the agent when the devices change so observations can be
+        /// grouped without comparing the device and component ids. An ordinal of 0 means the data
+        /// item has not been ordered.
+        ///
+        /// @param[in] ordinal the position of the data item consistent with `operator<`
+        /// @param[in] group the position of the device, component, and category of the data item
+        void setOrdinal(uint32_t ordinal, uint32_t group)
+        {
+          m_ordinal = ordinal;
+          m_group = group;
+        }
+        /// @brief the lock guarding the ordinals of all data items
+        ///
+        /// The agent renumbers the data items while it holds the lock exclusively. Printers hold
+        /// it shared while they read the ordinals so a sort never mixes old and new ordinals.
+        /// @return the ordinal mutex
+        static std::shared_mutex &getOrdinalMutex();
+        /// @brief get the position of the data item in the streams documents
+        /// @return the ordinal, 0 if it has not been ordered
+        uint32_t getOrdinal() const { return m_ordinal; }
+        /// @brief get the position of the device, component, and category in the streams
+        /// documents
+        /// @return the group ordinal, 0 if it has not been ordered
+        uint32_t getGroupOrdinal() const { return m_group; }
+
         /// @brief Return the category as a char *
         const char *getCategoryText() const { return m_categoryText; }
 
@@ -280,6 +310,7 @@ namespace mtconnect {
         std::string m_preferredName;
         std::optional<std::string> m_constantValue;
         std::optional<double> m_minimumDelta;
+        std::optional<int> m_significantDigits;
         std::optional<double> m_minimumPeriod;
         std::string m_key;
         std::string m_topic;
@@ -289,6 +320,10 @@ namespace mtconnect {
         Category m_category;
         const char *m_categoryText;
 
+        // Order in the streams documents
+        uint32_t m_ordinal {0};
+        uint32_t m_group {0};
+
         // Type for observation
         entity::QName m_observationName;
         entity::Properties m_observatonProperties;
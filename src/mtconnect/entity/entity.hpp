@@ -95,6 +95,12 @@ namespace mtconnect {
       /// @param props entity properties
       Entity(const std::string &name, const Properties &props) : m_name(name), m_properties(props)
       {}
+      /// @brief Create an entity taking ownership of a property set
+      /// @param name entity name
+      /// @param props entity properties
+      Entity(const std::string &name, Properties &&props)
+        : m_name(name), m_properties(std::move(props))
+      {}
       Entity(const Entity &entity) = default;
       virtual ~Entity() {}
 
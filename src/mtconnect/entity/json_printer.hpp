@@ -66,7 +66,13 @@ namespace mtconnect::entity {
         m_printer.printKey(*m_obj, *m_key);
         AutoJsonArray ary(m_writer);
         for (auto &d : v)
-          m_obj->Add(d);
+          m_obj->Add(isValue() ? m_printer.significant(d) : d);
+      }
+
+      void operator()(const double &d)
+      {
+        m_printer.printKey(*m_obj, *m_key);
+        m_obj->Add(isValue() ? m_printer.significant(d) : d);
       }
 
       void operator()(const DataSet &v)
@@ -88,6 +94,9 @@ namespace mtconnect::entity {
         m_obj->Add(arg);
       }
 
+      // Only the value is rounded, like the elements of the XML printer
+      bool isValue() const { return *m_key == "VALUE"; }
+
       PropertyVisitor(T &writer, JsonPrinter<T> &printer, std::optional<AutoJsonObject<T>> &obj,
                       const EntityPtr &entity)
         : m_obj(obj), m_printer(printer), m_entity(entity), m_writer(writer)
@@ -109,6 +118,10 @@ namespace mtconnect::entity {
     JsonPrinter(T &writer, uint32_t version, bool includeHidden = false)
       : m_version(version), m_writer(writer), m_includeHidden(includeHidden) {};
 
+    /// @brief round the double value and time series samples to a number of significant digits
+    /// @param digits the significant digits or `nullopt` to print the values unchanged
+    void setSignificantDigits(const std::optional<int> &digits) { m_significantDigits = digits; }
+
     /// @brief create a json object from an entity
     ///
     /// Cover method for `printEntity()`
@@ -268,11 +281,16 @@ namespace mtconnect::entity {
       }
     }
     void print(const Timestamp &t) { m_writer.String(format(t).c_str()); }
+    double significant(double d) const
+    {
+      return m_significantDigits ? roundSignificant(d, *m_significantDigits) : d;
+    }
 
   protected:
     uint32_t m_version;
     T &m_writer;
     bool m_includeHidden {false};
+    std::optional<int> m_significantDigits;
   };
 
   /// @brief Serialization wrapper to turn an entity into a json string.
@@ -283,6 +301,7 @@ namespace mtconnect::entity {
     JsonEntityPrinter(uint32_t version, bool pretty = false, bool includeHidden = false)
       : m_version(version), m_pretty(pretty), m_includeHidden(includeHidden)
     {}
+    virtual ~JsonEntityPrinter() = default;
 
     /// @brief wrapper around the JsonPrinter print method that creates the correct printer
     /// depending on pretty flag
@@ -290,14 +309,21 @@ namespace mtconnect::entity {
     /// @returns string representation  of the json
     std::string printEntity(const EntityPtr entity)
     {
-      using namespace rapidjson;
-      StringBuffer output;
+      std::string buffer;
+      printEntity(entity, buffer);
+      return buffer;
+    }
+
+    /// @brief print an entity appending the json to a buffer
+    /// @param[in] entity the entity to print
+    /// @param[out] buffer the buffer to append to
+    virtual void printEntity(const EntityPtr entity, std::string &buffer)
+    {
+      printer::StringOutputStream output(buffer);
       RenderJson(output, m_pretty, [&](auto &writer) {
         JsonPrinter printer(writer, m_version, m_includeHidden);
         printer.printEntity(entity);
       });
-
-      return std::string(output.GetString(), output.GetLength());
     }
 
     /// @brief wrapper around the JsonPrinter print method that creates the correct printer
@@ -309,14 +335,37 @@ namespace mtconnect::entity {
     /// @returns string representation  of the json
     std::string print(const EntityPtr entity)
     {
-      using namespace rapidjson;
-      StringBuffer output;
+      std::string buffer;
+      print(entity, buffer);
+      return buffer;
+    }
+
+    /// @brief print an entity wrapped in an object with its name appending the json to a buffer
+    /// @param[in] entity the entity to print
+    /// @param[out] buffer the buffer to append to
+    virtual void print(const EntityPtr entity, std::string &buffer)
+    {
+      printer::StringOutputStream output(buffer);
       RenderJson(output, m_pretty, [&](auto &writer) {
         JsonPrinter printer(writer, m_version, m_includeHidden);
         printer.print(entity);
       });
+    }
 
-      return std::string(output.GetString(), output.GetLength());
+    /// @brief print a list of entities appending the json to a buffer
+    ///
+    /// Version 1 creates an array of objects keyed by the entity names and version 2 groups
+    /// the entities by name.
+    ///
+    /// @param[in] list the entities to print
+    /// @param[out] buffer the buffer to append to
+    virtual void printEntityList(const EntityList &list, std::string &buffer)
+    {
+      printer::StringOutputStream output(buffer);
+      RenderJson(output, m_pretty, [&](auto &writer) {
+        JsonPrinter printer(writer, m_version, m_includeHidden);
+        printer.printEntityList(list);
+      });
     }
 
   protected:
@@ -277,12 +277,13 @@ namespace mtconnect {
       // ----------- Vector
       void operator()(const Vector &arg, string &v)
       {
-        if (arg.size() > 0)
+        v.clear();
+        v.reserve(arg.size() * 8);
+        for (auto &d : arg)
         {
-          stringstream s;
-          for (auto &v : arg)
-            s << formatted(v) << ' ';
-          v = string_view(s.str().c_str(), s.str().size() - 1);
+          if (!v.empty())
+            v.push_back(' ');
+          appendDouble(v, d);
         }
       }
       template <typename T>
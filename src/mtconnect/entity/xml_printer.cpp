@@ -17,11 +17,13 @@
 
 #include "xml_printer.hpp"
 
+#include <optional>
 #include <unordered_map>
 
 #include <libxml/xmlwriter.h>
 
 #include "mtconnect/logging.hpp"
+#include "mtconnect/printer/xml_direct_writer.hpp"
 #include "mtconnect/printer/xml_printer_helper.hpp"
 
 using namespace std;
@@ -41,46 +43,96 @@ namespace mtconnect {
       return name;
     }
 
-    static inline void addAttributes(xmlTextWriterPtr writer,
-                                     const std::map<string, string> &attributes)
+    // Writer primitives for libxml2 and the direct writer so the entity printing is shared
+    // between them.
+    static inline void startElement(xmlTextWriterPtr writer, const string &name)
+    {
+      openElement(writer, name.c_str());
+    }
+    static inline void endElement(xmlTextWriterPtr writer) { xmlTextWriterEndElement(writer); }
+    static inline void writeAttribute(xmlTextWriterPtr writer, const string &name,
+                                      const char *value)
+    {
+      THROW_IF_XML2_ERROR(
+          xmlTextWriterWriteAttribute(writer, BAD_CAST name.c_str(), BAD_CAST value));
+    }
+    static inline void writeString(xmlTextWriterPtr writer, const char *text)
+    {
+      THROW_IF_XML2_ERROR(xmlTextWriterWriteString(writer, BAD_CAST text));
+    }
+    static inline void writeRaw(xmlTextWriterPtr writer, const char *text)
+    {
+      THROW_IF_XML2_ERROR(xmlTextWriterWriteRaw(writer, BAD_CAST text));
+    }
+    static inline void writeEncoded(xmlTextWriterPtr writer, const string &text)
+    {
+      xmlChar *encoded = xmlEncodeEntitiesReentrant(nullptr, BAD_CAST text.c_str());
+      THROW_IF_XML2_ERROR(xmlTextWriterWriteRaw(writer, encoded));
+      xmlFree(encoded);
+    }
+
+    static inline void startElement(XmlDirectWriter &writer, const string &name)
+    {
+      writer.startElement(name);
+    }
+    static inline void endElement(XmlDirectWriter &writer) { writer.endElement(); }
+    static inline void writeAttribute(XmlDirectWriter &writer, const string &name,
+                                      const char *value)
+    {
+      writer.attribute(name, value);
+    }
+    static inline void writeString(XmlDirectWriter &writer, const char *text)
+    {
+      writer.text(text);
+    }
+    static inline void writeRaw(XmlDirectWriter &writer, const char *text) { writer.raw(text); }
+    static inline void writeEncoded(XmlDirectWriter &writer, const string &text)
+    {
+      writer.encodedText(text);
+    }
+
+    /// @brief Closes the element when it goes out of scope
+    template <typename W>
+    class Element
+    {
+    public:
+      Element(W &writer, const string &name) : m_writer(writer) { startElement(writer, name); }
+      ~Element() { endElement(m_writer); }
+
+    protected:
+      W &m_writer;
+    };
+
+    template <typename W>
+    static inline void addAttributes(W &writer, const std::map<string, string> &attributes)
     {
       for (const auto &attr : attributes)
       {
         if (!attr.second.empty())
-        {
-          THROW_IF_XML2_ERROR(xmlTextWriterWriteAttribute(writer, BAD_CAST attr.first.c_str(),
-                                                          BAD_CAST attr.second.c_str()));
-        }
+          writeAttribute(writer, attr.first, attr.second.c_str());
       }
     }
 
-    static void addSimpleElement(xmlTextWriterPtr writer, const string &element, const string &body,
-                                 const map<string, string> &attributes = {}, bool raw = false)
+    template <typename W>
+    static void addSimpleElement(W &writer, const string &element, const string &body,
+                                 const map<string, string> &attributes = {})
     {
-      AutoElement ele(writer, element);
+      Element<W> ele(writer, element);
 
       if (!attributes.empty())
         addAttributes(writer, attributes);
 
       if (!body.empty())
-      {
-        xmlChar *text = nullptr;
-        if (!raw)
-          text = xmlEncodeEntitiesReentrant(nullptr, BAD_CAST body.c_str());
-        else
-          text = BAD_CAST body.c_str();
-        THROW_IF_XML2_ERROR(xmlTextWriterWriteRaw(writer, text));
-        if (!raw)
-          xmlFree(text);
-      }
+        writeEncoded(writer, body);
     }
 
-    void printDataSet(xmlTextWriterPtr writer, const std::string &name, const DataSet &set)
+    template <typename W>
+    void printDataSet(W &writer, const std::string &name, const DataSet &set)
     {
-      AutoElement ele(writer);
+      std::optional<Element<W>> ele;
       if (name != "VALUE")
       {
-        ele.reset(name);
+        ele.emplace(writer, name);
       }
 
       for (auto &e : set)
@@ -104,7 +156,7 @@ namespace mtconnect {
                           },
                           [&writer, &attrs](const DataSet &row) {
                             // Table
-                            AutoElement ele(writer, "Entry");
+                            Element<W> ele(writer, "Entry");
                             addAttributes(writer, attrs);
                             for (auto &c : row)
                             {
@@ -147,33 +199,37 @@ namespace mtconnect {
       return s->c_str();
     }
 
-    void printProperty(xmlTextWriterPtr writer, const Property &p,
-                       const unordered_set<string> &namespaces)
+    template <typename W>
+    void printProperty(W &writer, const Property &p, const unordered_set<string> &namespaces)
     {
       string t;
       const char *s = toCharPtr(p.second, t);
       if (p.first == "VALUE")
       {
         // The value is the content for a simple element
-        THROW_IF_XML2_ERROR(xmlTextWriterWriteString(writer, BAD_CAST s));
+        writeString(writer, s);
       }
       else if (p.first == "RAW")
       {
-        THROW_IF_XML2_ERROR(xmlTextWriterWriteRaw(writer, BAD_CAST s));
+        writeRaw(writer, s);
       }
       else
       {
         QName name(p.first);
         string qname = stripUndeclaredNamespace(name, namespaces);
-        AutoElement element(writer, qname);
-        THROW_IF_XML2_ERROR(xmlTextWriterWriteString(writer, BAD_CAST s));
+        Element<W> element(writer, qname);
+        writeString(writer, s);
       }
     }
 
-    void XmlPrinter::print(xmlTextWriterPtr writer, const EntityPtr entity,
-                           const std::unordered_set<std::string> &namespaces)
+    template <typename W>
+    void printChild(W &writer, const Property &e, const unordered_set<string> &namespaces,
+                    bool includeHidden);
+
+    template <typename W>
+    void printEntity(W &writer, const EntityPtr entity, const unordered_set<string> &namespaces,
+                     bool includeHidden)
     {
-      NAMED_SCOPE("entity.xml_printer");
       const auto &properties = entity->getProperties();
       const auto order = entity->getOrder();
       const auto *localNamespaces = &namespaces;
@@ -197,7 +253,7 @@ namespace mtconnect {
       }
 
       string qname = stripUndeclaredNamespace(entity->getName(), *localNamespaces);
-      AutoElement element(writer, qname);
+      Element<W> element(writer, qname);
 
       list<Property> attributes;
       list<Property> elements;
@@ -207,7 +263,7 @@ namespace mtconnect {
       for (const auto &prop : properties)
       {
         auto &key = prop.first;
-        if (m_includeHidden || !entity->isHidden(key))
+        if (includeHidden || !entity->isHidden(key))
         {
           if (islower(key.getName()[0]) || attrs.count(key) > 0)
             attributes.emplace_back(prop);
@@ -239,25 +295,70 @@ namespace mtconnect {
         bool isNsDecl = name.hasNs() && name.getNs() == "xmlns";
         if (!isNsDecl || namespaces.count(string(name.getName())) == 0)
         {
-          THROW_IF_XML2_ERROR(xmlTextWriterWriteAttribute(writer, BAD_CAST a.first.c_str(),
-                                                          BAD_CAST toCharPtr(a.second, t)));
+          writeAttribute(writer, a.first, toCharPtr(a.second, t));
         }
       }
 
       for (auto &e : elements)
+        printChild(writer, e, *localNamespaces, includeHidden);
+    }
+
+    template <typename W>
+    void printChild(W &writer, const Property &e, const unordered_set<string> &namespaces,
+                    bool includeHidden)
+    {
+      visit(overloaded {[&writer, &namespaces, includeHidden](const EntityPtr &v) {
+                          printEntity(writer, v, namespaces, includeHidden);
+                        },
+                        [&writer, &namespaces, includeHidden](const EntityList &list) {
+                          for (auto &en : list)
+                            printEntity(writer, en, namespaces, includeHidden);
+                        },
+                        [&writer, &e](const DataSet &v) { printDataSet(writer, e.first, v); },
+                        [&writer, &e, &namespaces](const auto &v) {
+                          printProperty(writer, e, namespaces);
+                        }},
+            e.second);
+    }
+
+    void XmlPrinter::print(xmlTextWriterPtr writer, const EntityPtr entity,
+                           const std::unordered_set<std::string> &namespaces)
+    {
+      NAMED_SCOPE("entity.xml_printer");
+      printEntity(writer, entity, namespaces, m_includeHidden);
+    }
+
+    void XmlPrinter::print(XmlDirectWriter &writer, const EntityPtr entity,
+                           const std::unordered_set<std::string> &namespaces)
+    {
+      NAMED_SCOPE("entity.xml_printer");
+      printEntity(writer, entity, namespaces, m_includeHidden);
+    }
+
+    void XmlPrinter::printElement(XmlDirectWriter &writer, const Property &property,
+                                  const std::unordered_set<std::string> &namespaces)
+    {
+      const auto &value = property.second;
+      if (m_significantDigits &&
+          (holds_alternative<double>(value) || holds_alternative<Vector>(value)))
       {
-        visit(overloaded {[&writer, localNamespaces, this](const EntityPtr &v) {
-                            print(writer, v, *localNamespaces);
-                          },
-                          [&writer, localNamespaces, this](const EntityList &list) {
-                            for (auto &en : list)
-                              print(writer, en, *localNamespaces);
+        string text;
+        visit(overloaded {[&](const double d) { appendDouble(text, d, *m_significantDigits); },
+                          [&](const Vector &v) {
+                            for (auto &d : v)
+                            {
+                              if (!text.empty())
+                                text.push_back(' ');
+                              appendDouble(text, d, *m_significantDigits);
+                            }
                           },
-                          [&writer, &e](const DataSet &v) { printDataSet(writer, e.first, v); },
-                          [&writer, &e, localNamespaces](const auto &v) {
-                            printProperty(writer, e, *localNamespaces);
-                          }},
-              e.second);
+                          [](const auto &) {}},
+              value);
+        printChild(writer, Property(property.first, text), namespaces, m_includeHidden);
+      }
+      else
+      {
+        printChild(writer, property, namespaces, m_includeHidden);
       }
     }
   }  // namespace entity
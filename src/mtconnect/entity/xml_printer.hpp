@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <optional>
 #include <unordered_set>
 
 #include "mtconnect/config.hpp"
@@ -29,6 +30,10 @@ extern "C"
 }
 
 namespace mtconnect {
+  namespace printer {
+    class XmlDirectWriter;
+  }
+
   namespace entity {
     /// @brief Convert an entity to an XML document
     class AGENT_LIB_API XmlPrinter
@@ -42,9 +47,27 @@ namespace mtconnect {
       /// @param namespaces a set of namespaces to use in the document
       void print(xmlTextWriterPtr writer, const EntityPtr entity,
                  const std::unordered_set<std::string> &namespaces);
+      /// @brief convert an entity to XML using the direct writer
+      /// @param writer the direct writer
+      /// @param entity the entity
+      /// @param namespaces a set of namespaces to use in the document
+      void print(printer::XmlDirectWriter &writer, const EntityPtr entity,
+                 const std::unordered_set<std::string> &namespaces);
+      /// @brief print a property that is an element or the content of an entity
+      /// @param writer the direct writer
+      /// @param property the property
+      /// @param namespaces a set of namespaces to use in the document
+      void printElement(printer::XmlDirectWriter &writer, const Property &property,
+                        const std::unordered_set<std::string> &namespaces);
+
+      /// @brief format double values printed by `printElement()` with a number of significant
+      /// digits
+      /// @param digits the significant digits or `nullopt` for the default precision
+      void setSignificantDigits(const std::optional<int> &digits) { m_significantDigits = digits; }
 
     protected:
       bool m_includeHidden {false};
+      std::optional<int> m_significantDigits;
     };
   }  // namespace entity
 }  // namespace mtconnect
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "mtconnect/config.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
 #include "mtconnect/source/adapter/adapter.hpp"
 #include "mtconnect/source/adapter/adapter_pipeline.hpp"
 
@@ -26,17 +27,41 @@ namespace mtconnect {
   namespace mqtt_client {
     class MqttClient;
 
+    /// @brief MQTT 5 user properties, name and value pairs
+    using UserProperties = std::vector<std::pair<std::string, std::string>>;
+
+    /// @brief The MQTT 5 properties of a received message
+    struct MessageProperties
+    {
+      uint32_t m_subscription {0};  ///< The subscription identifier, 0 if there is none
+      UserProperties m_user;        ///< The user properties
+    };
+
     /// @brief MQTT Cient Handler for to know the status of the client connection
     struct ClientHandler
     {
       using Connect = std::function<void(std::shared_ptr<MqttClient>)>;
       using Received = std::function<void(std::shared_ptr<MqttClient>, const std::string &topic,
                                           const std::string &payload)>;
+      using ReceivedProperties =
+          std::function<void(std::shared_ptr<MqttClient>, const std::string &topic,
+                             const std::string &payload, const MessageProperties &properties)>;
 
       Connect m_connected;
       Connect m_connecting;
       Connect m_disconnected;
       Received m_receive;
+      /// Called instead of `m_receive` if set, with the properties of MQTT 5 messages
+      ReceivedProperties m_receiveProperties;
+    };
+
+    /// @brief Quality of service and retain flag of a published message
+    struct PublishOptions
+    {
+      uint8_t m_qos {1};     ///< 0: at most once, 1: at least once, 2: exactly once
+      bool m_retain {true};  ///< `true` if the broker keeps the message for new subscribers
+      std::chrono::seconds m_expiry {0};  ///< MQTT 5 message expiry, 0 if it does not expire
+      UserProperties m_properties;         ///< MQTT 5 user properties
     };
 
     class MqttClient : public std::enable_shared_from_this<MqttClient>
@@ -68,8 +93,10 @@ namespace mtconnect {
 
       /// @brief Subscribe Topic to the Mqtt Client
       /// @param topic Subscribing to the topic
+      /// @param identifier the MQTT 5 subscription identifier given with the messages of this
+      /// subscription, 0 for none
       /// @return boolean either topic sucessfully connected and subscribed
-      virtual bool subscribe(const std::string &topic) = 0;
+      virtual bool subscribe(const std::string &topic, uint32_t identifier = 0) = 0;
 
       /// @brief Publish Topic to the Mqtt Client
       /// @param topic Publishing to the topic
@@ -77,6 +104,55 @@ namespace mtconnect {
       /// @return boolean either topic sucessfully connected and published
       virtual bool publish(const std::string &topic, const std::string &payload) = 0;
 
+      /// @brief Publish a shared payload
+      ///
+      /// The client keeps a reference to the payload until it has been sent instead of copying
+      /// it.
+      ///
+      /// @param topic Publishing to the topic
+      /// @param payload Publishing to the payload
+      /// @return boolean either topic sucessfully connected and published
+      virtual bool publish(const std::string &topic, printer::BufferPtr payload)
+      {
+        return publish(topic, *payload);
+      }
+
+      /// @brief called when a published message is acknowledged by the broker, or has been
+      /// written for quality of service 0. The argument is `false` if the publish failed.
+      using Published = std::function<void(bool)>;
+
+      /// @brief Publish a shared payload with a quality of service and retain flag
+      /// @param topic Publishing to the topic
+      /// @param payload Publishing to the payload, held until the publish completes
+      /// @param options the quality of service and retain flag
+      /// @param done optional function called when the publish completes, only called if the
+      /// message was accepted
+      /// @return `true` if the message was accepted for publishing
+      virtual bool publish(const std::string &topic, printer::BufferPtr payload,
+                           const PublishOptions &options, Published done)
+      {
+        auto res = publish(topic, payload);
+        if (res && done)
+          done(true);
+        return res;
+      }
+
+      /// @brief set the message the broker publishes when the connection is lost
+      ///
+      /// Takes effect the next time the client connects.
+      ///
+      /// @param topic the topic of the message
+      /// @param payload the message
+      /// @param options the quality of service and retain flag
+      void setWill(const std::string &topic, const std::string &payload,
+                   const PublishOptions &options)
+      {
+        m_will.emplace(Will {topic, payload, options});
+      }
+
+      /// @brief `true` if the client connects with MQTT 5, otherwise MQTT 3.1.1 is used
+      bool isMqtt5() const { return m_mqtt5; }
+
       /// @brief Mqtt Client is connected
       /// @return bool Either Client is sucessfully connected or not
       auto isConnected() { return m_connected; }
@@ -88,15 +164,25 @@ namespace mtconnect {
       /// @brief set the Mqtt Client is completly connected
       void connectComplete() { m_connected = true; }
 
+    protected:
+      struct Will
+      {
+        std::string m_topic;
+        std::string m_payload;
+        PublishOptions m_options;
+      };
+
     protected:
       boost::asio::io_context &m_ioContext;
       std::string m_url;
       std::string m_identity;
       std::unique_ptr<ClientHandler> m_handler;
       std::chrono::milliseconds m_connectInterval;
+      std::optional<Will> m_will;
 
       bool m_running {false};
       bool m_connected {false};
+      bool m_mqtt5 {false};
     };
 
   }  // namespace mqtt_client
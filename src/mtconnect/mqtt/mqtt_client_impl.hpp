@@ -21,6 +21,8 @@
 #include <boost/uuid/name_generator_sha1.hpp>
 
 #include <inttypes.h>
+#include <mutex>
+#include <unordered_map>
 #include <mqtt/async_client.hpp>
 #include <mqtt/setup_log.hpp>
 
@@ -110,6 +112,10 @@ namespace mtconnect {
         auto ci = GetOption<Seconds>(options, configuration::MqttConnectInterval);
         if (ci)
           m_connectInterval = *ci;
+
+        m_mqtt5 = GetOption<int>(options, configuration::MqttProtocolVersion).value_or(3) == 5;
+        if (auto aliases = GetOption<int>(options, configuration::MqttTopicAliasMaximum))
+          m_topicAliasMaximum = uint16_t(std::clamp(*aliases, 0, 0xFFFF));
       }
 
       ~MqttClientImpl() { stop(); }
@@ -127,37 +133,71 @@ namespace mtconnect {
         client->clean_session();
         client->set_keep_alive_sec(10);
 
-        client->set_connack_handler([this](bool sp, mqtt::connect_return_code ec) {
-          if (!m_running)
-          {
-            return false;
-          }
-          else if (ec == mqtt::connect_return_code::accepted)
-          {
-            LOG(info) << "MQTT ConnAck: MQTT Connected";
-
-            if (m_handler && m_handler->m_connected)
-            {
-              m_handler->m_connected(shared_from_this());
-            }
-            else
-            {
-              LOG(debug) << "No connect handler, setting connected";
-              m_connected = true;
-            }
-          }
-          else
-          {
-            LOG(info) << "MQTT ConnAck: MQTT connection failed: " << ec;
-            reconnect();
-          }
-          return true;
-        });
+        if (m_mqtt5)
+        {
+          // Topics are replaced by aliases after they are first sent, up to the maximum
+          // given by the broker
+          client->set_auto_map_topic_alias_send(true);
+
+          client->set_v5_connack_handler(
+              [this](bool sp, mqtt::v5::connect_reason_code rc, mqtt::v5::properties props) {
+                if (rc != mqtt::v5::connect_reason_code::success)
+                  LOG(info) << "MQTT ConnAck: MQTT connection failed: " << rc;
+                return connack(rc == mqtt::v5::connect_reason_code::success);
+              });
+
+          // Reason codes below 0x80 are successful
+          client->set_v5_puback_handler([this](std::uint16_t packetId,
+                                               mqtt::v5::puback_reason_code rc,
+                                               mqtt::v5::properties props) {
+            acknowledge(packetId, static_cast<uint8_t>(rc) < 0x80);
+            return true;
+          });
+          client->set_v5_pubcomp_handler([this](std::uint16_t packetId,
+                                                mqtt::v5::pubcomp_reason_code rc,
+                                                mqtt::v5::properties props) {
+            acknowledge(packetId, static_cast<uint8_t>(rc) < 0x80);
+            return true;
+          });
+
+          client->set_v5_publish_handler(
+              [this](mqtt::optional<std::uint16_t> packet_id, mqtt::publish_options pubopts,
+                     mqtt::buffer topic_name, mqtt::buffer contents, mqtt::v5::properties props) {
+                if (m_running)
+                {
+                  receive(topic_name, contents, props);
+                  return true;
+                }
+                else
+                {
+                  return false;
+                }
+              });
+        }
+        else
+        {
+          client->set_connack_handler([this](bool sp, mqtt::connect_return_code ec) {
+            if (ec != mqtt::connect_return_code::accepted)
+              LOG(info) << "MQTT ConnAck: MQTT connection failed: " << ec;
+            return connack(ec == mqtt::connect_return_code::accepted);
+          });
+
+          // Acknowledgements of quality of service 1 and 2 messages
+          client->set_puback_handler([this](std::uint16_t packetId) {
+            acknowledge(packetId, true);
+            return true;
+          });
+          client->set_pubcomp_handler([this](std::uint16_t packetId) {
+            acknowledge(packetId, true);
+            return true;
+          });
+        }
 
         client->set_close_handler([this]() {
           LOG(info) << "MQTT " << m_url << ": connection closed";
           // Queue on a strand
           m_connected = false;
+          acknowledgeAll(false);
           if (m_handler && m_handler->m_disconnected)
             m_handler->m_disconnected(shared_from_this());
           if (m_running)
@@ -173,6 +213,7 @@ namespace mtconnect {
 
         client->set_error_handler([this](mqtt::error_code ec) {
           LOG(error) << "error: " << ec.message();
+          acknowledgeAll(false);
           if (m_running)
             reconnect();
         });
@@ -187,7 +228,7 @@ namespace mtconnect {
 
           if (m_running)
           {
-            receive(topic_name, contents);
+            receive(topic_name, contents, {});
             return true;
           }
           else
@@ -227,7 +268,7 @@ namespace mtconnect {
       /// @brief Subscribe Topic to the Mqtt Client
       /// @param topic Subscribing to the topic
       /// @return boolean either topic sucessfully connected and subscribed
-      bool subscribe(const std::string &topic) override
+      bool subscribe(const std::string &topic, uint32_t identifier = 0) override
       {
         NAMED_SCOPE("MqttClientImpl::subscribe");
         if (!m_connected)
@@ -237,20 +278,33 @@ namespace mtconnect {
         }
 
         LOG(debug) << "Subscribing to topic: " << topic;
+        auto done = [topic](mqtt::error_code ec) {
+          if (ec)
+          {
+            LOG(error) << "Subscribe failed: " << topic << ": " << ec.message();
+            return false;
+          }
+          else
+          {
+            LOG(debug) << "Subscribed to: " << topic;
+            return true;
+          }
+        };
+
         m_packetId = derived().getClient()->acquire_unique_packet_id();
-        derived().getClient()->async_subscribe(
-            m_packetId, topic.c_str(), mqtt::qos::at_least_once, [topic](mqtt::error_code ec) {
-              if (ec)
-              {
-                LOG(error) << "Subscribe failed: " << topic << ": " << ec.message();
-                return false;
-              }
-              else
-              {
-                LOG(debug) << "Subscribed to: " << topic;
-                return true;
-              }
-            });
+        if (m_mqtt5)
+        {
+          mqtt::v5::properties props;
+          if (identifier > 0)
+            props.emplace_back(mqtt::v5::property::subscription_identifier(identifier));
+          derived().getClient()->async_subscribe(m_packetId, topic, mqtt::qos::at_least_once,
+                                                 std::move(props), done);
+        }
+        else
+        {
+          derived().getClient()->async_subscribe(m_packetId, topic.c_str(),
+                                                 mqtt::qos::at_least_once, done);
+        }
 
         return true;
       }
@@ -282,6 +336,101 @@ namespace mtconnect {
         return true;
       }
 
+      /// @brief Publish a shared payload without copying it
+      /// @param topic Publishing to the topic
+      /// @param payload Publishing to the payload, held until the publish completes
+      /// @return boolean either topic sucessfully connected and published
+      bool publish(const std::string &topic, printer::BufferPtr payload) override
+      {
+        return publish(topic, payload, PublishOptions(), nullptr);
+      }
+
+      /// @brief Publish a shared payload without copying it
+      /// @param topic Publishing to the topic
+      /// @param payload Publishing to the payload, held until the publish completes
+      /// @param options the quality of service and retain flag
+      /// @param done optional function called when the message is acknowledged
+      /// @return boolean either topic sucessfully connected and published
+      bool publish(const std::string &topic, printer::BufferPtr payload,
+                   const PublishOptions &options, Published done) override
+      {
+        NAMED_SCOPE("MqttClientImpl::publish");
+        if (!m_connected)
+        {
+          LOG(debug) << "Not connected, cannot publish to " << topic;
+          return false;
+        }
+
+        // The payload buffer's lifetime is tied to the shared pointer so the client sends it
+        // in place
+        mqtt::buffer contents(mqtt::string_view(payload->data(), payload->size()),
+                              mqtt::const_shared_ptr_array(payload->data(),
+                                                           [payload](const char *) {}));
+
+        auto client = derived().getClient();
+        auto pubopts = mqtt::publish_options(mqtt::qos(std::min<uint8_t>(options.m_qos, 2))) |
+                       (options.m_retain ? mqtt::retain::yes : mqtt::retain::no);
+
+        // Quality of service 0 messages do not have a packet id and are complete when written
+        std::uint16_t packetId = 0;
+        Published written;
+        if (options.m_qos > 0)
+        {
+          packetId = client->acquire_unique_packet_id();
+          if (done)
+          {
+            std::lock_guard<std::mutex> lock(m_inflightMutex);
+            m_inflight.insert_or_assign(packetId, std::move(done));
+          }
+        }
+        else
+        {
+          written = std::move(done);
+        }
+
+        auto complete = [this, topic, packetId, written](mqtt::error_code ec) {
+          if (ec)
+          {
+            LOG(error) << "MqttClientImpl::publish: Publish failed to topic " << topic << ": "
+                       << ec.message();
+          }
+
+          if (packetId != 0)
+          {
+            if (ec)
+              acknowledge(packetId, false);
+          }
+          else if (written)
+          {
+            written(!ec);
+          }
+        };
+
+        if (m_mqtt5)
+        {
+          mqtt::v5::properties props;
+          if (options.m_expiry.count() > 0)
+          {
+            props.emplace_back(
+                mqtt::v5::property::message_expiry_interval(uint32_t(options.m_expiry.count())));
+          }
+          for (const auto &[name, value] : options.m_properties)
+          {
+            props.emplace_back(mqtt::v5::property::user_property(mqtt::allocate_buffer(name),
+                                                                 mqtt::allocate_buffer(value)));
+          }
+          client->async_publish(packetId, mqtt::allocate_buffer(topic), std::move(contents),
+                                pubopts, std::move(props), complete);
+        }
+        else
+        {
+          client->async_publish(packetId, mqtt::allocate_buffer(topic), std::move(contents),
+                                pubopts, complete);
+        }
+
+        return true;
+      }
+
     protected:
       void connect()
       {
@@ -289,7 +438,8 @@ namespace mtconnect {
           m_handler->m_connecting(shared_from_this());
 
         derived().getClient()->set_clean_session(true);
-        derived().getClient()->async_connect([this](mqtt::error_code ec) {
+        setWill();
+        asyncConnect([this](mqtt::error_code ec) {
           if (ec)
           {
             LOG(warning) << "MqttClientImpl::connect: cannot connect: " << ec.message()
@@ -303,10 +453,127 @@ namespace mtconnect {
         });
       }
 
-      void receive(mqtt::buffer &topic, mqtt::buffer &contents)
+      /// @brief connect, MQTT 5 connections allow the broker to use topic aliases
+      template <typename Handler>
+      void asyncConnect(Handler &&handler)
+      {
+        if (m_mqtt5)
+        {
+          mqtt::v5::properties props;
+          if (m_topicAliasMaximum > 0)
+            props.emplace_back(mqtt::v5::property::topic_alias_maximum(m_topicAliasMaximum));
+          derived().getClient()->async_connect(std::move(props), std::forward<Handler>(handler));
+        }
+        else
+        {
+          derived().getClient()->async_connect(std::forward<Handler>(handler));
+        }
+      }
+
+      /// @brief handle the broker's response to connecting
+      /// @param accepted `true` if the connection was accepted
+      bool connack(bool accepted)
+      {
+        if (!m_running)
+        {
+          return false;
+        }
+        else if (accepted)
+        {
+          LOG(info) << "MQTT ConnAck: MQTT Connected";
+
+          if (m_handler && m_handler->m_connected)
+          {
+            m_handler->m_connected(shared_from_this());
+          }
+          else
+          {
+            LOG(debug) << "No connect handler, setting connected";
+            m_connected = true;
+          }
+        }
+        else
+        {
+          reconnect();
+        }
+        return true;
+      }
+
+      /// @brief give the broker the current will before connecting
+      void setWill()
       {
-        if (m_handler && m_handler->m_receive)
+        if (m_will)
+        {
+          auto pubopts =
+              mqtt::publish_options(mqtt::qos(std::min<uint8_t>(m_will->m_options.m_qos, 2))) |
+              (m_will->m_options.m_retain ? mqtt::retain::yes : mqtt::retain::no);
+          derived().getClient()->set_will(mqtt::will(mqtt::allocate_buffer(m_will->m_topic),
+                                                     mqtt::allocate_buffer(m_will->m_payload),
+                                                     pubopts));
+        }
+      }
+
+      /// @brief complete a quality of service 1 or 2 publish
+      void acknowledge(std::uint16_t packetId, bool success)
+      {
+        Published done;
+        {
+          std::lock_guard<std::mutex> lock(m_inflightMutex);
+          auto it = m_inflight.find(packetId);
+          if (it == m_inflight.end())
+            return;
+          done = std::move(it->second);
+          m_inflight.erase(it);
+        }
+        done(success);
+      }
+
+      /// @brief complete all publishes waiting for an acknowledgement, used when the connection
+      /// closes
+      void acknowledgeAll(bool success)
+      {
+        std::unordered_map<std::uint16_t, Published> inflight;
+        {
+          std::lock_guard<std::mutex> lock(m_inflightMutex);
+          inflight.swap(m_inflight);
+        }
+        for (auto &done : inflight)
+          done.second(success);
+      }
+
+      /// @brief the protocol version to create the client with
+      mqtt::protocol_version protocolVersion() const
+      {
+        return m_mqtt5 ? mqtt::protocol_version::v5 : mqtt::protocol_version::v3_1_1;
+      }
+
+      void receive(mqtt::buffer &topic, mqtt::buffer &contents, const mqtt::v5::properties &props)
+      {
+        if (m_handler && m_handler->m_receiveProperties)
+        {
+          MessageProperties properties;
+          for (const auto &prop : props)
+          {
+            MQTT_NS::visit(
+                MQTT_NS::make_lambda_visitor(
+                    [&properties](const mqtt::v5::property::subscription_identifier &p) {
+                      // The first identifier if the message matched more than one subscription
+                      if (properties.m_subscription == 0)
+                        properties.m_subscription = uint32_t(p.val());
+                    },
+                    [&properties](const mqtt::v5::property::user_property &p) {
+                      properties.m_user.emplace_back(string(p.key()), string(p.val()));
+                    },
+                    [](const auto &) {}),
+                prop);
+          }
+          m_handler->m_receiveProperties(shared_from_this(), string(topic), string(contents),
+                                         properties);
+        }
+        else if (m_handler && m_handler->m_receive)
+        {
           m_handler->m_receive(shared_from_this(), string(topic), string(contents));
+        }
       }
 
       /// <summary>
@@ -331,7 +598,8 @@ namespace mtconnect {
                 LOG(info) << "MqttClientImpl::reconnect: reconnect now";
 
                 // Connect
-                derived().getClient()->async_connect([this](mqtt::error_code ec) {
+                setWill();
+                asyncConnect([this](mqtt::error_code ec) {
                   LOG(info) << "MqttClientImpl::reconnect async_connect callback: " << ec.message();
                   if (ec && ec != boost::asio::error::operation_aborted)
                   {
@@ -351,11 +619,16 @@ namespace mtconnect {
 
       std::uint16_t m_packetId {0};
 
+      std::uint16_t m_topicAliasMaximum {1024};  ///< Aliases the broker may use for MQTT 5
+
       std::optional<std::string> m_username;
 
       std::optional<std::string> m_password;
 
       boost::asio::steady_timer m_reconnectTimer;
+
+      std::mutex m_inflightMutex;
+      std::unordered_map<std::uint16_t, Published> m_inflight;  ///< Publishes waiting for acks
     };
 
     /// @brief Create an Mqtt TCP Client
@@ -370,7 +643,7 @@ namespace mtconnect {
       {
         if (!m_client)
         {
-          m_client = mqtt::make_async_client(m_ioContext, m_host, m_port);
+          m_client = mqtt::make_async_client(m_ioContext, m_host, m_port, protocolVersion());
           if (m_username)
             m_client->set_user_name(*m_username);
           if (m_password)
@@ -397,7 +670,7 @@ namespace mtconnect {
       {
         if (!m_client)
         {
-          m_client = mqtt::make_tls_async_client(m_ioContext, m_host, m_port);
+          m_client = mqtt::make_tls_async_client(m_ioContext, m_host, m_port, protocolVersion());
           if (m_username)
             m_client->set_user_name(*m_username);
           if (m_password)
@@ -439,7 +712,8 @@ namespace mtconnect {
       {
         if (!m_client)
         {
-          m_client = mqtt::make_tls_async_client_ws(m_ioContext, m_host, m_port);
+          m_client =
+              mqtt::make_tls_async_client_ws(m_ioContext, m_host, m_port, "/", protocolVersion());
           if (m_username)
             m_client->set_user_name(*m_username);
           if (m_password)
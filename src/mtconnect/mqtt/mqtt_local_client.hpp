@@ -0,0 +1,128 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <boost/asio/post.hpp>
+
+#include "mqtt_client.hpp"
+#include "mqtt_server.hpp"
+#include "mtconnect/configuration/config_options.hpp"
+#include "mtconnect/logging.hpp"
+
+namespace mtconnect {
+  namespace mqtt_client {
+    /// @brief A client that publishes to an MQTT server in the same process
+    ///
+    /// Messages are given to the server's dispatch without a connection, so they are not
+    /// encoded, written to a socket, and decoded again before they are sent to the
+    /// subscribers. The client is connected while it is running and the server is running.
+    /// Subscriptions and the will are not supported since the connection cannot be lost.
+    class MqttLocalClient : public MqttClient
+    {
+    public:
+      /// @brief Create a client of an MQTT server
+      /// @param ioContext a boost asio context
+      /// @param server the server to publish to
+      /// @param options configuration options
+      /// - MqttClientId, defaults to `_local`
+      /// @param handler the connection handlers
+      MqttLocalClient(boost::asio::io_context &ioContext,
+                      std::shared_ptr<mqtt_server::MqttServer> server,
+                      const ConfigOptions &options, std::unique_ptr<ClientHandler> &&handler)
+        : MqttClient(ioContext, std::move(handler)), m_server(server)
+      {
+        m_identity =
+            GetOption<std::string>(options, configuration::MqttClientId).value_or("_local");
+        m_mqtt5 = GetOption<int>(options, configuration::MqttProtocolVersion).value_or(3) == 5;
+      }
+
+      ~MqttLocalClient() { stop(); }
+
+      /// @brief Connect to the server once it is running. The handlers are called as if the
+      /// server had acknowledged a connection.
+      bool start() override
+      {
+        if (!m_server->isRunning())
+        {
+          LOG(error) << "MqttLocalClient: the MQTT server is not running";
+          return false;
+        }
+
+        m_url = m_server->getUrl();
+        m_running = true;
+        if (m_handler && m_handler->m_connecting)
+          m_handler->m_connecting(shared_from_this());
+
+        boost::asio::post(m_ioContext, [this, self = shared_from_this()]() {
+          if (!m_running)
+            return;
+
+          LOG(info) << "MqttLocalClient: connected to " << m_url;
+          if (m_handler && m_handler->m_connected)
+            m_handler->m_connected(self);
+          else
+            m_connected = true;
+        });
+
+        return true;
+      }
+
+      void stop() override
+      {
+        m_running = false;
+        m_connected = false;
+      }
+
+      bool subscribe(const std::string &topic, uint32_t = 0) override
+      {
+        LOG(warning) << "MqttLocalClient: cannot subscribe to " << topic;
+        return false;
+      }
+
+      bool publish(const std::string &topic, const std::string &payload) override
+      {
+        return publish(topic, std::make_shared<std::string>(payload), PublishOptions(),
+                       nullptr);
+      }
+
+      bool publish(const std::string &topic, printer::BufferPtr payload) override
+      {
+        return publish(topic, payload, PublishOptions(), nullptr);
+      }
+
+      /// @brief Give the message to the server. The message is complete once it has been
+      /// given to the subscribers' connections, so `done` is called before returning.
+      bool publish(const std::string &topic, printer::BufferPtr payload,
+                   const PublishOptions &options, Published done) override
+      {
+        if (!m_connected || !m_server->publish(topic, payload, options))
+        {
+          LOG(debug) << "Not connected, cannot publish to " << topic;
+          return false;
+        }
+
+        if (done)
+          done(true);
+        return true;
+      }
+
+    protected:
+      std::shared_ptr<mqtt_server::MqttServer> m_server;
+    };
+  }  // namespace mqtt_client
+}  // namespace mtconnect
@@ -14,6 +14,8 @@
 #pragma once
 
 #include "mtconnect/config.hpp"
+#include "mtconnect/mqtt/mqtt_client.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
 #include "mtconnect/source/adapter/adapter.hpp"
 #include "mtconnect/source/adapter/adapter_pipeline.hpp"
 
@@ -44,10 +46,26 @@ namespace mtconnect {
       /// @brief Shutdown the Mqtt server
       virtual void stop() = 0;
 
+      /// @brief Publish a message from within the agent
+      ///
+      /// The message is delivered to the matching subscriptions as if it had been received
+      /// from a client, without a connection to the server.
+      ///
+      /// @param topic the topic
+      /// @param payload the message, held until it has been written to the subscribers
+      /// @param options the quality of service, retain flag, and MQTT 5 properties
+      /// @return `false` if the server is not running
+      virtual bool publish(const std::string &topic, printer::BufferPtr payload,
+                           const mqtt_client::PublishOptions &options) = 0;
+
+      /// @brief `true` if the server has been started and not stopped
+      bool isRunning() const { return m_running; }
+
     protected:
       boost::asio::io_context &m_ioContext;
       std::string m_url;
       uint16_t m_port;
+      bool m_running {false};
     };
   }  // namespace mqtt_server
 }  // namespace mtconnect
@@ -15,13 +15,14 @@
 //    limitations under the License.
 //
 
+#pragma once
+
 #include <boost/log/trivial.hpp>
-#include <boost/multi_index/composite_key.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index_container.hpp>
 #include <boost/uuid/name_generator_sha1.hpp>
 
+#include <chrono>
+#include <optional>
+
 #include <inttypes.h>
 #include <mqtt/async_client.hpp>
 #include <mqtt/setup_log.hpp>
@@ -31,6 +32,7 @@
 #include "mtconnect/configuration/config_options.hpp"
 #include "mtconnect/source/adapter/adapter.hpp"
 #include "mtconnect/source/adapter/mqtt/mqtt_adapter.hpp"
+#include "topic_trie.hpp"
 
 using namespace std;
 namespace asio = boost::asio;
@@ -40,42 +42,12 @@ namespace mtconnect {
   using namespace entity;
   using namespace pipeline;
   using namespace source::adapter;
-  namespace mi = boost::multi_index;
 
   namespace mqtt_server {
 
     using con_t = MQTT_NS::server_tls_ws<>::endpoint_t;
     using con_sp_t = std::shared_ptr<con_t>;
 
-    struct sub_con
-    {
-      sub_con(MQTT_NS::buffer topic, con_sp_t con, MQTT_NS::qos qos_value)
-        : topic(std::move(topic)), con(std::move(con)), qos_value(qos_value)
-      {}
-      MQTT_NS::buffer topic;
-      con_sp_t con;
-      MQTT_NS::qos qos_value;
-    };
-
-    struct tag_topic
-    {};
-    struct tag_con
-    {};
-    struct tag_con_topic
-    {};
-
-    using mi_sub_con = mi::multi_index_container<
-        sub_con,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_con_topic>,
-                mi::composite_key<sub_con, BOOST_MULTI_INDEX_MEMBER(sub_con, con_sp_t, con),
-                                  BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::buffer, topic)>>,
-            mi::ordered_non_unique<mi::tag<tag_topic>,
-                                   BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::buffer, topic)>,
-            mi::ordered_non_unique<mi::tag<tag_con>,
-                                   BOOST_MULTI_INDEX_MEMBER(sub_con, con_sp_t, con)>>>;
-
     template <typename Derived>
     class MqttServerImpl : public MqttServer
     {
@@ -86,11 +58,17 @@ namespace mtconnect {
       /// - Port, defaults to 0/1883
       /// - MqttTls, defaults to false
       /// - ServerIp, defaults to 127.0.0.1/LocalHost
+      /// - MqttTopicAliasMaximum, the topic aliases accepted from MQTT 5 clients, defaults
+      ///   to 1024
       MqttServerImpl(boost::asio::io_context &ioContext, const ConfigOptions &options)
         : MqttServer(ioContext),
           m_options(options),
           m_host(*GetOption<std::string>(options, configuration::ServerIp))
       {
+        m_topicAliasMaximum = uint16_t(std::clamp(
+            GetOption<int>(options, configuration::MqttTopicAliasMaximum).value_or(1024), 0,
+            0xFFFF));
+
         std::stringstream url;
         url << "mqtt://" << m_host << ':' << m_port;
         m_url = url.str();
@@ -113,15 +91,11 @@ namespace mtconnect {
           std::weak_ptr<con_t> wp = spep;
           using packet_id_t = typename std::remove_reference_t<decltype(ep)>::packet_id_t;
           LOG(info) << "Server: Accepted" << std::endl;
-          // For server close if ep is closed.
-          auto g = MQTT_NS::shared_scope_guard([&server] {
-            LOG(info) << "Server: session end" << std::endl;
-            server.close();
-          });
           // Pass spep to keep lifetime.
           // It makes sure wp.lock() never return nullptr in the handlers below
-          // including close_handler and error_handler.
-          ep.start_session(std::make_tuple(std::move(spep), std::move(g)));
+          // including close_handler and error_handler. The server keeps accepting
+          // connections when a session ends.
+          ep.start_session(std::move(spep));
           ep.set_connect_handler([this, wp](MQTT_NS::buffer client_id,
                                             MQTT_NS::optional<MQTT_NS::buffer> username,
                                             MQTT_NS::optional<MQTT_NS::buffer> password,
@@ -141,11 +115,41 @@ namespace mtconnect {
               LOG(error) << "Server: Endpoint has been deleted";
               return false;
             }
-            m_connections.insert(sp);
+            {
+              std::lock_guard<std::mutex> lock(m_mutex);
+              m_connections.insert(sp);
+            }
             sp->connack(false, MQTT_NS::connect_return_code::accepted);
             return true;
           });
 
+          ep.set_v5_connect_handler([this, wp](MQTT_NS::buffer client_id,
+                                               MQTT_NS::optional<MQTT_NS::buffer>,
+                                               MQTT_NS::optional<MQTT_NS::buffer>,
+                                               MQTT_NS::optional<MQTT_NS::will>, bool clean_start,
+                                               std::uint16_t keep_alive, MQTT_NS::v5::properties) {
+            LOG(info) << "Server: Client_id    : " << client_id << " (MQTT 5)";
+            LOG(info) << "Server: Clean_start  : " << std::boolalpha << clean_start;
+            LOG(info) << "Server: Keep_alive   : " << keep_alive;
+            auto sp = wp.lock();
+            if (!sp)
+            {
+              LOG(error) << "Server: Endpoint has been deleted";
+              return false;
+            }
+            {
+              std::lock_guard<std::mutex> lock(m_mutex);
+              m_connections.insert(sp);
+            }
+
+            // Topic aliases sent by the client are resolved by the endpoint
+            MQTT_NS::v5::properties props;
+            if (m_topicAliasMaximum > 0)
+              props.emplace_back(MQTT_NS::v5::property::topic_alias_maximum(m_topicAliasMaximum));
+            sp->connack(false, MQTT_NS::v5::connect_reason_code::success, std::move(props));
+            return true;
+          });
+
           ep.set_close_handler([this, wp]() {
             LOG(info) << "MQTT "
                       << ": Server closed";
@@ -155,10 +159,10 @@ namespace mtconnect {
               LOG(error) << "Server Endpoint has been deleted";
               return false;
             }
+            std::lock_guard<std::mutex> lock(m_mutex);
             m_connections.erase(con);
-            auto &idx = m_subs.get<tag_con>();
-            auto r = idx.equal_range(con);
-            idx.erase(r.first, r.second);
+            m_subs.unsubscribeAll(con);
+            m_identifiers.erase(con);
 
             return true;
           });
@@ -171,10 +175,10 @@ namespace mtconnect {
               LOG(error) << "Server Endpoint has been deleted";
               return false;
             }
+            std::lock_guard<std::mutex> lock(m_mutex);
             m_connections.erase(con);
-            auto &idx = m_subs.get<tag_con>();
-            auto r = idx.equal_range(con);
-            idx.erase(r.first, r.second);
+            m_subs.unsubscribeAll(con);
+            m_identifiers.erase(con);
 
             return true;
           });
@@ -191,17 +195,122 @@ namespace mtconnect {
                   LOG(error) << "Server Endpoint has been deleted";
                   return false;
                 }
-                for (auto const &e : entries)
+                std::vector<Delivery> deliveries;
                 {
-                  LOG(debug) << "Server: topic_filter: " << e.topic_filter
-                             << " qos: " << e.subopts.get_qos() << std::endl;
-                  res.emplace_back(MQTT_NS::qos_to_suback_return_code(e.subopts.get_qos()));
-                  m_subs.emplace(std::move(e.topic_filter), sp, e.subopts.get_qos());
+                  std::lock_guard<std::mutex> lock(m_mutex);
+                  for (auto const &e : entries)
+                  {
+                    LOG(debug) << "Server: topic_filter: " << e.topic_filter
+                               << " qos: " << e.subopts.get_qos() << std::endl;
+                    if (m_subs.subscribe(e.topic_filter, sp, uint8_t(e.subopts.get_qos())))
+                    {
+                      res.emplace_back(MQTT_NS::qos_to_suback_return_code(e.subopts.get_qos()));
+                      retained(sp, e.topic_filter, e.subopts.get_qos(), {}, deliveries);
+                    }
+                    else
+                    {
+                      res.emplace_back(MQTT_NS::suback_return_code::failure);
+                    }
+                  }
                 }
                 sp->suback(packet_id, res);
+                deliver(deliveries);
+                return true;
+              });
+
+          ep.set_v5_subscribe_handler([this, wp](packet_id_t packet_id,
+                                                 std::vector<MQTT_NS::subscribe_entry> entries,
+                                                 MQTT_NS::v5::properties props) {
+            LOG(debug) << "Server: Subscribe received. packet_id: " << packet_id;
+            auto sp = wp.lock();
+            if (!sp)
+            {
+              LOG(error) << "Server Endpoint has been deleted";
+              return false;
+            }
+
+            std::optional<uint32_t> identifier;
+            for (auto const &prop : props)
+            {
+              MQTT_NS::visit(
+                  MQTT_NS::make_lambda_visitor(
+                      [&identifier](MQTT_NS::v5::property::subscription_identifier const &p) {
+                        identifier = uint32_t(p.val());
+                      },
+                      [](auto const &) {}),
+                  prop);
+            }
+
+            std::vector<MQTT_NS::v5::suback_reason_code> res;
+            res.reserve(entries.size());
+            std::vector<Delivery> deliveries;
+            {
+              std::lock_guard<std::mutex> lock(m_mutex);
+              for (auto const &e : entries)
+              {
+                LOG(debug) << "Server: topic_filter: " << e.topic_filter
+                           << " qos: " << e.subopts.get_qos();
+                if (m_subs.subscribe(e.topic_filter, sp, uint8_t(e.subopts.get_qos())))
+                {
+                  identify(sp, e.topic_filter, identifier);
+                  res.emplace_back(MQTT_NS::v5::qos_to_suback_reason_code(e.subopts.get_qos()));
+                  retained(sp, e.topic_filter, e.subopts.get_qos(), identifier, deliveries);
+                }
+                else
+                {
+                  res.emplace_back(MQTT_NS::v5::suback_reason_code::topic_filter_invalid);
+                }
+              }
+            }
+            sp->suback(packet_id, res);
+            deliver(deliveries);
+            return true;
+          });
+
+          ep.set_unsubscribe_handler(
+              [this, wp](packet_id_t packet_id, std::vector<MQTT_NS::unsubscribe_entry> entries) {
+                LOG(debug) << "Server: Unsubscribe received. packet_id: " << packet_id;
+                auto sp = wp.lock();
+                if (!sp)
+                {
+                  LOG(error) << "Server Endpoint has been deleted";
+                  return false;
+                }
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto const &e : entries)
+                {
+                  m_subs.unsubscribe(e.topic_filter, sp);
+                  identify(sp, e.topic_filter, std::nullopt);
+                }
+                sp->unsuback(packet_id);
                 return true;
               });
 
+          ep.set_v5_unsubscribe_handler([this, wp](packet_id_t packet_id,
+                                                   std::vector<MQTT_NS::unsubscribe_entry> entries,
+                                                   MQTT_NS::v5::properties) {
+            LOG(debug) << "Server: Unsubscribe received. packet_id: " << packet_id;
+            auto sp = wp.lock();
+            if (!sp)
+            {
+              LOG(error) << "Server Endpoint has been deleted";
+              return false;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<MQTT_NS::v5::unsubscribe_reason_code> res;
+            res.reserve(entries.size());
+            for (auto const &e : entries)
+            {
+              if (m_subs.unsubscribe(e.topic_filter, sp))
+                res.emplace_back(MQTT_NS::v5::unsubscribe_reason_code::success);
+              else
+                res.emplace_back(MQTT_NS::v5::unsubscribe_reason_code::no_subscription_existed);
+              identify(sp, e.topic_filter, std::nullopt);
+            }
+            sp->unsuback(packet_id, res);
+            return true;
+          });
+
           ep.set_publish_handler([this](mqtt::optional<std::uint16_t> packet_id,
                                         mqtt::publish_options pubopts, mqtt::buffer topic_name,
                                         mqtt::buffer contents) {
@@ -215,14 +324,27 @@ namespace mtconnect {
             LOG(debug) << "Server topic_name: " << topic_name;
             LOG(debug) << "Server contents: " << contents;
 
-            auto const &idx = m_subs.get<tag_topic>();
-            auto r = idx.equal_range(topic_name);
-            for (; r.first != r.second; ++r.first)
-            {
-              r.first->con->publish(topic_name, contents,
-                                    std::min(r.first->qos_value, pubopts.get_qos()));
-            }
+            forward(topic_name, contents, pubopts, {});
+            return true;
+          });
 
+          ep.set_v5_publish_handler([this](mqtt::optional<std::uint16_t> packet_id,
+                                           mqtt::publish_options pubopts,
+                                           mqtt::buffer topic_name, mqtt::buffer contents,
+                                           MQTT_NS::v5::properties props) {
+            LOG(debug) << "Server: publish received."
+                       << " dup: " << pubopts.get_dup() << " qos: " << pubopts.get_qos()
+                       << " retain: " << pubopts.get_retain();
+            if (packet_id)
+              LOG(debug) << "Server packet_id: " << *packet_id;
+            LOG(debug) << "Server topic_name: " << topic_name;
+
+            // The topic alias is only valid on the connection it was received on and the
+            // subscription identifiers are added for each subscriber
+            props.erase(std::remove_if(props.begin(), props.end(), isReceiverProperty),
+                        props.end());
+
+            forward(topic_name, contents, pubopts, props);
             return true;
           });
 
@@ -231,6 +353,7 @@ namespace mtconnect {
 
         server.listen();
         m_port = server.port();
+        m_running = true;
 
         return true;
       }
@@ -240,6 +363,7 @@ namespace mtconnect {
       {
         auto &server = derived().getServer();
         auto url = m_url;
+        m_running = false;
 
         if (server)
         {
@@ -250,10 +374,262 @@ namespace mtconnect {
         }
       }
 
+      bool publish(const std::string &topic, printer::BufferPtr payload,
+                   const mqtt_client::PublishOptions &options) override
+      {
+        if (!m_running)
+          return false;
+
+        // The payload is shared by the subscribers' endpoints without copying it
+        MQTT_NS::buffer contents(MQTT_NS::string_view(payload->data(), payload->size()),
+                                 MQTT_NS::const_shared_ptr_array(payload->data(),
+                                                                 [payload](const char *) {}));
+        auto pubopts =
+            MQTT_NS::publish_options(MQTT_NS::qos(std::min<uint8_t>(options.m_qos, 2))) |
+            (options.m_retain ? MQTT_NS::retain::yes : MQTT_NS::retain::no);
+
+        MQTT_NS::v5::properties props;
+        if (options.m_expiry.count() > 0)
+        {
+          props.emplace_back(MQTT_NS::v5::property::message_expiry_interval(
+              uint32_t(options.m_expiry.count())));
+        }
+        for (const auto &[name, value] : options.m_properties)
+        {
+          props.emplace_back(MQTT_NS::v5::property::user_property(MQTT_NS::allocate_buffer(name),
+                                                                  MQTT_NS::allocate_buffer(value)));
+        }
+
+        forward(MQTT_NS::allocate_buffer(topic), contents, pubopts, props);
+        return true;
+      }
+
+    protected:
+      /// @brief a message kept for new subscriptions
+      struct Retained
+      {
+        MQTT_NS::buffer m_topic;
+        MQTT_NS::buffer m_contents;
+        MQTT_NS::qos m_qos;
+        MQTT_NS::v5::properties m_properties;
+        std::optional<std::chrono::steady_clock::time_point> m_expires;
+      };
+
+      /// @brief a message to send to one subscriber
+      struct Delivery
+      {
+        con_sp_t m_connection;
+        MQTT_NS::buffer m_topic;
+        MQTT_NS::buffer m_contents;
+        MQTT_NS::publish_options m_options;
+        std::optional<MQTT_NS::v5::properties> m_properties;  //< only for MQTT 5 subscribers
+      };
+
+      /// @brief send a published message to the matching subscribers
+      ///
+      /// The topic and contents buffers are reference counted and shared by all the
+      /// subscribers, only the packet ids differ. MQTT 5 subscribers also receive the
+      /// properties and the identifiers of their matching subscriptions. The subscribers are
+      /// found with the mutex held and the messages are sent after it is released.
+      void forward(MQTT_NS::buffer topic, MQTT_NS::buffer contents,
+                   MQTT_NS::publish_options pubopts, const MQTT_NS::v5::properties &props)
+      {
+        std::vector<Delivery> deliveries;
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+
+          // An empty retained message removes the retained message of the topic
+          if (pubopts.get_retain() == MQTT_NS::retain::yes)
+          {
+            if (contents.empty())
+            {
+              m_retained.erase(std::string(topic));
+            }
+            else
+            {
+              Retained message {topic, contents, pubopts.get_qos(), props, std::nullopt};
+              if (auto expiry = expiryOf(props))
+                message.m_expires =
+                    std::chrono::steady_clock::now() + std::chrono::seconds(*expiry);
+              m_retained.insert_or_assign(std::string(topic), std::move(message));
+            }
+          }
+
+          std::vector<TopicTrie<con_sp_t>::Subscription> matches;
+          m_subs.match(topic, matches, m_cursor++);
+          deliveries.reserve(matches.size());
+          for (auto &match : matches)
+          {
+            auto &con = match.first;
+            auto qos = std::min(MQTT_NS::qos(match.second), pubopts.get_qos());
+            auto &delivery = deliveries.emplace_back(
+                Delivery {con, topic, contents, MQTT_NS::publish_options(qos), std::nullopt});
+            if (con->get_protocol_version() == MQTT_NS::protocol_version::v5)
+            {
+              auto &forwarded = delivery.m_properties.emplace(props);
+              if (auto ids = m_identifiers.find(con); ids != m_identifiers.end())
+              {
+                for (auto &[filter, id] : ids->second)
+                {
+                  if (TopicTrie<con_sp_t>::matches(filter, topic))
+                    forwarded.emplace_back(MQTT_NS::v5::property::subscription_identifier(id));
+                }
+              }
+            }
+          }
+        }
+
+        deliver(deliveries);
+      }
+
+      /// @brief send messages from the strand of each subscriber's connection
+      ///
+      /// The publish may be called from any thread, such as the agent's ingest thread, so the
+      /// endpoint is only used from its own strand and a slow subscriber does not block the
+      /// caller.
+      static void deliver(std::vector<Delivery> &deliveries)
+      {
+        for (auto &delivery : deliveries)
+        {
+          auto socket = delivery.m_connection->socket();
+          socket->post([delivery = std::move(delivery)]() mutable {
+            auto complete = [](MQTT_NS::error_code ec) {
+              if (ec)
+                LOG(warning) << "MqttServer: publish to subscriber failed: " << ec.message();
+            };
+            auto &con = delivery.m_connection;
+            if (delivery.m_properties)
+              con->async_publish(delivery.m_topic, delivery.m_contents, delivery.m_options,
+                                 std::move(*delivery.m_properties), complete);
+            else
+              con->async_publish(delivery.m_topic, delivery.m_contents, delivery.m_options,
+                                 complete);
+          });
+        }
+      }
+
+      /// @brief get the message expiry interval in seconds from the properties of a message
+      static std::optional<uint32_t> expiryOf(const MQTT_NS::v5::properties &props)
+      {
+        std::optional<uint32_t> expiry;
+        for (auto const &prop : props)
+        {
+          MQTT_NS::visit(MQTT_NS::make_lambda_visitor(
+                             [&expiry](MQTT_NS::v5::property::message_expiry_interval const &p) {
+                               expiry = uint32_t(p.val());
+                             },
+                             [](auto const &) {}),
+                         prop);
+        }
+        return expiry;
+      }
+
+      /// @brief `true` for the properties that are set for each receiver of a message
+      static bool isReceiverProperty(MQTT_NS::v5::property_variant const &prop)
+      {
+        return MQTT_NS::visit(
+            MQTT_NS::make_lambda_visitor(
+                [](MQTT_NS::v5::property::topic_alias const &) { return true; },
+                [](MQTT_NS::v5::property::subscription_identifier const &) { return true; },
+                [](auto const &) { return false; }),
+            prop);
+      }
+
+      /// @brief `true` for the message expiry interval property
+      static bool isExpiryProperty(MQTT_NS::v5::property_variant const &prop)
+      {
+        return MQTT_NS::visit(
+            MQTT_NS::make_lambda_visitor(
+                [](MQTT_NS::v5::property::message_expiry_interval const &) { return true; },
+                [](auto const &) { return false; }),
+            prop);
+      }
+
+      /// @brief collect the retained messages matching a new subscription, called with the
+      /// mutex held. Shared subscriptions do not receive retained messages. Expired messages
+      /// are removed and MQTT 5 subscribers receive the remaining expiry interval.
+      void retained(const con_sp_t &con, std::string_view filter, MQTT_NS::qos qos,
+                    std::optional<uint32_t> identifier, std::vector<Delivery> &deliveries)
+      {
+        using namespace std::chrono;
+
+        if (filter.substr(0, 7) == "$share/")
+          return;
+
+        auto now = steady_clock::now();
+        for (auto it = m_retained.begin(); it != m_retained.end();)
+        {
+          auto &[name, message] = *it;
+          if (message.m_expires && *message.m_expires <= now)
+          {
+            it = m_retained.erase(it);
+            continue;
+          }
+
+          if (TopicTrie<con_sp_t>::matches(filter, name))
+          {
+            auto pubopts = MQTT_NS::publish_options(std::min(qos, message.m_qos)) |
+                           MQTT_NS::retain::yes;
+            auto &delivery = deliveries.emplace_back(
+                Delivery {con, message.m_topic, message.m_contents, pubopts, std::nullopt});
+            if (con->get_protocol_version() == MQTT_NS::protocol_version::v5)
+            {
+              auto &props = delivery.m_properties.emplace(message.m_properties);
+              if (message.m_expires)
+              {
+                props.erase(std::remove_if(props.begin(), props.end(), isExpiryProperty),
+                            props.end());
+                auto remaining = duration_cast<seconds>(*message.m_expires - now + seconds(1));
+                props.emplace_back(
+                    MQTT_NS::v5::property::message_expiry_interval(uint32_t(remaining.count())));
+              }
+              if (identifier)
+                props.emplace_back(MQTT_NS::v5::property::subscription_identifier(*identifier));
+            }
+          }
+          it++;
+        }
+      }
+
+      /// @brief set or clear the subscription identifier of a topic filter, called with the
+      /// mutex held
+      void identify(const con_sp_t &con, std::string_view filter,
+                    std::optional<uint32_t> identifier)
+      {
+        auto it = m_identifiers.find(con);
+        if (it == m_identifiers.end())
+        {
+          if (identifier)
+            m_identifiers[con].emplace_back(filter, *identifier);
+          return;
+        }
+
+        auto &ids = it->second;
+        auto id = std::find_if(ids.begin(), ids.end(),
+                               [filter](const auto &e) { return e.first == filter; });
+        if (identifier && id != ids.end())
+          id->second = *identifier;
+        else if (identifier)
+          ids.emplace_back(filter, *identifier);
+        else if (id != ids.end())
+          ids.erase(id);
+
+        if (ids.empty())
+          m_identifiers.erase(it);
+      }
+
     protected:
       ConfigOptions m_options;
       std::set<con_sp_t> m_connections;
-      mi_sub_con m_subs;
+      TopicTrie<con_sp_t> m_subs;
+      size_t m_cursor {0};
+      std::map<con_sp_t, std::vector<std::pair<std::string, uint32_t>>> m_identifiers;
+      std::map<std::string, Retained> m_retained;
+
+      // The subscriptions and retained messages are shared by the connections and the
+      // agent's own publishes
+      std::mutex m_mutex;
+      uint16_t m_topicAliasMaximum;
       std::string m_host;
     };
 
@@ -0,0 +1,380 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mtconnect::mqtt_server {
+  /// @brief Subscriptions organized by the levels of their topic filters
+  ///
+  /// Published topics are matched level by level so the cost depends on the depth of the
+  /// topic and not on the number of subscriptions. Supports the single level `+` and multi
+  /// level `#` wildcards and shared subscriptions of the form `$share/<group>/<filter>`, where
+  /// each message is delivered to one member of the group in turn. Filters starting with a
+  /// wildcard do not match topics starting with `$`.
+  ///
+  /// The trie is not synchronized. Matching does not modify the trie, so concurrent matches
+  /// are safe as long as they do not overlap a subscribe or unsubscribe.
+  ///
+  /// @tparam Subscriber the subscriber type, must be ordered and equality comparable
+  template <typename Subscriber>
+  class TopicTrie
+  {
+  public:
+    /// @brief a subscriber and the maximum quality of service of a subscription
+    using Subscription = std::pair<Subscriber, uint8_t>;
+
+    /// @brief add a subscription or change its quality of service
+    /// @param[in] filter the topic filter, optionally prefixed by `$share/<group>/`
+    /// @param[in] subscriber the subscriber
+    /// @param[in] qos the maximum quality of service
+    /// @return `false` if the filter is not valid
+    bool subscribe(std::string_view filter, const Subscriber &subscriber, uint8_t qos)
+    {
+      std::string_view group;
+      if (!parse(filter, group))
+        return false;
+
+      auto &subscriptions = subscriptionsFor(node(filter), group);
+      auto it = find(subscriptions, subscriber);
+      if (it != subscriptions.end())
+      {
+        it->second = qos;
+      }
+      else
+      {
+        subscriptions.emplace_back(subscriber, qos);
+        m_filters[subscriber].emplace_back(full(filter, group));
+        m_count++;
+      }
+
+      return true;
+    }
+
+    /// @brief remove a subscription
+    /// @param[in] filter the topic filter used to subscribe
+    /// @param[in] subscriber the subscriber
+    /// @return `true` if the subscription was found
+    bool unsubscribe(std::string_view filter, const Subscriber &subscriber)
+    {
+      auto filters = m_filters.find(subscriber);
+      if (filters == m_filters.end())
+        return false;
+
+      auto &list = filters->second;
+      auto it = std::find(list.begin(), list.end(), filter);
+      if (it == list.end())
+        return false;
+
+      remove(*it, subscriber);
+      list.erase(it);
+      if (list.empty())
+        m_filters.erase(filters);
+
+      return true;
+    }
+
+    /// @brief remove all the subscriptions of a subscriber, used when a connection closes
+    /// @param[in] subscriber the subscriber
+    void unsubscribeAll(const Subscriber &subscriber)
+    {
+      auto filters = m_filters.find(subscriber);
+      if (filters == m_filters.end())
+        return;
+
+      for (auto &filter : filters->second)
+        remove(filter, subscriber);
+      m_filters.erase(filters);
+    }
+
+    /// @brief find the subscribers of a published topic
+    ///
+    /// A subscriber with more than one matching subscription is returned once with the highest
+    /// quality of service. One member of each matching shared subscription group is returned,
+    /// selected by the `cursor`. Shared subscriptions are independent of the others (MQTT 5
+    /// 4.8.2), so a member selected by a group is returned again for the group even if it
+    /// also has a matching subscription of its own.
+    ///
+    /// @param[in] topic the published topic
+    /// @param[out] matches the matching subscriptions, cleared first
+    /// @param[in] cursor selects the member of each shared subscription group. Pass a counter
+    ///            that advances with every message to deliver to the members in turn.
+    void match(std::string_view topic, std::vector<Subscription> &matches,
+               size_t cursor = 0) const
+    {
+      matches.clear();
+
+      std::vector<std::string_view> levels;
+      std::vector<Subscription> shared;
+      split(topic, levels);
+      match(m_root, levels, 0, !topic.empty() && topic[0] == '$', cursor, matches, shared);
+
+      if (matches.size() > 1)
+      {
+        std::sort(matches.begin(), matches.end(), [](const auto &a, const auto &b) {
+          return a.first < b.first || (a.first == b.first && a.second > b.second);
+        });
+        matches.erase(std::unique(matches.begin(), matches.end(),
+                                  [](const auto &a, const auto &b) { return a.first == b.first; }),
+                      matches.end());
+      }
+
+      if (!shared.empty())
+      {
+        matches.insert(matches.end(), shared.begin(), shared.end());
+        std::stable_sort(matches.begin(), matches.end(),
+                         [](const auto &a, const auto &b) { return a.first < b.first; });
+      }
+    }
+
+    /// @brief get the number of subscriptions
+    size_t size() const { return m_count; }
+
+    /// @brief check if a topic filter matches a published topic
+    /// @param[in] filter the topic filter, optionally prefixed by `$share/<group>/`
+    /// @param[in] topic the published topic
+    /// @return `true` if the filter matches
+    static bool matches(std::string_view filter, std::string_view topic)
+    {
+      std::string_view group;
+      if (!parse(filter, group))
+        return false;
+
+      std::vector<std::string_view> filters, levels;
+      split(filter, filters);
+      split(topic, levels);
+
+      if (!topic.empty() && topic[0] == '$' && (filters[0] == "+" || filters[0] == "#"))
+        return false;
+
+      for (size_t i = 0; i < filters.size(); i++)
+      {
+        if (filters[i] == "#")
+          return true;
+        if (i == levels.size() || (filters[i] != "+" && filters[i] != levels[i]))
+          return false;
+      }
+
+      return filters.size() == levels.size();
+    }
+
+  protected:
+    struct Group
+    {
+      std::vector<Subscription> m_members;
+    };
+
+    struct Node
+    {
+      std::map<std::string, std::unique_ptr<Node>, std::less<>> m_children;
+      std::vector<Subscription> m_subscriptions;
+      std::map<std::string, Group, std::less<>> m_groups;
+
+      bool empty() const
+      {
+        return m_children.empty() && m_subscriptions.empty() && m_groups.empty();
+      }
+    };
+
+    static typename std::vector<Subscription>::iterator find(
+        std::vector<Subscription> &subscriptions, const Subscriber &subscriber)
+    {
+      return std::find_if(subscriptions.begin(), subscriptions.end(),
+                          [&subscriber](const auto &s) { return s.first == subscriber; });
+    }
+
+    static void split(std::string_view topic, std::vector<std::string_view> &levels)
+    {
+      size_t start = 0;
+      for (auto pos = topic.find('/'); pos != std::string_view::npos;
+           pos = topic.find('/', start))
+      {
+        levels.emplace_back(topic.substr(start, pos - start));
+        start = pos + 1;
+      }
+      levels.emplace_back(topic.substr(start));
+    }
+
+    /// @brief remove the shared subscription prefix and validate the wildcards of a filter
+    static bool parse(std::string_view &filter, std::string_view &group)
+    {
+      constexpr std::string_view share("$share/");
+      if (filter.substr(0, share.size()) == share)
+      {
+        auto rest = filter.substr(share.size());
+        auto slash = rest.find('/');
+        if (slash == 0 || slash == std::string_view::npos)
+          return false;
+        group = rest.substr(0, slash);
+        filter = rest.substr(slash + 1);
+      }
+
+      if (filter.empty())
+        return false;
+
+      std::vector<std::string_view> levels;
+      split(filter, levels);
+      for (size_t i = 0; i < levels.size(); i++)
+      {
+        const auto &level = levels[i];
+        if (level.find_first_of("+#") != std::string_view::npos &&
+            (level.size() > 1 || (level == "#" && i + 1 != levels.size())))
+          return false;
+      }
+
+      return true;
+    }
+
+    static std::string full(std::string_view filter, std::string_view group)
+    {
+      if (group.empty())
+        return std::string(filter);
+
+      std::string text("$share/");
+      text.append(group).append("/").append(filter);
+      return text;
+    }
+
+    Node &node(std::string_view filter)
+    {
+      std::vector<std::string_view> levels;
+      split(filter, levels);
+
+      Node *node = &m_root;
+      for (const auto &level : levels)
+      {
+        auto child = node->m_children.find(level);
+        if (child == node->m_children.end())
+          child = node->m_children.emplace(std::string(level), std::make_unique<Node>()).first;
+        node = child->second.get();
+      }
+
+      return *node;
+    }
+
+    std::vector<Subscription> &subscriptionsFor(Node &node, std::string_view group)
+    {
+      if (group.empty())
+        return node.m_subscriptions;
+
+      auto it = node.m_groups.find(group);
+      if (it == node.m_groups.end())
+        it = node.m_groups.emplace(std::string(group), Group()).first;
+      return it->second.m_members;
+    }
+
+    /// @brief remove a subscription and prune the nodes that are no longer used
+    void remove(std::string_view filter, const Subscriber &subscriber)
+    {
+      std::string_view group;
+      if (!parse(filter, group))
+        return;
+
+      std::vector<std::string_view> levels;
+      split(filter, levels);
+      if (remove(m_root, levels, 0, group, subscriber))
+        m_count--;
+    }
+
+    bool remove(Node &node, const std::vector<std::string_view> &levels, size_t i,
+                std::string_view group, const Subscriber &subscriber)
+    {
+      if (i == levels.size())
+      {
+        bool removed = false;
+        if (group.empty())
+        {
+          auto it = find(node.m_subscriptions, subscriber);
+          if ((removed = it != node.m_subscriptions.end()))
+            node.m_subscriptions.erase(it);
+        }
+        else if (auto g = node.m_groups.find(group); g != node.m_groups.end())
+        {
+          auto it = find(g->second.m_members, subscriber);
+          if ((removed = it != g->second.m_members.end()))
+            g->second.m_members.erase(it);
+          if (g->second.m_members.empty())
+            node.m_groups.erase(g);
+        }
+        return removed;
+      }
+
+      auto child = node.m_children.find(levels[i]);
+      if (child == node.m_children.end())
+        return false;
+
+      bool removed = remove(*child->second, levels, i + 1, group, subscriber);
+      if (child->second->empty())
+        node.m_children.erase(child);
+      return removed;
+    }
+
+    static void add(const Node &node, size_t cursor, std::vector<Subscription> &matches,
+                    std::vector<Subscription> &shared)
+    {
+      matches.insert(matches.end(), node.m_subscriptions.begin(), node.m_subscriptions.end());
+      for (const auto &group : node.m_groups)
+      {
+        const auto &members = group.second.m_members;
+        shared.emplace_back(members[cursor % members.size()]);
+      }
+    }
+
+    void match(const Node &node, const std::vector<std::string_view> &levels, size_t i,
+               bool system, size_t cursor, std::vector<Subscription> &matches,
+               std::vector<Subscription> &shared) const
+    {
+      // Wildcards at the first level do not match topics starting with $
+      const bool wildcards = !(system && i == 0);
+
+      // The multi level wildcard also matches the parent level
+      if (wildcards)
+      {
+        if (auto hash = node.m_children.find("#"); hash != node.m_children.end())
+          add(*hash->second, cursor, matches, shared);
+      }
+
+      if (i == levels.size())
+      {
+        add(node, cursor, matches, shared);
+        return;
+      }
+
+      if (auto child = node.m_children.find(levels[i]); child != node.m_children.end())
+        match(*child->second, levels, i + 1, system, cursor, matches, shared);
+
+      if (wildcards)
+      {
+        if (auto plus = node.m_children.find("+"); plus != node.m_children.end())
+          match(*plus->second, levels, i + 1, system, cursor, matches, shared);
+      }
+    }
+
+  protected:
+    Node m_root;
+    std::map<Subscriber, std::vector<std::string>> m_filters;
+    size_t m_count {0};
+  };
+}  // namespace mtconnect::mqtt_server
@@ -0,0 +1,122 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "mtconnect/config.hpp"
+
+namespace mtconnect::observation {
+  /// @brief Serialized forms of an observation shared by all printers and requests
+  ///
+  /// Each format has a single slot that is filled the first time the observation is printed in
+  /// that format and freed with the observation when it leaves the buffer and checkpoints. The
+  /// fragments assume the observation is not modified once it has been added to the buffer;
+  /// copies of an observation start with an empty cache.
+  ///
+  /// A fragment is tagged with the key of the printer that rendered it so a printer with a
+  /// different configuration, such as another set of namespaces, will not use it. The fragment
+  /// of another printer is replaced; readers hold a reference to the fragment they are writing.
+  /// The total size of all fragments is limited by a global budget, once it is reached
+  /// observations are printed without being cached.
+  class AGENT_LIB_API FragmentCache
+  {
+  public:
+    /// @brief The serialization formats that can be cached
+    enum Format
+    {
+      XML,
+      XML_PRETTY,
+      JSON_V1,
+      JSON_V2,
+      CBOR,
+      FORMAT_COUNT
+    };
+
+    /// @brief A rendered observation
+    struct Fragment
+    {
+      uint64_t m_key;
+      std::string m_text;
+    };
+    using FragmentPtr = std::shared_ptr<const Fragment>;
+
+    FragmentCache() = default;
+    FragmentCache(const FragmentCache &) {}
+    ~FragmentCache() { clear(); }
+    FragmentCache &operator=(const FragmentCache &)
+    {
+      clear();
+      return *this;
+    }
+
+    /// @brief get the fragment for a format if it was rendered with the same key
+    /// @param[in] format the format
+    /// @param[in] key the key of the printer
+    /// @return the fragment or `nullptr` if it has not been cached
+    FragmentPtr get(Format format, uint64_t key) const
+    {
+      auto fragment = std::atomic_load(&m_fragments[format]);
+      if (fragment && fragment->m_key == key)
+        return fragment;
+      else
+        return nullptr;
+    }
+
+    /// @brief cache a fragment if there is room in the budget, replaces a fragment rendered
+    /// with a different key
+    /// @param[in] format the format
+    /// @param[in] key the key of the printer
+    /// @param[in] text the rendered observation
+    /// @return `true` if the fragment was cached
+    bool put(Format format, uint64_t key, std::string_view text) const;
+
+    /// @brief free all the fragments
+    void clear();
+
+    /// @brief set the maximum number of bytes for all fragments, 0 disables the cache
+    /// @param[in] budget the budget in bytes
+    static void setBudget(size_t budget) { s_budget.store(budget, std::memory_order_relaxed); }
+    /// @brief get the maximum number of bytes for all fragments
+    static size_t getBudget() { return s_budget.load(std::memory_order_relaxed); }
+    /// @brief get the number of bytes currently used by all fragments
+    static size_t getSize() { return s_size.load(std::memory_order_relaxed); }
+    /// @brief get a unique key for a printer configuration
+    ///
+    /// Key 0 is reserved for formats that do not depend on the printer configuration.
+    static uint64_t nextKey() { return s_nextKey.fetch_add(1, std::memory_order_relaxed); }
+
+  protected:
+    static size_t sizeOf(const Fragment &fragment)
+    {
+      return sizeof(Fragment) + fragment.m_text.capacity();
+    }
+
+  protected:
+    mutable std::array<FragmentPtr, FORMAT_COUNT> m_fragments;
+
+    static std::atomic<size_t> s_budget;
+    static std::atomic<size_t> s_size;
+    static std::atomic<uint64_t> s_nextKey;
+  };
+}  // namespace mtconnect::observation
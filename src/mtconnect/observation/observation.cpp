@@ -36,6 +36,47 @@ namespace mtconnect {
   using namespace entity;
 
   namespace observation {
+    std::atomic<size_t> FragmentCache::s_budget {64 * 1024 * 1024};
+    std::atomic<size_t> FragmentCache::s_size {0};
+    std::atomic<uint64_t> FragmentCache::s_nextKey {1};
+
+    bool FragmentCache::put(Format format, uint64_t key, std::string_view text) const
+    {
+      auto current = std::atomic_load(&m_fragments[format]);
+      if (current && current->m_key == key)
+        return false;
+
+      auto fragment = make_shared<const Fragment>(Fragment {key, string(text)});
+      auto size = sizeOf(*fragment);
+      if (s_size.fetch_add(size, std::memory_order_relaxed) + size >
+          s_budget.load(std::memory_order_relaxed))
+      {
+        s_size.fetch_sub(size, std::memory_order_relaxed);
+        return false;
+      }
+
+      // Another printer may have rendered the observation at the same time
+      if (!std::atomic_compare_exchange_strong(&m_fragments[format], &current, fragment))
+      {
+        s_size.fetch_sub(size, std::memory_order_relaxed);
+        return false;
+      }
+
+      if (current)
+        s_size.fetch_sub(sizeOf(*current), std::memory_order_relaxed);
+
+      return true;
+    }
+
+    void FragmentCache::clear()
+    {
+      for (auto &slot : m_fragments)
+      {
+        if (auto fragment = std::atomic_exchange(&slot, FragmentPtr()))
+          s_size.fetch_sub(sizeOf(*fragment), std::memory_order_relaxed);
+      }
+    }
+
     FactoryPtr Observation::getFactory()
     {
       static FactoryPtr factory;
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <date/date.h>
 #include <set>
@@ -29,6 +30,7 @@
 #include "mtconnect/device_model/component.hpp"
 #include "mtconnect/device_model/data_item/data_item.hpp"
 #include "mtconnect/entity/entity.hpp"
+#include "mtconnect/observation/fragment_cache.hpp"
 #include "mtconnect/utilities.hpp"
 
 /// @brief Observation namespace
@@ -37,7 +39,7 @@ namespace mtconnect::observation {
   class Observation;
   using ObservationPtr = std::shared_ptr<Observation>;
   using ConstObservationPtr = std::shared_ptr<const Observation>;
-  using ObservationList = std::list<ObservationPtr>;
+  using ObservationList = std::vector<ObservationPtr>;
 
   /// @brief Abstract observation
   class AGENT_LIB_API Observation : public entity::Entity
@@ -177,11 +179,16 @@ namespace mtconnect::observation {
     /// @brief Clear the reset triggered state
     void clearResetTriggered() { m_properties.erase("resetTriggered"); }
 
+    /// @brief get the serialized fragments of this observation
+    /// @return the fragment cache
+    const FragmentCache &getFragments() const { return m_fragments; }
+
   protected:
     Timestamp m_timestamp;
     bool m_unavailable {false};
     std::weak_ptr<device_model::data_item::DataItem> m_dataItem;
     uint64_t m_sequence {0};
+    FragmentCache m_fragments;
   };
 
   /// @brief A MTConnect Sample with a double value
@@ -530,4 +537,56 @@ namespace mtconnect::observation {
 
   using ObservationComparer = bool (*)(ObservationPtr &, ObservationPtr &);
   inline bool ObservationCompare(ObservationPtr &aE1, ObservationPtr &aE2) { return *aE1 < *aE2; }
+
+  /// @brief Sort observations by data item and sequence number
+  ///
+  /// Uses the ordinals the agent assigns to the data items so each observation's data item is
+  /// only resolved once. Falls back to comparing the observations when a data item has not been
+  /// ordered. The sort is stable.
+  ///
+  /// @param[in,out] observations the observations to sort
+  inline void SortObservations(ObservationList &observations)
+  {
+    struct Key
+    {
+      uint32_t m_ordinal;
+      uint64_t m_sequence;
+      size_t m_index;
+      bool operator<(const Key &other) const
+      {
+        if (m_ordinal != other.m_ordinal)
+          return m_ordinal < other.m_ordinal;
+        else if (m_sequence != other.m_sequence)
+          return m_sequence < other.m_sequence;
+        else
+          return m_index < other.m_index;
+      }
+    };
+
+    std::vector<Key> keys;
+    keys.reserve(observations.size());
+    std::shared_lock lock(device_model::data_item::DataItem::getOrdinalMutex());
+    for (size_t i = 0; i < observations.size(); i++)
+    {
+      const auto &observation = observations[i];
+      auto dataItem = observation->getDataItem();
+      if (!dataItem || dataItem->getOrdinal() == 0)
+      {
+        lock.unlock();
+        std::stable_sort(observations.begin(), observations.end(),
+                         [](const ObservationPtr &a, const ObservationPtr &b) { return *a < *b; });
+        return;
+      }
+      keys.push_back({dataItem->getOrdinal(), observation->getSequence(), i});
+    }
+    lock.unlock();
+
+    std::sort(keys.begin(), keys.end());
+
+    ObservationList sorted;
+    sorted.reserve(observations.size());
+    for (const auto &key : keys)
+      sorted.emplace_back(std::move(observations[key.m_index]));
+    observations.swap(sorted);
+  }
 }  // namespace mtconnect::observation
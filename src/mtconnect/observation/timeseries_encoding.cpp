@@ -0,0 +1,459 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "timeseries_encoding.hpp"
+
+#include <boost/beast/core/detail/base64.hpp>
+
+#include <cmath>
+#include <cstring>
+
+#include "mtconnect/device_model/data_item/data_item.hpp"
+
+using namespace std;
+
+namespace mtconnect::observation {
+  namespace base64 = boost::beast::detail::base64;
+
+  static constexpr pair<const char *, TimeseriesEncoding> s_encodings[] {
+      {"text", TimeseriesEncoding::TEXT},
+      {"float32", TimeseriesEncoding::FLOAT32},
+      {"float64", TimeseriesEncoding::FLOAT64},
+      {"delta", TimeseriesEncoding::DELTA},
+      {"gorilla", TimeseriesEncoding::GORILLA}};
+
+  optional<TimeseriesEncoding> ParseTimeseriesEncoding(string_view name)
+  {
+    for (const auto &e : s_encodings)
+    {
+      if (name == e.first)
+        return e.second;
+    }
+    return nullopt;
+  }
+
+  const char *TimeseriesEncodingName(TimeseriesEncoding encoding)
+  {
+    for (const auto &e : s_encodings)
+    {
+      if (encoding == e.second)
+        return e.first;
+    }
+    return "text";
+  }
+
+  /// @brief Packs bits most significant bit first
+  class BitWriter
+  {
+  public:
+    BitWriter(string &bytes) : m_bytes(bytes) {}
+
+    void write(uint64_t value, int bits)
+    {
+      while (bits > 0)
+      {
+        if (m_free == 0)
+        {
+          m_bytes.push_back(0);
+          m_free = 8;
+        }
+        int take = min(bits, m_free);
+        uint8_t chunk = uint8_t((value >> (bits - take)) & ((1u << take) - 1));
+        m_bytes.back() |= char(chunk << (m_free - take));
+        m_free -= take;
+        bits -= take;
+      }
+    }
+
+  protected:
+    string &m_bytes;
+    int m_free {0};
+  };
+
+  /// @brief Reads bits most significant bit first
+  class BitReader
+  {
+  public:
+    BitReader(string_view bytes) : m_bytes(bytes) {}
+
+    bool read(int bits, uint64_t &value)
+    {
+      value = 0;
+      while (bits > 0)
+      {
+        if (m_pos >= m_bytes.size())
+          return false;
+        int available = 8 - m_used;
+        int take = min(bits, available);
+        uint8_t byte = uint8_t(m_bytes[m_pos]);
+        value = (value << take) | ((byte >> (available - take)) & ((1u << take) - 1));
+        m_used += take;
+        bits -= take;
+        if (m_used == 8)
+        {
+          m_pos++;
+          m_used = 0;
+        }
+      }
+      return true;
+    }
+
+  protected:
+    string_view m_bytes;
+    size_t m_pos {0};
+    int m_used {0};
+  };
+
+  static inline void writeVarint(string &bytes, uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      bytes.push_back(char((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    bytes.push_back(char(value));
+  }
+
+  static inline bool readVarint(string_view bytes, size_t &pos, uint64_t &value)
+  {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      if (pos >= bytes.size())
+        return false;
+      uint8_t byte = uint8_t(bytes[pos++]);
+      value |= uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  static inline void writeLittleEndian(string &bytes, uint64_t value, int size)
+  {
+    for (int i = 0; i < size; i++)
+      bytes.push_back(char((value >> (i * 8)) & 0xff));
+  }
+
+  static inline uint64_t readLittleEndian(const char *bytes, int size)
+  {
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--)
+      value = (value << 8) | uint8_t(bytes[i]);
+    return value;
+  }
+
+  static inline uint64_t doubleBits(double d)
+  {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+  }
+
+  static inline double bitsDouble(uint64_t bits)
+  {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+
+  static inline int leadingZeros(uint64_t x)
+  {
+    int n = 0;
+    for (uint64_t mask = 1ull << 63; (x & mask) == 0; mask >>= 1)
+      n++;
+    return n;
+  }
+
+  static inline int trailingZeros(uint64_t x)
+  {
+    int n = 0;
+    for (; (x & 1) == 0; x >>= 1)
+      n++;
+    return n;
+  }
+
+  // XOR each value with the previous value and only store the meaningful bits, see Pelkonen et
+  // al. "Gorilla: A Fast, Scalable, In-Memory Time Series Database"
+  static void gorillaEncode(const entity::Vector &values, string &bytes)
+  {
+    writeVarint(bytes, values.size());
+    if (values.empty())
+      return;
+
+    BitWriter writer(bytes);
+    uint64_t prev = doubleBits(values[0]);
+    writer.write(prev, 64);
+
+    int prevLeading = -1, prevTrailing = 0;
+    for (size_t i = 1; i < values.size(); i++)
+    {
+      uint64_t cur = doubleBits(values[i]);
+      uint64_t x = cur ^ prev;
+      prev = cur;
+
+      if (x == 0)
+      {
+        writer.write(0, 1);
+        continue;
+      }
+
+      int leading = min(leadingZeros(x), 31);
+      int trailing = trailingZeros(x);
+      if (prevLeading >= 0 && leading >= prevLeading && trailing >= prevTrailing)
+      {
+        writer.write(0b10, 2);
+        writer.write(x >> prevTrailing, 64 - prevLeading - prevTrailing);
+      }
+      else
+      {
+        int significant = 64 - leading - trailing;
+        writer.write(0b11, 2);
+        writer.write(leading, 5);
+        writer.write(significant & 63, 6);
+        writer.write(x >> trailing, significant);
+        prevLeading = leading;
+        prevTrailing = trailing;
+      }
+    }
+  }
+
+  static bool gorillaDecode(string_view bytes, entity::Vector &values)
+  {
+    size_t pos = 0;
+    uint64_t count;
+    if (!readVarint(bytes, pos, count))
+      return false;
+    if (count == 0)
+      return true;
+    if (count > bytes.size() * 8)
+      return false;
+
+    values.reserve(count);
+    BitReader reader(bytes.substr(pos));
+    uint64_t prev;
+    if (!reader.read(64, prev))
+      return false;
+    values.push_back(bitsDouble(prev));
+
+    int leading = 0, trailing = 0;
+    for (uint64_t i = 1; i < count; i++)
+    {
+      uint64_t control, x;
+      if (!reader.read(1, control))
+        return false;
+      if (control == 1)
+      {
+        if (!reader.read(1, control))
+          return false;
+        if (control == 1)
+        {
+          uint64_t l, s;
+          if (!reader.read(5, l) || !reader.read(6, s))
+            return false;
+          if (s == 0)
+            s = 64;
+          if (l + s > 64)
+            return false;
+          leading = int(l);
+          trailing = int(64 - l - s);
+        }
+        if (!reader.read(64 - leading - trailing, x))
+          return false;
+        prev ^= x << trailing;
+      }
+      values.push_back(bitsDouble(prev));
+    }
+
+    return true;
+  }
+
+  static inline bool isIntegral(const entity::Vector &values)
+  {
+    for (auto v : values)
+    {
+      if (!(std::abs(v) < 9007199254740992.0) || v != std::trunc(v))
+        return false;
+    }
+    return true;
+  }
+
+  TimeseriesEncoding EncodeTimeseries(const entity::Vector &values, TimeseriesEncoding encoding,
+                                      string &text)
+  {
+    string bytes;
+    switch (encoding)
+    {
+      case TimeseriesEncoding::TEXT:
+      {
+        entity::Value value(values);
+        entity::ConvertValueToType(value, entity::STRING);
+        text = get<string>(value);
+        return encoding;
+      }
+
+      case TimeseriesEncoding::FLOAT32:
+        bytes.reserve(values.size() * 4);
+        for (auto v : values)
+        {
+          float f = float(v);
+          uint32_t bits;
+          memcpy(&bits, &f, sizeof(bits));
+          writeLittleEndian(bytes, bits, 4);
+        }
+        break;
+
+      case TimeseriesEncoding::DELTA:
+        if (isIntegral(values))
+        {
+          writeVarint(bytes, values.size());
+          int64_t prev = 0;
+          for (auto v : values)
+          {
+            int64_t cur = int64_t(v);
+            uint64_t delta = uint64_t(cur) - uint64_t(prev);
+            writeVarint(bytes, (delta << 1) ^ uint64_t(int64_t(delta) >> 63));
+            prev = cur;
+          }
+          break;
+        }
+        encoding = TimeseriesEncoding::FLOAT64;
+        [[fallthrough]];
+
+      case TimeseriesEncoding::FLOAT64:
+        bytes.reserve(values.size() * 8);
+        for (auto v : values)
+          writeLittleEndian(bytes, doubleBits(v), 8);
+        break;
+
+      case TimeseriesEncoding::GORILLA:
+        gorillaEncode(values, bytes);
+        break;
+    }
+
+    text.resize(base64::encoded_size(bytes.size()));
+    text.resize(base64::encode(text.data(), bytes.data(), bytes.size()));
+    return encoding;
+  }
+
+  bool DecodeTimeseries(TimeseriesEncoding encoding, string_view text, entity::Vector &values)
+  {
+    values.clear();
+    if (encoding == TimeseriesEncoding::TEXT)
+    {
+      entity::Value value(string {text});
+      entity::ConvertValueToType(value, entity::VECTOR);
+      values = get<entity::Vector>(value);
+      return true;
+    }
+
+    string bytes(base64::decoded_size(text.size()), '\0');
+    auto [written, read] = base64::decode(bytes.data(), text.data(), text.size());
+    if (text.find_first_not_of('=', read) != string_view::npos)
+      return false;
+    bytes.resize(written);
+
+    switch (encoding)
+    {
+      case TimeseriesEncoding::FLOAT32:
+        if (bytes.size() % 4 != 0)
+          return false;
+        values.reserve(bytes.size() / 4);
+        for (size_t i = 0; i < bytes.size(); i += 4)
+        {
+          auto bits = uint32_t(readLittleEndian(bytes.data() + i, 4));
+          float f;
+          memcpy(&f, &bits, sizeof(f));
+          values.push_back(f);
+        }
+        return true;
+
+      case TimeseriesEncoding::FLOAT64:
+        if (bytes.size() % 8 != 0)
+          return false;
+        values.reserve(bytes.size() / 8);
+        for (size_t i = 0; i < bytes.size(); i += 8)
+          values.push_back(bitsDouble(readLittleEndian(bytes.data() + i, 8)));
+        return true;
+
+      case TimeseriesEncoding::DELTA:
+      {
+        size_t pos = 0;
+        uint64_t count, zigzag;
+        if (!readVarint(bytes, pos, count) || count > bytes.size())
+          return false;
+        values.reserve(count);
+        int64_t prev = 0;
+        for (uint64_t i = 0; i < count; i++)
+        {
+          if (!readVarint(bytes, pos, zigzag))
+            return false;
+          uint64_t delta = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+          prev = int64_t(uint64_t(prev) + delta);
+          values.push_back(double(prev));
+        }
+        return true;
+      }
+
+      case TimeseriesEncoding::GORILLA:
+        return gorillaDecode(bytes, values);
+
+      default:
+        return false;
+    }
+  }
+
+  optional<entity::Vector> DecodeTimeseriesToken(string_view token)
+  {
+    auto colon = token.find(':');
+    if (colon == string_view::npos)
+      return nullopt;
+
+    auto encoding = ParseTimeseriesEncoding(token.substr(0, colon));
+    if (!encoding || *encoding == TimeseriesEncoding::TEXT)
+      return nullopt;
+
+    entity::Vector values;
+    if (!DecodeTimeseries(*encoding, token.substr(colon + 1), values))
+      return nullopt;
+
+    return values;
+  }
+
+  void EncodeTimeseries(ObservationList &observations, TimeseriesEncoding encoding)
+  {
+    if (encoding == TimeseriesEncoding::TEXT)
+      return;
+
+    string text;
+    for (auto &obs : observations)
+    {
+      if (obs->isOrphan() || !obs->getDataItem()->isTimeSeries())
+        continue;
+
+      auto values = get_if<entity::Vector>(&obs->getValue());
+      if (values == nullptr)
+        continue;
+
+      auto used = EncodeTimeseries(*values, encoding, text);
+      auto copy = obs->copy();
+      copy->setValue(text);
+      copy->setProperty("encoding", string(TimeseriesEncodingName(used)));
+      obs = copy;
+    }
+  }
+}  // namespace mtconnect::observation
@@ -0,0 +1,85 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/entity/requirement.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+namespace mtconnect::observation {
+  /// @brief Binary representations of timeseries values
+  ///
+  /// All binary representations are base64 encoded so they can be carried in XML text, JSON
+  /// strings, and SHDR tokens.
+  enum class TimeseriesEncoding
+  {
+    TEXT,     ///< Space separated values in XML and arrays in JSON
+    FLOAT32,  ///< Little-endian 32 bit floats
+    FLOAT64,  ///< Little-endian 64 bit floats
+    DELTA,    ///< Varint count, then zigzag varint deltas of integer values
+    GORILLA   ///< Varint count, then XOR compressed 64 bit floats
+  };
+
+  /// @brief get the encoding for a name
+  /// @param[in] name `text`, `float32`, `float64`, `delta`, or `gorilla`
+  /// @return the encoding or `nullopt` if the name is not known
+  AGENT_LIB_API std::optional<TimeseriesEncoding> ParseTimeseriesEncoding(std::string_view name);
+
+  /// @brief get the name of an encoding
+  /// @param[in] encoding the encoding
+  /// @return the name
+  AGENT_LIB_API const char *TimeseriesEncodingName(TimeseriesEncoding encoding);
+
+  /// @brief encode timeseries values
+  ///
+  /// `DELTA` can only represent integer values, other values are encoded as `FLOAT64`.
+  ///
+  /// @param[in] values the values
+  /// @param[in] encoding the requested binary encoding
+  /// @param[out] text the base64 text
+  /// @return the encoding used
+  AGENT_LIB_API TimeseriesEncoding EncodeTimeseries(const entity::Vector &values,
+                                                    TimeseriesEncoding encoding,
+                                                    std::string &text);
+
+  /// @brief decode timeseries values
+  /// @param[in] encoding the binary encoding
+  /// @param[in] text the base64 text
+  /// @param[out] values the decoded values
+  /// @return `true` if the text was valid
+  AGENT_LIB_API bool DecodeTimeseries(TimeseriesEncoding encoding, std::string_view text,
+                                      entity::Vector &values);
+
+  /// @brief decode a timeseries token of the form `<encoding>:<base64>`
+  /// @param[in] token the token
+  /// @return the values or `nullopt` if the token is not an encoded timeseries
+  AGENT_LIB_API std::optional<entity::Vector> DecodeTimeseriesToken(std::string_view token);
+
+  /// @brief replace the timeseries observations in a list with encoded copies
+  ///
+  /// The copies have their `VALUE` replaced by the base64 text and an `encoding` attribute
+  /// naming the encoding used. The observations in the buffer are not modified.
+  ///
+  /// @param[in,out] observations the observations
+  /// @param[in] encoding the binary encoding, `TEXT` leaves the list unchanged
+  AGENT_LIB_API void EncodeTimeseries(ObservationList &observations, TimeseriesEncoding encoding);
+}  // namespace mtconnect::observation
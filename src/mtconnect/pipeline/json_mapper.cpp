@@ -0,0 +1,486 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "json_mapper.hpp"
+
+#include <rapidjson/error/en.h>
+#include <rapidjson/reader.h>
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "mtconnect/logging.hpp"
+#include "mtconnect/utilities.hpp"
+
+using namespace std;
+
+namespace mtconnect::pipeline {
+  using namespace observation;
+
+  namespace {
+    enum class Event
+    {
+      NONE,
+      NULL_VALUE,
+      BOOL,
+      INT,
+      DOUBLE,
+      STRING,
+      KEY,
+      START_OBJECT,
+      END_OBJECT,
+      START_ARRAY,
+      END_ARRAY
+    };
+
+    /// @brief Keeps the last token read from the payload
+    ///
+    /// Strings are parsed in place, so the text refers to the payload.
+    struct Token : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Token>
+    {
+      bool Null() { return set(Event::NULL_VALUE); }
+      bool Bool(bool b)
+      {
+        m_bool = b;
+        return set(Event::BOOL);
+      }
+      bool Int(int i) { return Int64(i); }
+      bool Uint(unsigned i) { return Int64(i); }
+      bool Int64(int64_t i)
+      {
+        m_int = i;
+        return set(Event::INT);
+      }
+      bool Uint64(uint64_t i)
+      {
+        if (i > uint64_t(numeric_limits<int64_t>::max()))
+          return Double(double(i));
+        return Int64(int64_t(i));
+      }
+      bool Double(double d)
+      {
+        m_double = d;
+        return set(Event::DOUBLE);
+      }
+      bool String(const char *s, rapidjson::SizeType len, bool)
+      {
+        m_text = string_view(s, len);
+        return set(Event::STRING);
+      }
+      bool Key(const char *s, rapidjson::SizeType len, bool)
+      {
+        m_text = string_view(s, len);
+        return set(Event::KEY);
+      }
+      bool StartObject() { return set(Event::START_OBJECT); }
+      bool EndObject(rapidjson::SizeType) { return set(Event::END_OBJECT); }
+      bool StartArray() { return set(Event::START_ARRAY); }
+      bool EndArray(rapidjson::SizeType) { return set(Event::END_ARRAY); }
+
+      bool set(Event event)
+      {
+        m_event = event;
+        return true;
+      }
+
+      Event m_event {Event::NONE};
+      bool m_bool {false};
+      int64_t m_int {0};
+      double m_double {0.0};
+      string_view m_text;
+    };
+
+    class ParseError : public std::runtime_error
+    {
+    public:
+      using std::runtime_error::runtime_error;
+    };
+
+    /// @brief Reads the payload one token at a time and maps the members to observations
+    class Parser
+    {
+    public:
+      Parser(JsonMapper &mapper, std::string &payload, EntityList &results)
+        : m_mapper(mapper),
+          m_stream(payload.data()),
+          m_results(results),
+          m_now(std::chrono::system_clock::now())
+      {
+        m_reader.IterativeParseInit();
+      }
+
+      void parse(const DevicePtr &device, const DataItemPtr &dataItem)
+      {
+        auto event = next();
+        if (dataItem)
+        {
+          observation(dataItem, m_now);
+        }
+        else if (event == Event::START_OBJECT)
+        {
+          object(device, m_now);
+        }
+        else if (event == Event::START_ARRAY)
+        {
+          while (next() != Event::END_ARRAY)
+          {
+            if (m_token.m_event == Event::START_OBJECT)
+              object(device, m_now);
+            else
+              skip();
+          }
+        }
+      }
+
+    protected:
+      Event next()
+      {
+        if (m_reader.IterativeParseComplete() ||
+            !m_reader.IterativeParseNext<rapidjson::kParseInsituFlag>(m_stream, m_token))
+        {
+          std::stringstream msg;
+          msg << rapidjson::GetParseError_En(m_reader.GetParseErrorCode()) << " at offset "
+              << m_reader.GetErrorOffset();
+          throw ParseError(msg.str());
+        }
+
+        return m_token.m_event;
+      }
+
+      /// @brief skip the current value, including all the members of objects and arrays
+      void skip()
+      {
+        auto begins = [](Event e) { return e == Event::START_OBJECT || e == Event::START_ARRAY; };
+        auto ends = [](Event e) { return e == Event::END_OBJECT || e == Event::END_ARRAY; };
+        for (int depth = begins(m_token.m_event) ? 1 : 0; depth > 0;)
+        {
+          auto event = next();
+          if (begins(event))
+            depth++;
+          else if (ends(event))
+            depth--;
+        }
+      }
+
+      /// @brief the current token as a value, `null` is `UNAVAILABLE`
+      entity::Value scalar() const
+      {
+        switch (m_token.m_event)
+        {
+          case Event::BOOL:
+            return m_token.m_bool;
+
+          case Event::INT:
+            return m_token.m_int;
+
+          case Event::DOUBLE:
+            return m_token.m_double;
+
+          case Event::STRING:
+            return std::string(m_token.m_text);
+
+          default:
+            return "UNAVAILABLE"s;
+        }
+      }
+
+      bool isScalar() const
+      {
+        switch (m_token.m_event)
+        {
+          case Event::NULL_VALUE:
+          case Event::BOOL:
+          case Event::INT:
+          case Event::DOUBLE:
+          case Event::STRING:
+            return true;
+
+          default:
+            return false;
+        }
+      }
+
+      Timestamp readTimestamp(const Timestamp &current)
+      {
+        if (next() == Event::STRING)
+          return parseTimestamp(std::string(m_token.m_text));
+
+        skip();
+        return current;
+      }
+
+      /// @brief the numbers of an array
+      entity::Vector vector()
+      {
+        entity::Vector values;
+        while (next() != Event::END_ARRAY)
+        {
+          if (m_token.m_event == Event::INT)
+            values.emplace_back(double(m_token.m_int));
+          else if (m_token.m_event == Event::DOUBLE)
+            values.emplace_back(m_token.m_double);
+          else
+            skip();
+        }
+        return values;
+      }
+
+      /// @brief the entries of a data set, the values of a table are data sets
+      entity::DataSet dataSet(bool table)
+      {
+        entity::DataSet set;
+        while (next() == Event::KEY)
+        {
+          std::string key(m_token.m_text);
+          switch (next())
+          {
+            case Event::NULL_VALUE:
+              set.emplace(key, entity::DataSetValue(), true);
+              break;
+
+            case Event::INT:
+              set.emplace(key, entity::DataSetValue(m_token.m_int));
+              break;
+
+            case Event::DOUBLE:
+              set.emplace(key, entity::DataSetValue(m_token.m_double));
+              break;
+
+            case Event::BOOL:
+              set.emplace(key, entity::DataSetValue(int64_t(m_token.m_bool)));
+              break;
+
+            case Event::STRING:
+              set.emplace(key, entity::DataSetValue(std::string(m_token.m_text)));
+              break;
+
+            case Event::START_OBJECT:
+              if (table)
+              {
+                set.emplace(key, entity::DataSetValue(dataSet(false)));
+                break;
+              }
+              [[fallthrough]];
+
+            default:
+              skip();
+              break;
+          }
+        }
+        return set;
+      }
+
+      /// @brief the members of an observation object
+      void properties(const DataItemPtr &dataItem, entity::Properties &props, Timestamp &ts)
+      {
+        while (next() == Event::KEY)
+        {
+          auto key = m_token.m_text;
+          if (key == "timestamp")
+          {
+            ts = readTimestamp(ts);
+          }
+          else if (key == "value")
+          {
+            next();
+            value(dataItem, props);
+          }
+          else if (next() != Event::NULL_VALUE && isScalar())
+          {
+            props.insert_or_assign(std::string(key), scalar());
+          }
+          else
+          {
+            skip();
+          }
+        }
+      }
+
+      /// @brief the value of a data item, the current token is the start of the value
+      void value(const DataItemPtr &dataItem, entity::Properties &props)
+      {
+        if (m_token.m_event == Event::START_ARRAY)
+        {
+          auto values = vector();
+          if (dataItem->isTimeSeries() && props.count("sampleCount") == 0)
+            props.insert_or_assign("sampleCount", int64_t(values.size()));
+          props.insert_or_assign("VALUE", std::move(values));
+        }
+        else if (m_token.m_event == Event::START_OBJECT && dataItem->isDataSet())
+        {
+          props.insert_or_assign("VALUE", dataSet(dataItem->isTable()));
+        }
+        else if (isScalar())
+        {
+          // A condition is given by its level
+          props.insert_or_assign(dataItem->isCondition() ? "level" : "VALUE", scalar());
+        }
+        else
+        {
+          skip();
+        }
+      }
+
+      /// @brief map the current value to an observation of the data item
+      void observation(const DataItemPtr &dataItem, const Timestamp &ts)
+      {
+        entity::Properties props;
+        auto timestamp = ts;
+        if (m_token.m_event == Event::START_OBJECT && !dataItem->isDataSet())
+          properties(dataItem, props, timestamp);
+        else
+          value(dataItem, props);
+
+        if (dataItem->getConstantValue())
+          return;
+
+        entity::ErrorList errors;
+        try
+        {
+          auto obs = Observation::make(dataItem, props, timestamp, errors);
+          if (errors.empty())
+          {
+            m_mapper.deliver(std::move(obs), m_results);
+            return;
+          }
+        }
+        catch (entity::EntityError &e)
+        {
+          LOG(error) << "Could not create observation: " << e.what();
+        }
+        for (auto &e : errors)
+        {
+          LOG(warning) << "Error while parsing JSON for " << dataItem->getId() << ": "
+                       << e->what();
+        }
+      }
+
+      /// @brief map the members of an object to data items and devices, the current token is
+      /// the start of the object
+      void object(const DevicePtr &device, const Timestamp &ts)
+      {
+        auto timestamp = ts;
+        while (next() == Event::KEY)
+        {
+          auto key = m_token.m_text;
+          if (key == "timestamp")
+          {
+            timestamp = readTimestamp(timestamp);
+          }
+          else if (auto dataItem = device ? m_mapper.findDataItem(device, key) : nullptr)
+          {
+            next();
+            observation(dataItem, timestamp);
+          }
+          else if (auto other = m_mapper.findDevice(key))
+          {
+            if (next() == Event::START_OBJECT)
+              object(other, timestamp);
+            else
+              skip();
+          }
+          else
+          {
+            m_mapper.unresolved(key);
+            next();
+            skip();
+          }
+        }
+      }
+
+    protected:
+      JsonMapper &m_mapper;
+      rapidjson::Reader m_reader;
+      rapidjson::InsituStringStream m_stream;
+      Token m_token;
+      EntityList &m_results;
+      Timestamp m_now;
+    };
+  }  // namespace
+
+  EntityPtr JsonMapper::operator()(entity::EntityPtr &&entity)
+  {
+    NAMED_SCOPE("JsonMapper");
+
+    auto json = std::dynamic_pointer_cast<JsonMessage>(entity);
+    EntityList results;
+    if (auto body = std::get_if<std::string>(&json->getValue()))
+    {
+      // The payload is parsed in place, take it from the message
+      std::string payload(std::move(*body));
+
+      DevicePtr device = json->m_device.lock();
+      if (!device)
+        device = m_contract->findDevice(m_defaultDevice.value_or(""));
+
+      try
+      {
+        Parser parser(*this, payload, results);
+        parser.parse(device, json->m_dataItem);
+      }
+      catch (ParseError &e)
+      {
+        auto topic = json->maybeGet<std::string>("topic");
+        LOG(warning) << "Cannot parse JSON message for topic " << topic.value_or("unknown")
+                     << ": " << e.what();
+      }
+    }
+
+    auto res = std::make_shared<Entity>("Observations", entity::Properties {});
+    res->setValue(results);
+    return res;
+  }
+
+  DataItemPtr JsonMapper::findDataItem(const DevicePtr &device, std::string_view name)
+  {
+    const auto &uuid = *device->getUuid();
+    m_key.assign(uuid).append(1, ':').append(name);
+    if (auto it = m_dataItems.find(m_key); it != m_dataItems.end())
+    {
+      if (auto dataItem = it->second.lock())
+        return dataItem;
+    }
+
+    auto dataItem = m_contract->findDataItem(uuid, std::string(name));
+    if (dataItem)
+      m_dataItems.insert_or_assign(m_key, dataItem);
+
+    return dataItem;
+  }
+
+  DevicePtr JsonMapper::findDevice(std::string_view name)
+  {
+    // The contract returns the default device for an empty name
+    if (name.empty())
+      return nullptr;
+    return m_contract->findDevice(std::string(name));
+  }
+
+  void JsonMapper::unresolved(std::string_view key)
+  {
+    if (m_logOnce.find(key) != m_logOnce.end())
+    {
+      LOG(trace) << "Could not find data item or device: " << key;
+    }
+    else
+    {
+      LOG(info) << "Could not find data item or device: " << key;
+      m_logOnce.emplace(key);
+    }
+  }
+}  // namespace mtconnect::pipeline
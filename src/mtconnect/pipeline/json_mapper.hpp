@@ -0,0 +1,107 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/entity/entity.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "topic_mapper.hpp"
+#include "transform.hpp"
+
+namespace mtconnect::pipeline {
+  /// @brief Map the observations in a JSON message to data items
+  ///
+  /// The payload is read with a streaming parser in place, no document is built and keys and
+  /// string values are referenced in the payload until they are stored in an observation.
+  /// The message is an object or an array of objects with the following members:
+  /// * `timestamp` - the timestamp of the following observations of the object
+  /// * `<data item>` - the value of a data item of the device, the name, id, or source
+  /// * `<device>` - an object with the observations of another device, by name or uuid
+  ///
+  /// If the topic of the message was mapped to a data item, the message is the value of that
+  /// data item. Values are given as follows:
+  /// * a string, number, or boolean - the value, `null` is `UNAVAILABLE`
+  /// * an array of numbers - a three space sample or the samples of a time series
+  /// * an object for a `DATA_SET` or `TABLE` - the entries, `null` removes an entry
+  /// * an object otherwise - the `value`, `timestamp`, and the properties of the
+  ///   observation, such as the `level` and `nativeCode` of a condition
+  ///
+  /// Each observation is sent to the next transforms as it is parsed.
+  class AGENT_LIB_API JsonMapper : public Transform
+  {
+  public:
+    JsonMapper(const JsonMapper &other)
+      : Transform(other), m_contract(other.m_contract), m_defaultDevice(other.m_defaultDevice)
+    {}
+    /// @brief Create a JSON mapper
+    /// @param context the pipeline context
+    /// @param device the default device if the topic did not map to a device
+    JsonMapper(PipelineContextPtr context, const std::optional<std::string> &device = std::nullopt)
+      : Transform("JsonMapper"), m_contract(context->m_contract.get()), m_defaultDevice(device)
+    {
+      m_guard = TypeGuard<JsonMessage>(RUN);
+    }
+
+    /// @brief Parse the message and send the observations on
+    /// @param entity the json message
+    /// @return an `Observations` entity with the list of observations returned by the next
+    /// transforms
+    EntityPtr operator()(entity::EntityPtr &&entity) override;
+
+    /// @brief Find a data item of a device by name, id, or source
+    /// @param device the device
+    /// @param name the name from the message
+    /// @return the data item or `nullptr`
+    DataItemPtr findDataItem(const DevicePtr &device, std::string_view name);
+
+    /// @brief Find a device by name or uuid
+    /// @param name the name from the message
+    /// @return the device or `nullptr`
+    DevicePtr findDevice(std::string_view name);
+
+    /// @brief Send an observation on to the next transforms
+    /// @param observation the observation
+    /// @param results the list of entities returned from the next transforms
+    void deliver(ObservationPtr &&observation, EntityList &results)
+    {
+      if (auto fwd = next(std::move(observation)))
+        results.emplace_back(fwd);
+    }
+
+    /// @brief log a key that is not a data item or device once
+    /// @param key the key
+    void unresolved(std::string_view key);
+
+  protected:
+    PipelineContract *m_contract;
+    std::optional<std::string> m_defaultDevice;
+
+    // Data items by device uuid and key, the key is reused to avoid allocating a string for
+    // each lookup
+    std::unordered_map<std::string, WeakDataItemPtr> m_dataItems;
+    std::string m_key;
+    std::set<std::string, std::less<>> m_logOnce;
+  };
+}  // namespace mtconnect::pipeline
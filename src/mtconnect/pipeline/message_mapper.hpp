@@ -22,8 +22,7 @@
 #include <regex>
 #include <unordered_map>
 
-#include <nlohmann/json.hpp>
-
+#include "json_mapper.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/device_model/device.hpp"
 #include "mtconnect/entity/entity.hpp"
@@ -34,27 +33,6 @@
 #include "transform.hpp"
 
 namespace mtconnect::pipeline {
-  /// @brief JsonMapper does nothing, it is a placeholder for a json interpreter
-  class AGENT_LIB_API JsonMapper : public Transform
-  {
-  public:
-    JsonMapper(const JsonMapper &) = default;
-    JsonMapper(PipelineContextPtr context) : Transform("JsonMapper"), m_context(context)
-    {
-      m_guard = TypeGuard<JsonMessage>(RUN);
-    }
-
-    EntityPtr operator()(entity::EntityPtr &&entity) override
-    {
-      auto json = std::dynamic_pointer_cast<JsonMessage>(entity);
-
-      return nullptr;
-    }
-
-  protected:
-    PipelineContextPtr m_context;
-  };
-
   /// @brief Attempt to find a data item associated with a topic from a pub/sub message
   ///        system
   class AGENT_LIB_API DataMapper : public Transform
@@ -72,7 +50,8 @@ namespace mtconnect::pipeline {
       auto data = std::dynamic_pointer_cast<DataMessage>(entity);
       if (data->m_dataItem)
       {
-        entity::Properties props {{"VALUE", data->getValue()}};
+        entity::Properties props;
+        props.emplace("VALUE", std::move(data->getValue()));
         entity::ErrorList errors;
         try
         {
@@ -97,9 +76,10 @@ namespace mtconnect::pipeline {
         if (std::holds_alternative<std::string>(data->getValue()))
         {
           // Try processing as shdr data
-          auto entity = make_shared<Entity>(
-              "Data", Properties {{"VALUE", data->getValue()}, {"source", string("")}});
-          next(std::move(entity));
+          entity::Properties props;
+          props.emplace("VALUE", std::move(data->getValue()));
+          props.emplace("source", string(""));
+          next(make_shared<Entity>("Data", std::move(props)));
         }
         else
         {
@@ -23,6 +23,7 @@
 #include "mtconnect/entity/xml_parser.hpp"
 #include "mtconnect/logging.hpp"
 #include "mtconnect/observation/observation.hpp"
+#include "mtconnect/observation/timeseries_encoding.hpp"
 #include "upcase_value.hpp"
 
 using namespace std;
@@ -160,6 +161,16 @@ namespace mtconnect {
           continue;
         }
 
+        // Timeseries values may be sent as <encoding>:<base64>
+        if (req->getType() == entity::VECTOR && dataItem->isTimeSeries())
+        {
+          if (auto values = DecodeTimeseriesToken(tok))
+          {
+            props.insert_or_assign(req->getName(), std::move(*values));
+            continue;
+          }
+        }
+
         entity::Value value {extractResetTrigger(dataItem, tok, props)};
 
         try
@@ -19,8 +19,11 @@
 #include <boost/algorithm/string.hpp>
 
 #include <chrono>
+#include <list>
 #include <regex>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "mtconnect/config.hpp"
 #include "mtconnect/device_model/device.hpp"
@@ -58,12 +61,33 @@ namespace mtconnect::pipeline {
   };
 
   /// @brief A transform to map the topic to a data item
+  ///
+  /// Topics are resolved with a table of the device and data item names built from the device
+  /// model, and the results are kept in a bounded cache of the most recently used topics. A
+  /// cached topic is resolved without copying the topic or payload. Topics that cannot be
+  /// resolved are not cached so they are found once their device or data item is added.
+  ///
+  /// Messages with a `subscription` property, the MQTT 5 subscription identifier of a topic
+  /// without wildcards, are resolved by indexing a table of the subscriptions.
   class AGENT_LIB_API TopicMapper : public Transform
   {
   public:
-    TopicMapper(const TopicMapper &) = default;
-    TopicMapper(PipelineContextPtr context, const std::optional<std::string> &device = std::nullopt)
-      : Transform("TopicMapper"), m_context(context), m_defaultDevice(device)
+    TopicMapper(const TopicMapper &other)
+      : Transform(other),
+        m_context(other.m_context),
+        m_defaultDevice(other.m_defaultDevice),
+        m_cacheSize(other.m_cacheSize)
+    {}
+    /// @brief Create a topic mapper
+    /// @param context the pipeline context
+    /// @param device the default device
+    /// @param cacheSize the maximum number of topics to remember
+    TopicMapper(PipelineContextPtr context, const std::optional<std::string> &device = std::nullopt,
+                size_t cacheSize = 4096)
+      : Transform("TopicMapper"),
+        m_context(context),
+        m_defaultDevice(device),
+        m_cacheSize(std::max<size_t>(cacheSize, 1))
     {
       m_guard = EntityNameGuard("Message", RUN);
     }
@@ -75,111 +99,342 @@ namespace mtconnect::pipeline {
     /// 2. Try the default device and the data item name or id
     /// 3. Scan the path for any matching device and data item
     ///
-    /// If found, remember the mapping of the topic to the data item
+    /// If found, remember the mapping of the topic to the device and data item
     /// @param topic the topic
     /// @return
-    auto resolve(const std::string &topic)
+    auto resolve(std::string_view topic)
     {
-      using namespace std;
-      namespace algo = boost::algorithm;
-      using namespace boost;
-
       DataItemPtr dataItem;
       DevicePtr device;
 
-      string name, deviceName;
+      if (!m_built)
+        buildTable();
+
+      const std::string_view defaultDevice(m_defaultDevice ? *m_defaultDevice : "");
 
-      std::vector<string> path;
-      boost::split(path, topic, algo::is_any_of("/"));
-      if (path.size() > 1)
+      m_path.clear();
+      for (size_t start = 0;;)
       {
-        deviceName = path[0];
-        name = path[1];
-        dataItem = m_context->m_contract->findDataItem(deviceName, name);
+        auto pos = topic.find('/', start);
+        m_path.emplace_back(topic.substr(start, pos - start));
+        if (pos == std::string_view::npos)
+          break;
+        start = pos + 1;
       }
 
+      if (m_path.size() > 1)
+        dataItem = findDataItem(m_path[0], m_path[1]);
+
       if (!dataItem)
-      {
-        deviceName = m_defaultDevice.value_or("");
-        name = topic;
-        dataItem = m_context->m_contract->findDataItem(deviceName, name);
-      }
+        dataItem = findDataItem(defaultDevice, topic);
 
-      if (!dataItem && path.size() > 1)
-      {
-        name = path.back();
-        dataItem = m_context->m_contract->findDataItem(deviceName, name);
-      }
+      if (!dataItem && m_path.size() > 1)
+        dataItem = findDataItem(defaultDevice, m_path.back());
 
       if (!dataItem)
       {
-        for (auto &tok : path)
+        for (auto &tok : m_path)
         {
-          device = m_context->m_contract->findDevice(tok);
+          device = findDevice(tok);
           if (device)
             break;
         }
 
         if (device)
         {
-          for (auto &tok : path)
+          for (auto &tok : m_path)
           {
-            dataItem = device->getDeviceDataItem(tok);
+            dataItem = findDataItem(device, tok);
             if (dataItem)
               break;
           }
         }
       }
 
-      // Note even if null so we don't have to try again
-      m_resolved[topic] = dataItem;
-      m_devices[topic] = device;
+      if (device || dataItem)
+        remember(topic, device, dataItem);
 
       return std::make_tuple(device, dataItem);
     }
 
     EntityPtr operator()(entity::EntityPtr &&entity) override
     {
-      auto &body = entity->getValue<std::string>();
       DataItemPtr dataItem;
       DevicePtr device;
-      entity::Properties props {entity->getProperties()};
-      if (auto topic = entity->maybeGet<std::string>("topic"))
+      if (auto topic = std::get_if<std::string>(&entity->getProperty("topic")))
       {
-        if (auto it = m_devices.find(*topic); it != m_devices.end())
+        auto subscription = std::get_if<int64_t>(&entity->getProperty("subscription"));
+        if (!subscription || !lookupSubscription(*subscription, device, dataItem))
         {
-          device = it->second.lock();
+          if (!lookup(*topic, device, dataItem))
+            std::tie(device, dataItem) = resolve(*topic);
+          if (subscription)
+            rememberSubscription(*subscription, device, dataItem);
         }
-        if (auto it = m_resolved.find(*topic); it != m_resolved.end())
+      }
+
+      // Check for JSON Message, an object or an array
+      auto &value = entity->getValue();
+      std::string_view body;
+      if (auto text = std::get_if<std::string>(&value))
+        body = *text;
+      auto first = body.find_first_not_of(" \t\r\n");
+      bool json = first != std::string_view::npos && (body[first] == '{' || body[first] == '[');
+
+      // The payload is moved into the message
+      entity::Properties props;
+      for (auto &prop : entity->getProperties())
+      {
+        if (prop.first != "VALUE")
+          props.emplace(prop);
+      }
+      props.emplace("VALUE", std::move(value));
+
+      PipelineMessagePtr result;
+      if (json)
+        result = std::make_shared<JsonMessage>("JsonMessage", std::move(props));
+      else
+        result = std::make_shared<DataMessage>("DataMessage", std::move(props));
+      result->m_dataItem = dataItem;
+      result->m_device = device;
+
+      return next(result);
+    }
+
+    /// @brief get the number of topics remembered
+    size_t getCachedTopicCount() const { return m_cache.size(); }
+
+  protected:
+    /// @brief a resolved topic, with a device, a data item, or both
+    struct Resolved
+    {
+      std::string m_topic;
+      std::weak_ptr<device_model::Device> m_device;
+      std::weak_ptr<device_model::data_item::DataItem> m_dataItem;
+    };
+    using ResolvedList = std::list<Resolved>;
+
+    /// @brief the names of the data items of a device, in the order `Device` searches them
+    struct DeviceNames
+    {
+      std::weak_ptr<device_model::Device> m_device;
+      std::unordered_map<std::string, std::weak_ptr<device_model::data_item::DataItem>> m_names;
+    };
+
+    /// @brief find a topic in the cache and make it the most recently used
+    /// @return `false` if the topic is not cached or the device model has changed
+    bool lookup(std::string_view topic, DevicePtr &device, DataItemPtr &dataItem)
+    {
+      auto it = m_resolved.find(topic);
+      if (it == m_resolved.end())
+        return false;
+
+      auto &resolved = *it->second;
+      device = resolved.m_device.lock();
+      dataItem = resolved.m_dataItem.lock();
+      if (!device && !dataItem)
+      {
+        // The device model has been replaced
+        clear();
+        return false;
+      }
+
+      m_cache.splice(m_cache.begin(), m_cache, it->second);
+      return true;
+    }
+
+    /// @brief add a topic to the cache, removing the least recently used topic when full
+    void remember(std::string_view topic, const DevicePtr &device, const DataItemPtr &dataItem)
+    {
+      if (auto it = m_resolved.find(topic); it != m_resolved.end())
+      {
+        m_cache.erase(it->second);
+        m_resolved.erase(it);
+      }
+      else if (m_cache.size() >= m_cacheSize)
+      {
+        m_resolved.erase(m_cache.back().m_topic);
+        m_cache.pop_back();
+      }
+
+      m_cache.push_front(Resolved {std::string(topic), device, dataItem});
+      m_resolved.emplace(m_cache.front().m_topic, m_cache.begin());
+    }
+
+    /// @brief find the resolution of a subscription identifier
+    /// @return `false` if the subscription has not been resolved or the device model has changed
+    bool lookupSubscription(int64_t subscription, DevicePtr &device, DataItemPtr &dataItem)
+    {
+      if (subscription <= 0 || size_t(subscription) >= m_subscriptions.size() ||
+          !m_subscriptions[subscription])
+        return false;
+
+      auto &resolved = *m_subscriptions[subscription];
+      device = resolved.m_device.lock();
+      dataItem = resolved.m_dataItem.lock();
+      if (!device && !dataItem)
+      {
+        clear();
+        return false;
+      }
+
+      return true;
+    }
+
+    /// @brief remember the resolution of a subscription identifier, identifiers larger than
+    /// the cache size and unresolved topics are not remembered
+    void rememberSubscription(int64_t subscription, const DevicePtr &device,
+                              const DataItemPtr &dataItem)
+    {
+      if (subscription <= 0 || size_t(subscription) > m_cacheSize || (!device && !dataItem))
+        return;
+
+      if (size_t(subscription) >= m_subscriptions.size())
+        m_subscriptions.resize(subscription + 1);
+      m_subscriptions[subscription] = Resolved {{}, device, dataItem};
+    }
+
+    /// @brief forget the cached topics and the device model names
+    void clear()
+    {
+      m_resolved.clear();
+      m_cache.clear();
+      m_subscriptions.clear();
+      m_table.clear();
+      m_devices.clear();
+      m_built = false;
+    }
+
+    /// @brief index the devices by uuid and name, and their data items by id, original id,
+    /// name, and source. Devices added later are found through the pipeline contract.
+    void buildTable()
+    {
+      using namespace device_model::data_item;
+
+      m_built = true;
+      std::unordered_map<device_model::Device *, std::vector<DataItemPtr>> dataItems;
+      std::unordered_map<device_model::Device *, DevicePtr> devices;
+      m_context->m_contract->eachDataItem([&](const DataItemPtr di) {
+        if (auto component = di->getComponent())
+        {
+          if (auto device = component->getDevice())
+          {
+            devices.emplace(device.get(), device);
+            dataItems[device.get()].emplace_back(di);
+          }
+        }
+      });
+
+      auto add = [](DeviceNames &names, const DataItemPtr &di, const std::string &key) {
+        names.m_names.emplace(key, di);
+      };
+      for (auto &[ptr, device] : devices)
+      {
+        auto &names = m_table.emplace_back();
+        names.m_device = device;
+        auto &items = dataItems[ptr];
+        for (auto &di : items)
+          add(names, di, di->getId());
+        for (auto &di : items)
         {
-          dataItem = it->second.lock();
+          if (auto id = di->maybeGet<std::string>("originalId"))
+            add(names, di, *id);
         }
-        if (!dataItem && !device)
+        for (auto &di : items)
         {
-          std::tie(device, dataItem) = resolve(*topic);
+          if (di->getName())
+            add(names, di, *di->getName());
+        }
+        for (auto &di : items)
+        {
+          if (auto source = di->maybeGet<EntityPtr>("Source"))
+          {
+            if (auto value = (*source)->maybeGetValue<std::string>())
+              add(names, di, *value);
+          }
         }
       }
 
-      PipelineMessagePtr result;
-      // Check for JSON Message
-      if (body[0] == '{')
+      // Uuids are found before names
+      for (auto &names : m_table)
+        m_devices.emplace(*names.m_device.lock()->getUuid(), &names);
+      for (auto &names : m_table)
       {
-        result = std::make_shared<JsonMessage>("JsonMessage", props);
+        if (auto &name = names.m_device.lock()->getComponentName())
+          m_devices.emplace(*name, &names);
       }
-      else
+      if (auto device = m_context->m_contract->findDevice(m_defaultDevice.value_or("")))
       {
-        result = std::make_shared<DataMessage>("DataMessage", props);
+        for (auto &names : m_table)
+        {
+          if (names.m_device.lock() == device)
+            m_devices.emplace("", &names);
+        }
       }
-      result->m_dataItem = dataItem;
-      result->m_device = device;
+    }
 
-      return next(result);
+    /// @brief find a device in the table, or ask the pipeline contract for devices that have
+    /// been added since the table was built
+    DevicePtr findDevice(std::string_view name)
+    {
+      m_key.assign(name);
+      if (auto it = m_devices.find(m_key); it != m_devices.end())
+      {
+        if (auto device = it->second->m_device.lock())
+          return device;
+      }
+      return m_context->m_contract->findDevice(m_key);
+    }
+
+    DataItemPtr findDataItem(const DevicePtr &device, std::string_view name)
+    {
+      m_key.assign(name);
+      for (auto &names : m_table)
+      {
+        if (names.m_device.lock() == device)
+        {
+          if (auto it = names.m_names.find(m_key); it != names.m_names.end())
+            return it->second.lock();
+          break;
+        }
+      }
+      return device->getDeviceDataItem(m_key);
+    }
+
+    DataItemPtr findDataItem(std::string_view deviceName, std::string_view name)
+    {
+      m_key.assign(deviceName);
+      if (auto device = m_devices.find(m_key); device != m_devices.end())
+      {
+        m_key.assign(name);
+        auto &names = device->second->m_names;
+        if (auto it = names.find(m_key); it != names.end())
+        {
+          if (auto dataItem = it->second.lock())
+            return dataItem;
+        }
+      }
+      return m_context->m_contract->findDataItem(std::string(deviceName), std::string(name));
     }
 
   protected:
     PipelineContextPtr m_context;
     std::optional<std::string> m_defaultDevice;
-    std::unordered_map<std::string, std::weak_ptr<device_model::data_item::DataItem>> m_resolved;
-    std::unordered_map<std::string, std::weak_ptr<device_model::Device>> m_devices;
+    size_t m_cacheSize;
+
+    // Most recently used topics first, indexed by views of the topics in the list
+    ResolvedList m_cache;
+    std::unordered_map<std::string_view, ResolvedList::iterator> m_resolved;
+
+    // Resolutions indexed by subscription identifier
+    std::vector<std::optional<Resolved>> m_subscriptions;
+
+    // Names of the devices and data items, built from the device model on first use
+    std::list<DeviceNames> m_table;
+    std::unordered_map<std::string, DeviceNames *> m_devices;
+    bool m_built {false};
+
+    std::vector<std::string_view> m_path;
+    std::string m_key;
   };
 }  // namespace mtconnect::pipeline
@@ -0,0 +1,118 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace mtconnect::printer {
+  BufferPool &BufferPool::global()
+  {
+    static BufferPool pool(32, 256, 4 * 1024 * 1024, 8 * 1024 * 1024);
+    return pool;
+  }
+
+  string BufferPool::State::take(size_t reserve)
+  {
+    {
+      lock_guard<mutex> lock(m_mutex);
+
+      // Prefer the smallest buffer that does not need to grow
+      auto best = m_buffers.end();
+      for (auto it = m_buffers.begin(); it != m_buffers.end(); it++)
+      {
+        if (it->capacity() >= reserve &&
+            (best == m_buffers.end() || it->capacity() < best->capacity()))
+          best = it;
+      }
+      if (best == m_buffers.end() && !m_buffers.empty())
+      {
+        best = max_element(m_buffers.begin(), m_buffers.end(),
+                           [](const string &a, const string &b) {
+                             return a.capacity() < b.capacity();
+                           });
+      }
+
+      if (best != m_buffers.end())
+      {
+        string buffer(std::move(*best));
+        *best = std::move(m_buffers.back());
+        m_buffers.pop_back();
+        m_capacity -= buffer.capacity();
+
+        if (buffer.capacity() < reserve)
+        {
+          m_allocated++;
+          buffer.reserve(reserve);
+        }
+        else
+        {
+          m_reused++;
+        }
+        return buffer;
+      }
+    }
+
+    m_allocated++;
+    string buffer;
+    buffer.reserve(reserve);
+    return buffer;
+  }
+
+  void BufferPool::State::give(string &&buffer)
+  {
+    auto capacity = buffer.capacity();
+    if (capacity >= m_minCapacity && capacity <= m_maxCapacity)
+    {
+      lock_guard<mutex> lock(m_mutex);
+      if (m_buffers.size() < m_maxBuffers &&
+          m_capacity + capacity <= m_budget.load(memory_order_relaxed))
+      {
+        buffer.clear();
+        m_capacity += capacity;
+        m_buffers.emplace_back(std::move(buffer));
+        m_returned++;
+        return;
+      }
+    }
+
+    m_discarded++;
+    string().swap(buffer);
+  }
+
+  void BufferPool::State::setBudget(size_t budget)
+  {
+    vector<string> freed;
+    {
+      lock_guard<mutex> lock(m_mutex);
+      m_budget.store(budget, memory_order_relaxed);
+
+      // Free the largest buffers first until the pool fits
+      sort(m_buffers.begin(), m_buffers.end(), [](const string &a, const string &b) {
+        return a.capacity() < b.capacity();
+      });
+      while (!m_buffers.empty() && m_capacity > budget)
+      {
+        m_capacity -= m_buffers.back().capacity();
+        freed.emplace_back(std::move(m_buffers.back()));
+        m_buffers.pop_back();
+      }
+    }
+  }
+}  // namespace mtconnect::printer
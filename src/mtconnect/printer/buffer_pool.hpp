@@ -0,0 +1,150 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mtconnect/config.hpp"
+
+namespace mtconnect::printer {
+  /// @brief A shared output buffer that returns to its pool when the last reference is released
+  using BufferPtr = std::shared_ptr<std::string>;
+
+  /// @brief A pool of output buffers so documents are printed into memory that has already been
+  /// allocated.
+  ///
+  /// Buffers are either taken from the pool as a `std::string` and given back when the owner is
+  /// done with them, or acquired as a reference counted `BufferPtr` that is given back when the
+  /// last reference is released. Only buffers with a capacity between the minimum and maximum are
+  /// kept, and the pool holds at most `maxBuffers` of them with a total capacity of at most the
+  /// budget.
+  class AGENT_LIB_API BufferPool
+  {
+  public:
+    /// @brief Counters to measure how often the pool avoids an allocation
+    struct Statistics
+    {
+      uint64_t m_allocated;  ///< Buffers that needed a new allocation
+      uint64_t m_reused;     ///< Buffers that were taken from the pool
+      uint64_t m_returned;   ///< Buffers given back and kept in the pool
+      uint64_t m_discarded;  ///< Buffers given back that were too small or large to keep
+    };
+
+    /// @brief Create a pool
+    /// @param maxBuffers the maximum number of buffers kept in the pool
+    /// @param minCapacity the smallest buffer worth keeping
+    /// @param maxCapacity the largest buffer kept, larger buffers are freed
+    /// @param budget the maximum total capacity of the buffers kept, 0 for `maxBuffers` of the
+    /// largest buffers
+    BufferPool(size_t maxBuffers = 32, size_t minCapacity = 256,
+               size_t maxCapacity = 4 * 1024 * 1024, size_t budget = 0)
+      : m_state(std::make_shared<State>(maxBuffers, minCapacity, maxCapacity,
+                                        budget == 0 ? maxBuffers * maxCapacity : budget))
+    {}
+
+    /// @brief the pool shared by the printers and sinks
+    ///
+    /// The agent sets its budget from the `OutputBufferPoolSize` option.
+    ///
+    /// @return the global pool
+    static BufferPool &global();
+
+    /// @brief set the maximum total capacity of the buffers kept, buffers over the budget are
+    /// freed
+    /// @param budget the number of bytes
+    void setBudget(size_t budget) { m_state->setBudget(budget); }
+    /// @brief get the maximum total capacity of the buffers kept
+    /// @return the number of bytes
+    size_t getBudget() const { return m_state->m_budget.load(std::memory_order_relaxed); }
+
+    /// @brief take an empty buffer from the pool
+    /// @param reserve the capacity needed
+    /// @return an empty buffer with at least `reserve` capacity
+    std::string take(size_t reserve = 0) { return m_state->take(reserve); }
+    /// @brief give a buffer back to the pool
+    /// @param buffer the buffer, it is moved into the pool
+    void give(std::string &&buffer) { m_state->give(std::move(buffer)); }
+
+    /// @brief acquire a reference counted buffer from the pool
+    ///
+    /// The buffer is given back to the pool when the last reference is released, even if the
+    /// pool has been destroyed in the mean time.
+    ///
+    /// @param reserve the capacity needed
+    /// @return a shared buffer
+    BufferPtr acquire(size_t reserve = 0)
+    {
+      std::weak_ptr<State> state(m_state);
+      return BufferPtr(new std::string(m_state->take(reserve)), [state](std::string *buffer) {
+        if (auto pool = state.lock())
+          pool->give(std::move(*buffer));
+        delete buffer;
+      });
+    }
+
+    /// @brief get the counters for the pool
+    /// @return the statistics
+    Statistics getStatistics() const
+    {
+      return {m_state->m_allocated.load(), m_state->m_reused.load(), m_state->m_returned.load(),
+              m_state->m_discarded.load()};
+    }
+    /// @brief get the number of buffers waiting in the pool
+    /// @return the number of buffers
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(m_state->m_mutex);
+      return m_state->m_buffers.size();
+    }
+
+  protected:
+    struct State
+    {
+      State(size_t maxBuffers, size_t minCapacity, size_t maxCapacity, size_t budget)
+        : m_maxBuffers(maxBuffers),
+          m_minCapacity(minCapacity),
+          m_maxCapacity(maxCapacity),
+          m_budget(budget)
+      {}
+
+      std::string take(size_t reserve);
+      void give(std::string &&buffer);
+      void setBudget(size_t budget);
+
+      const size_t m_maxBuffers;
+      const size_t m_minCapacity;
+      const size_t m_maxCapacity;
+      std::atomic<size_t> m_budget;
+
+      std::mutex m_mutex;
+      std::vector<std::string> m_buffers;
+      size_t m_capacity {0};  ///< The total capacity of the buffers in the pool
+
+      std::atomic<uint64_t> m_allocated {0};
+      std::atomic<uint64_t> m_reused {0};
+      std::atomic<uint64_t> m_returned {0};
+      std::atomic<uint64_t> m_discarded {0};
+    };
+
+    std::shared_ptr<State> m_state;
+  };
+}  // namespace mtconnect::printer
@@ -0,0 +1,129 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "cbor_printer.hpp"
+
+#include <unordered_map>
+
+#include "mtconnect/printer/buffer_pool.hpp"
+
+using namespace std;
+
+namespace mtconnect::printer {
+  using namespace observation;
+
+  const vector<string_view> &CborWriter::keys()
+  {
+    // Only append to this table, the index is the encoding used by existing consumers
+    static const vector<string_view> keys {
+        // Documents and headers
+        "MTConnectStreams", "MTConnectDevices", "MTConnectAssets", "MTConnectError", "Header",
+        "jsonVersion", "schemaVersion", "version", "creationTime", "testIndicator", "instanceId",
+        "sender", "deviceModelChangeTime", "bufferSize", "assetBufferSize", "assetCount",
+        "nextSequence", "firstSequence", "lastSequence", "Errors", "Error", "errorCode",
+        // Streams
+        "Streams", "DeviceStream", "ComponentStream", "Samples", "Events", "Condition", "name",
+        "uuid", "component", "componentId",
+        // Observations
+        "dataItemId", "timestamp", "sequence", "value", "type", "subType", "compositionId",
+        "nativeCode", "nativeSeverity", "qualifier", "statistic", "duration", "resetTriggered",
+        "sampleRate", "count", "Normal", "Warning", "Fault", "Unavailable",
+        // Devices and assets
+        "Devices", "Device", "Components", "DataItems", "DataItem", "Compositions", "Composition",
+        "Description", "Configuration", "References", "Constraints", "Filters", "Source",
+        "Definition", "Relationships", "InitialValue", "ResetTrigger", "id", "category", "units",
+        "nativeUnits", "nativeScale", "nativeName", "representation", "significantDigits",
+        "discrete", "coordinateSystem", "coordinateSystemIdRef", "sampleInterval", "Assets",
+        "assetId", "assetType", "deviceUuid", "hash", "removed", "list"};
+
+    return keys;
+  }
+
+  optional<uint64_t> CborWriter::keyIndex(const string_view &key)
+  {
+    static const auto index = [] {
+      unordered_map<string_view, uint64_t> index;
+      const auto &table = keys();
+      for (uint64_t i = 0; i < table.size(); i++)
+        index.emplace(table[i], i);
+      return index;
+    }();
+
+    if (auto it = index.find(key); it != index.end())
+      return it->second;
+    else
+      return nullopt;
+  }
+
+  std::string CborPrinter::printErrors(const uint64_t instanceId, const unsigned int bufferSize,
+                                       const uint64_t nextSeq, const ProtoErrorList &list,
+                                       bool pretty) const
+  {
+    defaultSchemaVersion();
+
+    string ret = BufferPool::global().take();
+    CborWriter writer(ret);
+    renderErrors(writer, instanceId, bufferSize, list);
+
+    return ret;
+  }
+
+  std::string CborPrinter::printProbe(const uint64_t instanceId, const unsigned int bufferSize,
+                                      const uint64_t nextSeq, const unsigned int assetBufferSize,
+                                      const unsigned int assetCount,
+                                      const std::list<DevicePtr> &devices,
+                                      const std::map<std::string, size_t> *count,
+                                      bool includeHidden, bool pretty) const
+  {
+    defaultSchemaVersion();
+
+    string ret = BufferPool::global().take();
+    CborWriter writer(ret);
+    renderProbe(writer, instanceId, bufferSize, assetBufferSize, assetCount, devices,
+                includeHidden);
+
+    return ret;
+  }
+
+  std::string CborPrinter::printSample(const uint64_t instanceId, const unsigned int bufferSize,
+                                       const uint64_t nextSeq, const uint64_t firstSeq,
+                                       const uint64_t lastSeq, ObservationList &observations,
+                                       bool pretty) const
+  {
+    defaultSchemaVersion();
+
+    string ret = BufferPool::global().take(m_sampleSize.load(std::memory_order_relaxed));
+    CborWriter writer(ret);
+    renderSample(writer, instanceId, bufferSize, nextSeq, firstSeq, lastSeq, observations);
+
+    m_sampleSize.store(ret.size(), std::memory_order_relaxed);
+    return ret;
+  }
+
+  std::string CborPrinter::printAssets(const uint64_t instanceId, const unsigned int bufferSize,
+                                       const unsigned int assetCount, const asset::AssetList &asset,
+                                       bool pretty) const
+  {
+    defaultSchemaVersion();
+
+    string ret = BufferPool::global().take();
+    CborWriter writer(ret);
+    renderAssets(writer, instanceId, bufferSize, assetCount, asset);
+
+    return ret;
+  }
+}  // namespace mtconnect::printer
@@ -0,0 +1,95 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/entity/json_printer.hpp"
+#include "mtconnect/printer/cbor_writer.hpp"
+#include "mtconnect/printer/json_printer.hpp"
+
+namespace mtconnect::printer {
+  /// @brief Printer to generate binary CBOR documents
+  ///
+  /// The documents have the same structure as the JSON version 2 documents. Keys in the
+  /// `CborWriter` key table are encoded as integers and numbers are encoded natively. The
+  /// documents are never pretty printed.
+  class AGENT_LIB_API CborPrinter : public JsonPrinter
+  {
+  public:
+    CborPrinter() : JsonPrinter(2, false) {}
+    ~CborPrinter() override = default;
+
+    std::string printErrors(const uint64_t instanceId, const unsigned int bufferSize,
+                            const uint64_t nextSeq, const ProtoErrorList &list,
+                            bool pretty = false) const override;
+
+    std::string printProbe(const uint64_t instanceId, const unsigned int bufferSize,
+                           const uint64_t nextSeq, const unsigned int assetBufferSize,
+                           const unsigned int assetCount, const std::list<DevicePtr> &devices,
+                           const std::map<std::string, size_t> *count = nullptr,
+                           bool includeHidden = false, bool pretty = false) const override;
+
+    std::string printSample(const uint64_t instanceId, const unsigned int bufferSize,
+                            const uint64_t nextSeq, const uint64_t firstSeq, const uint64_t lastSeq,
+                            observation::ObservationList &results,
+                            bool pretty = false) const override;
+    std::string printAssets(const uint64_t anInstanceId, const unsigned int bufferSize,
+                            const unsigned int assetCount, const asset::AssetList &asset,
+                            bool pretty = false) const override;
+    std::string mimeType() const override { return "application/mtconnect+cbor"; }
+    bool isBinary() const override { return true; }
+    bool cachesObservations(bool pretty = false) const override { return true; }
+    void cacheObservation(const observation::ObservationPtr &observation,
+                          bool pretty = false) const override
+    {
+      cacheFragment(observation, true);
+    }
+  };
+
+  /// @brief Serialization wrapper to encode a single entity as CBOR
+  class AGENT_LIB_API CborEntityPrinter : public entity::JsonEntityPrinter
+  {
+  public:
+    /// @brief Create a printer using the JSON version 2 structure
+    CborEntityPrinter(bool includeHidden = false) : JsonEntityPrinter(2, false, includeHidden) {}
+
+    using JsonEntityPrinter::print;
+    using JsonEntityPrinter::printEntity;
+
+    void printEntity(const entity::EntityPtr entity, std::string &buffer) override
+    {
+      CborWriter writer(buffer);
+      entity::JsonPrinter printer(writer, m_version, m_includeHidden);
+      printer.printEntity(entity);
+    }
+
+    void print(const entity::EntityPtr entity, std::string &buffer) override
+    {
+      CborWriter writer(buffer);
+      entity::JsonPrinter printer(writer, m_version, m_includeHidden);
+      printer.print(entity);
+    }
+
+    void printEntityList(const entity::EntityList &list, std::string &buffer) override
+    {
+      CborWriter writer(buffer);
+      entity::JsonPrinter printer(writer, m_version, m_includeHidden);
+      printer.printEntityList(list);
+    }
+  };
+}  // namespace mtconnect::printer
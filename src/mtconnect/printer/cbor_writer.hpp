@@ -0,0 +1,180 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <rapidjson/rapidjson.h>
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mtconnect/config.hpp"
+
+namespace mtconnect::printer {
+  /// @brief A writer with the same interface as the rapidjson writers that encodes the document
+  /// as CBOR (RFC 8949)
+  ///
+  /// Objects and arrays are encoded with indefinite lengths so they can be streamed without
+  /// knowing the number of members. Keys found in the key table are encoded as unsigned integers,
+  /// all other keys are encoded as text. Numbers are encoded as native integers and 64 bit
+  /// floating point values.
+  class AGENT_LIB_API CborWriter
+  {
+  public:
+    /// @brief Create a writer that appends to a buffer
+    /// @param[in] buffer the buffer
+    CborWriter(std::string &buffer) : m_buffer(buffer) {}
+
+    /// @name rapidjson writer interface
+    /// @{
+    bool Null()
+    {
+      m_buffer.push_back(char(0xf6));
+      return true;
+    }
+    bool Bool(bool b)
+    {
+      m_buffer.push_back(char(b ? 0xf5 : 0xf4));
+      return true;
+    }
+    bool Int(int i) { return Int64(i); }
+    bool Uint(unsigned u) { return Uint64(u); }
+    bool Int64(int64_t i)
+    {
+      if (i < 0)
+        head(1, ~uint64_t(i));
+      else
+        head(0, uint64_t(i));
+      return true;
+    }
+    bool Uint64(uint64_t u)
+    {
+      head(0, u);
+      return true;
+    }
+    bool Double(double d)
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &d, sizeof(bits));
+      m_buffer.push_back(char(0xfb));
+      bigEndian(bits, 8);
+      return true;
+    }
+    bool String(const char *s) { return String(s, rapidjson::SizeType(std::strlen(s))); }
+    bool String(const char *s, rapidjson::SizeType length, bool copy = false)
+    {
+      head(3, length);
+      m_buffer.append(s, length);
+      return true;
+    }
+    bool Key(const char *s) { return Key(s, rapidjson::SizeType(std::strlen(s))); }
+    bool Key(const char *s, rapidjson::SizeType length, bool copy = false)
+    {
+      if (auto key = keyIndex(std::string_view(s, length)))
+      {
+        head(0, *key);
+        return true;
+      }
+      return String(s, length);
+    }
+    bool StartObject()
+    {
+      m_buffer.push_back(char(0xbf));
+      m_depth++;
+      return true;
+    }
+    bool EndObject(rapidjson::SizeType count = 0) { return end(); }
+    bool StartArray()
+    {
+      m_buffer.push_back(char(0x9f));
+      m_depth++;
+      return true;
+    }
+    bool EndArray(rapidjson::SizeType count = 0) { return end(); }
+    /// @brief append a value that has already been encoded
+    bool RawValue(const char *value, size_t length, rapidjson::Type type)
+    {
+      m_buffer.append(value, length);
+      return true;
+    }
+    /// @brief `true` when all objects and arrays have been closed
+    bool IsComplete() const { return m_depth == 0; }
+    /// @}
+
+    /// @brief get the integer for a key in the key table
+    /// @param[in] key the key
+    /// @return the integer or `nullopt` if the key is not in the table
+    static std::optional<uint64_t> keyIndex(const std::string_view &key);
+    /// @brief get the key table
+    ///
+    /// The index of a key is its integer encoding. Keys are only ever appended so the encoding of
+    /// existing keys is stable across versions.
+    /// @return the keys in order
+    static const std::vector<std::string_view> &keys();
+
+  protected:
+    void head(uint8_t major, uint64_t value)
+    {
+      const char type = char(major << 5);
+      if (value < 24)
+      {
+        m_buffer.push_back(type | char(value));
+      }
+      else if (value <= 0xff)
+      {
+        m_buffer.push_back(type | 24);
+        m_buffer.push_back(char(value));
+      }
+      else if (value <= 0xffff)
+      {
+        m_buffer.push_back(type | 25);
+        bigEndian(value, 2);
+      }
+      else if (value <= 0xffffffff)
+      {
+        m_buffer.push_back(type | 26);
+        bigEndian(value, 4);
+      }
+      else
+      {
+        m_buffer.push_back(type | 27);
+        bigEndian(value, 8);
+      }
+    }
+
+    void bigEndian(uint64_t value, int bytes)
+    {
+      for (int i = bytes - 1; i >= 0; i--)
+        m_buffer.push_back(char((value >> (i * 8)) & 0xff));
+    }
+
+    bool end()
+    {
+      m_buffer.push_back(char(0xff));
+      m_depth--;
+      return true;
+    }
+
+  protected:
+    std::string &m_buffer;
+    int m_depth {0};
+  };
+}  // namespace mtconnect::printer
@@ -18,16 +18,11 @@
 #include "json_printer.hpp"
 
 #include <boost/asio/ip/host_name.hpp>
-#include <boost/multi_index/composite_key.hpp>
-#include <boost/multi_index/identity.hpp>
-#include <boost/multi_index/key.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index_container.hpp>
 #include <boost/range/algorithm/sort.hpp>
 
+#include <algorithm>
 #include <cstdlib>
+#include <map>
 #include <set>
 #include <sstream>
 
@@ -37,6 +32,8 @@
 #include "mtconnect/device_model/reference.hpp"
 #include "mtconnect/entity/json_printer.hpp"
 #include "mtconnect/logging.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
+#include "mtconnect/printer/cbor_writer.hpp"
 #include "mtconnect/printer/json_printer_helper.hpp"
 #include "mtconnect/version.h"
 
@@ -110,6 +107,69 @@ namespace mtconnect::printer {
                  firstSequence);
   }
 
+  /// @brief The parts of a streams header that only change with the instance or device model
+  struct JsonPrinter::SampleHeader
+  {
+    uint64_t m_instanceId;
+    unsigned int m_bufferSize;
+    string m_schemaVersion;
+    string m_modelChangeTime;
+    string m_prefix;  ///< `{"version":"...","creationTime":"`
+    string m_suffix;  ///< `","testIndicator":false,...,"nextSequence":`
+  };
+
+  void JsonPrinter::sampleHeader(string &text, const uint64_t instanceId,
+                                 const unsigned int bufferSize, const uint64_t nextSeq,
+                                 const uint64_t firstSeq, const uint64_t lastSeq) const
+  {
+    auto cached = atomic_load(&m_sampleHeader);
+    if (!cached || cached->m_instanceId != instanceId || cached->m_bufferSize != bufferSize ||
+        cached->m_schemaVersion != *m_schemaVersion ||
+        cached->m_modelChangeTime != m_modelChangeTime)
+    {
+      auto fresh = make_shared<SampleHeader>();
+      fresh->m_instanceId = instanceId;
+      fresh->m_bufferSize = bufferSize;
+      fresh->m_schemaVersion = *m_schemaVersion;
+      fresh->m_modelChangeTime = m_modelChangeTime;
+
+      // Render the common header and split it around the creation time
+      string rendered;
+      StringOutputStream output(rendered);
+      rapidjson::Writer<StringOutputStream> writer(output);
+      {
+        AutoJsonObject obj(writer);
+        header(obj, m_version, hostname(), instanceId, bufferSize, *m_schemaVersion,
+               m_modelChangeTime);
+      }
+
+      const string_view time = "\"creationTime\":\"";
+      auto start = rendered.find(time) + time.size();
+      auto end = rendered.find('"', start);
+      fresh->m_prefix = rendered.substr(0, start);
+      fresh->m_suffix = rendered.substr(end, rendered.size() - end - 1);
+      fresh->m_suffix.append(",\"nextSequence\":");
+
+      cached = fresh;
+      atomic_store(&m_sampleHeader, cached);
+    }
+
+    auto number = [&text](uint64_t value) {
+      char buffer[24];
+      text.append(buffer, to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+    };
+
+    text.append(cached->m_prefix);
+    text.append(getCurrentTime(GMT));
+    text.append(cached->m_suffix);
+    number(nextSeq);
+    text.append(",\"lastSequence\":");
+    number(lastSeq);
+    text.append(",\"firstSequence\":");
+    number(firstSeq);
+    text.push_back('}');
+  }
+
   template <typename T1, class T2>
   inline void toJson(T1 &writer, const string &collection, T2 &list)
   {
@@ -123,58 +183,87 @@ namespace mtconnect::printer {
     }
   }
 
-  std::string JsonPrinter::printErrors(const uint64_t instanceId, const unsigned int bufferSize,
-                                       const uint64_t nextSeq, const ProtoErrorList &list,
-                                       bool pretty) const
+  template <typename W>
+  void JsonPrinter::renderErrors(W &writer, const uint64_t instanceId,
+                                 const unsigned int bufferSize, const ProtoErrorList &list) const
   {
-    defaultSchemaVersion();
+    AutoJsonObject obj(writer);
+    {
+      AutoJsonObject obj(writer, "MTConnectError");
+      obj.AddPairs("jsonVersion", m_jsonVersion);
 
-    StringBuffer output;
-    RenderJson(output, m_pretty || pretty, [&](auto &writer) {
-      AutoJsonObject obj(writer);
       {
-        AutoJsonObject obj(writer, "MTConnectError");
-        obj.AddPairs("jsonVersion", m_jsonVersion);
-
-        {
-          AutoJsonObject obj(writer, "Header");
-          header(obj, m_version, hostname(), instanceId, bufferSize, *m_schemaVersion,
-                 m_modelChangeTime);
-        }
+        AutoJsonObject obj(writer, "Header");
+        header(obj, m_version, hostname(), instanceId, bufferSize, *m_schemaVersion,
+               m_modelChangeTime);
+      }
+      {
+        if (m_jsonVersion > 1)
         {
-          if (m_jsonVersion > 1)
+          AutoJsonObject obj(writer, "Errors");
           {
-            AutoJsonObject obj(writer, "Errors");
+            AutoJsonArray ary(writer, "Error");
+            for (auto &e : list)
             {
-              AutoJsonArray ary(writer, "Error");
-              for (auto &e : list)
-              {
-                AutoJsonObject obj(writer);
-                string s(e.second);
-                obj.AddPairs("errorCode", e.first, "value", trim(s));
-              }
+              AutoJsonObject obj(writer);
+              string s(e.second);
+              obj.AddPairs("errorCode", e.first, "value", trim(s));
             }
           }
-          else
+        }
+        else
+        {
+          AutoJsonArray obj(writer, "Errors");
           {
-            AutoJsonArray obj(writer, "Errors");
+            for (auto &e : list)
             {
-              for (auto &e : list)
+              AutoJsonObject obj(writer);
               {
-                AutoJsonObject obj(writer);
-                {
-                  AutoJsonObject obj(writer, "Error");
-                  string s(e.second);
-                  obj.AddPairs("errorCode", e.first, "value", trim(s));
-                }
+                AutoJsonObject obj(writer, "Error");
+                string s(e.second);
+                obj.AddPairs("errorCode", e.first, "value", trim(s));
               }
             }
           }
         }
       }
-    });
+    }
+  }
+
+  std::string JsonPrinter::printErrors(const uint64_t instanceId, const unsigned int bufferSize,
+                                       const uint64_t nextSeq, const ProtoErrorList &list,
+                                       bool pretty) const
+  {
+    defaultSchemaVersion();
 
-    return string(output.GetString(), output.GetLength());
+    string ret = BufferPool::global().take();
+    StringOutputStream output(ret);
+    RenderJson(output, m_pretty || pretty,
+               [&](auto &writer) { renderErrors(writer, instanceId, bufferSize, list); });
+
+    return ret;
+  }
+
+  template <typename W>
+  void JsonPrinter::renderProbe(W &writer, const uint64_t instanceId,
+                                const unsigned int bufferSize, const unsigned int assetBufferSize,
+                                const unsigned int assetCount, const std::list<DevicePtr> &devices,
+                                bool includeHidden) const
+  {
+    entity::JsonPrinter printer(writer, m_jsonVersion, includeHidden);
+
+    AutoJsonObject top(writer);
+    AutoJsonObject obj(writer, "MTConnectDevices");
+    obj.AddPairs("jsonVersion", m_jsonVersion, "schemaVersion", *m_schemaVersion);
+    {
+      AutoJsonObject obj(writer, "Header");
+      probeAssetHeader(obj, m_version, hostname(), instanceId, bufferSize, assetBufferSize,
+                       assetCount, *m_schemaVersion, m_modelChangeTime);
+    }
+    {
+      obj.Key("Devices");
+      printer.printEntityList(devices);
+    }
   }
 
   std::string JsonPrinter::printProbe(const uint64_t instanceId, const unsigned int bufferSize,
@@ -186,25 +275,122 @@ namespace mtconnect::printer {
   {
     defaultSchemaVersion();
 
-    StringBuffer output;
+    string ret = BufferPool::global().take();
+    StringOutputStream output(ret);
     RenderJson(output, m_pretty || pretty, [&](auto &writer) {
-      entity::JsonPrinter printer(writer, m_jsonVersion, includeHidden);
+      renderProbe(writer, instanceId, bufferSize, assetBufferSize, assetCount, devices,
+                  includeHidden);
+    });
+
+    return ret;
+  }
+
+  /// @brief print an asset with the entity printer, version 1 documents repeat the asset name in
+  /// an object
+  template <typename T>
+  inline void printAssetEntity(T &writer, uint32_t jsonVersion, const asset::AssetPtr &asset)
+  {
+    entity::JsonPrinter printer(writer, jsonVersion);
+    if (jsonVersion == 1)
+      printer.print(asset);
+    else
+      printer.printEntity(asset);
+  }
 
-      AutoJsonObject top(writer);
-      AutoJsonObject obj(writer, "MTConnectDevices");
-      obj.AddPairs("jsonVersion", m_jsonVersion, "schemaVersion", *m_schemaVersion);
+  /// @brief print an asset using the asset's cached compact JSON or CBOR fragment
+  ///
+  /// Pretty printed fragments depend on the nesting level so they are always rendered.
+  template <typename T>
+  inline void printAsset(T &writer, uint32_t jsonVersion, const asset::AssetPtr &asset)
+  {
+    constexpr bool cbor = std::is_same_v<std::decay_t<T>, CborWriter>;
+    if constexpr (cbor || IsCompactWriter<std::decay_t<T>>::value)
+    {
+      using Format = asset::AssetFragmentCache::Format;
+      const auto format = cbor               ? Format::CBOR
+                          : jsonVersion == 1 ? Format::JSON_V1
+                                             : Format::JSON_V2;
+      const auto &fragments = asset->getFragments();
+      if (auto fragment = fragments.get(format, 0))
       {
-        AutoJsonObject obj(writer, "Header");
-        probeAssetHeader(obj, m_version, hostname(), instanceId, bufferSize, assetBufferSize,
-                         assetCount, *m_schemaVersion, m_modelChangeTime);
+        writer.RawValue(fragment->m_text.data(), fragment->m_text.size(), rapidjson::kObjectType);
+        return;
       }
+
+      auto generation = fragments.generation();
+      thread_local string text;
+      text.clear();
+      if constexpr (cbor)
       {
-        obj.Key("Devices");
-        printer.printEntityList(devices);
+        CborWriter element(text);
+        printAssetEntity(element, jsonVersion, asset);
+      }
+      else
+      {
+        StringOutputStream output(text);
+        rapidjson::Writer<StringOutputStream> element(output);
+        printAssetEntity(element, jsonVersion, asset);
       }
-    });
 
-    return string(output.GetString(), output.GetLength());
+      fragments.put(format, 0, text, generation);
+      writer.RawValue(text.data(), text.size(), rapidjson::kObjectType);
+    }
+    else
+    {
+      printAssetEntity(writer, jsonVersion, asset);
+    }
+  }
+
+  /// @brief print the asset list, version 2 documents group the assets by name
+  template <typename T>
+  inline void printAssetList(T &writer, uint32_t jsonVersion, const asset::AssetList &list)
+  {
+    if (jsonVersion == 1)
+    {
+      AutoJsonArray ary(writer);
+      for (auto &asset : list)
+        printAsset(writer, jsonVersion, asset);
+    }
+    else if (jsonVersion == 2)
+    {
+      AutoJsonObject obj(writer);
+      std::multimap<std::string_view, asset::AssetPtr> assets;
+      for (auto &asset : list)
+        assets.emplace(std::string_view(asset->getName()), asset);
+
+      for (auto it = assets.begin(); it != assets.end();)
+      {
+        auto next = assets.upper_bound(it->first);
+
+        obj.Key(it->first);
+        AutoJsonArray ary(writer);
+        for (; it != next; it++)
+          printAsset(writer, jsonVersion, it->second);
+      }
+    }
+    else
+    {
+      throw std::runtime_error("Invalid json printer version");
+    }
+  }
+
+  template <typename W>
+  void JsonPrinter::renderAssets(W &writer, const uint64_t instanceId,
+                                 const unsigned int bufferSize, const unsigned int assetCount,
+                                 const asset::AssetList &asset) const
+  {
+    AutoJsonObject top(writer);
+    AutoJsonObject obj(writer, "MTConnectAssets");
+    obj.AddPairs("jsonVersion", m_jsonVersion, "schemaVersion", *m_schemaVersion);
+    {
+      AutoJsonObject obj(writer, "Header");
+      probeAssetHeader(obj, m_version, hostname(), instanceId, 0, bufferSize, assetCount,
+                       *m_schemaVersion, m_modelChangeTime);
+    }
+    {
+      obj.Key("Assets");
+      printAssetList(writer, m_jsonVersion, asset);
+    }
   }
 
   std::string JsonPrinter::printAssets(const uint64_t instanceId, const unsigned int bufferSize,
@@ -213,31 +399,18 @@ namespace mtconnect::printer {
   {
     defaultSchemaVersion();
 
-    StringBuffer output;
+    string ret = BufferPool::global().take();
+    StringOutputStream output(ret);
     RenderJson(output, m_pretty || pretty, [&](auto &writer) {
-      entity::JsonPrinter printer(writer, m_jsonVersion);
-
-      AutoJsonObject top(writer);
-      AutoJsonObject obj(writer, "MTConnectAssets");
-      obj.AddPairs("jsonVersion", m_jsonVersion, "schemaVersion", *m_schemaVersion);
-      {
-        AutoJsonObject obj(writer, "Header");
-        probeAssetHeader(obj, m_version, hostname(), instanceId, 0, bufferSize, assetCount,
-                         *m_schemaVersion, m_modelChangeTime);
-      }
-      {
-        obj.Key("Assets");
-        printer.printEntityList(asset);
-      }
+      renderAssets(writer, instanceId, bufferSize, assetCount, asset);
     });
-    return string(output.GetString(), output.GetLength());
+    return ret;
   }
 
   using namespace boost;
-  using namespace multi_index;
   using namespace device_model::data_item;
 
-  /// @brief A structure used by the multimap to create a composite key for a list of observations.
+  /// @brief A structure used to order a list of observations by a composite key.
   ///
   /// Caches the data item, component, category, and device associated with the observation
   struct ObservationRef
@@ -248,6 +421,7 @@ namespace mtconnect::printer {
       m_category = m_dataItem->getCategory();
       m_component = m_dataItem->getComponent();
       m_device = m_component->getDevice();
+      m_group = m_dataItem->getGroupOrdinal();
     }
 
     std::string_view getDeviceId() const { return m_device->getId(); }
@@ -261,26 +435,119 @@ namespace mtconnect::printer {
     DataItemPtr m_dataItem;
     DevicePtr m_device;
     DataItem::Category m_category;
+    uint32_t m_group;
   };
 
-  using ObservationMap = multi_index_container<
-      ObservationRef,
-      indexed_by<ordered_non_unique<composite_key<
-          ObservationRef,
-          const_mem_fun<ObservationRef, std::string_view, &ObservationRef::getDeviceId>,
-          const_mem_fun<ObservationRef, std::string_view, &ObservationRef::getComponentId>,
-          const_mem_fun<ObservationRef, DataItem::Category, &ObservationRef::getCategory>,
-          const_mem_fun<ObservationRef, std::string_view, &ObservationRef::getType>,
-          const_mem_fun<ObservationRef, SequenceNumber_t, &ObservationRef::getSequence>>>>>;
+  using ObservationRefs = std::vector<ObservationRef>;
+
+  /// @brief Order the observations by Device, Component, Category, Observation Type, and Sequence
+  ///
+  /// The device, component, and category are compared using the group ordinal of the data item
+  /// when all the data items have been ordered by the agent.
+  /// @param[in,out] observations the observations to sort
+  inline void SortObservationRefs(ObservationRefs &observations)
+  {
+    auto ordered = all_of(observations.begin(), observations.end(),
+                          [](const ObservationRef &ref) { return ref.m_group != 0; });
+    auto compare = [ordered](const ObservationRef &a, const ObservationRef &b) {
+      if (ordered)
+      {
+        if (a.m_group != b.m_group)
+          return a.m_group < b.m_group;
+      }
+      else
+      {
+        if (auto c = a.getDeviceId().compare(b.getDeviceId()); c != 0)
+          return c < 0;
+        if (auto c = a.getComponentId().compare(b.getComponentId()); c != 0)
+          return c < 0;
+        if (a.getCategory() != b.getCategory())
+          return a.getCategory() < b.getCategory();
+      }
+
+      if (auto c = a.getType().compare(b.getType()); c != 0)
+        return c < 0;
+      return a.getSequence() < b.getSequence();
+    };
+
+    stable_sort(observations.begin(), observations.end(), compare);
+  }
+
+  /// @brief print an observation with the entity printer, version 1 documents repeat the
+  /// observation name in an object
+  template <typename T>
+  inline void printObservationEntity(entity::JsonPrinter<T> &printer, uint32_t jsonVersion,
+                                     const ObservationPtr &obs)
+  {
+    if (auto dataItem = obs->getDataItem())
+      printer.setSignificantDigits(dataItem->getSignificantDigits());
+
+    if (jsonVersion == 1)
+      printer.print(obs);
+    else
+      printer.printEntity(obs);
+  }
+
+  /// @brief get the compact JSON or CBOR fragment of an observation, rendering and caching it
+  /// if it has not been printed before
+  /// @tparam cbor `true` for CBOR
+  /// @return the fragment, only valid until the next call on this thread
+  template <bool cbor>
+  inline std::string_view observationFragment(uint32_t jsonVersion, const ObservationPtr &obs)
+  {
+    const auto format = cbor               ? FragmentCache::CBOR
+                        : jsonVersion == 1 ? FragmentCache::JSON_V1
+                                           : FragmentCache::JSON_V2;
+    const auto &fragments = obs->getFragments();
+    if (auto fragment = fragments.get(format, 0))
+      return fragment->m_text;
+
+    thread_local string text;
+    text.clear();
+    if constexpr (cbor)
+    {
+      CborWriter element(text);
+      entity::JsonPrinter printer(element, jsonVersion);
+      printObservationEntity(printer, jsonVersion, obs);
+    }
+    else
+    {
+      StringOutputStream output(text);
+      rapidjson::Writer<StringOutputStream> element(output);
+      entity::JsonPrinter printer(element, jsonVersion);
+      printObservationEntity(printer, jsonVersion, obs);
+    }
+
+    fragments.put(format, 0, text);
+    return text;
+  }
+
+  /// @brief print an observation using the fragment cache when the output is compact or CBOR
+  ///
+  /// Pretty printed fragments depend on the nesting level so they are always rendered.
+  template <typename T>
+  inline void printObservation(T &writer, uint32_t jsonVersion, const ObservationPtr &obs)
+  {
+    constexpr bool cbor = std::is_same_v<std::decay_t<T>, CborWriter>;
+    if constexpr (cbor || IsCompactWriter<std::decay_t<T>>::value)
+    {
+      auto text = observationFragment<cbor>(jsonVersion, obs);
+      writer.RawValue(text.data(), text.size(), rapidjson::kObjectType);
+    }
+    else
+    {
+      entity::JsonPrinter printer(writer, jsonVersion);
+      printObservationEntity(printer, jsonVersion, obs);
+    }
+  }
 
   template <typename T>
-  void printSampleVersion1(T &writer, uint32_t jsonVersion, ObservationMap &observations)
+  void printSampleVersion1(T &writer, uint32_t jsonVersion, ObservationRefs &observations)
   {
     using WriterType = decltype(writer);
     using StackType = JsonStack<WriterType>;
 
     StackType stack(writer);
-    entity::JsonPrinter printer(writer, jsonVersion);
 
     AutoJsonArray streams(writer, "Streams");
 
@@ -328,14 +595,14 @@ namespace mtconnect::printer {
         stack.addArray(ref.m_dataItem->getCategoryText());
       }
 
-      printer.print(ref.m_observation);
+      printObservation(writer, jsonVersion, ref.m_observation);
     }
 
     stack.clear();
   }
 
   template <typename T>
-  void printSampleVersion2(T &writer, uint32_t jsonVersion, ObservationMap &observations)
+  void printSampleVersion2(T &writer, uint32_t jsonVersion, ObservationRefs &observations)
   {
     using WriterType = decltype(writer);
     using StackType = JsonStack<WriterType>;
@@ -343,7 +610,6 @@ namespace mtconnect::printer {
     AutoJsonObject streams(writer, "Streams");
     AutoJsonArray devStream(writer, "DeviceStream");
     StackType stack(writer);
-    entity::JsonPrinter printer(writer, jsonVersion);
 
     std::string_view deviceId;
     std::string_view componentId;
@@ -400,53 +666,102 @@ namespace mtconnect::printer {
         stack.addArray(obsType);
       }
 
-      printer.printEntity(ref.m_observation);
+      printObservation(writer, jsonVersion, ref.m_observation);
     }
 
     stack.clear();
   }
 
-  std::string JsonPrinter::printSample(const uint64_t instanceId, const unsigned int bufferSize,
-                                       const uint64_t nextSeq, const uint64_t firstSeq,
-                                       const uint64_t lastSeq, ObservationList &observations,
-                                       bool pretty) const
+  template <typename W>
+  void JsonPrinter::renderSample(W &writer, const uint64_t instanceId,
+                                 const unsigned int bufferSize, const uint64_t nextSeq,
+                                 const uint64_t firstSeq, const uint64_t lastSeq,
+                                 ObservationList &observations) const
   {
-    defaultSchemaVersion();
-
-    StringBuffer output;
-    RenderJson(output, m_pretty || pretty, [&](auto &writer) {
-      AutoJsonObject top(writer);
-      AutoJsonObject obj(writer, "MTConnectStreams");
-      obj.AddPairs("jsonVersion", m_jsonVersion, "schemaVersion", *m_schemaVersion);
-      {
-        AutoJsonObject obj(writer, "Header");
-        streamHeader(obj, m_version, hostname(), instanceId, bufferSize, nextSeq, firstSeq, lastSeq,
-                     *m_schemaVersion, m_modelChangeTime);
-      }
+    AutoJsonObject top(writer);
+    AutoJsonObject obj(writer, "MTConnectStreams");
+    obj.AddPairs("jsonVersion", m_jsonVersion, "schemaVersion", *m_schemaVersion);
+    if constexpr (IsCompactWriter<W>::value)
+    {
+      thread_local string text;
+      text.clear();
+      sampleHeader(text, instanceId, bufferSize, nextSeq, firstSeq, lastSeq);
+      obj.Key("Header");
+      writer.RawValue(text.data(), text.size(), rapidjson::kObjectType);
+    }
+    else
+    {
+      AutoJsonObject obj(writer, "Header");
+      streamHeader(obj, m_version, hostname(), instanceId, bufferSize, nextSeq, firstSeq, lastSeq,
+                   *m_schemaVersion, m_modelChangeTime);
+    }
 
+    {
+      if (!observations.empty())
       {
-        if (!observations.empty())
+        // Order the observations by Device, Component, Category, Observation Type, and Sequence
+        ObservationRefs obs;
+        obs.reserve(observations.size());
         {
-          // Order the observations by Device, Component, Category, Observation Type, and Sequence
-          ObservationMap obs;
+          std::shared_lock lock(DataItem::getOrdinalMutex());
           for (const auto &o : observations)
           {
             if (!o->isOrphan())
-              obs.emplace(o);
+              obs.emplace_back(o);
           }
-
-          if (m_jsonVersion == 1)
-            printSampleVersion1(writer, m_jsonVersion, obs);
-          else if (m_jsonVersion == 2)
-            printSampleVersion2(writer, m_jsonVersion, obs);
-        }
-        else
-        {
-          AutoJsonObject streams(writer, "Streams");
         }
+        SortObservationRefs(obs);
+
+        if (m_jsonVersion == 1)
+          printSampleVersion1(writer, m_jsonVersion, obs);
+        else if (m_jsonVersion == 2)
+          printSampleVersion2(writer, m_jsonVersion, obs);
       }
+      else
+      {
+        AutoJsonObject streams(writer, "Streams");
+      }
+    }
+  }
+
+  std::string JsonPrinter::printSample(const uint64_t instanceId, const unsigned int bufferSize,
+                                       const uint64_t nextSeq, const uint64_t firstSeq,
+                                       const uint64_t lastSeq, ObservationList &observations,
+                                       bool pretty) const
+  {
+    defaultSchemaVersion();
+
+    // Print directly into a pooled buffer that is moved into the response
+    string ret = BufferPool::global().take(m_sampleSize.load(std::memory_order_relaxed));
+    StringOutputStream output(ret);
+    RenderJson(output, m_pretty || pretty, [&](auto &writer) {
+      renderSample(writer, instanceId, bufferSize, nextSeq, firstSeq, lastSeq, observations);
     });
 
-    return string(output.GetString(), output.GetLength());
+    m_sampleSize.store(ret.size(), std::memory_order_relaxed);
+    return ret;
   }
+
+  void JsonPrinter::cacheFragment(const ObservationPtr &observation, bool cbor) const
+  {
+    if (observation->isOrphan())
+      return;
+
+    if (cbor)
+      observationFragment<true>(m_jsonVersion, observation);
+    else
+      observationFragment<false>(m_jsonVersion, observation);
+  }
+
+  // The CBOR printer renders the same documents with a binary writer
+  template void JsonPrinter::renderErrors(CborWriter &, const uint64_t, const unsigned int,
+                                          const ProtoErrorList &) const;
+  template void JsonPrinter::renderProbe(CborWriter &, const uint64_t, const unsigned int,
+                                         const unsigned int, const unsigned int,
+                                         const std::list<DevicePtr> &, bool) const;
+  template void JsonPrinter::renderSample(CborWriter &, const uint64_t, const unsigned int,
+                                          const uint64_t, const uint64_t, const uint64_t,
+                                          ObservationList &) const;
+  template void JsonPrinter::renderAssets(CborWriter &, const uint64_t, const unsigned int,
+                                          const unsigned int, const asset::AssetList &) const;
 }  // namespace mtconnect::printer
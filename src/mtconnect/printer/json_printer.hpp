@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include "mtconnect/asset/cutting_tool.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/printer/printer.hpp"
@@ -48,13 +51,51 @@ namespace mtconnect::printer {
                             const unsigned int assetCount, const asset::AssetList &asset,
                             bool pretty = false) const override;
     std::string mimeType() const override { return "application/mtconnect+json"; }
+    bool cachesObservations(bool pretty = false) const override { return !(m_pretty || pretty); }
+    void cacheObservation(const observation::ObservationPtr &observation,
+                          bool pretty = false) const override
+    {
+      if (!(m_pretty || pretty))
+        cacheFragment(observation, false);
+    }
 
     uint32_t getJsonVersion() const { return m_jsonVersion; }
 
   protected:
+    /// @name Document rendering shared by the JSON and CBOR printers
+    /// @tparam W the writer type
+    /// @{
+    template <typename W>
+    void renderErrors(W &writer, const uint64_t instanceId, const unsigned int bufferSize,
+                      const ProtoErrorList &list) const;
+    template <typename W>
+    void renderProbe(W &writer, const uint64_t instanceId, const unsigned int bufferSize,
+                     const unsigned int assetBufferSize, const unsigned int assetCount,
+                     const std::list<DevicePtr> &devices, bool includeHidden) const;
+    template <typename W>
+    void renderSample(W &writer, const uint64_t instanceId, const unsigned int bufferSize,
+                      const uint64_t nextSeq, const uint64_t firstSeq, const uint64_t lastSeq,
+                      observation::ObservationList &results) const;
+    template <typename W>
+    void renderAssets(W &writer, const uint64_t instanceId, const unsigned int bufferSize,
+                      const unsigned int assetCount, const asset::AssetList &asset) const;
+    /// @}
+
+    /// @brief render an observation into its compact JSON or CBOR fragment
+    void cacheFragment(const observation::ObservationPtr &observation, bool cbor) const;
+
+    /// @brief compact JSON text of a streams header with the sequence numbers and creation time
+    /// patched into a cached template
+    struct SampleHeader;
+    void sampleHeader(std::string &text, const uint64_t instanceId, const unsigned int bufferSize,
+                      const uint64_t nextSeq, const uint64_t firstSeq,
+                      const uint64_t lastSeq) const;
+
     const std::string &hostname() const;
     std::string m_version;
     std::string m_hostname;
     uint32_t m_jsonVersion;
+    mutable std::atomic<size_t> m_sampleSize {0};
+    mutable std::shared_ptr<const SampleHeader> m_sampleHeader;
   };
 }  // namespace mtconnect::printer
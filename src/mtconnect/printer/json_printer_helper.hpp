@@ -22,7 +22,56 @@
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
 namespace mtconnect::printer {
+  /// @brief A rapidjson output stream that appends to a `std::string`
+  ///
+  /// Lets the writers print directly into the buffer that is sent, avoiding the copy out of a
+  /// `rapidjson::StringBuffer`.
+  class StringOutputStream
+  {
+  public:
+    using Ch = char;
+
+    /// @brief Create a stream appending to a buffer
+    /// @param[in] buffer the buffer
+    StringOutputStream(std::string &buffer) : m_buffer(buffer) {}
+
+    /// @brief append a character
+    /// @param[in] c the character
+    void Put(Ch c) { m_buffer.push_back(c); }
+    /// @brief nothing to flush
+    void Flush() {}
+    /// @brief make room for more characters while keeping the geometric growth of the string
+    /// @param[in] count the number of characters
+    void Reserve(size_t count)
+    {
+      auto size = m_buffer.size() + count;
+      if (size > m_buffer.capacity())
+        m_buffer.reserve(std::max(size, m_buffer.capacity() * 2));
+    }
+
+  protected:
+    std::string &m_buffer;
+  };
+
+  /// @brief Reserve space in a string output stream, found by argument dependent lookup from the
+  /// rapidjson writers.
+  inline void PutReserve(StringOutputStream &stream, size_t count) { stream.Reserve(count); }
+  /// @brief Append a character to a string output stream after it has been reserved
+  inline void PutUnsafe(StringOutputStream &stream, char c) { stream.Put(c); }
+
+  /// @brief `true` if the writer is a compact writer and not a `rapidjson::PrettyWriter`
+  /// @tparam W the writer type
+  template <typename W>
+  struct IsCompactWriter : std::false_type
+  {};
+  template <typename OS, typename SE, typename TE, typename SA, unsigned F>
+  struct IsCompactWriter<rapidjson::Writer<OS, SE, TE, SA, F>> : std::true_type
+  {};
 
   /// @brief Abstract helper wrapping the rapidjson writer and providing some helper methods
   /// serializing types.
@@ -332,13 +381,13 @@ namespace mtconnect::printer {
   {
     if (pretty)
     {
-      rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(output);
+      rapidjson::PrettyWriter<T> writer(output);
       writer.SetIndent(' ', 2);
       func(writer);
     }
     else
     {
-      rapidjson::Writer<rapidjson::StringBuffer> writer(output);
+      rapidjson::Writer<T> writer(output);
       func(writer);
     }
   }
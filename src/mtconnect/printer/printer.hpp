@@ -113,6 +113,23 @@ namespace mtconnect {
       /// @brief get the mime type for the documents
       /// @return the mime type
       virtual std::string mimeType() const = 0;
+      /// @brief check if the documents are binary and cannot be sent as text
+      /// @return `true` if the documents are binary
+      virtual bool isBinary() const { return false; }
+      /// @brief check if the printer caches rendered observations in their fragment cache
+      /// @param[in] pretty `true` if the document will be pretty printed
+      /// @return `true` if `cacheObservation()` renders observations for the document
+      virtual bool cachesObservations(bool pretty = false) const { return false; }
+      /// @brief render an observation into its fragment cache before printing a document
+      ///
+      /// Can be called concurrently to render the observations of a large document in parallel,
+      /// `printSample()` then only copies the rendered fragments.
+      ///
+      /// @param[in] observation the observation
+      /// @param[in] pretty `true` if the document will be pretty printed
+      virtual void cacheObservation(const observation::ObservationPtr &observation,
+                                    bool pretty = false) const
+      {}
       /// @brief Set the last model change time
       /// @param t the time
       void setModelChangeTime(const std::string &t) { m_modelChangeTime = t; }
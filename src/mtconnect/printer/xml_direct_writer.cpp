@@ -0,0 +1,146 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "xml_direct_writer.hpp"
+
+#include <cstdio>
+
+using namespace std;
+
+namespace mtconnect::printer {
+  // Appends the text, replacing the characters that need to be escaped. Runs of characters
+  // without replacements are copied in one append.
+  template <typename Replace>
+  static inline void escape(string &out, string_view text, Replace replace)
+  {
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+      if (const char *r = replace(text[i]))
+      {
+        out.append(text, start, i - start).append(r);
+        start = i + 1;
+      }
+    }
+    out.append(text, start, text.size() - start);
+  }
+
+  void XmlDirectWriter::escapeAttribute(string &out, string_view value)
+  {
+    escape(out, value, [](char c) -> const char * {
+      switch (c)
+      {
+        case '<':
+          return "&lt;";
+        case '>':
+          return "&gt;";
+        case '&':
+          return "&amp;";
+        case '"':
+          return "&quot;";
+        case '\r':
+          return "&#13;";
+        case '\n':
+          return "&#10;";
+        case '\t':
+          return "&#9;";
+        default:
+          return nullptr;
+      }
+    });
+  }
+
+  void XmlDirectWriter::escapeText(string &out, string_view text)
+  {
+    escape(out, text, [](char c) -> const char * {
+      switch (c)
+      {
+        case '<':
+          return "&lt;";
+        case '>':
+          return "&gt;";
+        case '&':
+          return "&amp;";
+        case '"':
+          return "&quot;";
+        case '\r':
+          return "&#13;";
+        default:
+          return nullptr;
+      }
+    });
+  }
+
+  void XmlDirectWriter::escapeEntities(string &out, string_view text)
+  {
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+      const char *r = nullptr;
+      auto c = static_cast<unsigned char>(text[i]);
+      switch (c)
+      {
+        case '<':
+          r = "&lt;";
+          break;
+        case '>':
+          r = "&gt;";
+          break;
+        case '&':
+          r = "&amp;";
+          break;
+        case '\r':
+          r = "&#13;";
+          break;
+      }
+
+      if (r != nullptr)
+      {
+        out.append(text, start, i - start).append(r);
+        start = i + 1;
+      }
+      else if (c >= 0x80)
+      {
+        // Decode the UTF-8 sequence and write it as a character reference. Bytes that are
+        // not part of a valid sequence are written as decimal references.
+        size_t len = c >= 0xF8 ? 0 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+        uint32_t code = c & (0x7F >> len);
+        size_t n = 1;
+        for (; n < len && i + n < text.size() &&
+               (static_cast<unsigned char>(text[i + n]) & 0xC0) == 0x80;
+             n++)
+          code = (code << 6) | (static_cast<unsigned char>(text[i + n]) & 0x3F);
+
+        char ref[16];
+        size_t consumed = 1;
+        if (len > 0 && n == len)
+        {
+          snprintf(ref, sizeof(ref), "&#x%X;", code);
+          consumed = len;
+        }
+        else
+        {
+          snprintf(ref, sizeof(ref), "&#%d;", int(c));
+        }
+        out.append(text, start, i - start).append(ref);
+        i += consumed - 1;
+        start = i + 1;
+      }
+    }
+    out.append(text, start, text.size() - start);
+  }
+}  // namespace mtconnect::printer
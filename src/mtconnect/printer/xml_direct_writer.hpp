@@ -0,0 +1,190 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mtconnect/config.hpp"
+
+namespace mtconnect::printer {
+  /// @brief XML writer that appends directly to a `std::string`.
+  ///
+  /// Produces the same bytes as a `libxml2` memory `xmlTextWriter` with an optional two space
+  /// indent, including the escaping rules for attributes, text, and entity encoded content.
+  /// Element names are not validated or escaped, and pre-escaped fragments can be written with
+  /// `startElementRaw` and `rawAttributes`.
+  class AGENT_LIB_API XmlDirectWriter
+  {
+  public:
+    /// @brief Create a writer appending to a buffer
+    /// @param buffer the buffer to write to
+    /// @param pretty `true` if output is formatted with indentation
+    /// @param depth the number of enclosing elements when writing a fragment of a document
+    XmlDirectWriter(std::string &buffer, bool pretty, size_t depth = 0)
+      : m_buffer(buffer), m_pretty(pretty), m_depth(depth)
+    {}
+
+    /// @brief write the XML declaration
+    void startDocument() { m_buffer.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"); }
+    /// @brief close all open elements and end the document
+    void endDocument()
+    {
+      while (!m_elements.empty())
+        endElement();
+      if (!m_pretty)
+        m_buffer.push_back('\n');
+    }
+
+    /// @brief write a processing instruction
+    /// @param pi the target and content of the processing instruction
+    void processingInstruction(std::string_view pi)
+    {
+      m_buffer.append("<?").append(pi).append("?>");
+      if (m_pretty)
+        m_buffer.push_back('\n');
+    }
+
+    /// @brief open an element
+    /// @param name the element name
+    void startElement(std::string_view name) { startElementRaw(name, name); }
+    /// @brief open an element with pre-escaped attributes
+    /// @param fragment the element name followed by the attributes, ` attr="value"`
+    /// @param name the element name used to close the element
+    void startElementRaw(std::string_view fragment, std::string_view name)
+    {
+      closeStartTag(true);
+      m_elements.push_back(m_names.size());
+      m_names.append(name);
+      m_open = true;
+      indent();
+      m_buffer.push_back('<');
+      m_buffer.append(fragment);
+    }
+    /// @brief write a complete element rendered by a writer with the same depth
+    /// @param fragment the element
+    void element(std::string_view fragment)
+    {
+      closeStartTag(true);
+      m_buffer.append(fragment);
+      m_doIndent = true;
+    }
+    /// @brief close the last open element
+    void endElement()
+    {
+      if (m_open)
+      {
+        m_doIndent = true;
+        m_buffer.append("/>");
+        m_open = false;
+      }
+      else
+      {
+        if (m_doIndent)
+          indent();
+        m_doIndent = true;
+        m_buffer.append("</").append(m_names, m_elements.back()).push_back('>');
+      }
+      if (m_pretty)
+        m_buffer.push_back('\n');
+      m_names.resize(m_elements.back());
+      m_elements.pop_back();
+    }
+
+    /// @brief add an attribute to the open element
+    /// @param name the attribute name
+    /// @param value the unescaped value
+    void attribute(std::string_view name, std::string_view value)
+    {
+      m_buffer.push_back(' ');
+      m_buffer.append(name).append("=\"");
+      escapeAttribute(m_buffer, value);
+      m_buffer.push_back('"');
+    }
+    /// @brief add pre-escaped attributes to the open element
+    /// @param fragment attributes formatted as ` attr="value"`
+    void rawAttributes(std::string_view fragment) { m_buffer.append(fragment); }
+
+    /// @brief write text content escaping special characters
+    /// @param text the text
+    void text(std::string_view text)
+    {
+      startContent();
+      escapeText(m_buffer, text);
+    }
+    /// @brief write content escaping entities and non-ASCII characters as character references
+    /// @param text the text
+    void encodedText(std::string_view text)
+    {
+      startContent();
+      escapeEntities(m_buffer, text);
+    }
+    /// @brief write content as is
+    /// @param text the text
+    void raw(std::string_view text)
+    {
+      startContent();
+      m_buffer.append(text);
+    }
+
+    /// @brief escape an attribute value
+    /// @param[out] out the string to append to
+    /// @param[in] value the value to escape
+    static void escapeAttribute(std::string &out, std::string_view value);
+    /// @brief escape text content
+    /// @param[out] out the string to append to
+    /// @param[in] text the text to escape
+    static void escapeText(std::string &out, std::string_view text);
+    /// @brief escape entities and replace non-ASCII characters with character references
+    /// @param[out] out the string to append to
+    /// @param[in] text the text to escape
+    static void escapeEntities(std::string &out, std::string_view text);
+
+  protected:
+    void closeStartTag(bool newline)
+    {
+      if (m_open)
+      {
+        m_buffer.push_back('>');
+        if (newline && m_pretty)
+          m_buffer.push_back('\n');
+        m_open = false;
+      }
+    }
+    void startContent()
+    {
+      m_doIndent = false;
+      closeStartTag(false);
+    }
+    void indent()
+    {
+      if (m_pretty)
+        m_buffer.append((m_depth + m_elements.size() - 1) * 2, ' ');
+    }
+
+  protected:
+    std::string &m_buffer;
+    std::string m_names;             ///< Names of the open elements
+    std::vector<size_t> m_elements;  ///< Offset of each open element name in `m_names`
+    bool m_pretty;
+    size_t m_depth;
+    bool m_open {false};
+    bool m_doIndent {true};
+  };
+}  // namespace mtconnect::printer
@@ -19,7 +19,10 @@
 
 #include <boost/asio/ip/host_name.hpp>
 
+#include <cstring>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <typeindex>
 #include <typeinfo>
 #include <utility>
@@ -32,7 +35,9 @@
 #include "mtconnect/device_model/configuration/configuration.hpp"
 #include "mtconnect/device_model/device.hpp"
 #include "mtconnect/logging.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
 #include "mtconnect/version.h"
+#include "xml_direct_writer.hpp"
 #include "xml_printer.hpp"
 
 #define strfy(line) #line
@@ -100,7 +105,99 @@ namespace mtconnect::printer {
     xmlBufferPtr m_buf;
   };
 
-  XmlPrinter::XmlPrinter(bool pretty) : Printer(pretty) { NAMED_SCOPE("xml.printer"); }
+  using DataItem = device_model::data_item::DataItem;
+
+  /// @brief Observations are nested in the document, Streams, DeviceStream, ComponentStream and
+  /// category elements
+  constexpr int ObservationDepth = 5;
+
+  /// @brief Assets are nested in the document and the Assets element
+  constexpr int AssetDepth = 2;
+
+  /// @brief Pre-escaped element name and observation attributes of a data item
+  struct XmlPrinter::DataItemFragment
+  {
+    struct Attribute
+    {
+      string m_key;
+      string m_value;
+      string m_fragment;  ///< ` key="escaped value"`
+    };
+
+    weak_ptr<DataItem> m_owner;
+    entity::QName m_name;       ///< The observation name the element was created for
+    string m_element;           ///< The element name with undeclared namespaces removed
+    bool m_declaresNs {false};  ///< The element may need a namespace declaration
+    vector<Attribute> m_attributes;
+  };
+
+  /// @brief Pre-escaped stream elements of a component
+  struct XmlPrinter::ComponentFragment
+  {
+    weak_ptr<device_model::Component> m_owner;
+    string m_id;
+    string m_name;
+    optional<string> m_componentName;
+    optional<string> m_uuid;
+    string m_deviceStream;     ///< `DeviceStream name="..." uuid="..."`
+    string m_componentStream;  ///< `ComponentStream component="..." name="..." componentId="..."`
+  };
+
+  /// @brief Fragment caches for the data items and components of a streams document
+  struct XmlPrinter::StreamFragments
+  {
+    template <typename T, typename F, typename Make, typename Valid = nullptr_t>
+    shared_ptr<const F> get(unordered_map<const T *, shared_ptr<const F>> &map,
+                            const shared_ptr<T> &owner, Make make, Valid valid = nullptr)
+    {
+      {
+        shared_lock<shared_mutex> lock(m_lock);
+        auto it = map.find(owner.get());
+        if (it != map.end() && it->second->m_owner.lock() == owner)
+        {
+          if constexpr (is_same_v<Valid, nullptr_t>)
+            return it->second;
+          else if (valid(*it->second))
+            return it->second;
+        }
+      }
+
+      shared_ptr<const F> fragment = make();
+      unique_lock<shared_mutex> lock(m_lock);
+      for (auto it = map.begin(); it != map.end();)
+      {
+        if (it->second->m_owner.expired())
+          it = map.erase(it);
+        else
+          it++;
+      }
+      map.insert_or_assign(owner.get(), fragment);
+      return fragment;
+    }
+
+    void clear()
+    {
+      unique_lock<shared_mutex> lock(m_lock);
+      m_dataItems.clear();
+      m_components.clear();
+    }
+
+    shared_mutex m_lock;
+    unordered_map<const DataItem *, shared_ptr<const DataItemFragment>> m_dataItems;
+    unordered_map<const device_model::Component *, shared_ptr<const ComponentFragment>>
+        m_components;
+  };
+
+  XmlPrinter::XmlPrinter(bool pretty)
+    : Printer(pretty),
+      m_fragments(make_unique<StreamFragments>()),
+      m_fragmentKey(observation::FragmentCache::nextKey()),
+      m_assetFragmentKey(observation::FragmentCache::nextKey())
+  {
+    NAMED_SCOPE("xml.printer");
+  }
+
+  XmlPrinter::~XmlPrinter() = default;
 
   void XmlPrinter::addDevicesNamespace(const std::string &urn, const std::string &location,
                                        const std::string &prefix)
@@ -179,9 +276,16 @@ namespace mtconnect::printer {
     m_streamsNsSet.insert(prefix);
 
     m_streamsNamespaces.insert(item);
+    m_fragments->clear();
+    m_fragmentKey = observation::FragmentCache::nextKey();
   }
 
-  void XmlPrinter::clearStreamsNamespaces() { m_streamsNamespaces.clear(); }
+  void XmlPrinter::clearStreamsNamespaces()
+  {
+    m_streamsNamespaces.clear();
+    m_fragments->clear();
+    m_fragmentKey = observation::FragmentCache::nextKey();
+  }
 
   string XmlPrinter::getStreamsUrn(const std::string &prefix)
   {
@@ -212,9 +316,14 @@ namespace mtconnect::printer {
     m_assetNsSet.insert(prefix);
 
     m_assetNamespaces.insert(item);
+    m_assetFragmentKey = observation::FragmentCache::nextKey();
   }
 
-  void XmlPrinter::clearAssetsNamespaces() { m_assetNamespaces.clear(); }
+  void XmlPrinter::clearAssetsNamespaces()
+  {
+    m_assetNamespaces.clear();
+    m_assetFragmentKey = observation::FragmentCache::nextKey();
+  }
 
   string XmlPrinter::getAssetsUrn(const std::string &prefix)
   {
@@ -339,6 +448,49 @@ namespace mtconnect::printer {
     }
   }
 
+  static inline void addAttribute(XmlDirectWriter &writer, const char *key,
+                                  const std::string &value)
+  {
+    if (!value.empty())
+      writer.attribute(key, value);
+  }
+
+  static inline void openElement(XmlDirectWriter &writer, const char *name)
+  {
+    writer.startElement(name);
+  }
+
+  static inline void closeElement(XmlDirectWriter &writer) { writer.endElement(); }
+
+  void addSimpleElement(XmlDirectWriter &writer, const string &element, const string &body,
+                        const map<string, string> &attributes = {})
+  {
+    writer.startElement(element);
+    for (const auto &attr : attributes)
+      addAttribute(writer, attr.first.c_str(), attr.second);
+    if (!body.empty())
+      writer.encodedText(body);
+    writer.endElement();
+  }
+
+  static inline void startDocument(xmlTextWriterPtr writer)
+  {
+    THROW_IF_XML2_ERROR(xmlTextWriterStartDocument(writer, nullptr, "UTF-8", nullptr));
+  }
+
+  static inline void startDocument(XmlDirectWriter &writer) { writer.startDocument(); }
+
+  static inline void processingInstruction(xmlTextWriterPtr writer, const string &pi)
+  {
+    THROW_IF_XML2_ERROR(xmlTextWriterStartPI(writer, BAD_CAST pi.c_str()));
+    THROW_IF_XML2_ERROR(xmlTextWriterEndPI(writer));
+  }
+
+  static inline void processingInstruction(XmlDirectWriter &writer, const string &pi)
+  {
+    writer.processingInstruction(pi);
+  }
+
   std::string XmlPrinter::printErrors(const uint64_t instanceId, const unsigned int bufferSize,
                                       const uint64_t nextSeq, const ProtoErrorList &list,
                                       bool pretty) const
@@ -418,77 +570,106 @@ namespace mtconnect::printer {
                                  const uint64_t lastSeq, ObservationList &observations,
                                  bool pretty) const
   {
-    string ret;
+    // Start with a pooled buffer the size of the last document so the buffer rarely grows
+    string ret = BufferPool::global().take(m_sampleSize.load(std::memory_order_relaxed));
 
     try
     {
-      XmlWriter writer(m_pretty || pretty);
+      const bool formatted = m_pretty || pretty;
+      XmlDirectWriter writer(ret, formatted);
+      const auto format =
+          formatted ? observation::FragmentCache::XML_PRETTY : observation::FragmentCache::XML;
+      const uint64_t key = m_fragmentKey;
+      string text;
 
       initXmlDoc(writer, eSTREAMS, instanceId, bufferSize, 0, 0, nextSeq, firstSeq, lastSeq);
 
-      AutoElement streams(writer, "Streams");
+      writer.startElement("Streams");
 
       // Sort the vector by category.
       if (observations.size() > 0)
       {
-        observations.sort(ObservationCompare);
+        SortObservations(observations);
 
-        AutoElement deviceElement(writer);
+        string deviceId, componentId;
+        const char *category = nullptr;
+        int open = 0;
+
+        for (auto &observation : observations)
         {
-          AutoElement componentStreamElement(writer);
+          if (!observation->isOrphan())
           {
-            AutoElement categoryElement(writer);
+            const auto &dataItem = observation->getDataItem();
+            const auto &component = dataItem->getComponent();
+            const auto &device = component->getDevice();
+
+            if (open < 1 || deviceId != device->getId())
+            {
+              for (; open > 0; open--)
+                writer.endElement();
+
+              auto fragment = componentFragment(device);
+              writer.startElementRaw(fragment->m_deviceStream, "DeviceStream");
+              deviceId = device->getId();
+              open = 1;
+            }
 
-            for (auto &observation : observations)
+            if (open < 2 || componentId != component->getId())
             {
-              if (!observation->isOrphan())
-              {
-                const auto &dataItem = observation->getDataItem();
-                const auto &component = dataItem->getComponent();
-                const auto &device = component->getDevice();
-
-                if (deviceElement.key() != device->getId())
-                {
-                  categoryElement.reset("");
-                  componentStreamElement.reset("");
-
-                  deviceElement.reset("DeviceStream", device->getId());
-                  addAttribute(writer, "name", *device->getComponentName());
-                  addAttribute(writer, "uuid", *device->getUuid());
-                }
-
-                if (componentStreamElement.key() != component->getId())
-                {
-                  categoryElement.reset("");
-
-                  componentStreamElement.reset("ComponentStream", component->getId());
-                  addAttribute(writer, "component", component->getName());
-                  if (component->getComponentName())
-                    addAttribute(writer, "name", *component->getComponentName());
-                  addAttribute(writer, "componentId", component->getId());
-                }
-
-                categoryElement.reset(dataItem->getCategoryText());
-
-                addObservation(writer, observation);
-              }
+              for (; open > 1; open--)
+                writer.endElement();
+
+              auto fragment = componentFragment(component);
+              writer.startElementRaw(fragment->m_componentStream, "ComponentStream");
+              componentId = component->getId();
+              open = 2;
+            }
+
+            if (open < 3 || strcmp(category, dataItem->getCategoryText()) != 0)
+            {
+              if (open > 2)
+                writer.endElement();
+
+              category = dataItem->getCategoryText();
+              writer.startElement(category);
+              open = 3;
+            }
+
+            // Observations are rendered once and shared by every document that contains them
+            const auto &fragments = observation->getFragments();
+            if (auto fragment = fragments.get(format, key))
+            {
+              writer.element(fragment->m_text);
+            }
+            else
+            {
+              text.clear();
+              XmlDirectWriter element(text, formatted, ObservationDepth);
+              addObservation(element, observation, dataItem);
+              writer.element(text);
+              fragments.put(format, key, text);
             }
           }
         }
+
+        for (; open > 0; open--)
+          writer.endElement();
       }
 
-      streams.reset("");
-      closeElement(writer);  // MTConnectStreams
+      writer.endElement();  // Streams
+      writer.endDocument();
 
-      ret = writer.getContent();
+      m_sampleSize.store(ret.size(), std::memory_order_relaxed);
     }
     catch (string error)
     {
       LOG(error) << "printSample: " << error;
+      ret.clear();
     }
     catch (...)
     {
       LOG(error) << "printSample: unknown error";
+      ret.clear();
     }
 
     return ret;
@@ -498,49 +679,229 @@ namespace mtconnect::printer {
                                  const unsigned int assetCount, const AssetList &asset,
                                  bool pretty) const
   {
-    string ret;
+    string ret = BufferPool::global().take();
     try
     {
-      XmlWriter writer(m_pretty || pretty);
+      const bool formatted = m_pretty || pretty;
+      XmlDirectWriter writer(ret, formatted);
+      const auto format =
+          formatted ? observation::FragmentCache::XML_PRETTY : observation::FragmentCache::XML;
+      const uint64_t key = m_assetFragmentKey;
+      entity::XmlPrinter printer;
+      string text;
+
       initXmlDoc(writer, eASSETS, instanceId, 0u, bufferSize, assetCount, 0ull);
 
+      writer.startElement("Assets");
+      for (const auto &asset : asset)
       {
-        AutoElement ele(writer, "Assets");
-        entity::XmlPrinter printer;
-
-        for (const auto &asset : asset)
+        // Assets are rendered once and shared until they change
+        const auto &fragments = asset->getFragments();
+        if (auto fragment = fragments.get(format, key))
+        {
+          writer.element(fragment->m_text);
+        }
+        else
         {
-          printer.print(writer, asset, m_assetNsSet);
+          auto generation = fragments.generation();
+          text.clear();
+          XmlDirectWriter element(text, formatted, AssetDepth);
+          printer.print(element, asset, m_assetNsSet);
+          writer.element(text);
+          fragments.put(format, key, text, generation);
         }
       }
-
-      ret = writer.getContent();
+      writer.endElement();  // Assets
+      writer.endDocument();
     }
     catch (string error)
     {
       LOG(error) << "printAssets: " << error;
+      ret.clear();
     }
     catch (...)
     {
       LOG(error) << "printAssets: unknown error";
+      ret.clear();
     }
 
     return ret;
   }
 
-  void XmlPrinter::addObservation(xmlTextWriterPtr writer, ObservationPtr result) const
+  shared_ptr<const XmlPrinter::ComponentFragment> XmlPrinter::componentFragment(
+      const device_model::ComponentPtr &component) const
+  {
+    using Fragment = ComponentFragment;
+    return m_fragments->get(
+        m_fragments->m_components, component,
+        [&component]() {
+          auto fragment = make_shared<Fragment>();
+          fragment->m_owner = component;
+          fragment->m_id = component->getId();
+          fragment->m_name = component->getName();
+          fragment->m_componentName = component->getComponentName();
+          fragment->m_uuid = component->getUuid();
+
+          auto attribute = [](string &out, const char *key, const string &value) {
+            if (!value.empty())
+            {
+              out.append(" ").append(key).append("=\"");
+              XmlDirectWriter::escapeAttribute(out, value);
+              out.push_back('"');
+            }
+          };
+
+          fragment->m_deviceStream = "DeviceStream";
+          if (fragment->m_componentName)
+            attribute(fragment->m_deviceStream, "name", *fragment->m_componentName);
+          if (fragment->m_uuid)
+            attribute(fragment->m_deviceStream, "uuid", *fragment->m_uuid);
+
+          fragment->m_componentStream = "ComponentStream";
+          attribute(fragment->m_componentStream, "component", fragment->m_name);
+          if (fragment->m_componentName)
+            attribute(fragment->m_componentStream, "name", *fragment->m_componentName);
+          attribute(fragment->m_componentStream, "componentId", fragment->m_id);
+
+          return fragment;
+        },
+        [&component](const Fragment &fragment) {
+          return fragment.m_id == component->getId() && fragment.m_name == component->getName() &&
+                 fragment.m_componentName == component->getComponentName() &&
+                 fragment.m_uuid == component->getUuid();
+        });
+  }
+
+  shared_ptr<const XmlPrinter::DataItemFragment> XmlPrinter::dataItemFragment(
+      const DataItemPtr &dataItem) const
+  {
+    using Fragment = DataItemFragment;
+    return m_fragments->get(m_fragments->m_dataItems, dataItem, [this, &dataItem]() {
+      auto fragment = make_shared<Fragment>();
+      fragment->m_owner = dataItem;
+      fragment->m_name = dataItem->getObservationName();
+
+      const auto &name = fragment->m_name;
+      if (name.hasNs() && m_streamsNsSet.count(string(name.getNs())) == 0)
+      {
+        fragment->m_element = name.getName();
+        fragment->m_declaresNs = true;
+      }
+      else
+      {
+        fragment->m_element = name;
+      }
+
+      for (const auto &prop : dataItem->getObservationProperties())
+      {
+        if (holds_alternative<string>(prop.second))
+        {
+          DataItemFragment::Attribute attr {prop.first, get<string>(prop.second), " "};
+          attr.m_fragment.append(prop.first).append("=\"");
+          XmlDirectWriter::escapeAttribute(attr.m_fragment, attr.m_value);
+          attr.m_fragment.push_back('"');
+          fragment->m_attributes.emplace_back(std::move(attr));
+        }
+      }
+
+      return fragment;
+    });
+  }
+
+  void XmlPrinter::cacheObservation(const ObservationPtr &observation, bool pretty) const
   {
+    const bool formatted = m_pretty || pretty;
+    const auto format =
+        formatted ? observation::FragmentCache::XML_PRETTY : observation::FragmentCache::XML;
+    const auto &fragments = observation->getFragments();
+    if (observation->isOrphan() || fragments.get(format, m_fragmentKey))
+      return;
+
+    thread_local string text;
+    text.clear();
+    XmlDirectWriter element(text, formatted, ObservationDepth);
+    addObservation(element, observation, observation->getDataItem());
+    fragments.put(format, m_fragmentKey, text);
+  }
+
+  void XmlPrinter::addObservation(XmlDirectWriter &writer, const ObservationPtr &observation,
+                                  const DataItemPtr &dataItem) const
+  {
+    auto fragment = dataItemFragment(dataItem);
+    const auto &name = observation->getName();
+
+    // Observations that may declare their own namespace or order their elements are rare, let
+    // the entity printer handle them.
+    if (observation->getOrder() || (name == fragment->m_name && fragment->m_declaresNs) ||
+        (name != fragment->m_name && name.hasNs()))
+    {
+      entity::XmlPrinter printer;
+      printer.print(writer, observation, m_streamsNsSet);
+      return;
+    }
+
+    writer.startElement(name == fragment->m_name ? fragment->m_element : name);
+
+    // Attributes are printed in property order, the same as the entity printer
+    const auto &properties = observation->getProperties();
+    const auto &attrs = observation->getAttributes();
+    auto isAttribute = [&attrs](const entity::PropertyKey &key) {
+      return islower(key.getName()[0]) || attrs.count(key) > 0;
+    };
+
+    string temp;
+    for (const auto &prop : properties)
+    {
+      const auto &key = prop.first;
+      if (observation->isHidden(key) || !isAttribute(key))
+        continue;
+
+      if (key.hasNs() && key.getNs() == "xmlns" &&
+          m_streamsNsSet.count(string(key.getName())) > 0)
+        continue;
+
+      const string *value = get_if<string>(&prop.second);
+      if (value != nullptr)
+      {
+        auto cached = find_if(
+            fragment->m_attributes.begin(), fragment->m_attributes.end(),
+            [&key](const DataItemFragment::Attribute &attr) { return attr.m_key == key; });
+        if (cached != fragment->m_attributes.end() && cached->m_value == *value)
+        {
+          writer.rawAttributes(cached->m_fragment);
+          continue;
+        }
+      }
+      else
+      {
+        entity::Value conv = prop.second;
+        entity::ConvertValueToType(conv, entity::STRING);
+        temp = get<string>(conv);
+        value = &temp;
+      }
+
+      writer.attribute(key, *value);
+    }
+
     entity::XmlPrinter printer;
-    printer.print(writer, result, m_streamsNsSet);
+    printer.setSignificantDigits(dataItem->getSignificantDigits());
+    for (const auto &prop : properties)
+    {
+      if (!observation->isHidden(prop.first) && !isAttribute(prop.first))
+        printer.printElement(writer, prop, m_streamsNsSet);
+    }
+
+    writer.endElement();
   }
 
-  void XmlPrinter::initXmlDoc(xmlTextWriterPtr writer, EDocumentType aType,
-                              const uint64_t instanceId, const unsigned int bufferSize,
-                              const unsigned int assetBufferSize, const unsigned int assetCount,
-                              const uint64_t nextSeq, const uint64_t firstSeq,
-                              const uint64_t lastSeq, const map<string, size_t> *count) const
+  template <typename W>
+  void XmlPrinter::initXmlDoc(W &writer, EDocumentType aType, const uint64_t instanceId,
+                              const unsigned int bufferSize, const unsigned int assetBufferSize,
+                              const unsigned int assetCount, const uint64_t nextSeq,
+                              const uint64_t firstSeq, const uint64_t lastSeq,
+                              const map<string, size_t> *count) const
   {
-    THROW_IF_XML2_ERROR(xmlTextWriterStartDocument(writer, nullptr, "UTF-8", nullptr));
+    startDocument(writer);
 
     // TODO: Cache the locations and header attributes.
     // Write the root element
@@ -577,8 +938,7 @@ namespace mtconnect::printer {
     if (!style.empty())
     {
       string pi = R"(xml-stylesheet type="text/xsl" href=")" + style + '"';
-      THROW_IF_XML2_ERROR(xmlTextWriterStartPI(writer, BAD_CAST pi.c_str()));
-      THROW_IF_XML2_ERROR(xmlTextWriterEndPI(writer));
+      processingInstruction(writer, pi);
     }
 
     string rootName = "MTConnect" + xmlType;
@@ -630,7 +990,7 @@ namespace mtconnect::printer {
     addAttribute(writer, "xsi:schemaLocation", location);
 
     // Create the header
-    AutoElement header(writer, "Header");
+    openElement(writer, "Header");
 
     addAttribute(writer, "creationTime", getCurrentTime(GMT));
 
@@ -681,12 +1041,16 @@ namespace mtconnect::printer {
 
     if (major < 2 && aType == eDEVICES && count && !count->empty())
     {
-      AutoElement ele(writer, "AssetCounts");
+      openElement(writer, "AssetCounts");
 
       for (const auto &pair : *count)
       {
         addSimpleElement(writer, "AssetCount", to_string(pair.second), {{"assetType", pair.first}});
       }
+
+      closeElement(writer);  // AssetCounts
     }
+
+    closeElement(writer);  // Header
   }
 }  // namespace mtconnect::printer
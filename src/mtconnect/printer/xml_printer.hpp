@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <unordered_set>
 
 #include "mtconnect/asset/asset.hpp"
@@ -35,13 +37,14 @@ namespace mtconnect {
 
   namespace printer {
     class XmlWriter;
+    class XmlDirectWriter;
 
     /// @brief Printer to generate XML Documents
     class AGENT_LIB_API XmlPrinter : public Printer
     {
     public:
       XmlPrinter(bool pretty = false);
-      ~XmlPrinter() override = default;
+      ~XmlPrinter() override;
 
       std::string printErrors(const uint64_t instanceId, const unsigned int bufferSize,
                               const uint64_t nextSeq, const ProtoErrorList &list,
@@ -61,6 +64,9 @@ namespace mtconnect {
                               const unsigned int assetCount, const asset::AssetList &asset,
                               bool pretty = false) const override;
       std::string mimeType() const override { return "text/xml"; }
+      bool cachesObservations(bool pretty = false) const override { return true; }
+      void cacheObservation(const observation::ObservationPtr &observation,
+                            bool pretty = false) const override;
 
       /// @brief Add a Devices XML device namespace
       /// @param urn the namespace URN
@@ -111,6 +117,7 @@ namespace mtconnect {
       void clearStreamsNamespaces();
       /// @brief remove all Assets namespaces
       void clearAssetsNamespaces();
+
       ///@}
 
       /// @brief Get the Devices URN for a prefix
@@ -162,8 +169,13 @@ namespace mtconnect {
         std::string mSchemaLocation;
       };
 
+      struct DataItemFragment;
+      struct ComponentFragment;
+      struct StreamFragments;
+
       // Initiate all documents
-      void initXmlDoc(xmlTextWriterPtr writer, EDocumentType docType, const uint64_t instanceId,
+      template <typename W>
+      void initXmlDoc(W &writer, EDocumentType docType, const uint64_t instanceId,
                       const unsigned int bufferSize, const unsigned int assetBufferSize,
                       const unsigned int assetCount, const uint64_t nextSeq,
                       const uint64_t firstSeq = 0, const uint64_t lastSeq = 0,
@@ -173,7 +185,14 @@ namespace mtconnect {
       void printProbeHelper(xmlTextWriterPtr writer, device_model::ComponentPtr component,
                             const char *name) const;
       void printDataItem(xmlTextWriterPtr writer, DataItemPtr dataItem) const;
-      void addObservation(xmlTextWriterPtr writer, observation::ObservationPtr result) const;
+
+      // Direct streams printing with cached fragments
+      void addObservation(XmlDirectWriter &writer, const observation::ObservationPtr &observation,
+                          const DataItemPtr &dataItem) const;
+      std::shared_ptr<const ComponentFragment> componentFragment(
+          const device_model::ComponentPtr &component) const;
+      std::shared_ptr<const DataItemFragment> dataItemFragment(
+          const DataItemPtr &dataItem) const;
 
     protected:
       std::map<std::string, SchemaNamespace> m_devicesNamespaces;
@@ -190,6 +209,11 @@ namespace mtconnect {
       std::string m_devicesStyle;
       std::string m_errorStyle;
       std::string m_assetStyle;
+
+      std::unique_ptr<StreamFragments> m_fragments;
+      mutable std::atomic<size_t> m_sampleSize {0};
+      std::atomic<uint64_t> m_fragmentKey;       ///< Key for observation fragments
+      std::atomic<uint64_t> m_assetFragmentKey;  ///< Key for asset fragments
     };
   }  // namespace printer
 }  // namespace mtconnect
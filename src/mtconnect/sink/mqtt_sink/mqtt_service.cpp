@@ -17,11 +17,22 @@
 
 #include "mqtt_service.hpp"
 
+#include <boost/algorithm/string/join.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include "mtconnect/configuration/config_options.hpp"
 #include "mtconnect/entity/entity.hpp"
 #include "mtconnect/entity/factory.hpp"
 #include "mtconnect/entity/json_parser.hpp"
 #include "mtconnect/mqtt/mqtt_client_impl.hpp"
+#include "mtconnect/mqtt/mqtt_local_client.hpp"
+#include "mtconnect/mqtt/mqtt_server_impl.hpp"
+#include "mtconnect/printer/cbor_printer.hpp"
 #include "mtconnect/printer/json_printer.hpp"
 
 using ptree = boost::property_tree::ptree;
@@ -41,49 +52,87 @@ namespace mtconnect {
 
       MqttService::MqttService(boost::asio::io_context &context, sink::SinkContractPtr &&contract,
                                const ConfigOptions &options, const ptree &config)
-        : Sink("MqttService", std::move(contract)), m_context(context), m_options(options)
+        : Sink("MqttService", std::move(contract)),
+          m_context(context),
+          m_strand(context),
+          m_batchTimer(context),
+          m_snapshotTimer(context),
+          m_options(options)
       {
-        auto jsonPrinter = dynamic_cast<printer::JsonPrinter *>(m_sinkContract->getPrinter("json"));
-        m_jsonPrinter = make_unique<entity::JsonEntityPrinter>(jsonPrinter->getJsonVersion());
-
         GetOptions(config, m_options, options);
         AddOptions(config, m_options,
                    {{configuration::MqttCaCert, string()},
                     {configuration::MqttPrivateKey, string()},
                     {configuration::MqttCert, string()},
-                    {configuration::MqttClientId, string()}});
+                    {configuration::MqttClientId, string()},
+                    {configuration::MqttSpoolDirectory, string()},
+                    {configuration::MqttTopicAliasMaximum, 0}});
         AddDefaultedOptions(config, m_options,
                             {{configuration::MqttHost, "127.0.0.1"s},
                              {configuration::DeviceTopic, "MTConnect/Device/"s},
                              {configuration::AssetTopic, "MTConnect/Asset/"s},
                              {configuration::ObservationTopic, "MTConnect/Observation/"s},
                              {configuration::MqttPort, 1883},
-                             {configuration::MqttTls, false}});
+                             {configuration::MqttTls, false},
+                             {configuration::MqttFormat, "json"s},
+                             {configuration::DeviceQoS, 1},
+                             {configuration::AssetQoS, 1},
+                             {configuration::ObservationQoS, 1},
+                             {configuration::DeviceRetain, true},
+                             {configuration::AssetRetain, true},
+                             {configuration::ObservationRetain, true},
+                             {configuration::DeviceMaxInflight, 0},
+                             {configuration::AssetMaxInflight, 0},
+                             {configuration::ObservationMaxInflight, 0},
+                             {configuration::ObservationMaxPending, 10000},
+                             {configuration::ObservationBatchInterval, 0ms},
+                             {configuration::ObservationBatchTopic, "device"s},
+                             {configuration::SnapshotPublishRate, 5000},
+                             {configuration::MqttSpoolSize, "64M"s},
+                             {configuration::MqttSpoolReplayRate, 1000},
+                             {configuration::MqttConnections, 1},
+                             {configuration::MqttEmbeddedBroker, false},
+                             {configuration::MqttProtocolVersion, 3},
+                             {configuration::ObservationExpiry, 0s},
+                             {configuration::ObservationShardBy, "device"s},
+                             {configuration::SparkplugGroupId, "MTConnect"s}});
+        AddOptions(config, m_options, {{configuration::SparkplugNodeId, string()}});
+
+        const auto &format = get<string>(m_options[configuration::MqttFormat]);
+        if (format == "sparkplug")
+        {
+          m_sparkplug = make_unique<SparkplugPrinter>();
+          m_sparkplugPrefix =
+              "spBv1.0/"s + get<string>(m_options[configuration::SparkplugGroupId]) + '/';
+        }
 
-        auto clientHandler = make_unique<ClientHandler>();
-        clientHandler->m_connected = [this](shared_ptr<MqttClient> client) {
-          // Publish latest devices, assets, and observations
-          auto &circ = m_sinkContract->getCircularBuffer();
-          std::lock_guard<buffer::CircularBuffer> lock(circ);
-          client->connectComplete();
+        if (format == "cbor" || m_sparkplug)
+        {
+          m_jsonPrinter = make_unique<printer::CborEntityPrinter>();
+        }
+        else
+        {
+          auto jsonPrinter =
+              dynamic_cast<printer::JsonPrinter *>(m_sinkContract->getPrinter("json"));
+          m_jsonPrinter = make_unique<entity::JsonEntityPrinter>(jsonPrinter->getJsonVersion());
+        }
 
-          for (auto &dev : m_sinkContract->getDevices())
-          {
-            publish(dev);
-          }
+        auto connected = [this](shared_ptr<MqttClient> client) {
+          client->connectComplete();
+          if (m_sparkplug && client == m_client)
+            publishNodeBirth();
 
-          auto obsList {circ.getLatest().getObservations()};
-          for (auto &obs : obsList)
+          // Each connection publishes independently. The spooled observations are older than the
+          // snapshot, so they are replayed first. The snapshot skips the connections that are
+          // down, they are brought up to date when they connect.
+          if (m_spool && !m_spool->empty())
           {
-            observation::ObservationPtr p {obs.second};
-            publish(p);
+            auto generation = ++m_snapshotGeneration;
+            asio::post(m_strand, [this, generation]() { replaySpoolPage(generation); });
           }
-
-          AssetList list;
-          m_sinkContract->getAssetStorage()->getAssets(list, 100000);
-          for (auto &asset : list)
+          else
           {
-            publish(asset);
+            publishSnapshot();
           }
         };
 
@@ -91,34 +140,441 @@ namespace mtconnect {
         m_assetPrefix = get<string>(m_options[configuration::AssetTopic]);
         m_observationPrefix = get<string>(m_options[configuration::ObservationTopic]);
 
-        if (IsOptionSet(m_options, configuration::MqttTls))
+        auto topicClass = [this](TopicClass &topics, const char *qos, const char *retain,
+                                 const char *maxInflight) {
+          topics.m_options.m_qos = uint8_t(std::clamp(get<int>(m_options[qos]), 0, 2));
+          topics.m_options.m_retain = IsOptionSet(m_options, retain);
+          topics.m_maxInflight = size_t(std::max(get<int>(m_options[maxInflight]), 0));
+        };
+        topicClass(m_deviceTopics, configuration::DeviceQoS, configuration::DeviceRetain,
+                   configuration::DeviceMaxInflight);
+        topicClass(m_assetTopics, configuration::AssetQoS, configuration::AssetRetain,
+                   configuration::AssetMaxInflight);
+
+        m_snapshotRate =
+            size_t(std::max(get<int>(m_options[configuration::SnapshotPublishRate]), 0));
+        m_batchInterval = get<Milliseconds>(m_options[configuration::ObservationBatchInterval]);
+        m_batchByComponent =
+            get<string>(m_options[configuration::ObservationBatchTopic]) == "component";
+
+        auto spoolDirectory = GetOption<string>(m_options, configuration::MqttSpoolDirectory);
+        if (spoolDirectory && !spoolDirectory->empty())
         {
-          m_client = make_shared<MqttTlsClient>(m_context, m_options, std::move(clientHandler));
+          // Sparkplug data carries the sequence of the current connection
+          if (m_sparkplug)
+          {
+            LOG(warning) << "MqttService: MqttSpoolDirectory is ignored for the sparkplug format";
+          }
+          else
+          {
+            try
+            {
+              auto size = ConvertFileSize(m_options, configuration::MqttSpoolSize,
+                                          64 * 1024 * 1024);
+              m_spool = make_unique<MqttSpool>(*spoolDirectory, size_t(size));
+            }
+            catch (std::exception &e)
+            {
+              LOG(error) << "MqttService: cannot open the spool in " << *spoolDirectory << ": "
+                         << e.what();
+            }
+          }
         }
-        else
+        m_spoolReplayRate =
+            size_t(std::max(get<int>(m_options[configuration::MqttSpoolReplayRate]), 0));
+
+        // Sparkplug data carries one sequence for the node, so it cannot be sharded
+        auto connections = std::max(get<int>(m_options[configuration::MqttConnections]), 1);
+        if (m_sparkplug && connections > 1)
         {
-          m_client = make_shared<MqttTcpClient>(m_context, m_options, std::move(clientHandler));
+          LOG(warning) << "MqttService: MqttConnections is ignored for the sparkplug format";
+          connections = 1;
+        }
+        m_shardByDevice = get<string>(m_options[configuration::ObservationShardBy]) != "dataItem";
+
+        // The agent is the broker, the sink publishes to it without a connection
+        if (IsOptionSet(m_options, configuration::MqttEmbeddedBroker))
+        {
+          if (connections > 1)
+          {
+            LOG(warning) << "MqttService: MqttConnections is ignored for the embedded broker";
+            connections = 1;
+          }
+
+          ConfigOptions options(m_options);
+          options[configuration::ServerIp] = m_options[configuration::MqttHost];
+          if (IsOptionSet(m_options, configuration::MqttTls))
+          {
+            // The TLS server listens on the Port option
+            options[configuration::Port] = m_options[configuration::MqttPort];
+            m_server = make_shared<mqtt_server::MqttTlsServer>(m_context, options);
+          }
+          else
+          {
+            m_server = make_shared<mqtt_server::MqttTcpServer>(m_context, options);
+          }
+        }
+
+        for (int i = 0; i < connections; i++)
+        {
+          auto clientHandler = make_unique<ClientHandler>();
+          clientHandler->m_connected = connected;
+
+          // The broker closes a connection when another connects with the same client id
+          ConfigOptions options(m_options);
+          if (i > 0)
+            options[configuration::MqttClientId] = m_client->getIdentity() + '_' + to_string(i);
+
+          shared_ptr<MqttClient> client;
+          if (m_server)
+          {
+            client = make_shared<MqttLocalClient>(m_context, m_server, options,
+                                                  std::move(clientHandler));
+          }
+          else if (IsOptionSet(m_options, configuration::MqttTls))
+          {
+            client = make_shared<MqttTlsClient>(m_context, options, std::move(clientHandler));
+          }
+          else
+          {
+            client = make_shared<MqttTcpClient>(m_context, options, std::move(clientHandler));
+          }
+          if (i == 0)
+            m_client = client;
+          m_clients.emplace_back(client);
+
+          auto topics = make_unique<TopicClass>();
+          topicClass(*topics, configuration::ObservationQoS, configuration::ObservationRetain,
+                     configuration::ObservationMaxInflight);
+          topics->m_options.m_expiry = get<Seconds>(m_options[configuration::ObservationExpiry]);
+          topics->m_maxPending =
+              size_t(std::max(get<int>(m_options[configuration::ObservationMaxPending]), 0));
+          topics->m_client = client;
+          topics->m_spooled = bool(m_spool);
+          m_observationTopics.emplace_back(std::move(topics));
+        }
+        m_deviceTopics.m_client = m_client;
+        m_assetTopics.m_client = m_client;
+
+        if (m_sparkplug)
+        {
+          auto node = GetOption<string>(m_options, configuration::SparkplugNodeId);
+          m_sparkplugNode = node && !node->empty() ? *node : m_client->getIdentity();
+
+          string death;
+          m_sparkplug->printNodeDeath(m_bdSeq, death);
+          m_client->setWill(sparkplugTopic("NDEATH"), death, {1, false});
         }
       }
 
       void MqttService::start()
       {
-        // mqtt client side not a server side...
-        if (!m_client)
+        if (m_server && !m_server->start())
+        {
+          LOG(error) << "MqttService: cannot start the embedded broker";
           return;
+        }
 
-        m_client->start();
+        for (auto &client : m_clients)
+          client->start();
       }
 
       void MqttService::stop()
       {
-        // stop client side
-        if (m_client)
-          m_client->stop();
+        // stop client side, the timers are only used on the strand
+        asio::post(m_strand, [this]() {
+          m_batchTimer.cancel();
+          m_snapshotTimer.cancel();
+        });
+        m_snapshotGeneration++;
+
+        // The broker only publishes the will if the connection is lost
+        if (m_sparkplug && isConnected())
+        {
+          auto death = printer::BufferPool::global().acquire();
+          m_sparkplug->printNodeDeath(m_bdSeq - 1, *death);
+          m_client->publish(sparkplugTopic("NDEATH"), death, {1, false}, nullptr);
+        }
+
+        for (auto &client : m_clients)
+          client->stop();
+
+        if (m_server)
+          m_server->stop();
+
+        if (m_spool)
+          m_spool->flush();
+      }
+
+      void MqttService::publishNodeBirth()
+      {
+        // The birth and its will share the sequence number of the connection
+        auto bdSeq = m_bdSeq++;
+        auto birth = printer::BufferPool::global().acquire();
+        m_sparkplug->printNodeBirth(bdSeq, *birth);
+        send(m_deviceTopics, sparkplugTopic("NBIRTH"), birth);
+
+        string death;
+        m_sparkplug->printNodeDeath(bdSeq + 1, death);
+        m_client->setWill(sparkplugTopic("NDEATH"), death, {1, false});
       }
 
       std::shared_ptr<MqttClient> MqttService::getClient() { return m_client; }
 
+      std::vector<ConnectionMetrics> MqttService::getConnectionMetrics()
+      {
+        std::vector<ConnectionMetrics> metrics;
+        for (size_t i = 0; i < m_clients.size(); i++)
+        {
+          auto &topics = *m_observationTopics[i];
+          ConnectionMetrics m;
+          m.m_identity = m_clients[i]->getIdentity();
+          m.m_connected = m_clients[i]->isConnected();
+          m.m_published = topics.m_published;
+          m.m_failed = topics.m_failed;
+          m.m_dropped = topics.m_dropped;
+          {
+            std::lock_guard<std::mutex> lock(topics.m_mutex);
+            m.m_inflight = topics.m_inflight;
+            m.m_pending = topics.m_pending.size();
+          }
+
+          // The devices and assets are published on the first connection
+          if (i == 0)
+          {
+            m.m_published += m_deviceTopics.m_published + m_assetTopics.m_published;
+            m.m_failed += m_deviceTopics.m_failed + m_assetTopics.m_failed;
+          }
+          metrics.emplace_back(m);
+        }
+
+        return metrics;
+      }
+
+      MqttService::TopicClass &MqttService::observationTopics(const std::string &topic)
+      {
+        if (m_observationTopics.size() == 1)
+          return *m_observationTopics.front();
+
+        string_view key(topic);
+        if (m_shardByDevice && key.size() > m_observationPrefix.size())
+        {
+          auto end = key.find('/', m_observationPrefix.size());
+          if (end != string_view::npos)
+            key = key.substr(0, end);
+        }
+
+        return *m_observationTopics[hash<string_view>()(key) % m_observationTopics.size()];
+      }
+
+      std::string MqttService::observationTopic(const DataItemPtr &dataItem) const
+      {
+        if (m_sparkplug)
+        {
+          return sparkplugTopic("DDATA", &*dataItem->getComponent()->getDevice()->getUuid());
+        }
+        else if (m_batchInterval.count() == 0)
+        {
+          return m_observationPrefix + dataItem->getTopic();
+        }
+        else if (m_batchByComponent)
+        {
+          std::list<std::string> path;
+          dataItem->getComponent()->path(path);
+          return m_observationPrefix + boost::algorithm::join(path, "/");
+        }
+        else
+        {
+          return m_observationPrefix + *dataItem->getComponent()->getDevice()->getUuid();
+        }
+      }
+
+      void MqttService::publishSnapshot()
+      {
+        // Only the checkpoint is copied while ingest is blocked, the observations are
+        // published from the copy
+        auto snapshot = make_shared<Snapshot>();
+        snapshot->m_generation = ++m_snapshotGeneration;
+        {
+          auto &circ = m_sinkContract->getCircularBuffer();
+          std::unique_lock<buffer::CircularBuffer> lock(circ);
+          buffer::Checkpoint latest(circ.getLatest());
+          lock.unlock();
+
+          // The device births carry the current values of their data items
+          if (!m_sparkplug)
+          {
+            snapshot->m_observations.reserve(latest.getObservations().size());
+            for (auto &obs : latest.getObservations())
+              snapshot->m_observations.emplace_back(obs.second);
+          }
+        }
+
+        snapshot->m_devices = m_sinkContract->getDevices();
+        {
+          AssetList assets;
+          auto storage = m_sinkContract->getAssetStorage();
+          storage->getAssets(assets, storage->getMaxAssets());
+          for (auto &asset : assets)
+            snapshot->m_assetIds.emplace_back(asset->getAssetId());
+        }
+
+        asio::post(m_strand, [this, snapshot]() { publishSnapshotPage(snapshot); });
+      }
+
+      void MqttService::publishSnapshotPage(std::shared_ptr<Snapshot> snapshot)
+      {
+        NAMED_SCOPE("MqttService::publishSnapshotPage");
+
+        // A newer connection replaces the snapshot
+        if (snapshot->m_generation != m_snapshotGeneration)
+          return;
+
+        // The devices and assets are published on the first connection
+        if (!m_client->isConnected())
+        {
+          snapshot->m_devices.clear();
+          snapshot->m_assetIds.clear();
+        }
+
+        // Publish a tenth of the rate every 100ms
+        constexpr auto interval = 100ms;
+        const size_t page = m_snapshotRate == 0 ? std::numeric_limits<size_t>::max()
+                                                : std::max<size_t>(m_snapshotRate / 10, 1);
+        size_t count = 0;
+
+        for (; !snapshot->m_devices.empty() && count < page; count++)
+        {
+          publish(snapshot->m_devices.front());
+          snapshot->m_devices.pop_front();
+        }
+
+        if (count < page && snapshot->m_next < snapshot->m_observations.size())
+        {
+          auto end = snapshot->m_next + std::min(page - count, snapshot->m_observations.size() -
+                                                                   snapshot->m_next);
+
+          // Skip observations that have been replaced and published since the snapshot, only
+          // the pointers are compared while ingest is blocked
+          observation::ObservationList current;
+          {
+            auto &circ = m_sinkContract->getCircularBuffer();
+            std::lock_guard<buffer::CircularBuffer> lock(circ);
+            const auto &latest = circ.getLatest();
+            for (auto i = snapshot->m_next; i < end; i++)
+            {
+              auto &obs = snapshot->m_observations[i];
+              if (!obs->isOrphan() && latest.getObservation(obs->getDataItem()->getId()) == obs)
+                current.emplace_back(obs);
+            }
+          }
+
+          for (auto &obs : current)
+          {
+            if (observationTopics(observationTopic(obs->getDataItem())).m_client->isConnected())
+              publish(obs);
+          }
+
+          count += end - snapshot->m_next;
+          snapshot->m_next = end;
+        }
+
+        // The assets are looked up when their page is published, assets removed since the
+        // snapshot are skipped
+        if (count < page && !snapshot->m_assetIds.empty())
+        {
+          std::list<std::string> ids;
+          for (; count < page && !snapshot->m_assetIds.empty(); count++)
+          {
+            ids.emplace_back(std::move(snapshot->m_assetIds.front()));
+            snapshot->m_assetIds.pop_front();
+          }
+
+          AssetList list;
+          m_sinkContract->getAssetStorage()->getAssets(list, ids);
+          for (auto &asset : list)
+          {
+            if (!asset->isRemoved())
+              publish(asset);
+          }
+        }
+
+        if (snapshot->m_devices.empty() && snapshot->m_next >= snapshot->m_observations.size() &&
+            snapshot->m_assetIds.empty())
+        {
+          LOG(debug) << "Published the current state after connecting";
+          return;
+        }
+
+        m_snapshotTimer.expires_after(interval);
+        m_snapshotTimer.async_wait(
+            asio::bind_executor(m_strand, [this, snapshot](boost::system::error_code ec) {
+              if (!ec)
+                publishSnapshotPage(snapshot);
+            }));
+      }
+
+      void MqttService::replaySpoolPage(uint64_t generation)
+      {
+        NAMED_SCOPE("MqttService::replaySpoolPage");
+
+        // A newer connection replays the rest of the spool
+        if (generation != m_snapshotGeneration)
+          return;
+
+        // Publish a tenth of the rate every 100ms
+        constexpr auto interval = 100ms;
+        const size_t page = m_spoolReplayRate == 0 ? std::numeric_limits<size_t>::max()
+                                                   : std::max<size_t>(m_spoolReplayRate / 10, 1);
+        bool empty, blocked = false;
+        {
+          // New observations are spooled until the spool is empty
+          std::lock_guard<std::mutex> lock(m_spoolMutex);
+          // A message stays in the spool until the client of its connection accepts it. When
+          // that connection is down the replay stops and starts again when it connects.
+          string topic;
+          uint64_t order;
+          for (size_t count = 0; count < page; count++)
+          {
+            auto payload = printer::BufferPool::global().acquire();
+            if (!m_spool->peek(topic, *payload, order))
+              break;
+            auto &topics = observationTopics(topic);
+            if (!topics.m_client->isConnected() ||
+                !publishMessage(topics, topic, payload, {}, order))
+            {
+              blocked = true;
+              break;
+            }
+            m_spool->pop();
+          }
+          empty = m_spool->empty();
+        }
+
+        if (empty)
+        {
+          LOG(info) << "MqttService: replayed the observations spooled while disconnected";
+          if (auto dropped = m_spool->getDropped(); dropped > 0)
+          {
+            LOG(warning) << "MqttService: " << dropped
+                         << " spooled observations were dropped because the spool was full";
+          }
+          publishSnapshot();
+          return;
+        }
+        else if (blocked)
+        {
+          return;
+        }
+
+        m_snapshotTimer.expires_after(interval);
+        m_snapshotTimer.async_wait(
+            asio::bind_executor(m_strand, [this, generation](boost::system::error_code ec) {
+              if (!ec)
+                replaySpoolPage(generation);
+            }));
+      }
+
       bool MqttService::publish(observation::ObservationPtr &observation)
       {
         // get the data item from observation
@@ -127,28 +583,249 @@ namespace mtconnect {
 
         DataItemPtr dataItem = observation->getDataItem();
 
-        auto topic = m_observationPrefix + dataItem->getTopic();  // client asyn topic
-        auto content = dataItem->getTopicName();                  // client asyn content
+        if (m_batchInterval.count() > 0)
+        {
+          // Collect the observations of a device or component. A later value of a data item
+          // replaces the earlier value, conditions are kept by native code, and discrete and
+          // data set values are never replaced.
+          auto topic = observationTopic(dataItem);
+          string key = dataItem->getId();
+          if (dataItem->isCondition())
+            key.append("|").append(observation->maybeGet<string>("nativeCode").value_or(""));
+          else if (dataItem->isDiscrete() || dataItem->isDataSet())
+            key.append("|").append(to_string(observation->getSequence()));
+
+          std::lock_guard<std::mutex> lock(m_batchMutex);
+          m_batch[topic].insert_or_assign(key, observation);
+          if (!m_batchScheduled)
+          {
+            m_batchScheduled = true;
+            asio::post(m_strand, [this]() {
+              m_batchTimer.expires_after(m_batchInterval);
+              m_batchTimer.async_wait(
+                  asio::bind_executor(m_strand, [this](boost::system::error_code ec) {
+                    if (!ec)
+                      flushBatch();
+                  }));
+            });
+          }
 
-        // We may want to use the observation from the checkpoint.
-        auto doc = m_jsonPrinter->printEntity(observation);
+          return true;
+        }
 
-        if (m_client)
-          m_client->publish(topic, doc);
+        // Print into a pooled buffer that the client holds until it is sent
+        auto doc = printer::BufferPool::global().acquire();
+        if (m_sparkplug)
+        {
+          const auto &uuid = *dataItem->getComponent()->getDevice()->getUuid();
+          m_sparkplug->printDeviceData(uuid, {observation}, *doc);
+          send(*m_observationTopics.front(), sparkplugTopic("DDATA", &uuid), doc);
+          return true;
+        }
+
+        auto topic = observationTopic(dataItem);  // client asyn topic
+        m_jsonPrinter->printEntity(observation, *doc);
+        send(observationTopics(topic), topic, doc, userProperties(observation));
 
         return true;
       }
 
+      void MqttService::flushBatch()
+      {
+        decltype(m_batch) batch;
+        {
+          std::lock_guard<std::mutex> lock(m_batchMutex);
+          batch.swap(m_batch);
+          m_batchScheduled = false;
+        }
+
+        for (auto &[topic, observations] : batch)
+        {
+          observation::ObservationList list;
+          list.reserve(observations.size());
+          for (auto &obs : observations)
+            list.emplace_back(obs.second);
+          std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) {
+            return a->getSequence() < b->getSequence();
+          });
+
+          auto doc = printer::BufferPool::global().acquire();
+          if (m_sparkplug)
+          {
+            const auto &device = list.front()->getDataItem()->getComponent()->getDevice();
+            m_sparkplug->printDeviceData(*device->getUuid(), list, *doc);
+          }
+          else
+          {
+            entity::EntityList entities(list.begin(), list.end());
+            m_jsonPrinter->printEntityList(entities, *doc);
+          }
+
+          // The properties of the latest observation in the batch
+          send(observationTopics(topic), topic, doc, userProperties(list.back()));
+        }
+      }
+
+      UserProperties MqttService::userProperties(
+          const observation::ObservationPtr &observation) const
+      {
+        if (!m_client->isMqtt5())
+          return {};
+
+        return {{"sequence", to_string(observation->getSequence())},
+                {"timestamp", format(observation->getTimestamp())}};
+      }
+
+      void MqttService::send(TopicClass &topics, const std::string &topic,
+                             printer::BufferPtr payload, UserProperties &&properties)
+      {
+        if (!topics.m_client)
+          return;
+
+        if (topics.m_spooled)
+        {
+          // Keep the order of the observations, they are spooled until the spool has been
+          // replayed
+          std::lock_guard<std::mutex> lock(m_spoolMutex);
+          if (!topics.m_client->isConnected() || !m_spool->empty())
+          {
+            {
+              // The pending messages are older than the spooled messages
+              std::lock_guard<std::mutex> pending(topics.m_mutex);
+              for (auto &message : topics.m_pending)
+                m_spool->pushFront(message.m_topic, *message.m_payload, message.m_order);
+              topics.m_pending.clear();
+            }
+            m_spool->push(topic, *payload);
+          }
+          else if (!publishMessage(topics, topic, payload, std::move(properties)))
+          {
+            m_spool->push(topic, *payload);
+          }
+          return;
+        }
+
+        if (!publishMessage(topics, topic, payload, std::move(properties)))
+          topics.m_failed++;
+      }
+
+      bool MqttService::publishMessage(TopicClass &topics, const std::string &topic,
+                                       printer::BufferPtr payload, UserProperties &&properties,
+                                       uint64_t order)
+      {
+        if (order == 0)
+          order = m_messageOrder++;
+
+        // Quality of service 0 messages are not acknowledged and are not limited
+        if (topics.m_maxInflight == 0 || topics.m_options.m_qos == 0)
+        {
+          if (!topics.m_client->publish(topic, payload, topics.options(std::move(properties)),
+                                        nullptr))
+            return false;
+          topics.m_published++;
+          return true;
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(topics.m_mutex);
+          if (topics.m_inflight >= topics.m_maxInflight)
+          {
+            // The newer observations supersede the oldest waiting message
+            if (topics.m_maxPending > 0 && topics.m_pending.size() >= topics.m_maxPending)
+            {
+              topics.m_pending.pop_front();
+              topics.m_dropped++;
+            }
+            topics.m_pending.push_back(
+                {topic, std::move(payload), std::move(properties), order});
+            return true;
+          }
+          topics.m_inflight++;
+        }
+
+        if (topics.m_client->publish(topic, payload, topics.options(std::move(properties)),
+                                     completion(topics, {topic, payload, {}, order})))
+        {
+          topics.m_published++;
+          return true;
+        }
+
+        sent(topics);
+        return false;
+      }
+
+      MqttClient::Published MqttService::completion(TopicClass &topics,
+                                                    TopicClass::Message message)
+      {
+        return [this, &topics, message = std::move(message)](bool success) {
+          sent(topics, success ? nullptr : &message);
+        };
+      }
+
+      void MqttService::sent(TopicClass &topics, const TopicClass::Message *failed)
+      {
+        // A message that was not delivered is older than the messages spooled since it was
+        // published, so it is returned to the head of the spool in its original order.
+        if (failed && topics.m_spooled)
+          m_spool->pushFront(failed->m_topic, *failed->m_payload, failed->m_order);
+
+        // Hand the inflight slot to the next pending message. Messages that cannot be published
+        // because the client is disconnected are spooled if they are observations and the spool
+        // is configured, otherwise they are dropped and the latest values are published when
+        // the client reconnects.
+        std::unique_lock<std::mutex> lock(topics.m_mutex);
+        while (!topics.m_pending.empty())
+        {
+          auto next = std::move(topics.m_pending.front());
+          topics.m_pending.pop_front();
+          lock.unlock();
+
+          if (topics.m_client->publish(
+                  next.m_topic, next.m_payload, topics.options(std::move(next.m_properties)),
+                  completion(topics, {next.m_topic, next.m_payload, {}, next.m_order})))
+          {
+            topics.m_published++;
+            return;
+          }
+          if (topics.m_spooled)
+            m_spool->pushFront(next.m_topic, *next.m_payload, next.m_order);
+          else
+            topics.m_failed++;
+
+          lock.lock();
+        }
+        topics.m_inflight--;
+      }
+
       bool MqttService::publish(device_model::DevicePtr device)
       {
-        auto topic = m_devicePrefix + *device->getUuid();
-        auto doc = m_jsonPrinter->print(device);
+        if (m_sparkplug)
+        {
+          observation::ObservationList current;
+          {
+            auto &circ = m_sinkContract->getCircularBuffer();
+            std::lock_guard<buffer::CircularBuffer> lock(circ);
+            const auto &latest = circ.getLatest();
+            for (auto &di : device->getDeviceDataItems())
+            {
+              if (auto dataItem = di.lock())
+              {
+                if (auto obs = latest.getObservation(dataItem->getId()))
+                  current.emplace_back(obs);
+              }
+            }
+          }
 
-        stringstream buffer;
-        buffer << doc;
+          auto birth = printer::BufferPool::global().acquire();
+          m_sparkplug->printDeviceBirth(device, current, *birth);
+          send(m_deviceTopics, sparkplugTopic("DBIRTH", &*device->getUuid()), birth);
+          return true;
+        }
 
-        if (m_client)
-          m_client->publish(topic, buffer.str());
+        auto topic = m_devicePrefix + *device->getUuid();
+        auto doc = printer::BufferPool::global().acquire();
+        m_jsonPrinter->print(device, *doc);
+        send(m_deviceTopics, topic, doc);
 
         return true;
       }
@@ -156,13 +833,9 @@ namespace mtconnect {
       bool MqttService::publish(asset::AssetPtr asset)
       {
         auto topic = m_assetPrefix + get<string>(asset->getIdentity());
-        auto doc = m_jsonPrinter->print(asset);
-
-        stringstream buffer;
-        buffer << doc;
-
-        if (m_client)
-          m_client->publish(topic, buffer.str());
+        auto doc = printer::BufferPool::global().acquire();
+        m_jsonPrinter->print(asset, *doc);
+        send(m_assetTopics, topic, doc);
 
         return true;
       }
@@ -18,18 +18,30 @@
 #pragma once
 
 #include "boost/asio/io_context.hpp"
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/dll/alias.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include "mtconnect/buffer/checkpoint.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/configuration/agent_config.hpp"
 #include "mtconnect/entity/json_printer.hpp"
 #include "mtconnect/mqtt/mqtt_client.hpp"
+#include "mtconnect/mqtt/mqtt_server.hpp"
 #include "mtconnect/observation/observation.hpp"
 #include "mtconnect/printer/printer.hpp"
 #include "mtconnect/printer/xml_printer_helper.hpp"
 #include "mtconnect/sink/sink.hpp"
 #include "mtconnect/utilities.hpp"
+#include "mqtt_spool.hpp"
+#include "sparkplug_printer.hpp"
 
 using namespace std;
 using namespace mtconnect::entity;
@@ -43,6 +55,18 @@ namespace mtconnect {
     /// @brief MTConnect Mqtt implemention namespace
 
     namespace mqtt_sink {
+      /// @brief Publishing metrics of a connection to the broker
+      struct ConnectionMetrics
+      {
+        std::string m_identity;   ///< The client id of the connection
+        bool m_connected {false};  ///< `true` if the connection is connected
+        uint64_t m_published {0};  ///< Messages given to the client
+        uint64_t m_failed {0};     ///< Messages that could not be published
+        size_t m_inflight {0};     ///< Observations waiting to be acknowledged
+        size_t m_pending {0};      ///< Observations waiting for the inflight limit
+        uint64_t m_dropped {0};    ///< Pending observations dropped when the queue was full
+      };
+
       class AGENT_LIB_API MqttService : public sink::Sink
       {
         // dynamic loading of sink
@@ -85,22 +109,185 @@ namespace mtconnect {
         static void registerFactory(SinkFactory &factory);
 
         /// @brief gets a Mqtt Client
-        /// @return MqttClient
+        /// @return the client of the first connection, which publishes the devices and assets
         std::shared_ptr<MqttClient> getClient();
+        /// @brief get the clients of the connections the observations are sharded across
+        const auto &getClients() const { return m_clients; }
+        /// @brief get the embedded broker
+        /// @return the broker the sink publishes to in process, `nullptr` unless
+        /// `MqttEmbeddedBroker` is set
+        std::shared_ptr<mqtt_server::MqttServer> getServer() { return m_server; }
 
         /// @brief Mqtt Client is Connected or not
-        /// @return `true` when the client was connected
-        bool isConnected() { return m_client && m_client->isConnected(); }
+        /// @return `true` when the clients of all the connections are connected
+        bool isConnected()
+        {
+          return !m_clients.empty() &&
+                 std::all_of(m_clients.begin(), m_clients.end(),
+                             [](const auto &client) { return client->isConnected(); });
+        }
+        /// @brief is the client of a connection connected
+        /// @param shard the index of the connection
+        /// @return `true` if the client of the connection is connected
+        bool isConnected(size_t shard)
+        {
+          return shard < m_clients.size() && m_clients[shard]->isConnected();
+        }
+
+        /// @brief get the publishing metrics of each connection, the connections publish
+        /// independently and a connection that is down does not hold up the others
+        std::vector<ConnectionMetrics> getConnectionMetrics();
+
+        /// @brief get the spool of observations published while disconnected
+        /// @return the spool or `nullptr` if it is not configured
+        MqttSpool *getSpool() { return m_spool.get(); }
+
+      protected:
+        /// @brief Quality of service, retain flag, and inflight limit of the device, asset, or
+        /// observation topics
+        ///
+        /// When the inflight limit is reached, messages wait until the broker acknowledges
+        /// an earlier message. When the pending limit is reached, the oldest waiting message
+        /// is dropped.
+        struct TopicClass
+        {
+          PublishOptions m_options;
+          size_t m_maxInflight {0};  ///< 0 if the number of messages in flight is not limited
+          size_t m_maxPending {0};   ///< 0 if the number of waiting messages is not limited
+          bool m_spooled {false};    ///< `true` if messages are spooled while disconnected
+          std::shared_ptr<MqttClient> m_client;
+
+          /// @brief a message waiting for the inflight limit or to be acknowledged
+          struct Message
+          {
+            std::string m_topic;
+            printer::BufferPtr m_payload;
+            UserProperties m_properties;
+            uint64_t m_order {0};  ///< The position of the message, kept if it is spooled
+          };
+
+          /// @brief get the options of a message with its user properties
+          PublishOptions options(UserProperties &&properties) const
+          {
+            PublishOptions options(m_options);
+            options.m_properties = std::move(properties);
+            return options;
+          }
+
+          std::mutex m_mutex;
+          size_t m_inflight {0};
+          std::deque<Message> m_pending;
+
+          std::atomic<uint64_t> m_published {0};
+          std::atomic<uint64_t> m_failed {0};
+          std::atomic<uint64_t> m_dropped {0};
+        };
+
+        /// @brief get the observation topics of the connection of a topic
+        ///
+        /// The shard is the hash of the device part of the topic or the whole topic, so the
+        /// observations of a data item are always published in order on the same connection.
+        TopicClass &observationTopics(const std::string &topic);
+        /// @brief get the topic an observation of a data item is published to
+        /// @return the observation topic, or the batch topic when observations are batched
+        std::string observationTopic(const DataItemPtr &dataItem) const;
+
+        /// @brief publish or queue a message for a class of topics
+        ///
+        /// Observations are written to the spool while the client is disconnected or the
+        /// spool is being replayed.
+        void send(TopicClass &topics, const std::string &topic, printer::BufferPtr payload,
+                  UserProperties &&properties = {});
+        /// @brief publish a message or queue it if the inflight limit is reached
+        /// @param order the order of a message returned to the spool, 0 for a new message
+        /// @return `true` if the message was published or queued
+        bool publishMessage(TopicClass &topics, const std::string &topic,
+                            printer::BufferPtr payload, UserProperties &&properties = {},
+                            uint64_t order = 0);
+        /// @brief get the function called when a message in flight completes
+        MqttClient::Published completion(TopicClass &topics, TopicClass::Message message);
+        /// @brief get the MQTT 5 user properties of an observation, its sequence and timestamp
+        /// @return the properties, empty if the client does not use MQTT 5
+        UserProperties userProperties(const observation::ObservationPtr &observation) const;
+        /// @brief a message of a class of topics completed, publish the next pending message
+        /// @param failed the message if it could not be delivered
+        void sent(TopicClass &topics, const TopicClass::Message *failed = nullptr);
+        /// @brief publish the observations collected in the batch interval
+        void flushBatch();
+
+        /// @brief The devices, latest observations, and assets to publish after the client
+        /// connects. The assets are kept by id so they are paged like the observations.
+        struct Snapshot
+        {
+          uint64_t m_generation;
+          std::list<DevicePtr> m_devices;
+          std::vector<observation::ObservationPtr> m_observations;
+          size_t m_next {0};
+          std::deque<std::string> m_assetIds;
+        };
+
+        /// @brief take a snapshot of the latest observations and start publishing it
+        void publishSnapshot();
+        /// @brief publish the next page of the snapshot and schedule the following page
+        void publishSnapshotPage(std::shared_ptr<Snapshot> snapshot);
+        /// @brief publish the next page of the spooled observations and schedule the following
+        /// page, the snapshot is published once the spool is empty
+        void replaySpoolPage(uint64_t generation);
+
+        /// @brief get a Sparkplug topic, `spBv1.0/<group>/<type>/<node>[/<device>]`
+        std::string sparkplugTopic(const char *type, const std::string *device = nullptr) const
+        {
+          auto topic = m_sparkplugPrefix + type + '/' + m_sparkplugNode;
+          if (device)
+            topic.append("/").append(*device);
+          return topic;
+        }
+        /// @brief publish the node birth certificate and give the client the death certificate
+        /// of the next connection
+        void publishNodeBirth();
 
       protected:
         std::string m_devicePrefix;
         std::string m_assetPrefix;
         std::string m_observationPrefix;
 
+        TopicClass m_deviceTopics;
+        TopicClass m_assetTopics;
+        std::vector<std::unique_ptr<TopicClass>> m_observationTopics;  ///< One per connection
+        bool m_shardByDevice {true};
+
+        // Observations batched by device or component topic and coalesced by data item
+        std::chrono::milliseconds m_batchInterval {0};
+        bool m_batchByComponent {false};
+        std::mutex m_batchMutex;
+        bool m_batchScheduled {false};
+        std::map<std::string, std::map<std::string, observation::ObservationPtr>> m_batch;
+
+        // Messages published after connecting per second, 0 publishes the snapshot in one step
+        size_t m_snapshotRate {0};
+        std::atomic<uint64_t> m_snapshotGeneration {0};
+
+        // Observations published while disconnected, replayed in order after connecting
+        std::unique_ptr<MqttSpool> m_spool;
+        std::mutex m_spoolMutex;
+        size_t m_spoolReplayRate {0};
+        std::atomic<uint64_t> m_messageOrder {1};
+
         boost::asio::io_context &m_context;
+        boost::asio::io_context::strand m_strand;
+        boost::asio::steady_timer m_batchTimer;
+        boost::asio::steady_timer m_snapshotTimer;
         ConfigOptions m_options;
         std::unique_ptr<JsonEntityPrinter> m_jsonPrinter;
-        std::shared_ptr<MqttClient> m_client;
+
+        // Sparkplug births, deaths, and data replace the device and observation topics
+        std::unique_ptr<SparkplugPrinter> m_sparkplug;
+        std::string m_sparkplugPrefix;
+        std::string m_sparkplugNode;
+        std::atomic<uint64_t> m_bdSeq {0};
+        std::shared_ptr<MqttClient> m_client;  ///< The first client, same as `m_clients[0]`
+        std::vector<std::shared_ptr<MqttClient>> m_clients;
+        std::shared_ptr<mqtt_server::MqttServer> m_server;
       };
     }  // namespace mqtt_sink
   }    // namespace sink
@@ -0,0 +1,427 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "mqtt_spool.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+namespace ip = boost::interprocess;
+
+namespace mtconnect::sink::mqtt_sink {
+  namespace {
+    constexpr char Magic[4] = {'M', 'T', 'S', 'P'};
+    constexpr uint32_t Version = 1;
+    constexpr size_t MinimumSegmentSize = 4096;
+
+    /// The header at the start of each segment. The offsets are from the start of the file.
+    struct Header
+    {
+      char m_magic[4];
+      uint32_t m_version;
+      uint64_t m_begin;
+      uint64_t m_end;
+      uint32_t m_count;
+      uint32_t m_reserved;
+    };
+
+    /// Each record is the length of the topic and payload followed by their bytes
+    struct RecordHeader
+    {
+      uint32_t m_topic;
+      uint32_t m_payload;
+    };
+
+    string segmentName(uint64_t index)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "spool-%016llx.seg", (unsigned long long)index);
+      return name;
+    }
+
+    optional<uint64_t> segmentIndex(const fs::path &path)
+    {
+      auto name = path.filename().string();
+      if (name.size() != 26 || name.compare(0, 6, "spool-") != 0 ||
+          path.extension() != ".seg")
+        return nullopt;
+
+      try
+      {
+        size_t pos;
+        auto index = stoull(name.substr(6, 16), &pos, 16);
+        if (pos == 16)
+          return index;
+      }
+      catch (std::exception &)
+      {}
+      return nullopt;
+    }
+  }  // namespace
+
+  struct MqttSpool::Segment
+  {
+    Segment(const fs::path &path, uint64_t index)
+      : m_path(path),
+        m_index(index),
+        m_file(path.string().c_str(), ip::read_write),
+        m_region(m_file, ip::read_write)
+    {}
+
+    Header &header() { return *static_cast<Header *>(m_region.get_address()); }
+    char *data() { return static_cast<char *>(m_region.get_address()); }
+    size_t capacity() const { return m_region.get_size(); }
+    uint32_t count() { return header().m_count; }
+
+    void reset()
+    {
+      auto &h = header();
+      h.m_begin = h.m_end = sizeof(Header);
+      h.m_count = 0;
+    }
+
+    bool fits(size_t length) { return header().m_end + length <= capacity(); }
+
+    void append(string_view topic, string_view payload)
+    {
+      auto &h = header();
+      RecordHeader record {uint32_t(topic.size()), uint32_t(payload.size())};
+      char *p = data() + h.m_end;
+      memcpy(p, &record, sizeof(record));
+      p += sizeof(record);
+      memcpy(p, topic.data(), topic.size());
+      p += topic.size();
+      memcpy(p, payload.data(), payload.size());
+
+      // Move the end after the record has been written
+      h.m_end += sizeof(record) + topic.size() + payload.size();
+      h.m_count++;
+    }
+
+    void read(string &topic, string &payload)
+    {
+      RecordHeader record;
+      const char *p = data() + header().m_begin;
+      memcpy(&record, p, sizeof(record));
+      p += sizeof(record);
+      topic.assign(p, record.m_topic);
+      p += record.m_topic;
+      payload.assign(p, record.m_payload);
+    }
+
+    void skip()
+    {
+      auto &h = header();
+      RecordHeader record;
+      memcpy(&record, data() + h.m_begin, sizeof(record));
+
+      h.m_begin += sizeof(record) + record.m_topic + record.m_payload;
+      h.m_count--;
+    }
+
+    /// Check the header and that the records fill the segment from the beginning to the end
+    bool valid()
+    {
+      if (capacity() < sizeof(Header))
+        return false;
+
+      auto &h = header();
+      if (memcmp(h.m_magic, Magic, sizeof(Magic)) != 0 || h.m_version != Version ||
+          h.m_begin < sizeof(Header) || h.m_begin > h.m_end || h.m_end > capacity())
+        return false;
+
+      uint64_t offset = h.m_begin;
+      uint32_t count = 0;
+      while (offset < h.m_end)
+      {
+        if (offset + sizeof(RecordHeader) > h.m_end)
+          return false;
+        RecordHeader record;
+        memcpy(&record, data() + offset, sizeof(record));
+        offset += sizeof(record) + uint64_t(record.m_topic) + record.m_payload;
+        count++;
+      }
+
+      return offset == h.m_end && count == h.m_count;
+    }
+
+    fs::path m_path;
+    uint64_t m_index;
+    ip::file_mapping m_file;
+    ip::mapped_region m_region;
+  };
+
+  MqttSpool::MqttSpool(const fs::path &directory, size_t size, size_t segments)
+    : m_directory(directory), m_maxSegments(std::max<size_t>(segments, 1))
+  {
+    m_segmentSize = std::max(size / m_maxSegments, MinimumSegmentSize);
+
+    fs::create_directories(m_directory);
+
+    map<uint64_t, fs::path> files;
+    for (auto &entry : fs::directory_iterator(m_directory))
+    {
+      if (entry.is_regular_file())
+      {
+        if (auto index = segmentIndex(entry.path()))
+          files.emplace(*index, entry.path());
+      }
+    }
+
+    for (auto &[index, path] : files)
+    {
+      m_nextIndex = index + 1;
+      if (auto segment = open(path, index))
+      {
+        m_count += segment->count();
+        m_segments.emplace_back(std::move(segment));
+      }
+    }
+
+    // The size may have been reduced since the segments were written
+    while (m_segments.size() > m_maxSegments)
+    {
+      m_count -= m_segments.front()->count();
+      m_dropped += m_segments.front()->count();
+      discard(m_segments.front());
+      m_segments.pop_front();
+    }
+
+    if (m_count > 0)
+    {
+      LOG(info) << "MqttSpool: " << m_count << " messages recovered from " << m_directory;
+    }
+  }
+
+  MqttSpool::~MqttSpool() { flush(); }
+
+  MqttSpool::SegmentPtr MqttSpool::open(const fs::path &path, uint64_t index)
+  {
+    SegmentPtr segment;
+    try
+    {
+      segment = make_unique<Segment>(path, index);
+      if (segment->valid() && segment->count() > 0)
+        return segment;
+
+      if (segment->count() > 0)
+      {
+        LOG(warning) << "MqttSpool: discarding invalid segment " << path;
+      }
+    }
+    catch (std::exception &e)
+    {
+      LOG(warning) << "MqttSpool: cannot open segment " << path << ": " << e.what();
+    }
+
+    discard(segment);
+    error_code ec;
+    fs::remove(path, ec);
+    return nullptr;
+  }
+
+  MqttSpool::SegmentPtr MqttSpool::create(uint64_t index)
+  {
+    auto path = m_directory / segmentName(index);
+    {
+      ofstream file(path, ios::binary | ios::trunc);
+      if (!file)
+        throw runtime_error("cannot create " + path.string());
+    }
+    fs::resize_file(path, m_segmentSize);
+
+    auto segment = make_unique<Segment>(path, index);
+    auto &h = segment->header();
+    memcpy(h.m_magic, Magic, sizeof(Magic));
+    h.m_version = Version;
+    h.m_reserved = 0;
+    segment->reset();
+
+    return segment;
+  }
+
+  void MqttSpool::discard(SegmentPtr &segment)
+  {
+    if (segment)
+    {
+      // Unmap the segment before the file is removed
+      auto path = segment->m_path;
+      segment.reset();
+      error_code ec;
+      fs::remove(path, ec);
+      if (ec)
+      {
+        LOG(warning) << "MqttSpool: cannot remove " << path << ": " << ec.message();
+      }
+    }
+  }
+
+  bool MqttSpool::push(string_view topic, string_view payload)
+  {
+    size_t length = sizeof(RecordHeader) + topic.size() + payload.size();
+    if (length + sizeof(Header) > m_segmentSize)
+    {
+      LOG(warning) << "MqttSpool: message for " << topic << " is larger than a segment";
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_segments.empty() || !m_segments.back()->fits(length))
+    {
+      // A recovered segment may be smaller than the current segment size
+      if (!m_segments.empty() && m_segments.back()->count() == 0)
+      {
+        discard(m_segments.back());
+        m_segments.pop_back();
+      }
+
+      if (m_segments.size() >= m_maxSegments)
+      {
+        auto &oldest = m_segments.front();
+        if (m_dropped == 0)
+        {
+          LOG(warning) << "MqttSpool: spool is full, discarding the oldest messages";
+        }
+        m_count -= oldest->count();
+        m_dropped += oldest->count();
+        discard(oldest);
+        m_segments.pop_front();
+      }
+
+      try
+      {
+        m_segments.emplace_back(create(m_nextIndex++));
+      }
+      catch (std::exception &e)
+      {
+        LOG(error) << "MqttSpool: cannot create segment: " << e.what();
+        return false;
+      }
+    }
+
+    m_segments.back()->append(topic, payload);
+    m_count++;
+
+    return true;
+  }
+
+  void MqttSpool::pushFront(string_view topic, string_view payload, uint64_t order)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto pos = upper_bound(m_returned.begin(), m_returned.end(), order,
+                           [](uint64_t order, const Returned &r) { return order < r.m_order; });
+    m_returned.insert(pos, Returned {order, string(topic), string(payload)});
+  }
+
+  bool MqttSpool::peek(string &topic, string &payload, uint64_t &order)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_returned.empty())
+    {
+      const auto &front = m_returned.front();
+      topic = front.m_topic;
+      payload = front.m_payload;
+      order = front.m_order;
+      return true;
+    }
+
+    if (m_count == 0)
+      return false;
+
+    m_segments.front()->read(topic, payload);
+    order = 0;
+    return true;
+  }
+
+  bool MqttSpool::pop(string &topic, string &payload)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_returned.empty())
+    {
+      topic = std::move(m_returned.front().m_topic);
+      payload = std::move(m_returned.front().m_payload);
+      m_returned.pop_front();
+      return true;
+    }
+
+    if (m_count == 0)
+      return false;
+
+    m_segments.front()->read(topic, payload);
+    removeFront();
+    return true;
+  }
+
+  bool MqttSpool::pop()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_returned.empty())
+    {
+      m_returned.pop_front();
+      return true;
+    }
+
+    if (m_count == 0)
+      return false;
+
+    removeFront();
+    return true;
+  }
+
+  void MqttSpool::removeFront()
+  {
+    auto &front = m_segments.front();
+    front->skip();
+    m_count--;
+
+    // The last segment is kept to write to, the others are removed when they are empty
+    if (front->count() == 0)
+    {
+      if (m_segments.size() > 1)
+      {
+        discard(front);
+        m_segments.pop_front();
+      }
+      else
+      {
+        front->reset();
+      }
+    }
+  }
+
+  void MqttSpool::flush()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &segment : m_segments)
+      segment->m_region.flush();
+  }
+}  // namespace mtconnect::sink::mqtt_sink
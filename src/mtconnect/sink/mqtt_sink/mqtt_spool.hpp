@@ -0,0 +1,138 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "mtconnect/config.hpp"
+
+namespace mtconnect::sink::mqtt_sink {
+  /// @brief A bounded first in, first out queue of messages kept in memory mapped files
+  ///
+  /// Messages are appended to segment files of a fixed size in a directory. When the last
+  /// segment is full a new segment is created, and when the spool has its maximum number of
+  /// segments the oldest segment is discarded with its messages. Segments are removed once
+  /// all their messages have been read.
+  ///
+  /// The read and write positions are kept in the segment files, so the messages left in
+  /// the spool when the agent stops are read after it starts again.
+  ///
+  /// Messages that were read but could not be delivered are returned to the head of the spool.
+  /// They are kept in memory and read before the segments.
+  ///
+  /// The spool is synchronized.
+  class AGENT_LIB_API MqttSpool
+  {
+  public:
+    /// @brief Open or create a spool
+    /// @param directory the directory of the segment files, created if it does not exist
+    /// @param size the maximum size of all the segments in bytes
+    /// @param segments the maximum number of segments
+    /// @throws std::exception if the directory or the segments cannot be opened
+    MqttSpool(const std::filesystem::path &directory, size_t size, size_t segments = 8);
+    ~MqttSpool();
+
+    /// @brief append a message
+    /// @param topic the topic
+    /// @param payload the message
+    /// @return `false` if the message could not be written
+    bool push(std::string_view topic, std::string_view payload);
+
+    /// @brief return a message that could not be delivered to the head of the spool
+    ///
+    /// The returned messages are read before the messages in the segments, ordered by `order`.
+    /// They are lost if the agent stops before they are read.
+    ///
+    /// @param topic the topic
+    /// @param payload the message
+    /// @param order the position of the message, given when it was first published
+    void pushFront(std::string_view topic, std::string_view payload, uint64_t order);
+
+    /// @brief read the oldest message without removing it
+    /// @param[out] topic the topic
+    /// @param[out] payload the message
+    /// @param[out] order the order of a returned message, 0 for a message from a segment
+    /// @return `false` if the spool is empty
+    bool peek(std::string &topic, std::string &payload, uint64_t &order);
+
+    /// @brief remove the oldest message
+    /// @param[out] topic the topic
+    /// @param[out] payload the message
+    /// @return `false` if the spool is empty
+    bool pop(std::string &topic, std::string &payload);
+
+    /// @brief remove the oldest message without reading it
+    /// @return `false` if the spool is empty
+    bool pop();
+
+    /// @brief write the segments to disk
+    void flush();
+
+    /// @brief get the number of messages in the spool
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_count + m_returned.size();
+    }
+    /// @brief `true` if the spool has no messages
+    bool empty() const { return size() == 0; }
+    /// @brief get the number of messages discarded because the spool was full
+    uint64_t getDropped() const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_dropped;
+    }
+    /// @brief get the size of a segment in bytes
+    size_t getSegmentSize() const { return m_segmentSize; }
+
+  protected:
+    struct Segment;
+    using SegmentPtr = std::unique_ptr<Segment>;
+
+    /// @brief a message returned to the head of the spool
+    struct Returned
+    {
+      uint64_t m_order;
+      std::string m_topic;
+      std::string m_payload;
+    };
+
+    SegmentPtr open(const std::filesystem::path &path, uint64_t index);
+    void removeFront();
+    SegmentPtr create(uint64_t index);
+    void discard(SegmentPtr &segment);
+
+  protected:
+    std::filesystem::path m_directory;
+    size_t m_segmentSize;
+    size_t m_maxSegments;
+
+    mutable std::mutex m_mutex;
+    std::deque<SegmentPtr> m_segments;
+    std::deque<Returned> m_returned;
+    uint64_t m_nextIndex {0};
+    size_t m_count {0};
+    uint64_t m_dropped {0};
+  };
+}  // namespace mtconnect::sink::mqtt_sink
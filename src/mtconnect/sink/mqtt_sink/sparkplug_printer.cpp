@@ -0,0 +1,318 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "sparkplug_printer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
+#include "mtconnect/printer/cbor_writer.hpp"
+
+using namespace std;
+
+namespace mtconnect::sink::mqtt_sink {
+  using namespace observation;
+  using namespace device_model;
+  using printer::CborWriter;
+
+  namespace {
+    int64_t microseconds(const Timestamp &ts)
+    {
+      return chrono::duration_cast<chrono::microseconds>(ts.time_since_epoch()).count();
+    }
+
+    int64_t now() { return microseconds(chrono::system_clock::now()); }
+
+    /// Keys are written as text so the payloads can be read by any CBOR decoder
+    void key(CborWriter &writer, const string_view &key)
+    {
+      writer.String(key.data(), rapidjson::SizeType(key.size()));
+    }
+
+    void text(CborWriter &writer, const std::string &s)
+    {
+      writer.String(s.c_str(), rapidjson::SizeType(s.size()));
+    }
+
+    struct DataSetValueWriter
+    {
+      void operator()(const std::monostate &) { m_writer.Null(); }
+      void operator()(const std::string &s) { text(m_writer, s); }
+      void operator()(const int64_t &i) { m_writer.Int64(i); }
+      void operator()(const double &d) { m_writer.Double(d); }
+      void operator()(const entity::DataSet &set)
+      {
+        m_writer.StartObject();
+        for (auto &e : set)
+        {
+          text(m_writer, e.m_key);
+          if (e.m_removed)
+            m_writer.Null();
+          else
+            visit(*this, e.m_value);
+        }
+        m_writer.EndObject();
+      }
+
+      CborWriter &m_writer;
+    };
+
+    struct ValueWriter
+    {
+      void operator()(const std::monostate &) { m_writer.Null(); }
+      void operator()(const std::nullptr_t &) { m_writer.Null(); }
+      void operator()(const entity::EntityPtr &) { m_writer.Null(); }
+      void operator()(const entity::EntityList &) { m_writer.Null(); }
+      void operator()(const std::string &s) { text(m_writer, s); }
+      void operator()(const int64_t &i) { m_writer.Int64(i); }
+      void operator()(const double &d) { m_writer.Double(d); }
+      void operator()(const bool &b) { m_writer.Bool(b); }
+      void operator()(const entity::Vector &v)
+      {
+        m_writer.StartArray();
+        for (auto &d : v)
+          m_writer.Double(d);
+        m_writer.EndArray();
+      }
+      void operator()(const entity::DataSet &set) { DataSetValueWriter {m_writer}(set); }
+      void operator()(const Timestamp &ts) { m_writer.Int64(microseconds(ts)); }
+
+      CborWriter &m_writer;
+    };
+
+    void value(CborWriter &writer, const ObservationPtr &obs)
+    {
+      if (obs->isUnavailable())
+        writer.Null();
+      else
+        visit(ValueWriter {writer}, obs->getValue());
+    }
+
+    /// The properties that are carried by the topic, the birth certificate, or the value
+    bool isAttribute(const ObservationPtr &obs, const std::string &name)
+    {
+      static const unordered_set<std::string> skip {"dataItemId", "timestamp", "sequence",
+                                                    "VALUE",      "name",      "type",
+                                                    "subType",    "compositionId"};
+      return skip.count(name) == 0 && !obs->isHidden(name);
+    }
+
+    bool hasAttributes(const ObservationPtr &obs)
+    {
+      if (obs->getDataItem()->isCondition())
+        return true;
+      for (auto &prop : obs->getProperties())
+      {
+        if (isAttribute(obs, prop.first))
+          return true;
+      }
+      return false;
+    }
+
+    /// Write the other properties of an observation as a map, the condition level is given
+    /// as `level`
+    void attributes(CborWriter &writer, const ObservationPtr &obs)
+    {
+      writer.StartObject();
+      if (obs->getDataItem()->isCondition())
+      {
+        key(writer, "level");
+        text(writer, obs->getName());
+      }
+      for (auto &[name, v] : obs->getProperties())
+      {
+        if (isAttribute(obs, name))
+        {
+          text(writer, name);
+          visit(ValueWriter {writer}, v);
+        }
+      }
+      writer.EndObject();
+    }
+  }  // namespace
+
+  void SparkplugPrinter::printNodeBirth(uint64_t bdSeq, std::string &buffer)
+  {
+    m_seq = 0;
+
+    CborWriter writer(buffer);
+    writer.StartObject();
+    key(writer, "timestamp");
+    writer.Int64(now());
+    key(writer, "seq");
+    writer.Uint64(nextSeq());
+    key(writer, "bdSeq");
+    writer.Uint64(bdSeq);
+    writer.EndObject();
+  }
+
+  void SparkplugPrinter::printNodeDeath(uint64_t bdSeq, std::string &buffer) const
+  {
+    CborWriter writer(buffer);
+    writer.StartObject();
+    key(writer, "timestamp");
+    writer.Int64(now());
+    key(writer, "bdSeq");
+    writer.Uint64(bdSeq);
+    writer.EndObject();
+  }
+
+  void SparkplugPrinter::printDeviceBirth(const DevicePtr device, const ObservationList &current,
+                                          std::string &buffer)
+  {
+    const auto &uuid = *device->getUuid();
+
+    // Keep the aliases of the data items that have already been born so consumers can keep
+    // their tables when the device model changes
+    vector<DataItemPtr> dataItems;
+    for (auto &weak : device->getDeviceDataItems())
+    {
+      if (auto di = weak.lock())
+        dataItems.emplace_back(di);
+    }
+    sort(dataItems.begin(), dataItems.end(),
+         [](const auto &a, const auto &b) { return a->getId() < b->getId(); });
+
+    auto aliases = make_shared<AliasTable>();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto &table = m_aliases[uuid];
+      uint64_t next = 0;
+      if (table)
+      {
+        for (auto &a : *table)
+          next = std::max(next, a.second + 1);
+      }
+      for (auto &di : dataItems)
+      {
+        const AliasTable::value_type *existing = nullptr;
+        if (table)
+        {
+          auto it = table->find(di->getId());
+          if (it != table->end())
+            existing = &*it;
+        }
+        aliases->emplace(di->getId(), existing ? existing->second : next++);
+      }
+      table = aliases;
+    }
+
+    unordered_map<std::string, ObservationPtr> values;
+    for (auto &obs : current)
+    {
+      if (!obs->isOrphan())
+        values.emplace(obs->getDataItem()->getId(), obs);
+    }
+
+    CborWriter writer(buffer);
+    writer.StartObject();
+    key(writer, "timestamp");
+    writer.Int64(now());
+    key(writer, "seq");
+    writer.Uint64(nextSeq());
+    key(writer, "uuid");
+    text(writer, uuid);
+    if (const auto &name = device->getComponentName())
+    {
+      key(writer, "name");
+      text(writer, *name);
+    }
+
+    key(writer, "metrics");
+    writer.StartArray();
+    for (auto &di : dataItems)
+    {
+      writer.StartObject();
+      key(writer, "name");
+      text(writer, di->getId());
+      key(writer, "alias");
+      writer.Uint64(aliases->at(di->getId()));
+      key(writer, "category");
+      writer.String(di->getCategoryText());
+      key(writer, "type");
+      text(writer, di->getType());
+      if (auto subType = di->maybeGet<std::string>("subType"))
+      {
+        key(writer, "subType");
+        text(writer, *subType);
+      }
+      if (auto units = di->maybeGet<std::string>("units"))
+      {
+        key(writer, "units");
+        text(writer, *units);
+      }
+      key(writer, "topic");
+      text(writer, di->getTopic());
+
+      if (auto obs = values.find(di->getId()); obs != values.end())
+      {
+        key(writer, "timestamp");
+        writer.Int64(microseconds(obs->second->getTimestamp()));
+        key(writer, "value");
+        value(writer, obs->second);
+        if (hasAttributes(obs->second))
+        {
+          key(writer, "properties");
+          attributes(writer, obs->second);
+        }
+      }
+      writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+  }
+
+  void SparkplugPrinter::printDeviceData(const std::string &uuid,
+                                         const ObservationList &observations, std::string &buffer)
+  {
+    auto aliases = getAliases(uuid);
+
+    // Timestamps are offsets in microseconds from the earliest observation
+    int64_t base = now();
+    for (auto &obs : observations)
+      base = std::min(base, microseconds(obs->getTimestamp()));
+
+    CborWriter writer(buffer);
+    writer.StartObject();
+    key(writer, "timestamp");
+    writer.Int64(base);
+    key(writer, "seq");
+    writer.Uint64(nextSeq());
+
+    key(writer, "metrics");
+    writer.StartArray();
+    for (auto &obs : observations)
+    {
+      const auto &id = obs->getDataItem()->getId();
+
+      writer.StartArray();
+      auto alias = aliases ? aliases->find(id) : AliasTable::const_iterator();
+      if (aliases && alias != aliases->end())
+        writer.Uint64(alias->second);
+      else
+        text(writer, id);
+      writer.Uint64(uint64_t(microseconds(obs->getTimestamp()) - base));
+      value(writer, obs);
+      if (hasAttributes(obs))
+        attributes(writer, obs);
+      writer.EndArray();
+    }
+    writer.EndArray();
+    writer.EndObject();
+  }
+}  // namespace mtconnect::sink::mqtt_sink
@@ -0,0 +1,92 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+namespace mtconnect::sink::mqtt_sink {
+  /// @brief Prints Sparkplug B style birth, death, and data payloads encoded as CBOR
+  ///
+  /// A device birth certificate assigns each data item of the device a small integer alias.
+  /// Data payloads refer to the data items by alias and carry the observations as compact
+  /// arrays of `[alias, timestamp offset, value]` with an optional map of the other
+  /// observation properties. Aliases of a device are kept when the device is born again, new
+  /// data items are given the next aliases.
+  ///
+  /// Every birth and data payload carries a `seq` from 0 to 255 that increments with each
+  /// message of the node and restarts with the node birth.
+  class AGENT_LIB_API SparkplugPrinter
+  {
+  public:
+    /// @brief the aliases of the data items of a device by data item id
+    using AliasTable = std::unordered_map<std::string, uint64_t>;
+
+    /// @brief print a node birth certificate and restart the message sequence
+    /// @param[in] bdSeq the birth and death sequence number of the connection
+    /// @param[out] buffer the payload
+    void printNodeBirth(uint64_t bdSeq, std::string &buffer);
+
+    /// @brief print a node death certificate
+    /// @param[in] bdSeq the birth and death sequence number of the connection
+    /// @param[out] buffer the payload
+    void printNodeDeath(uint64_t bdSeq, std::string &buffer) const;
+
+    /// @brief print a device birth certificate assigning the aliases of its data items
+    /// @param[in] device the device
+    /// @param[in] current the current observations of the device
+    /// @param[out] buffer the payload
+    void printDeviceBirth(const device_model::DevicePtr device,
+                          const observation::ObservationList &current, std::string &buffer);
+
+    /// @brief print the observations of a device
+    ///
+    /// Data items that have not been born are identified by their id instead of an alias.
+    ///
+    /// @param[in] uuid the device uuid
+    /// @param[in] observations the observations in sequence order
+    /// @param[out] buffer the payload
+    void printDeviceData(const std::string &uuid,
+                         const observation::ObservationList &observations, std::string &buffer);
+
+    /// @brief get the aliases of a device
+    /// @param[in] uuid the device uuid
+    /// @return the aliases or `nullptr` if the device has not been born
+    std::shared_ptr<const AliasTable> getAliases(const std::string &uuid) const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_aliases.find(uuid);
+      return it == m_aliases.end() ? nullptr : it->second;
+    }
+
+  protected:
+    uint64_t nextSeq() { return m_seq++ % 256; }
+
+  protected:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const AliasTable>> m_aliases;
+    std::atomic<uint64_t> m_seq {0};
+  };
+}  // namespace mtconnect::sink::mqtt_sink
@@ -20,11 +20,16 @@
 #include <boost/beast/http/status.hpp>
 #include <boost/beast/http/verb.hpp>
 
+#include <memory>
 #include <optional>
 
 #include "mtconnect/config.hpp"
 #include "parameter.hpp"
 
+namespace mtconnect::buffer {
+  class Checkpoint;
+}
+
 namespace mtconnect::sink::rest_sink {
   /// @brief An error that occurred during a request
   class AGENT_LIB_API RequestError : public std::logic_error
@@ -68,6 +73,13 @@ namespace mtconnect::sink::rest_sink {
     QueryMap m_query;                 ///< The parsed query parameters
     ParameterMap m_parameters;        ///< The parsed path parameters
 
+    std::optional<std::string> m_requestId;    ///< Request id when multiplexed over a websocket
+    std::optional<std::string> m_lastEventId;  ///< Last-Event-ID when resuming an event stream
+    std::optional<std::string> m_ifNoneMatch;  ///< If-None-Match entity tags of a cached document
+    std::optional<uint64_t> m_asOf;  ///< Last sequence number a batched request is answered as of
+    /// Latest checkpoint as of `m_asOf`, shared by the requests of a batch
+    std::shared_ptr<const buffer::Checkpoint> m_checkpoint;
+
     /// @brief Find a parameter by type
     /// @tparam T the type of the parameter
     /// @param s the name of the parameter
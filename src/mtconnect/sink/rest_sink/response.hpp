@@ -25,6 +25,7 @@
 
 #include "cached_file.hpp"
 #include "mtconnect/config.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
 #include "mtconnect/utilities.hpp"
 #include "request.hpp"
 
@@ -40,12 +41,16 @@ namespace mtconnect {
     {
       /// @brief Create a response with a status and a body
       /// @param[in] status the status
-      /// @param[in] body the body of the response
+      /// @param[in] body the body of the response, printed documents are moved in without copying
       /// @param[in] mimeType the mime type of the response
-      Response(status status = status::ok, const std::string &body = "",
+      Response(status status = status::ok, std::string body = "",
                const std::string &mimeType = "text/xml")
-        : m_status(status), m_body(body), m_mimeType(mimeType), m_expires(0)
+        : m_status(status), m_body(std::move(body)), m_mimeType(mimeType), m_expires(0)
       {}
+      /// @brief Give the body back to the buffer pool once it has been written
+      ~Response() { printer::BufferPool::global().give(std::move(m_body)); }
+      Response(const Response &) = default;
+      Response(Response &&) = default;
       /// @brief Create a response with a status and a cached file
       /// @param[in] status the status of the response
       /// @param[in] file the file
@@ -61,6 +66,7 @@ namespace mtconnect {
       std::string m_body;                     ///< The body of the response
       std::string m_mimeType;                 ///< The mime type of the response
       std::optional<std::string> m_location;  ///< optional location
+      std::optional<std::string> m_etag;      ///< optional entity tag of the document
       std::chrono::seconds
           m_expires;         ///< how long should this session should stay open before it is closed
       bool m_close {false};  ///< `true` if this session should closed after it responds
@@ -17,11 +17,23 @@
 
 #include "rest_service.hpp"
 
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
 #include "mtconnect/configuration/config_options.hpp"
 #include "mtconnect/entity/xml_parser.hpp"
 #include "mtconnect/pipeline/shdr_token_mapper.hpp"
 #include "mtconnect/pipeline/shdr_tokenizer.hpp"
 #include "mtconnect/pipeline/timestamp_extractor.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
+#include "mtconnect/printer/json_printer_helper.hpp"
 #include "mtconnect/printer/xml_printer.hpp"
 #include "server.hpp"
 
@@ -56,6 +68,10 @@ namespace mtconnect {
       m_fileCache.setMaxCachedFileSize(maxSize);
       m_fileCache.setMinCompressedFileSize(compressSize);
 
+      m_workerThreads = GetOption<int>(options, config::WorkerThreads).value_or(1);
+      m_parallelRenderThreshold =
+          GetOption<int>(options, config::ParallelRenderThreshold).value_or(10000);
+
       // Unique id number for agent instance
       m_instanceId = getCurrentTimeInSec();
 
@@ -102,18 +118,31 @@ namespace mtconnect {
            {"assetId", PATH, "An assetId to select"},
            {"path", QUERY, "XPath to filter DataItems matched against the probe document"},
            {"at", QUERY, "Sequence number at which the observation snapshot is taken"},
+           {"since", QUERY,
+            "Only include data items that changed after this sequence number, use the "
+            "`lastSequence` of the previous response"},
            {"to", QUERY, "Sequence number at to stop reporting observations"},
            {"from", QUERY, "Sequence number at to start reporting observations"},
            {"interval", QUERY, "Time in ms between publishing data–starts streaming"},
            {"pretty", QUERY, "Instructs the result to be pretty printed"},
            {"heartbeat", QUERY,
-            "Time in ms between publishing a empty document when no data has changed"}});
+            "Time in ms between publishing a empty document when no data has changed"},
+           {"backpressure", QUERY,
+            "How a slow streaming client is handled: `keep` sends every observation, `coalesce` "
+            "sends the latest observation of each data item when the client is more than a "
+            "chunk behind, and `bounded` when it is more than `maxLag` observations behind"},
+           {"maxLag", QUERY,
+            "Number of observations a `bounded` streaming client can fall behind"},
+           {"timeseries", QUERY,
+            "Encoding of timeseries values: `text`, or base64 `float32`, `float64`, `delta`, or "
+            "`gorilla`"}});
 
       createProbeRoutings();
       createCurrentRoutings();
       createSampleRoutings();
       createAssetRoutings();
       createPutObservationRoutings();
+      createBatchRoutings();
       createFileRoutings();
 
       makeLoopbackSource(m_sinkContract->m_pipelineContext);
@@ -445,7 +474,8 @@ namespace mtconnect {
         auto printer = printerForAccepts(request->m_accepts);
 
         respond(session, assetRequest(printer, count, removed, request->parameter<string>("type"),
-                                      request->parameter<string>("device")));
+                                      request->parameter<string>("device"), false,
+                                      request->m_ifNoneMatch));
         return true;
       };
 
@@ -460,7 +490,7 @@ namespace mtconnect {
           string id;
           while (getline(str, id, ';'))
             ids.emplace_back(id);
-          respond(session, assetIdsRequest(printer, ids));
+          respond(session, assetIdsRequest(printer, ids, false, request->m_ifNoneMatch));
         }
         else
         {
@@ -574,25 +604,37 @@ namespace mtconnect {
         auto interval = request->parameter<int32_t>("interval");
         if (interval)
         {
-          streamCurrentRequest(session, printerForAccepts(request->m_accepts), *interval,
-                               request->parameter<string>("device"),
-                               request->parameter<string>("path"),
-                               *request->parameter<bool>("pretty"));
+          auto printer = printerForAccepts(request->m_accepts);
+          streamCurrentRequest(
+              session, printer, *interval, request->parameter<string>("device"),
+              request->parameter<string>("path"), *request->parameter<bool>("pretty"),
+              acceptsEventStream(printer, request),
+              timeseriesEncoding(printer, request->parameter<string>("timeseries")));
         }
         else
         {
-          respond(session, currentRequest(printerForAccepts(request->m_accepts),
-                                          request->parameter<string>("device"),
-                                          request->parameter<uint64_t>("at"),
+          auto printer = printerForAccepts(request->m_accepts);
+          auto timeseries = timeseriesEncoding(printer, request->parameter<string>("timeseries"));
+          auto at = request->parameter<uint64_t>("at");
+          const buffer::Checkpoint *snapshot = nullptr;
+          if (!at && request->m_checkpoint)
+          {
+            // A batch answers from the checkpoint it copied when it was formed
+            at = request->m_asOf;
+            snapshot = request->m_checkpoint.get();
+          }
+          respond(session, currentRequest(printer, request->parameter<string>("device"), at,
                                           request->parameter<string>("path"),
-                                          *request->parameter<bool>("pretty")));
+                                          *request->parameter<bool>("pretty"),
+                                          request->parameter<uint64_t>("since"), timeseries,
+                                          snapshot));
         }
         return true;
       };
 
       string qp(
           "path={string}&at={unsigned_integer}&"
-          "interval={integer}&pretty={bool:false}");
+          "interval={integer}&since={unsigned_integer}&timeseries={string}&pretty={bool:false}");
       m_server->addRouting({boost::beast::http::verb::get, "/current?" + qp, handler})
           .document("MTConnect current request",
                     "Gets a stapshot of the state of all the observations for all devices "
@@ -610,20 +652,35 @@ namespace mtconnect {
         auto interval = request->parameter<int32_t>("interval");
         if (interval)
         {
+          // A reconnecting event stream resumes from the id of the last event received
+          auto printer = printerForAccepts(request->m_accepts);
+          auto eventStream = acceptsEventStream(printer, request);
+          auto from = request->parameter<uint64_t>("from");
+          if (eventStream)
+          {
+            if (auto last = lastEventId(request))
+              from = last;
+          }
+
           streamSampleRequest(
-              session, printerForAccepts(request->m_accepts), *interval,
-              *request->parameter<int32_t>("heartbeat"), *request->parameter<int32_t>("count"),
-              request->parameter<string>("device"), request->parameter<uint64_t>("from"),
-              request->parameter<string>("path"), *request->parameter<bool>("pretty"));
+              session, printer, *interval, *request->parameter<int32_t>("heartbeat"),
+              *request->parameter<int32_t>("count"), request->parameter<string>("device"), from,
+              request->parameter<string>("path"), *request->parameter<bool>("pretty"),
+              eventStream, backpressure(printer, request->parameter<string>("backpressure")),
+              request->parameter<int32_t>("maxLag"),
+              timeseriesEncoding(printer, request->parameter<string>("timeseries")));
         }
         else
         {
+          auto printer = printerForAccepts(request->m_accepts);
           respond(session,
                   sampleRequest(
-                      printerForAccepts(request->m_accepts), *request->parameter<int32_t>("count"),
+                      printer, *request->parameter<int32_t>("count"),
                       request->parameter<string>("device"), request->parameter<uint64_t>("from"),
                       request->parameter<uint64_t>("to"), request->parameter<string>("path"),
-                      *request->parameter<bool>("pretty")));
+                      *request->parameter<bool>("pretty"),
+                      timeseriesEncoding(printer, request->parameter<string>("timeseries")),
+                      request->m_asOf));
         }
         return true;
       };
@@ -632,7 +689,7 @@ namespace mtconnect {
           "path={string}&from={unsigned_integer}&"
           "interval={integer}&count={integer:100}&"
           "heartbeat={integer:10000}&to={unsigned_integer}&"
-          "pretty={bool:false}");
+          "backpressure={string}&maxLag={integer}&timeseries={string}&pretty={bool:false}");
       m_server->addRouting({boost::beast::http::verb::get, "/sample?" + qp, handler})
           .document("MTConnect sample request",
                     "Gets a time series of at maximum `count` observations for all devices "
@@ -643,6 +700,17 @@ namespace mtconnect {
                     "Gets a time series of at maximum `count` observations for device `device` "
                     "optionally filtered by the `path` and starting at `from`. By default, from is "
                     "the first available observation known to the agent");
+
+      auto metricsHandler = [&](SessionPtr session, RequestPtr request) -> bool {
+        respond(session, streamMetricsRequest(*request->parameter<bool>("pretty")));
+        return true;
+      };
+      // Below sample so it cannot take the probe request of a device named `streams`
+      m_server
+          ->addRouting({boost::beast::http::verb::get, "/sample/streams?pretty={bool:false}",
+                        metricsHandler})
+          .document("Sample stream metrics",
+                    "Gets the lag, chunks, and catch ups of each active sample stream as JSON");
     }
 
     void RestService::createPutObservationRoutings()
@@ -679,6 +747,22 @@ namespace mtconnect {
       }
     }
 
+    void RestService::createBatchRoutings()
+    {
+      using namespace rest_sink;
+      auto handler = [&](SessionPtr session, RequestPtr request) -> bool {
+        respond(session, batchRequest(printerForAccepts(request->m_accepts), session, request));
+        return true;
+      };
+
+      m_server->addRouting({boost::beast::http::verb::post, "/batch?pretty={bool:false}", handler})
+          .document("Batch of MTConnect requests",
+                    "The body is a JSON array of probe, current, sample, and asset requests, for "
+                    "example `[{\"request\": \"current\", \"device\": \"Mill\"}]`. The "
+                    "results are returned in order as a multipart/mixed response and are evaluated "
+                    "with the observation buffer locked so they are consistent.");
+    }
+
     // ----------------------------------------------------
     // Observation Add Method
     // ----------------------------------------------------
@@ -730,7 +814,10 @@ namespace mtconnect {
     ResponsePtr RestService::currentRequest(const Printer *printer,
                                             const std::optional<std::string> &device,
                                             const std::optional<SequenceNumber_t> &at,
-                                            const std::optional<std::string> &path, bool pretty)
+                                            const std::optional<std::string> &path, bool pretty,
+                                            const std::optional<SequenceNumber_t> &since,
+                                            TimeseriesEncoding timeseries,
+                                            const buffer::Checkpoint *snapshot)
     {
       using namespace rest_sink;
       DevicePtr dev {nullptr};
@@ -747,7 +834,8 @@ namespace mtconnect {
 
       // Check if there is a frequency to stream data or not
       return make_unique<Response>(rest_sink::status::ok,
-                                   fetchCurrentData(printer, filter, at, pretty),
+                                   fetchCurrentData(printer, filter, at, pretty, nullptr, since,
+                                                    timeseries, snapshot),
                                    printer->mimeType());
     }
 
@@ -755,7 +843,9 @@ namespace mtconnect {
                                            const std::optional<std::string> &device,
                                            const std::optional<SequenceNumber_t> &from,
                                            const std::optional<SequenceNumber_t> &to,
-                                           const std::optional<std::string> &path, bool pretty)
+                                           const std::optional<std::string> &path, bool pretty,
+                                           TimeseriesEncoding timeseries,
+                                           const std::optional<SequenceNumber_t> &asOf)
     {
       using namespace rest_sink;
       DevicePtr dev {nullptr};
@@ -776,7 +866,8 @@ namespace mtconnect {
 
       return make_unique<Response>(
           rest_sink::status::ok,
-          fetchSampleData(printer, filter, count, from, to, end, endOfBuffer, nullptr, pretty),
+          fetchSampleData(printer, filter, count, from, to, end, endOfBuffer, nullptr, pretty,
+                          timeseries, asOf),
           printer->mimeType());
     }
 
@@ -804,13 +895,22 @@ namespace mtconnect {
       chrono::system_clock::time_point m_last;
       boost::asio::steady_timer m_timer;
       bool m_pretty {false};
+      bool m_eventStream {false};
+      TimeseriesEncoding m_timeseries {TimeseriesEncoding::TEXT};
+      Backpressure m_backpressure {Backpressure::KEEP};
+      SequenceNumber_t m_maxLag {0};
+      StreamMetrics m_metrics;
+      chrono::steady_clock::time_point m_written;
     };
 
     void RestService::streamSampleRequest(rest_sink::SessionPtr session, const Printer *printer,
                                           const int interval, const int heartbeatIn,
                                           const int count, const std::optional<std::string> &device,
                                           const std::optional<SequenceNumber_t> &from,
-                                          const std::optional<std::string> &path, bool pretty)
+                                          const std::optional<std::string> &path, bool pretty,
+                                          bool eventStream, Backpressure backpressure,
+                                          const std::optional<int> &maxLag,
+                                          TimeseriesEncoding timeseries)
     {
       NAMED_SCOPE("RestService::streamSampleRequest");
 
@@ -820,6 +920,8 @@ namespace mtconnect {
 
       checkRange(printer, interval, -1, numeric_limits<int>().max(), "interval");
       checkRange(printer, heartbeatIn, 1, numeric_limits<int>().max(), "heartbeat");
+      if (maxLag)
+        checkRange(printer, *maxLag, 0, numeric_limits<int>().max(), "maxLag");
       DevicePtr dev {nullptr};
       if (device)
       {
@@ -832,6 +934,17 @@ namespace mtconnect {
       asyncResponse->m_heartbeat = std::chrono::milliseconds(heartbeatIn);
       asyncResponse->m_service = getptr();
       asyncResponse->m_pretty = pretty;
+      asyncResponse->m_eventStream = eventStream;
+      asyncResponse->m_timeseries = timeseries;
+      asyncResponse->m_backpressure = backpressure;
+      if (backpressure == Backpressure::BOUNDED && maxLag)
+        asyncResponse->m_maxLag = *maxLag;
+      else
+        asyncResponse->m_maxLag = count;
+
+      const auto &remote = session->getRemote();
+      asyncResponse->m_metrics.m_remote =
+          remote.address().to_string() + ":" + to_string(remote.port());
 
       checkPath(asyncResponse->m_printer, path, dev, asyncResponse->m_filter);
 
@@ -865,8 +978,14 @@ namespace mtconnect {
       asyncResponse->m_interval = chrono::milliseconds(interval);
       asyncResponse->m_logStreamData = m_logStreamData;
 
+      {
+        std::lock_guard<std::mutex> lock(m_streamsLock);
+        m_streams.remove_if([](const auto &stream) { return stream.expired(); });
+        m_streams.emplace_back(asyncResponse);
+      }
+
       session->beginStreaming(
-          printer->mimeType(),
+          eventStream ? EventStreamMimeType : printer->mimeType(),
           asio::bind_executor(
               m_strand, boost::bind(&RestService::streamSampleWriteComplete, this, asyncResponse)));
     }
@@ -876,6 +995,12 @@ namespace mtconnect {
       NAMED_SCOPE("RestService::streamSampleWriteComplete");
 
       asyncResponse->m_last = chrono::system_clock::now();
+      if (asyncResponse->m_metrics.m_chunks > 0)
+      {
+        std::lock_guard<std::mutex> lock(m_streamsLock);
+        asyncResponse->m_metrics.m_writeTime = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - asyncResponse->m_written);
+      }
       if (asyncResponse->m_endOfBuffer)
       {
         using boost::placeholders::_1;
@@ -970,9 +1095,19 @@ namespace mtconnect {
         string content;
         asyncResponse->m_endOfBuffer = true;
 
+        // The buffer is locked for the whole chunk, so the lag is measured against the same
+        // buffer the chunk is fetched from and recorded in the metrics. Only the observations
+        // of the stream's data items count, a stream is not behind when other items change.
+        auto &buffer = m_sinkContract->getCircularBuffer();
+        bool behind = asyncResponse->m_sequence < buffer.getFirstSequence();
+        SequenceNumber_t lag =
+            buffer.countObservations(asyncResponse->m_filter, asyncResponse->m_sequence);
+        bool catchUp = asyncResponse->m_backpressure != Backpressure::KEEP &&
+                       (behind || lag > asyncResponse->m_maxLag);
+
         // Check if we're falling too far behind. If we are, generate an
         // MTConnectError and return.
-        if (asyncResponse->m_sequence < m_sinkContract->getCircularBuffer().getFirstSequence())
+        if (behind && asyncResponse->m_backpressure == Backpressure::KEEP)
         {
           LOG(warning) << "Client fell too far behind, disconnecting";
           asyncResponse->m_session->fail(boost::beast::http::status::not_found,
@@ -980,33 +1115,57 @@ namespace mtconnect {
           return;
         }
 
-        // end and endOfBuffer are set during the fetch sample data while the
-        // mutex is held. This removed the race to check if we are at the end of
-        // the bufffer and setting the next start to the last sequence number
-        // sent.
-        content = fetchSampleData(asyncResponse->m_printer, asyncResponse->m_filter,
-                                  asyncResponse->m_count, asyncResponse->m_sequence, nullopt, end,
-                                  asyncResponse->m_endOfBuffer, &asyncResponse->m_observer,
-                                  asyncResponse->m_pretty);
-
-        // Even if we are at the end of the buffer, or within range. If we are filtering,
-        // we will need to make sure we are not spinning when there are no valid events
-        // to be reported. we will waste cycles spinning on the end of the buffer when
-        // we should be in a heartbeat wait as well.
-        if (!asyncResponse->m_endOfBuffer)
+        if (catchUp)
         {
-          // If we're not at the end of the buffer, move to the end of the previous set and
-          // begin filtering from where we left off.
+          // Coalesce the backlog to the latest observation of each data item. The checkpoint
+          // has every data item, so this also catches up a client that fell out of the buffer.
+          LOG(debug) << "Client " << asyncResponse->m_metrics.m_remote << " is "
+                     << lag << " observations behind, catching up";
+
+          optional<SequenceNumber_t> since;
+          if (!behind && asyncResponse->m_sequence > 1)
+            since = asyncResponse->m_sequence - 1;
+          content = fetchCurrentData(asyncResponse->m_printer, asyncResponse->m_filter, nullopt,
+                                     asyncResponse->m_pretty, &end, since,
+                                     asyncResponse->m_timeseries);
+          asyncResponse->m_observer.reset();
           asyncResponse->m_sequence = end;
         }
+        else
+        {
+          // end and endOfBuffer are set during the fetch sample data while the
+          // mutex is held. This removed the race to check if we are at the end of
+          // the bufffer and setting the next start to the last sequence number
+          // sent.
+          content = fetchSampleData(asyncResponse->m_printer, asyncResponse->m_filter,
+                                    asyncResponse->m_count, asyncResponse->m_sequence, nullopt,
+                                    end, asyncResponse->m_endOfBuffer, &asyncResponse->m_observer,
+                                    asyncResponse->m_pretty, asyncResponse->m_timeseries);
+
+          // Even if we are at the end of the buffer, or within range. If we are filtering,
+          // we will need to make sure we are not spinning when there are no valid events
+          // to be reported. we will waste cycles spinning on the end of the buffer when
+          // we should be in a heartbeat wait as well.
+          if (!asyncResponse->m_endOfBuffer)
+          {
+            // If we're not at the end of the buffer, move to the end of the previous set and
+            // begin filtering from where we left off.
+            asyncResponse->m_sequence = end;
+          }
+        }
+
+        asyncResponse->m_written = chrono::steady_clock::now();
+        updateMetrics(*asyncResponse, lag, catchUp);
 
         if (m_logStreamData)
           asyncResponse->m_log << content << endl;
 
+        // The next sequence is the event id, a reconnecting client resumes from there.
         asyncResponse->m_session->writeChunk(
-            content,
+            std::move(content),
             asio::bind_executor(m_strand, boost::bind(&RestService::streamSampleWriteComplete, this,
-                                                      asyncResponse)));
+                                                      asyncResponse)),
+            to_string(end));
       }
     }
 
@@ -1023,12 +1182,14 @@ namespace mtconnect {
       FilterSetOpt m_filter;
       boost::asio::steady_timer m_timer;
       bool m_pretty {false};
+      TimeseriesEncoding m_timeseries {TimeseriesEncoding::TEXT};
     };
 
     void RestService::streamCurrentRequest(SessionPtr session, const Printer *printer,
                                            const int interval,
                                            const std::optional<std::string> &device,
-                                           const std::optional<std::string> &path, bool pretty)
+                                           const std::optional<std::string> &path, bool pretty,
+                                           bool eventStream, TimeseriesEncoding timeseries)
     {
       checkRange(printer, interval, 0, numeric_limits<int>().max(), "interval");
       DevicePtr dev {nullptr};
@@ -1047,9 +1208,11 @@ namespace mtconnect {
       asyncResponse->m_printer = printer;
       asyncResponse->m_service = getptr();
       asyncResponse->m_pretty = pretty;
+      asyncResponse->m_timeseries = timeseries;
 
       asyncResponse->m_session->beginStreaming(
-          printer->mimeType(), boost::asio::bind_executor(m_strand, [this, asyncResponse]() {
+          eventStream ? EventStreamMimeType : printer->mimeType(),
+          boost::asio::bind_executor(m_strand, [this, asyncResponse]() {
             streamNextCurrent(asyncResponse, boost::system::error_code {});
           }));
     }
@@ -1081,20 +1244,87 @@ namespace mtconnect {
         return;
       }
 
+      SequenceNumber_t next;
+      auto content = fetchCurrentData(asyncResponse->m_printer, asyncResponse->m_filter, nullopt,
+                                      asyncResponse->m_pretty, &next, nullopt,
+                                      asyncResponse->m_timeseries);
       asyncResponse->m_session->writeChunk(
-          fetchCurrentData(asyncResponse->m_printer, asyncResponse->m_filter, nullopt,
-                           asyncResponse->m_pretty),
-          boost::asio::bind_executor(m_strand, [this, asyncResponse]() {
-            asyncResponse->m_timer.expires_from_now(asyncResponse->m_interval);
-            asyncResponse->m_timer.async_wait(boost::asio::bind_executor(
-                m_strand, boost::bind(&RestService::streamNextCurrent, this, asyncResponse, _1)));
-          }));
+          std::move(content),
+          boost::asio::bind_executor(m_strand,
+                                     [this, asyncResponse]() {
+                                       asyncResponse->m_timer.expires_from_now(
+                                           asyncResponse->m_interval);
+                                       asyncResponse->m_timer.async_wait(boost::asio::bind_executor(
+                                           m_strand, boost::bind(&RestService::streamNextCurrent,
+                                                                 this, asyncResponse, _1)));
+                                     }),
+          to_string(next));
+    }
+
+    /// @brief Create a weak entity tag for an assets document
+    ///
+    /// The tag changes when the content, removed state, or timestamp of any of the assets changes
+    /// or when the header would change. The creation time is ignored.
+    static string assetsEntityTag(const Printer *printer, const uint64_t instanceId,
+                                  const size_t assetCount, const AssetList &list, bool pretty)
+    {
+      boost::uuids::detail::sha1 sha1;
+      auto add = [&sha1](const string &text) { sha1.process_bytes(text.c_str(), text.size() + 1); };
+
+      add(printer->mimeType());
+      add(to_string(instanceId));
+      add(to_string(assetCount));
+      add(pretty ? "pretty" : "");
+      for (const auto &asset : list)
+      {
+        add(asset->getAssetId());
+        add(asset->getContentHash());
+        add(asset->isRemoved() ? "removed" : "");
+        if (auto ts = asset->getTimestamp())
+          add(to_string(ts->time_since_epoch().count()));
+      }
+
+      unsigned int digest[5];
+      sha1.get_digest(digest);
+
+      char encoded[32];
+      auto len = boost::beast::detail::base64::encode(encoded, digest, sizeof(digest));
+
+      return "W/\"" + string(encoded, len) + "\"";
+    }
+
+    /// @brief Check if an If-None-Match header matches an entity tag using weak comparison
+    static bool entityTagMatches(const optional<string> &ifNoneMatch, const string &etag)
+    {
+      if (!ifNoneMatch)
+        return false;
+
+      auto opaque = [](string_view tag) {
+        tag.remove_prefix(std::min(tag.find_first_not_of(" \t"), tag.size()));
+        tag.remove_suffix(tag.size() - std::min(tag.find_last_not_of(" \t") + 1, tag.size()));
+        if (tag.substr(0, 2) == "W/")
+          tag.remove_prefix(2);
+        return tag;
+      };
+
+      string_view tags(*ifNoneMatch);
+      while (!tags.empty())
+      {
+        auto comma = tags.find(',');
+        auto tag = opaque(tags.substr(0, comma));
+        if (tag == "*" || tag == opaque(etag))
+          return true;
+        tags.remove_prefix(comma == string_view::npos ? tags.size() : comma + 1);
+      }
+
+      return false;
     }
 
     ResponsePtr RestService::assetRequest(const Printer *printer, const int32_t count,
                                           const bool removed,
                                           const std::optional<std::string> &type,
-                                          const std::optional<std::string> &device, bool pretty)
+                                          const std::optional<std::string> &device, bool pretty,
+                                          const std::optional<std::string> &ifNoneMatch)
     {
       using namespace rest_sink;
 
@@ -1108,16 +1338,28 @@ namespace mtconnect {
       }
 
       m_sinkContract->getAssetStorage()->getAssets(list, count, !removed, uuid, type);
-      return make_unique<Response>(
+      auto assetCount = m_sinkContract->getAssetStorage()->getCount();
+      auto etag = assetsEntityTag(printer, m_instanceId, assetCount, list, pretty);
+      if (entityTagMatches(ifNoneMatch, etag))
+      {
+        auto response = make_unique<Response>(status::not_modified, "", printer->mimeType());
+        response->m_etag = etag;
+        return response;
+      }
+
+      auto response = make_unique<Response>(
           status::ok,
-          printer->printAssets(
-              m_instanceId, uint32_t(m_sinkContract->getAssetStorage()->getMaxAssets()),
-              uint32_t(m_sinkContract->getAssetStorage()->getCount()), list, pretty),
+          printer->printAssets(m_instanceId,
+                               uint32_t(m_sinkContract->getAssetStorage()->getMaxAssets()),
+                               uint32_t(assetCount), list, pretty),
           printer->mimeType());
+      response->m_etag = etag;
+      return response;
     }
 
     ResponsePtr RestService::assetIdsRequest(const Printer *printer,
-                                             const std::list<std::string> &ids, bool pretty)
+                                             const std::list<std::string> &ids, bool pretty,
+                                             const std::optional<std::string> &ifNoneMatch)
     {
       using namespace rest_sink;
 
@@ -1136,12 +1378,23 @@ namespace mtconnect {
       }
       else
       {
-        return make_unique<Response>(
+        auto assetCount = m_sinkContract->getAssetStorage()->getCount();
+        auto etag = assetsEntityTag(printer, m_instanceId, assetCount, list, pretty);
+        if (entityTagMatches(ifNoneMatch, etag))
+        {
+          auto response = make_unique<Response>(status::not_modified, "", printer->mimeType());
+          response->m_etag = etag;
+          return response;
+        }
+
+        auto response = make_unique<Response>(
             status::ok,
-            printer->printAssets(
-                m_instanceId, uint32_t(m_sinkContract->getAssetStorage()->getMaxAssets()),
-                uint32_t(m_sinkContract->getAssetStorage()->getCount()), list, pretty),
+            printer->printAssets(m_instanceId,
+                                 uint32_t(m_sinkContract->getAssetStorage()->getMaxAssets()),
+                                 uint32_t(assetCount), list, pretty),
             printer->mimeType());
+        response->m_etag = etag;
+        return response;
       }
     }
 
@@ -1301,6 +1554,151 @@ namespace mtconnect {
       }
     }
 
+    /// @brief Collects the responses of the requests in a batch
+    class BatchSession : public Session
+    {
+    public:
+      BatchSession(const SessionPtr &parent, Dispatch dispatch, ErrorFunction error)
+        : Session(dispatch, error)
+      {
+        m_remote = parent->getRemote();
+      }
+
+      void run() override {}
+      void writeResponse(ResponsePtr &&response, Complete complete = nullptr) override
+      {
+        m_responses.emplace_back(std::move(response));
+        if (complete)
+          complete();
+      }
+      void writeFailureResponse(ResponsePtr &&response, Complete complete = nullptr) override
+      {
+        writeResponse(std::move(response), complete);
+      }
+      void beginStreaming(const std::string &mimeType, Complete complete) override
+      {
+        m_responses.emplace_back(make_unique<Response>(
+            status::bad_request, "Streaming is not supported in a batch", "text/plain"));
+      }
+      void writeChunk(std::string chunk, Complete complete,
+                      const std::optional<std::string> &id = std::nullopt) override
+      {}
+      void close() override {}
+      void closeStream() override {}
+
+      std::list<ResponsePtr> m_responses;
+    };
+
+    ResponsePtr RestService::batchRequest(const Printer *printer, SessionPtr session,
+                                          const RequestPtr &request)
+    {
+      NAMED_SCOPE("RestService::batchRequest");
+
+      using json = nlohmann::json;
+      static const set<string> commands {"probe", "current", "sample", "asset", "assets"};
+
+      auto invalid = [&](const string &msg) {
+        return make_unique<Response>(status::bad_request,
+                                     printError(printer, "INVALID_REQUEST", msg),
+                                     printer->mimeType());
+      };
+
+      json doc;
+      try
+      {
+        doc = json::parse(request->m_body);
+      }
+      catch (json::exception &e)
+      {
+        return invalid(string("Invalid batch request: ") + e.what());
+      }
+      if (!doc.is_array())
+        return invalid("A batch request must be a JSON array of requests");
+
+      auto asString = [](const json &value) {
+        return value.is_string() ? value.get<string>() : value.dump();
+      };
+
+      auto batch = make_shared<BatchSession>(
+          session, [this](SessionPtr s, RequestPtr r) { return m_server->dispatch(s, r); },
+          m_server->getErrorFunction());
+
+      // Every document is answered as of the same sequence number so they are consistent. The
+      // latest checkpoint is copied once for the current requests, each request only holds the
+      // buffer while it collects its observations and they are rendered after it is released.
+      SequenceNumber_t asOf;
+      std::shared_ptr<const Checkpoint> checkpoint;
+      {
+        std::lock_guard<CircularBuffer> lock(m_sinkContract->getCircularBuffer());
+        asOf = m_sinkContract->getCircularBuffer().getSequence() - 1;
+        checkpoint = make_shared<const Checkpoint>(m_sinkContract->getCircularBuffer().getLatest());
+      }
+
+      for (auto &entry : doc)
+      {
+        if (!entry.is_object() || !entry.contains("request") ||
+            commands.count(asString(entry["request"])) == 0)
+        {
+          batch->writeResponse(invalid("Each batch entry must have a request of probe, "
+                                       "current, sample, or asset"));
+          continue;
+        }
+        if (entry.contains("interval"))
+        {
+          batch->writeResponse(invalid("Streaming is not supported in a batch"));
+          continue;
+        }
+
+        auto sub = make_shared<Request>();
+        sub->m_verb = boost::beast::http::verb::get;
+        sub->m_accepts = request->m_accepts;
+        sub->m_foreignIp = request->m_foreignIp;
+        sub->m_foreignPort = request->m_foreignPort;
+        sub->m_asOf = asOf;
+        sub->m_checkpoint = checkpoint;
+
+        string device;
+        for (auto &[key, value] : entry.items())
+        {
+          if (key == "request")
+            continue;
+          else if (key == "device")
+            device = asString(value);
+          else
+            sub->m_query[key] = asString(value);
+        }
+        if (!sub->m_query.count("pretty") && request->m_query.count("pretty"))
+          sub->m_query["pretty"] = request->m_query.at("pretty");
+
+        auto command = asString(entry["request"]);
+        if (device.empty())
+          sub->m_path = "/" + command;
+        else
+          sub->m_path = "/" + device + "/" + command;
+
+        auto count = batch->m_responses.size();
+        m_server->dispatch(batch, sub);
+        if (batch->m_responses.size() == count)
+          batch->writeResponse(invalid("No response for " + sub->m_path));
+      }
+
+      // Each result is a part in the same format as a multipart stream
+      boost::uuids::random_generator gen;
+      auto boundary = boost::uuids::to_string(gen());
+      ostringstream body;
+      for (auto &response : batch->m_responses)
+      {
+        body << "--" << boundary << "\r\n"
+             << "Content-Type: " << response->m_mimeType << "\r\n"
+             << "Content-Length: " << response->m_body.length() << "\r\n"
+             << "Status: " << static_cast<int>(response->m_status) << "\r\n\r\n"
+             << response->m_body << "\r\n";
+      }
+      body << "--" << boundary << "--\r\n";
+
+      return make_unique<Response>(status::ok, body.str(), "multipart/mixed;boundary=" + boundary);
+    }
+
     // For debugging
     void RestService::setLogStreamData(bool log) { m_logStreamData = log; }
 
@@ -1337,6 +1735,134 @@ namespace mtconnect {
         return errorCode + ": " + text;
     }
 
+    // -----------------------------------------------
+    // Stream Backpressure
+    // -----------------------------------------------
+
+    Backpressure RestService::backpressure(const Printer *printer,
+                                           const std::optional<std::string> &policy) const
+    {
+      if (!policy || *policy == "keep")
+        return Backpressure::KEEP;
+      else if (*policy == "coalesce")
+        return Backpressure::COALESCE;
+      else if (*policy == "bounded")
+        return Backpressure::BOUNDED;
+
+      string msg("'backpressure' must be keep, coalesce, or bounded");
+      throw RequestError(msg.c_str(), printError(printer, "INVALID_REQUEST", msg),
+                         printer->mimeType(), status::bad_request);
+    }
+
+    // -----------------------------------------------
+    // Timeseries Encoding
+    // -----------------------------------------------
+
+    TimeseriesEncoding RestService::timeseriesEncoding(
+        const Printer *printer, const std::optional<std::string> &encoding) const
+    {
+      if (!encoding)
+        return TimeseriesEncoding::TEXT;
+      else if (auto e = ParseTimeseriesEncoding(*encoding))
+        return *e;
+
+      string msg("'timeseries' must be text, float32, float64, delta, or gorilla");
+      throw RequestError(msg.c_str(), printError(printer, "INVALID_REQUEST", msg),
+                         printer->mimeType(), status::bad_request);
+    }
+
+    void RestService::updateMetrics(AsyncSampleResponse &asyncResponse, SequenceNumber_t lag,
+                                    bool catchUp)
+    {
+      std::lock_guard<std::mutex> lock(m_streamsLock);
+      auto &metrics = asyncResponse.m_metrics;
+      metrics.m_sequence = asyncResponse.m_sequence;
+      metrics.m_lag = lag;
+      metrics.m_chunks++;
+      if (catchUp)
+        metrics.m_catchUps++;
+    }
+
+    std::list<StreamMetrics> RestService::getStreamMetrics()
+    {
+      std::lock_guard<std::mutex> lock(m_streamsLock);
+      std::list<StreamMetrics> metrics;
+      for (auto it = m_streams.begin(); it != m_streams.end();)
+      {
+        if (auto stream = it->lock())
+        {
+          metrics.emplace_back(stream->m_metrics);
+          it++;
+        }
+        else
+        {
+          it = m_streams.erase(it);
+        }
+      }
+
+      return metrics;
+    }
+
+    ResponsePtr RestService::streamMetricsRequest(bool pretty)
+    {
+      using namespace rest_sink;
+      using namespace printer;
+
+      // The client addresses are only logged, they are not given to any client that asks
+      auto metrics = getStreamMetrics();
+      string body = BufferPool::global().take();
+      StringOutputStream output(body);
+      RenderJson(output, pretty, [&metrics](auto &writer) {
+        AutoJsonObject obj(writer);
+        AutoJsonArray streams(writer, "Streams");
+        for (const auto &stream : metrics)
+        {
+          AutoJsonObject entry(writer);
+          entry.AddPairs("sequence", uint64_t(stream.m_sequence), "lag", uint64_t(stream.m_lag),
+                         "chunks", stream.m_chunks, "catchUps", stream.m_catchUps, "writeTime",
+                         int64_t(stream.m_writeTime.count()));
+        }
+      });
+
+      return make_unique<Response>(status::ok, std::move(body), "application/json");
+    }
+
+    // -----------------------------------------------
+    // Server-Sent Events
+    // -----------------------------------------------
+
+    bool RestService::acceptsEventStream(const Printer *printer, const RequestPtr &request) const
+    {
+      if (request->m_accepts.find(EventStreamMimeType) == string::npos)
+        return false;
+
+      // Event data is text, so binary documents cannot be sent as events
+      if (printer->isBinary())
+      {
+        string msg("text/event-stream cannot be used with " + printer->mimeType());
+        throw RequestError(msg.c_str(), printError(printer, "INVALID_REQUEST", msg),
+                           printer->mimeType(), status::not_acceptable);
+      }
+
+      return true;
+    }
+
+    std::optional<SequenceNumber_t> RestService::lastEventId(const RequestPtr &request) const
+    {
+      if (!request->m_lastEventId || request->m_lastEventId->empty())
+        return nullopt;
+
+      try
+      {
+        return boost::lexical_cast<SequenceNumber_t>(*request->m_lastEventId);
+      }
+      catch (boost::bad_lexical_cast &)
+      {
+        LOG(warning) << "Ignoring invalid Last-Event-ID: " << *request->m_lastEventId;
+        return nullopt;
+      }
+    }
+
     // -----------------------------------------------
     // Validation methods
     // -----------------------------------------------
@@ -1407,7 +1933,11 @@ namespace mtconnect {
     // -------------------------------------------
 
     string RestService::fetchCurrentData(const Printer *printer, const FilterSetOpt &filterSet,
-                                         const optional<SequenceNumber_t> &at, bool pretty)
+                                         const optional<SequenceNumber_t> &at, bool pretty,
+                                         SequenceNumber_t *next,
+                                         const optional<SequenceNumber_t> &since,
+                                         TimeseriesEncoding timeseries,
+                                         const buffer::Checkpoint *snapshot)
     {
       ObservationList observations;
       SequenceNumber_t firstSeq, seq;
@@ -1417,19 +1947,34 @@ namespace mtconnect {
 
         firstSeq = m_sinkContract->getCircularBuffer().getFirstSequence();
         seq = m_sinkContract->getCircularBuffer().getSequence();
-        if (at)
-        {
+        if (at && !snapshot)
           checkRange(printer, *at, firstSeq - 1, seq, "at");
+        if (since)
+          checkRange(printer, *since, SequenceNumber_t(0), at ? *at + 1 : seq, "since");
 
+        if (at && snapshot)
+        {
+          // The copy stays valid after the buffer has moved past `at`
+          seq = *at + 1;
+          snapshot->getObservations(observations, filterSet, since);
+        }
+        else if (at)
+        {
           auto check = m_sinkContract->getCircularBuffer().getCheckpointAt(*at, filterSet);
-          check->getObservations(observations);
+          check->getObservations(observations, nullopt, since);
         }
         else
         {
-          m_sinkContract->getCircularBuffer().getLatest().getObservations(observations, filterSet);
+          m_sinkContract->getCircularBuffer().getLatest().getObservations(observations, filterSet,
+                                                                          since);
         }
       }
 
+      if (next)
+        *next = seq;
+
+      EncodeTimeseries(observations, timeseries);
+      renderInParallel(printer, observations, pretty);
       return printer->printSample(m_instanceId, m_sinkContract->getCircularBuffer().getBufferSize(),
                                   seq, firstSeq, seq - 1, observations, pretty);
     }
@@ -1438,7 +1983,9 @@ namespace mtconnect {
                                         int count, const std::optional<SequenceNumber_t> &from,
                                         const std::optional<SequenceNumber_t> &to,
                                         SequenceNumber_t &end, bool &endOfBuffer,
-                                        ChangeObserver *observer, bool pretty)
+                                        ChangeObserver *observer, bool pretty,
+                                        TimeseriesEncoding timeseries,
+                                        const std::optional<SequenceNumber_t> &asOf)
     {
       std::unique_ptr<ObservationList> observations;
       SequenceNumber_t firstSeq, lastSeq;
@@ -1447,6 +1994,8 @@ namespace mtconnect {
         std::lock_guard<CircularBuffer> lock(m_sinkContract->getCircularBuffer());
         firstSeq = m_sinkContract->getCircularBuffer().getFirstSequence();
         auto seq = m_sinkContract->getCircularBuffer().getSequence();
+        if (asOf && *asOf < seq)
+          seq = *asOf + 1;
         lastSeq = seq - 1;
         int upperCountLimit = m_sinkContract->getCircularBuffer().getBufferSize() + 1;
         int lowerCountLimit = -upperCountLimit;
@@ -1463,16 +2012,99 @@ namespace mtconnect {
         }
         checkRange(printer, count, lowerCountLimit, upperCountLimit, "count", true);
 
+        // Reading backwards starts at the last sequence the request is answered as of
+        auto start = from;
+        if (asOf && count < 0 && !start)
+          start = lastSeq;
+
         observations = m_sinkContract->getCircularBuffer().getObservations(
-            count, filterSet, from, to, end, firstSeq, endOfBuffer);
+            count, filterSet, start, to, end, firstSeq, endOfBuffer);
+
+        // Reading forwards can pass it, so leave out anything added since
+        if (asOf && end > seq)
+        {
+          observations->erase(std::remove_if(observations->begin(), observations->end(),
+                                             [seq](const ObservationPtr &o) {
+                                               return o->getSequence() >= seq;
+                                             }),
+                              observations->end());
+          end = seq;
+          endOfBuffer = true;
+        }
 
         if (observer)
           observer->reset();
       }
 
+      EncodeTimeseries(*observations, timeseries);
+      renderInParallel(printer, *observations, pretty);
       return printer->printSample(m_instanceId, m_sinkContract->getCircularBuffer().getBufferSize(),
                                   end, firstSeq, lastSeq, *observations, pretty);
     }
 
+    void RestService::renderInParallel(const Printer *printer, const ObservationList &observations,
+                                       bool pretty)
+    {
+      if (m_workerThreads < 2 || m_parallelRenderThreshold == 0 ||
+          observations.size() < m_parallelRenderThreshold ||
+          FragmentCache::getSize() >= FragmentCache::getBudget() ||
+          !printer->cachesObservations(pretty))
+        return;
+
+      constexpr size_t batchSize = 512;
+
+      // Helpers that start after all the batches have been claimed return without touching the
+      // printer or the observations
+      struct Work
+      {
+        const Printer *m_printer;
+        bool m_pretty;
+        vector<ObservationPtr> m_observations;
+        size_t m_batches;
+        std::atomic<size_t> m_next {0};
+        std::mutex m_lock;
+        std::condition_variable m_finished;
+        size_t m_done {0};
+
+        void run()
+        {
+          size_t batch;
+          while ((batch = m_next.fetch_add(1)) < m_batches)
+          {
+            auto first = batch * batchSize;
+            auto last = std::min(first + batchSize, m_observations.size());
+            try
+            {
+              for (auto i = first; i < last; i++)
+                m_printer->cacheObservation(m_observations[i], m_pretty);
+            }
+            catch (...)
+            {
+              // Observations that are not cached are rendered when the document is printed
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (++m_done == m_batches)
+              m_finished.notify_all();
+          }
+        }
+      };
+
+      auto work = make_shared<Work>();
+      work->m_printer = printer;
+      work->m_pretty = pretty;
+      work->m_observations.assign(observations.begin(), observations.end());
+      work->m_batches = (observations.size() + batchSize - 1) / batchSize;
+
+      auto helpers = std::min<size_t>(m_workerThreads - 1, work->m_batches - 1);
+      for (size_t i = 0; i < helpers; i++)
+        asio::post(m_context, [work]() { work->run(); });
+
+      work->run();
+
+      std::unique_lock<std::mutex> lock(work->m_lock);
+      work->m_finished.wait(lock, [&work]() { return work->m_done == work->m_batches; });
+    }
+
   }  // namespace sink::rest_sink
 }  // namespace mtconnect
@@ -18,9 +18,12 @@
 #pragma once
 
 #include <boost/asio/io_context.hpp>
+#include <list>
+#include <mutex>
 
 #include "mtconnect/buffer/circular_buffer.hpp"
 #include "mtconnect/config.hpp"
+#include "mtconnect/observation/timeseries_encoding.hpp"
 #include "mtconnect/sink/sink.hpp"
 #include "mtconnect/source/loopback_source.hpp"
 #include "mtconnect/utilities.hpp"
@@ -38,6 +41,25 @@ namespace mtconnect {
     struct AsyncSampleResponse;
     struct AsyncCurrentResponse;
 
+    /// @brief How a sample stream treats a client that cannot keep up with the observations
+    enum class Backpressure
+    {
+      KEEP,      ///< Send every observation, disconnect if the client falls out of the buffer
+      COALESCE,  ///< Send the latest observation per data item when more than a chunk behind
+      BOUNDED    ///< Send the latest observation per data item when more than `maxLag` behind
+    };
+
+    /// @brief Lag metrics for a sample stream
+    struct StreamMetrics
+    {
+      std::string m_remote;              ///< The client address and port, only logged
+      SequenceNumber_t m_sequence {0};   ///< The next sequence number to send
+      SequenceNumber_t m_lag {0};        ///< Observations of the stream not yet sent
+      uint64_t m_chunks {0};             ///< Number of chunks sent
+      uint64_t m_catchUps {0};           ///< Number of coalesced documents sent to catch up
+      std::chrono::milliseconds m_writeTime {0};  ///< Time taken to write the last chunk
+    };
+
     /// @brief Callback fundtion for setting namespaces
     using NamespaceFunction = void (printer::XmlPrinter::*)(const std::string &,
                                                             const std::string &,
@@ -105,12 +127,19 @@ namespace mtconnect {
       /// @param[in] at optional sequence number to take the snapshot
       /// @param[in] path an xpath to filter
       /// @param[in] pretty `true` to ensure response is formatted
+      /// @param[in] since optional sequence number, only data items that changed after `since`
+      ///            are included. The `lastSequence` of the response is the next `since`.
+      /// @param[in] timeseries the encoding of timeseries values
+      /// @param[in] snapshot optional copy of the checkpoint at `at`, used instead of
+      ///            reconstructing it from the buffer
       /// @return MTConnect Streams response
-      ResponsePtr currentRequest(const printer::Printer *p,
-                                 const std::optional<std::string> &device = std::nullopt,
-                                 const std::optional<SequenceNumber_t> &at = std::nullopt,
-                                 const std::optional<std::string> &path = std::nullopt,
-                                 bool pretty = false);
+      ResponsePtr currentRequest(
+          const printer::Printer *p, const std::optional<std::string> &device = std::nullopt,
+          const std::optional<SequenceNumber_t> &at = std::nullopt,
+          const std::optional<std::string> &path = std::nullopt, bool pretty = false,
+          const std::optional<SequenceNumber_t> &since = std::nullopt,
+          observation::TimeseriesEncoding timeseries = observation::TimeseriesEncoding::TEXT,
+          const buffer::Checkpoint *snapshot = nullptr);
 
       /// @brief Handler for a sample request
       /// @param[in] p printer for doc generation
@@ -120,13 +149,18 @@ namespace mtconnect {
       /// @param[in] to optional ending sequence number
       /// @param[in] path an xpath for filtering
       /// @param[in] pretty `true` to ensure response is formatted
+      /// @param[in] timeseries the encoding of timeseries values
+      /// @param[in] asOf optional last sequence number to include, observations added after it
+      ///            are left out
       /// @return MTConnect Streams response
-      ResponsePtr sampleRequest(const printer::Printer *p, const int count = 100,
-                                const std::optional<std::string> &device = std::nullopt,
-                                const std::optional<SequenceNumber_t> &from = std::nullopt,
-                                const std::optional<SequenceNumber_t> &to = std::nullopt,
-                                const std::optional<std::string> &path = std::nullopt,
-                                bool pretty = false);
+      ResponsePtr sampleRequest(
+          const printer::Printer *p, const int count = 100,
+          const std::optional<std::string> &device = std::nullopt,
+          const std::optional<SequenceNumber_t> &from = std::nullopt,
+          const std::optional<SequenceNumber_t> &to = std::nullopt,
+          const std::optional<std::string> &path = std::nullopt, bool pretty = false,
+          observation::TimeseriesEncoding timeseries = observation::TimeseriesEncoding::TEXT,
+          const std::optional<SequenceNumber_t> &asOf = std::nullopt);
       /// @brief Handler for a streaming sample
       /// @param[in] session session to stream data to
       /// @param[in] p printer for doc generation
@@ -137,12 +171,18 @@ namespace mtconnect {
       /// @param[in] from optional starting sequence number
       /// @param[in] path optional path for filtering
       /// @param[in] pretty `true` to ensure response is formatted
-      void streamSampleRequest(SessionPtr session, const printer::Printer *p, const int interval,
-                               const int heartbeat, const int count = 100,
-                               const std::optional<std::string> &device = std::nullopt,
-                               const std::optional<SequenceNumber_t> &from = std::nullopt,
-                               const std::optional<std::string> &path = std::nullopt,
-                               bool pretty = false);
+      /// @param[in] eventStream `true` to send Server-Sent Events with the next sequence as the id
+      /// @param[in] backpressure how to handle a client that falls behind
+      /// @param[in] maxLag the number of observations a `BOUNDED` client can fall behind
+      /// @param[in] timeseries the encoding of timeseries values
+      void streamSampleRequest(
+          SessionPtr session, const printer::Printer *p, const int interval, const int heartbeat,
+          const int count = 100, const std::optional<std::string> &device = std::nullopt,
+          const std::optional<SequenceNumber_t> &from = std::nullopt,
+          const std::optional<std::string> &path = std::nullopt, bool pretty = false,
+          bool eventStream = false, Backpressure backpressure = Backpressure::KEEP,
+          const std::optional<int> &maxLag = std::nullopt,
+          observation::TimeseriesEncoding timeseries = observation::TimeseriesEncoding::TEXT);
 
       /// @brief Handler for a streaming current
       /// @param[in] session session to stream data to
@@ -151,10 +191,14 @@ namespace mtconnect {
       /// @param[in] device optional device name or uuid
       /// @param[in] path optional path for filtering
       /// @param[in] pretty `true` to ensure response is formatted
-      void streamCurrentRequest(SessionPtr session, const printer::Printer *p, const int interval,
-                                const std::optional<std::string> &device = std::nullopt,
-                                const std::optional<std::string> &path = std::nullopt,
-                                bool pretty = false);
+      /// @param[in] eventStream `true` to send Server-Sent Events with the next sequence as the id
+      /// @param[in] timeseries the encoding of timeseries values
+      void streamCurrentRequest(
+          SessionPtr session, const printer::Printer *p, const int interval,
+          const std::optional<std::string> &device = std::nullopt,
+          const std::optional<std::string> &path = std::nullopt, bool pretty = false,
+          bool eventStream = false,
+          observation::TimeseriesEncoding timeseries = observation::TimeseriesEncoding::TEXT);
       /// @brief Handler for put/post observation
       /// @param[in] p printer for response generation
       /// @param[in] device device
@@ -165,6 +209,18 @@ namespace mtconnect {
                                         const QueryMap observations,
                                         const std::optional<std::string> &time = std::nullopt);
 
+      /// @brief Handler for a batch of requests
+      ///
+      /// The body is a JSON array of objects with a `request` of `probe`, `current`, `sample`,
+      /// or `asset`, an optional `device`, and the query parameters of the request. The requests
+      /// are evaluated while holding the circular buffer lock.
+      /// @param[in] p printer for the error documents
+      /// @param[in] session the session of the batch request
+      /// @param[in] request the batch request
+      /// @return multipart/mixed response with one part per request
+      ResponsePtr batchRequest(const printer::Printer *p, SessionPtr session,
+                               const RequestPtr &request);
+
       ///@}
 
       /// @name Async stream method
@@ -197,19 +253,23 @@ namespace mtconnect {
       /// @param[in] type optional type of asset to filter
       /// @param[in] device optional device name or uuid
       /// @param[in] pretty `true` to ensure response is formatted
-      /// @return MTConnect Assets response document
+      /// @param[in] ifNoneMatch entity tags of the client's copy of the document
+      /// @return MTConnect Assets response document or not modified if the entity tag matches
       ResponsePtr assetRequest(const printer::Printer *p, const int32_t count, const bool removed,
                                const std::optional<std::string> &type = std::nullopt,
                                const std::optional<std::string> &device = std::nullopt,
-                               bool pretty = false);
+                               bool pretty = false,
+                               const std::optional<std::string> &ifNoneMatch = std::nullopt);
 
       /// @brief Asset request handler using a list of asset ids
       /// @param[in] p printer for the response document
       /// @param[in] ids list of asset ids
       /// @param[in] pretty `true` to ensure response is formatted
-      /// @return MTConnect Assets response document
+      /// @param[in] ifNoneMatch entity tags of the client's copy of the document
+      /// @return MTConnect Assets response document or not modified if the entity tag matches
       ResponsePtr assetIdsRequest(const printer::Printer *p, const std::list<std::string> &ids,
-                                  bool pretty = false);
+                                  bool pretty = false,
+                                  const std::optional<std::string> &ifNoneMatch = std::nullopt);
 
       /// @brief Asset request handler to update an asset
       /// @param p printer for the response document
@@ -258,6 +318,15 @@ namespace mtconnect {
       std::string printError(const printer::Printer *printer, const std::string &errorCode,
                              const std::string &text, bool pretty = false) const;
 
+      /// @brief Get the lag metrics of the active sample streams
+      /// @return list of stream metrics
+      std::list<StreamMetrics> getStreamMetrics();
+
+      /// @brief Handler for the stream metrics request
+      /// @param pretty `true` to indent the document
+      /// @return a JSON document with the metrics of each active sample stream
+      ResponsePtr streamMetricsRequest(bool pretty = false);
+
       /// @name For testing only
       ///@{
       auto instanceId() const { return m_instanceId; }
@@ -293,9 +362,16 @@ namespace mtconnect {
 
       void createAssetRoutings();
 
+      void createBatchRoutings();
+
       // Current Data Collection
-      std::string fetchCurrentData(const printer::Printer *printer, const FilterSetOpt &filterSet,
-                                   const std::optional<SequenceNumber_t> &at, bool pretty = false);
+      std::string fetchCurrentData(
+          const printer::Printer *printer, const FilterSetOpt &filterSet,
+          const std::optional<SequenceNumber_t> &at, bool pretty = false,
+          SequenceNumber_t *next = nullptr,
+          const std::optional<SequenceNumber_t> &since = std::nullopt,
+          observation::TimeseriesEncoding timeseries = observation::TimeseriesEncoding::TEXT,
+          const buffer::Checkpoint *snapshot = nullptr);
 
       // Sample data collection
       std::string fetchSampleData(const printer::Printer *printer, const FilterSetOpt &filterSet,
@@ -303,7 +379,21 @@ namespace mtconnect {
                                   const std::optional<SequenceNumber_t> &to, SequenceNumber_t &end,
                                   bool &endOfBuffer,
                                   observation::ChangeObserver *observer = nullptr,
-                                  bool pretty = false);
+                                  bool pretty = false,
+                                  observation::TimeseriesEncoding timeseries =
+                                      observation::TimeseriesEncoding::TEXT,
+                                  const std::optional<SequenceNumber_t> &asOf = std::nullopt);
+
+      /// @brief render the observations of a large document in parallel on the worker threads
+      ///
+      /// The observations are rendered into their fragment caches in batches. The calling thread
+      /// renders batches as well, so the document is complete even if no other worker is free.
+      ///
+      /// @param[in] printer the printer for the document
+      /// @param[in] observations the observations in the document
+      /// @param[in] pretty `true` if the document will be pretty printed
+      void renderInParallel(const printer::Printer *printer,
+                            const observation::ObservationList &observations, bool pretty);
 
       // Verification methods
       template <typename T>
@@ -315,6 +405,19 @@ namespace mtconnect {
 
       DevicePtr checkDevice(const printer::Printer *printer, const std::string &uuid) const;
 
+      // Server-Sent Events
+      bool acceptsEventStream(const printer::Printer *printer, const RequestPtr &request) const;
+
+      std::optional<SequenceNumber_t> lastEventId(const RequestPtr &request) const;
+
+      Backpressure backpressure(const printer::Printer *printer,
+                                const std::optional<std::string> &policy) const;
+      void updateMetrics(AsyncSampleResponse &asyncResponse, SequenceNumber_t lag, bool catchUp);
+
+      // Timeseries encoding
+      observation::TimeseriesEncoding timeseriesEncoding(
+          const printer::Printer *printer, const std::optional<std::string> &encoding) const;
+
     protected:
       // Loopback
       boost::asio::io_context &m_context;
@@ -335,6 +438,14 @@ namespace mtconnect {
       FileCache m_fileCache;
 
       bool m_logStreamData {false};
+
+      // Parallel rendering of large documents
+      int m_workerThreads {1};
+      size_t m_parallelRenderThreshold {0};
+
+      // Active sample streams
+      std::mutex m_streamsLock;
+      std::list<std::weak_ptr<AsyncSampleResponse>> m_streams;
     };
   }  // namespace sink::rest_sink
 }  // namespace mtconnect
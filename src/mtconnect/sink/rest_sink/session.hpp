@@ -23,6 +23,7 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
 
 #include "mtconnect/config.hpp"
 #include "routing.hpp"
@@ -39,6 +40,9 @@ namespace mtconnect::sink::rest_sink {
   using Complete = std::function<void()>;
   using FieldList = std::list<std::pair<std::string, std::string>>;
 
+  /// @brief Mime type given to `beginStreaming` to stream Server-Sent Events
+  inline const std::string EventStreamMimeType {"text/event-stream"};
+
   /// @brief An abstract Session for an HTTP connection to a client
   ///
   /// The HTTP or HTTPS connections are subclasses of the session
@@ -62,13 +66,17 @@ namespace mtconnect::sink::rest_sink {
     /// @param complete optional completion callback
     virtual void writeFailureResponse(ResponsePtr &&response, Complete complete = nullptr) = 0;
     /// @brief begin streaming data to the client using x-multipart-replace
+    ///
+    /// If the mime type is `EventStreamMimeType`, the chunks are sent as Server-Sent Events
     /// @param mimeType the mime type of the response
     /// @param complete completion callback
     virtual void beginStreaming(const std::string &mimeType, Complete complete) = 0;
     /// @brief write a chunk for a streaming session
-    /// @param chunk the chunk to write
+    /// @param chunk the chunk to write, moved into the write so it is not copied
     /// @param complete a completion callback
-    virtual void writeChunk(const std::string &chunk, Complete complete) = 0;
+    /// @param id optional id of the chunk, used as the event id for Server-Sent Events
+    virtual void writeChunk(std::string chunk, Complete complete,
+                            const std::optional<std::string> &id = std::nullopt) = 0;
     /// @brief close the session
     virtual void close() = 0;
     /// @brief close the stream
@@ -30,10 +30,13 @@
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+#include <array>
+
 #include "mtconnect/logging.hpp"
 #include "request.hpp"
 #include "response.hpp"
 #include "tls_dector.hpp"
+#include "websocket_session.hpp"
 
 namespace mtconnect::sink::rest_sink {
   namespace beast = boost::beast;  // from <boost/beast.hpp>
@@ -146,14 +149,20 @@ namespace mtconnect::sink::rest_sink {
     }
   }
 
+  template <typename Message>
+  static inline bool isBatch(const Message &msg)
+  {
+    auto target = msg.target();
+    return msg.method() == http::verb::post && target.substr(0, target.find('?')) == "/batch";
+  }
+
   template <class Derived>
   void SessionImpl<Derived>::reset()
   {
-    m_response.reset();
     m_request.reset();
-    m_serializer.reset();
     m_boundary.clear();
     m_mimeType.clear();
+    m_eventStream = false;
 
     m_parser.emplace();
   }
@@ -171,19 +180,39 @@ namespace mtconnect::sink::rest_sink {
   {
     NAMED_SCOPE("SessionImpl::read");
     reset();
+    m_reading = true;
     m_parser->body_limit(100000);
     beast::get_lowest_layer(derived().stream()).expires_after(30s);
     http::async_read(derived().stream(), m_buffer, *m_parser,
                      beast::bind_front_handler(&SessionImpl::requested, shared_ptr()));
   }
 
+  template <class Derived>
+  void SessionImpl<Derived>::readNext()
+  {
+    // Pipelined requests are read once the previous request has a response queued, this
+    // keeps the responses in the order of the requests.
+    if (!m_reading && !m_dispatching && !m_streaming && !m_upgraded && !m_close && !m_idle &&
+        m_outstanding == 0 && m_queue.size() < MaxPipelinedResponses)
+      read();
+  }
+
   template <class Derived>
   void SessionImpl<Derived>::requested(boost::system::error_code ec, size_t len)
   {
     NAMED_SCOPE("SessionImpl::requested");
 
+    m_reading = false;
     if (ec)
     {
+      // Finish writing the queued responses before closing the connection
+      if (!m_queue.empty())
+      {
+        LOG(debug) << "Closing after queued responses: " << ec.message();
+        m_close = true;
+        return;
+      }
+
       fail(status::internal_server_error, "Could not read request", ec);
       return;
     }
@@ -197,8 +226,17 @@ namespace mtconnect::sink::rest_sink {
     auto &msg = m_parser->get();
     const auto &remote = beast::get_lowest_layer(derived().stream()).socket().remote_endpoint();
 
-    // Check for put, post, or delete
-    if (msg.method() != http::verb::get)
+    if (beast::websocket::is_upgrade(msg))
+    {
+      if (m_queue.empty())
+        upgrade();
+      else
+        m_idle = [this]() { upgrade(); };
+      return;
+    }
+
+    // Check for put, post, or delete. A batch is posted, but only reads from the agent.
+    if (msg.method() != http::verb::get && !isBatch(msg))
     {
       if (!m_allowPuts)
       {
@@ -226,6 +264,10 @@ namespace mtconnect::sink::rest_sink {
       m_request->m_contentType = string(a->value());
     if (auto a = msg.find(http::field::accept_encoding); a != msg.end())
       m_request->m_acceptsEncoding = string(a->value());
+    if (auto a = msg.find("Last-Event-ID"); a != msg.end())
+      m_request->m_lastEventId = string(a->value());
+    if (auto a = msg.find(http::field::if_none_match); a != msg.end())
+      m_request->m_ifNoneMatch = string(a->value());
     m_request->m_body = msg.body();
 
     if (auto f = msg.find(http::field::content_type);
@@ -243,12 +285,59 @@ namespace mtconnect::sink::rest_sink {
     LOG(info) << "ReST Request: From [" << m_request->m_foreignIp << ':' << remote.port()
               << "]: " << msg.method() << " " << msg.target();
 
-    if (!m_dispatch(shared_ptr(), m_request))
+    m_encodings.push_back(m_request->m_acceptsEncoding);
+    m_outstanding++;
+    m_dispatching = true;
+    auto dispatched = m_dispatch(shared_ptr(), m_request);
+    m_dispatching = false;
+    if (!dispatched)
     {
       ostringstream txt;
       txt << "Failed to find handler for " << msg.method() << " " << msg.target();
       LOG(error) << txt.str();
     }
+
+    readNext();
+  }
+
+  template <class Derived>
+  void SessionImpl<Derived>::upgrade()
+  {
+    NAMED_SCOPE("SessionImpl::upgrade");
+
+    LOG(info) << "Upgrading to websocket: From [" << m_remote.address() << ':' << m_remote.port()
+              << "]: " << m_parser->get().target();
+
+    using Stream = std::decay_t<decltype(derived().stream())>;
+
+    // The websocket takes over the stream, this session will be released once the
+    // last reference is dropped.
+    m_upgraded = true;
+    auto ws = std::make_shared<WebsocketSessionImpl<Stream>>(
+        derived().releaseStream(), m_parser->release(), std::move(m_buffer), m_remote, m_dispatch,
+        m_errorFunction);
+    ws->run();
+  }
+
+  template <class Derived>
+  void SessionImpl<Derived>::write(std::function<void()> &&write, Complete complete,
+                                   bool response)
+  {
+    // Writes are queued on the stream's executor so the responses to pipelined requests are
+    // sent in order and never overlap with a chunk of a stream.
+    asio::dispatch(derived().stream().get_executor(),
+                   [self = shared_ptr(), write = std::move(write), complete, response]() mutable {
+                     self->m_queue.push_back({std::move(write), complete});
+                     if (self->m_queue.size() == 1)
+                       self->m_queue.front().m_write();
+
+                     if (response)
+                     {
+                       if (self->m_outstanding > 0)
+                         self->m_outstanding--;
+                       self->readNext();
+                     }
+                   });
   }
 
   template <class Derived>
@@ -256,26 +345,45 @@ namespace mtconnect::sink::rest_sink {
   {
     NAMED_SCOPE("SessionImpl::sent");
 
-    if (m_outgoing)
+    if (ec)
     {
-      m_outgoing.reset();
+      m_queue.clear();
+      fail(status::internal_server_error, "Error sending message - ", ec);
+      return;
     }
 
-    if (ec)
+    Complete complete;
+    if (!m_queue.empty())
     {
-      fail(status::internal_server_error, "Error sending message - ", ec);
+      complete = std::move(m_queue.front().m_complete);
+      m_queue.pop_front();
     }
-    else if (m_complete)
+
+    if (!m_queue.empty())
     {
-      m_complete();
+      m_queue.front().m_write();
+      readNext();
     }
-    if (!m_streaming)
+    else if (!m_streaming)
     {
-      if (!m_close)
-        read();
-      else
+      if (m_idle)
+      {
+        auto idle = std::move(m_idle);
+        m_idle = nullptr;
+        idle();
+      }
+      else if (m_close && !m_reading)
+      {
         close();
+      }
+      else
+      {
+        readNext();
+      }
     }
+
+    if (complete)
+      complete();
   }
 
   template <class Derived>
@@ -289,16 +397,26 @@ namespace mtconnect::sink::rest_sink {
     using namespace boost::uuids;
     random_generator gen;
     m_boundary = to_string(gen());
-    m_complete = complete;
     m_mimeType = mimeType;
     m_streaming = true;
+    m_eventStream = mimeType == EventStreamMimeType;
+    if (!m_encodings.empty())
+      m_encodings.pop_front();
 
     auto res = make_shared<http::response<empty_body>>(status::ok, 11);
-    m_response = res;
     res->chunked(true);
     res->set(field::server, "MTConnectAgent");
     res->set(field::connection, "close");
-    res->set(field::content_type, "multipart/mixed;boundary=" + m_boundary);
+    if (m_eventStream)
+    {
+      res->set(field::content_type, EventStreamMimeType);
+      // Ask reverse proxies not to buffer the events
+      res->set("X-Accel-Buffering", "no");
+    }
+    else
+    {
+      res->set(field::content_type, "multipart/mixed;boundary=" + m_boundary);
+    }
     res->set(field::expires, "-1");
     res->set(field::cache_control, "no-cache, no-store, max-age=0");
     for (const auto &f : m_fields)
@@ -307,13 +425,17 @@ namespace mtconnect::sink::rest_sink {
     }
 
     auto sr = make_shared<response_serializer<empty_body>>(*res);
-    m_serializer = sr;
-    async_write_header(derived().stream(), *sr,
-                       beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+    write(
+        [self = shared_ptr(), res, sr]() {
+          async_write_header(self->derived().stream(), *sr,
+                             beast::bind_front_handler(&SessionImpl::sent, self));
+        },
+        complete, true);
   }
 
   template <class Derived>
-  void SessionImpl<Derived>::writeChunk(const std::string &body, Complete complete)
+  void SessionImpl<Derived>::writeChunk(std::string body, Complete complete,
+                                        const std::optional<std::string> &id)
   {
     NAMED_SCOPE("SessionImpl::writeChunk");
 
@@ -321,17 +443,64 @@ namespace mtconnect::sink::rest_sink {
 
     beast::get_lowest_layer(derived().stream()).expires_after(30s);
 
-    m_complete = complete;
-    m_streamBuffer.emplace();
-    ostream str(&m_streamBuffer.value());
-
-    str << "--" + m_boundary << "\r\n"
-        << to_string(field::content_type) << ": " << m_mimeType << "\r\n"
-        << to_string(field::content_length) << ": " << to_string(body.length()) << "\r\n\r\n"
-        << body << "\r\n";
-
-    async_write(derived().stream(), http::make_chunk(m_streamBuffer->data()),
-                beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+    if (m_eventStream)
+    {
+      auto buffer = make_shared<asio::streambuf>();
+      ostream str(buffer.get());
+
+      // Each line of the document becomes a data field of the event
+      if (id)
+        str << "id: " << *id << '\n';
+      string_view rest(body);
+      while (!rest.empty())
+      {
+        auto eol = rest.find('\n');
+        auto line = rest.substr(0, eol);
+        if (!line.empty() && line.back() == '\r')
+          line.remove_suffix(1);
+        str << "data: " << line << '\n';
+        if (eol == string_view::npos)
+          break;
+        rest.remove_prefix(eol + 1);
+      }
+      str << '\n';
+
+      write(
+          [self = shared_ptr(), buffer]() {
+            async_write(self->derived().stream(), http::make_chunk(buffer->data()),
+                        beast::bind_front_handler(&SessionImpl::sent, self));
+          },
+          complete, false);
+    }
+    else
+    {
+      // The part header and the body are written as one chunk without copying the body, the
+      // body is given back to the buffer pool when the write completes
+      using Part = pair<string, string>;
+      auto part = std::shared_ptr<Part>(new Part, [](Part *p) {
+        printer::BufferPool::global().give(std::move(p->second));
+        delete p;
+      });
+      part->first.append("--")
+          .append(m_boundary)
+          .append("\r\nContent-Type: ")
+          .append(m_mimeType)
+          .append("\r\nContent-Length: ")
+          .append(to_string(body.length()))
+          .append("\r\n\r\n");
+      part->second = std::move(body);
+
+      write(
+          [self = shared_ptr(), part]() {
+            static const char crlf[] = "\r\n";
+            std::array<asio::const_buffer, 3> buffers {asio::buffer(part->first),
+                                                       asio::buffer(part->second),
+                                                       asio::buffer(crlf, 2)};
+            async_write(self->derived().stream(), http::make_chunk(buffers),
+                        beast::bind_front_handler(&SessionImpl::sent, self));
+          },
+          complete, false);
+    }
   }
 
   template <class Derived>
@@ -339,10 +508,13 @@ namespace mtconnect::sink::rest_sink {
   {
     NAMED_SCOPE("SessionImpl::closeStream");
 
-    m_complete = [this]() { close(); };
-    http::fields trailer;
-    async_write(derived().stream(), http::make_chunk_last(trailer),
-                beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+    write(
+        [self = shared_ptr()]() {
+          http::fields trailer;
+          async_write(self->derived().stream(), http::make_chunk_last(trailer),
+                      beast::bind_front_handler(&SessionImpl::sent, self));
+        },
+        [this]() { close(); }, false);
   }
 
   template <class Derived>
@@ -352,7 +524,13 @@ namespace mtconnect::sink::rest_sink {
     res->set(http::field::server, "MTConnectAgent");
     if (response.m_close || m_close)
       res->set(http::field::connection, "close");
-    if (response.m_expires == 0s)
+    if (response.m_etag)
+    {
+      // Clients may keep the document but must revalidate it with the entity tag
+      res->set(http::field::etag, *response.m_etag);
+      res->set(http::field::cache_control, "no-cache");
+    }
+    else if (response.m_expires == 0s)
     {
       res->set(http::field::expires, "-1");
       res->set(http::field::cache_control, "no-store, max-age=0");
@@ -378,23 +556,31 @@ namespace mtconnect::sink::rest_sink {
     namespace fs = std::filesystem;
     using std::move;
 
-    m_complete = complete;
-    m_outgoing = std::move(responsePtr);
+    // The response must outlive the write when it is queued behind pipelined responses
+    std::shared_ptr<Response> outgoing(std::move(responsePtr));
 
-    if (m_outgoing->m_file && !m_outgoing->m_file->m_cached)
+    // The responses are written in the order of the requests
+    string acceptsEncoding;
+    if (!m_encodings.empty())
+    {
+      acceptsEncoding = std::move(m_encodings.front());
+      m_encodings.pop_front();
+    }
+
+    if (outgoing->m_file && !outgoing->m_file->m_cached)
     {
       beast::error_code ec;
       http::file_body::value_type body;
       fs::path path;
       optional<string> encoding;
-      if (m_request->m_acceptsEncoding.find("gzip") != string::npos && m_outgoing->m_file->m_pathGz)
+      if (acceptsEncoding.find("gzip") != string::npos && outgoing->m_file->m_pathGz)
       {
         encoding.emplace("gzip");
-        path = *m_outgoing->m_file->m_pathGz;
+        path = *outgoing->m_file->m_pathGz;
       }
       else
       {
-        path = m_outgoing->m_file->m_path;
+        path = outgoing->m_file->m_path;
       }
 
       body.open(path.string().c_str(), beast::file_mode::scan, ec);
@@ -406,45 +592,51 @@ namespace mtconnect::sink::rest_sink {
       auto size = body.size();
       auto res = make_shared<http::response<http::file_body>>(
           std::piecewise_construct, std::make_tuple(std::move(body)),
-          std::make_tuple(m_outgoing->m_status, 11));
-      res->set(http::field::content_type, m_outgoing->m_mimeType);
+          std::make_tuple(outgoing->m_status, 11));
+      res->set(http::field::content_type, outgoing->m_mimeType);
       res->content_length(size);
       if (encoding)
         res->set(http::field::content_encoding, "gzip");
-      addHeaders(*m_outgoing, res);
-
-      m_response = res;
-
-      async_write(derived().stream(), *res,
-                  beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+      addHeaders(*outgoing, res);
+
+      write(
+          [self = shared_ptr(), res]() {
+            async_write(self->derived().stream(), *res,
+                        beast::bind_front_handler(&SessionImpl::sent, self));
+          },
+          complete, true);
     }
     else
     {
       const char *bp;
       size_t size;
-      if (m_outgoing->m_file)
+      if (outgoing->m_file)
       {
-        bp = m_outgoing->m_file->m_buffer;
-        size = m_outgoing->m_file->m_size;
+        bp = outgoing->m_file->m_buffer;
+        size = outgoing->m_file->m_size;
       }
       else
       {
-        bp = m_outgoing->m_body.c_str();
-        size = m_outgoing->m_body.size();
+        bp = outgoing->m_body.c_str();
+        size = outgoing->m_body.size();
       }
 
       auto res = make_shared<http::response<http::span_body<const char>>>(
           std::piecewise_construct, std::make_tuple(bp, size),
-          std::make_tuple(m_outgoing->m_status, 11));
+          std::make_tuple(outgoing->m_status, 11));
 
-      addHeaders(*m_outgoing, res);
+      addHeaders(*outgoing, res);
       res->chunked(false);
-      res->content_length(size);
-
-      m_response = res;
-
-      async_write(derived().stream(), *res,
-                  beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+      // A not modified response has no body, a length would be taken as the document's
+      if (outgoing->m_status != status::not_modified)
+        res->content_length(size);
+
+      write(
+          [self = shared_ptr(), outgoing, res]() {
+            async_write(self->derived().stream(), *res,
+                        beast::bind_front_handler(&SessionImpl::sent, self));
+          },
+          complete, true);
     }
   }
 
@@ -453,8 +645,7 @@ namespace mtconnect::sink::rest_sink {
   {
     if (m_streaming)
     {
-      m_outgoing = std::move(response);
-      writeChunk(m_outgoing->m_body, [this] { closeStream(); });
+      writeChunk(std::move(response->m_body), [this] { closeStream(); });
     }
     else
     {
@@ -508,7 +699,7 @@ namespace mtconnect::sink::rest_sink {
     /// @brief shutdown the stream asyncronously closing the secure stream
     void close() override
     {
-      if (!m_closing)
+      if (!m_closing && !m_upgraded)
       {
         m_closing = true;
         // Set the timeout.
@@ -20,6 +20,7 @@
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 
+#include <deque>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -70,7 +71,8 @@ namespace mtconnect {
       void writeResponse(ResponsePtr &&response, Complete complete = nullptr) override;
       void writeFailureResponse(ResponsePtr &&response, Complete complete = nullptr) override;
       void beginStreaming(const std::string &mimeType, Complete complete) override;
-      void writeChunk(const std::string &chunk, Complete complete) override;
+      void writeChunk(std::string chunk, Complete complete,
+                      const std::optional<std::string> &id = std::nullopt) override;
       void closeStream() override;
       ///@}
     protected:
@@ -80,17 +82,40 @@ namespace mtconnect {
       void requested(boost::system::error_code ec, size_t len);
       void sent(boost::system::error_code ec, size_t len);
       void read();
+      void readNext();
       void reset();
+      void upgrade();
+      void write(std::function<void()> &&write, Complete complete, bool response);
 
     protected:
       using RequestParser = boost::beast::http::request_parser<boost::beast::http::string_body>;
 
-      Complete m_complete;
+      /// @brief A write waiting for the previous writes to complete
+      ///
+      /// The write function owns the message and serializer until the write has completed.
+      struct Outgoing
+      {
+        std::function<void()> m_write;
+        Complete m_complete;
+      };
+
+      /// @brief Maximum number of responses queued for a pipelined connection before the
+      ///        next request is read.
+      static constexpr size_t MaxPipelinedResponses {16};
+
+      std::deque<Outgoing> m_queue;
+      std::deque<std::string> m_encodings;  ///< Accept-Encoding of the requests awaiting a response
+      Complete m_idle;
+      int m_outstanding {0};
+      bool m_reading {false};
+      bool m_dispatching {false};
       bool m_streaming {false};
+      bool m_upgraded {false};
 
       // For Streaming
       std::string m_boundary;
       std::string m_mimeType;
+      bool m_eventStream {false};
       bool m_close {false};
 
       // Additional fields
@@ -99,11 +124,7 @@ namespace mtconnect {
       // References to retain lifecycle for callbacks.
       RequestPtr m_request;
       boost::beast::flat_buffer m_buffer;
-      std::optional<boost::asio::streambuf> m_streamBuffer;
       std::optional<RequestParser> m_parser;
-      std::shared_ptr<void> m_response;
-      std::shared_ptr<void> m_serializer;
-      ResponsePtr m_outgoing;
     };
 
     /// @brief An HTTP Session for communication without TLS
@@ -134,6 +155,9 @@ namespace mtconnect {
       /// @brief get the stream
       /// @return the stream
       auto &stream() { return m_stream; }
+      /// @brief return the stream and hand over ownership
+      /// @return the stream
+      boost::beast::tcp_stream releaseStream() { return std::move(m_stream); }
 
       /// @brief close the session and shutdown the socket
       void close() override
@@ -141,6 +165,9 @@ namespace mtconnect {
         NAMED_SCOPE("HttpSession::close");
 
         m_request.reset();
+        if (m_upgraded)
+          return;
+
         boost::beast::error_code ec;
         m_stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
       }
@@ -0,0 +1,509 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "websocket_session.hpp"
+
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+#include "mtconnect/logging.hpp"
+
+namespace mtconnect::sink::rest_sink {
+  namespace beast = boost::beast;
+  namespace http = beast::http;
+  namespace websocket = beast::websocket;
+  namespace asio = boost::asio;
+  using json = nlohmann::json;
+
+  using namespace std;
+
+  // ---------------------------------------------------------------------------
+  // Websocket Request
+  // ---------------------------------------------------------------------------
+
+  void WebsocketRequest::gate(Complete complete)
+  {
+    if (m_cancelled || !complete)
+      return;
+
+    if (!m_credits)
+    {
+      complete();
+    }
+    else if (*m_credits > 0)
+    {
+      --(*m_credits);
+      complete();
+    }
+    else
+    {
+      m_pending = complete;
+    }
+  }
+
+  void WebsocketRequest::addCredits(int credits)
+  {
+    if (!m_credits)
+      return;
+
+    *m_credits += credits;
+    if (m_pending && *m_credits > 0)
+    {
+      auto pending = std::move(m_pending);
+      m_pending = nullptr;
+      gate(pending);
+    }
+  }
+
+  void WebsocketRequest::writeResponse(ResponsePtr &&response, Complete complete)
+  {
+    NAMED_SCOPE("WebsocketRequest::writeResponse");
+
+    auto parent = m_parent.lock();
+    if (!parent)
+      return;
+
+    string body;
+    if (response->m_file)
+    {
+      if (response->m_file->m_cached)
+      {
+        body.assign(response->m_file->m_buffer, response->m_file->m_size);
+      }
+      else
+      {
+        ifstream file(response->m_file->m_path, ios::binary);
+        body.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+      }
+    }
+    else
+    {
+      body = std::move(response->m_body);
+    }
+
+    parent->post([parent, self = shared_ptr(), st = response->m_status,
+                  mimeType = response->m_mimeType, body = std::move(body), complete]() {
+      if (self->m_cancelled)
+        return;
+
+      parent->send(self->m_id, st, mimeType, body, complete);
+      if (!self->m_streaming)
+        parent->remove(self);
+    });
+  }
+
+  void WebsocketRequest::writeFailureResponse(ResponsePtr &&response, Complete complete)
+  {
+    NAMED_SCOPE("WebsocketRequest::writeFailureResponse");
+
+    auto parent = m_parent.lock();
+    if (!parent)
+      return;
+
+    parent->post([parent, self = shared_ptr(), st = response->m_status,
+                  mimeType = response->m_mimeType, body = std::move(response->m_body),
+                  complete]() {
+      if (self->m_cancelled)
+        return;
+
+      parent->send(self->m_id, st, mimeType, body, complete);
+      self->cancel();
+      parent->remove(self);
+    });
+  }
+
+  void WebsocketRequest::beginStreaming(const std::string &mimeType, Complete complete)
+  {
+    NAMED_SCOPE("WebsocketRequest::beginStreaming");
+
+    auto parent = m_parent.lock();
+    if (!parent)
+      return;
+
+    parent->post([self = shared_ptr(), mimeType, complete]() {
+      self->m_streaming = true;
+      self->m_mimeType = mimeType;
+      self->gate(complete);
+    });
+  }
+
+  void WebsocketRequest::writeChunk(std::string chunk, Complete complete,
+                                    const std::optional<std::string> &id)
+  {
+    NAMED_SCOPE("WebsocketRequest::writeChunk");
+
+    auto parent = m_parent.lock();
+    if (!parent)
+      return;
+
+    parent->post([parent, self = shared_ptr(), chunk = std::move(chunk), complete]() {
+      // Dropping the completion ends the stream and releases the observers
+      if (self->m_cancelled)
+        return;
+
+      parent->send(self->m_id, status::ok, self->m_mimeType, chunk,
+                   [self, complete]() { self->gate(complete); });
+    });
+  }
+
+  void WebsocketRequest::closeStream()
+  {
+    auto parent = m_parent.lock();
+    if (!parent)
+      return;
+
+    parent->post([parent, self = shared_ptr()]() {
+      self->cancel();
+      parent->remove(self);
+    });
+  }
+
+  void WebsocketRequest::close() { closeStream(); }
+
+  // ---------------------------------------------------------------------------
+  // Websocket Session
+  // ---------------------------------------------------------------------------
+
+  void WebsocketSession::writeResponse(ResponsePtr &&response, Complete complete)
+  {
+    post([self = getptr(), st = response->m_status, mimeType = response->m_mimeType,
+          body = std::move(response->m_body), complete]() {
+      self->send("", st, mimeType, body, complete);
+    });
+  }
+
+  void WebsocketSession::writeFailureResponse(ResponsePtr &&response, Complete complete)
+  {
+    writeResponse(std::move(response), complete);
+  }
+
+  void WebsocketSession::beginStreaming(const std::string &mimeType, Complete complete)
+  {
+    LOG(error) << "Streaming must be performed by a websocket request";
+  }
+
+  void WebsocketSession::writeChunk(std::string chunk, Complete complete,
+                                    const std::optional<std::string> &id)
+  {
+    LOG(error) << "Streaming must be performed by a websocket request";
+  }
+
+  void WebsocketSession::closeStream() { close(); }
+
+  void WebsocketSession::send(const std::string &id, status st, const std::string &mimeType,
+                              const std::string_view &body, Complete complete)
+  {
+    string message;
+    message.reserve(body.size() + id.size() + mimeType.size() + 48);
+    message.append("Request-Id: ")
+        .append(id)
+        .append("\r\nStatus: ")
+        .append(to_string(static_cast<unsigned>(st)))
+        .append("\r\nContent-Type: ")
+        .append(mimeType)
+        .append("\r\n\r\n")
+        .append(body);
+
+    // Nothing more is written once the websocket is closing
+    if (m_closing)
+      return;
+
+    // Binary documents, such as CBOR, cannot be sent as text frames
+    bool binary = !(starts_with(mimeType, "text/") || ends_with(mimeType, "json") ||
+                    ends_with(mimeType, "xml"));
+    m_queue.push_back({std::move(message), binary, complete});
+    if (m_queue.size() == 1)
+      asyncWrite(m_queue.front().m_text, m_queue.front().m_binary);
+  }
+
+  void WebsocketSession::written(boost::system::error_code ec)
+  {
+    NAMED_SCOPE("WebsocketSession::written");
+
+    if (ec)
+    {
+      m_queue.clear();
+      fail(status::internal_server_error, "Error sending websocket message", ec);
+      return;
+    }
+
+    auto complete = std::move(m_queue.front().m_complete);
+    m_queue.pop_front();
+    if (!m_queue.empty())
+      asyncWrite(m_queue.front().m_text, m_queue.front().m_binary);
+    else if (m_closing)
+      asyncClose();
+
+    if (complete)
+      complete();
+  }
+
+  void WebsocketSession::remove(std::shared_ptr<WebsocketRequest> request)
+  {
+    auto it = m_requests.find(request->getId());
+    if (it != m_requests.end() && it->second == request)
+      m_requests.erase(it);
+  }
+
+  void WebsocketSession::cancelAll()
+  {
+    for (auto &request : m_requests)
+      request.second->cancel();
+    m_requests.clear();
+  }
+
+  static inline string asString(const json &value)
+  {
+    if (value.is_string())
+      return value.get<string>();
+    else
+      return value.dump();
+  }
+
+  void WebsocketSession::received(const std::string &text)
+  {
+    NAMED_SCOPE("WebsocketSession::received");
+
+    try
+    {
+      auto doc = json::parse(text);
+      if (!doc.is_object() || !doc.contains("id") || !doc.contains("request"))
+      {
+        fail(status::bad_request, "Websocket request must be an object with an id and a request");
+        return;
+      }
+
+      auto id = asString(doc["id"]);
+      auto command = asString(doc["request"]);
+      auto existing = m_requests.find(id);
+
+      if (command == "next")
+      {
+        if (existing != m_requests.end())
+          existing->second->addCredits(doc.value("credits", 1));
+        else
+          fail(status::bad_request, "Cannot find websocket request: " + id);
+        return;
+      }
+
+      // A new request with the same id replaces the active request
+      if (existing != m_requests.end())
+      {
+        existing->second->cancel();
+        m_requests.erase(existing);
+      }
+
+      if (command == "cancel")
+        return;
+
+      auto request = make_shared<Request>();
+      request->m_verb = http::verb::get;
+      request->m_accepts = m_accepts;
+      request->m_foreignIp = m_remote.address().to_string();
+      request->m_foreignPort = m_remote.port();
+      request->m_requestId = id;
+
+      optional<int> credits;
+      string device;
+      for (auto &[key, value] : doc.items())
+      {
+        if (key == "id" || key == "request")
+          continue;
+        else if (key == "credits")
+          credits = value.get<int>();
+        else if (key == "device")
+          device = asString(value);
+        else if (key == "accept")
+          request->m_accepts = asString(value);
+        else
+          request->m_query[key] = asString(value);
+      }
+
+      if (device.empty())
+        request->m_path = "/" + command;
+      else
+        request->m_path = "/" + device + "/" + command;
+
+      auto child = make_shared<WebsocketRequest>(getptr(), id, credits, m_remote, m_dispatch,
+                                                 m_errorFunction);
+      m_requests.emplace(id, child);
+
+      LOG(info) << "Websocket Request: From [" << request->m_foreignIp << ':'
+                << request->m_foreignPort << "]: " << id << " " << request->m_path;
+
+      if (!m_dispatch(child, request))
+      {
+        LOG(error) << "Failed to find handler for websocket request " << request->m_path;
+        remove(child);
+      }
+    }
+    catch (json::exception &e)
+    {
+      fail(status::bad_request, string("Invalid websocket request: ") + e.what());
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Websocket Session Implementation
+  // ---------------------------------------------------------------------------
+
+  template <class Stream>
+  WebsocketSessionImpl<Stream>::WebsocketSessionImpl(Stream &&stream, RequestMessage &&upgrade,
+                                                     beast::flat_buffer &&buffered,
+                                                     const asio::ip::tcp::endpoint &remote,
+                                                     Dispatch dispatch, ErrorFunction error)
+    : WebsocketSession(remote, dispatch, error),
+      m_stream(std::move(stream)),
+      m_upgrade(std::move(upgrade))
+  {
+    if (auto a = m_upgrade.find(http::field::accept); a != m_upgrade.end())
+      m_accepts = string(a->value());
+
+    // A client can send its first frame right after the upgrade request. Those bytes are
+    // already in the HTTP session's buffer, so the handshake is accepted from the request
+    // followed by them and the websocket stream keeps the rest.
+    if (buffered.size() > 0)
+    {
+      ostringstream handshake;
+      handshake << m_upgrade;
+      m_handshake = handshake.str();
+      m_handshake.append(beast::buffers_to_string(buffered.data()));
+    }
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::run()
+  {
+    NAMED_SCOPE("WebsocketSession::run");
+
+    // The websocket stream has its own keep alive and idle timeouts
+    beast::get_lowest_layer(m_stream).expires_never();
+    m_stream.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+
+    websocket::permessage_deflate pmd;
+    pmd.server_enable = true;
+    m_stream.set_option(pmd);
+
+    m_stream.set_option(websocket::stream_base::decorator(
+        [](websocket::response_type &res) { res.set(http::field::server, "MTConnectAgent"); }));
+
+    if (m_handshake.empty())
+      m_stream.async_accept(
+          m_upgrade, beast::bind_front_handler(&WebsocketSessionImpl::accepted, shared_ptr()));
+    else
+      m_stream.async_accept(
+          asio::buffer(m_handshake),
+          beast::bind_front_handler(&WebsocketSessionImpl::accepted, shared_ptr()));
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::accepted(boost::system::error_code ec)
+  {
+    if (ec)
+    {
+      fail(status::internal_server_error, "Could not accept websocket", ec);
+      return;
+    }
+
+    read();
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::read()
+  {
+    m_stream.async_read(m_buffer,
+                        beast::bind_front_handler(&WebsocketSessionImpl::onRead, shared_ptr()));
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::onRead(boost::system::error_code ec, size_t len)
+  {
+    NAMED_SCOPE("WebsocketSession::onRead");
+
+    if (ec == websocket::error::closed)
+    {
+      LOG(info) << "Websocket closed by " << m_remote.address();
+      m_closing = true;
+      cancelAll();
+      return;
+    }
+    else if (ec)
+    {
+      fail(status::internal_server_error, "Could not read websocket request", ec);
+      return;
+    }
+
+    auto text = beast::buffers_to_string(m_buffer.data());
+    m_buffer.consume(m_buffer.size());
+
+    received(text);
+    read();
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::asyncWrite(const std::string &message, bool binary)
+  {
+    m_stream.binary(binary);
+    m_stream.async_write(asio::buffer(message),
+                         beast::bind_front_handler(&WebsocketSessionImpl::onWrite, shared_ptr()));
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::onWrite(boost::system::error_code ec, size_t len)
+  {
+    written(ec);
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::post(std::function<void()> &&f)
+  {
+    asio::post(m_stream.get_executor(), std::move(f));
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::close()
+  {
+    NAMED_SCOPE("WebsocketSession::close");
+
+    cancelAll();
+    if (!m_closing)
+    {
+      m_closing = true;
+
+      // Only one write can be in progress, the close follows the queued messages
+      if (m_queue.empty())
+        asyncClose();
+    }
+  }
+
+  template <class Stream>
+  void WebsocketSessionImpl<Stream>::asyncClose()
+  {
+    m_stream.async_close(websocket::close_code::normal,
+                         [self = shared_ptr()](boost::system::error_code ec) {
+                           if (ec)
+                             LOG(debug) << "Websocket close: " << ec.message();
+                         });
+  }
+
+  template class WebsocketSessionImpl<beast::tcp_stream>;
+  template class WebsocketSessionImpl<beast::ssl_stream<beast::tcp_stream>>;
+}  // namespace mtconnect::sink::rest_sink
@@ -0,0 +1,256 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/utilities.hpp"
+#include "request.hpp"
+#include "response.hpp"
+#include "session.hpp"
+
+namespace mtconnect::sink::rest_sink {
+  class WebsocketSession;
+
+  /// @brief A single request multiplexed over a websocket connection
+  ///
+  /// Every request the client sends over the websocket is dispatched with its own
+  /// `WebsocketRequest` so the streams created by the REST service can be throttled and
+  /// cancelled independently. All state is mutated on the executor of the websocket.
+  class AGENT_LIB_API WebsocketRequest : public Session
+  {
+  public:
+    /// @brief Create a request for a websocket session
+    /// @param parent the websocket session that owns the connection
+    /// @param id the client supplied request id
+    /// @param credits optional number of chunks that can be sent before the client asks for more
+    /// @param remote the remote endpoint of the connection
+    /// @param dispatch dispatch function
+    /// @param error error function
+    WebsocketRequest(std::shared_ptr<WebsocketSession> parent, const std::string &id,
+                     std::optional<int> credits, const boost::asio::ip::tcp::endpoint &remote,
+                     Dispatch dispatch, ErrorFunction error)
+      : Session(dispatch, error), m_parent(parent), m_id(id), m_credits(credits)
+    {
+      m_remote = remote;
+    }
+    ~WebsocketRequest() override = default;
+
+    /// @brief get a shared pointer to this
+    /// @return shared websocket request
+    std::shared_ptr<WebsocketRequest> shared_ptr()
+    {
+      return std::dynamic_pointer_cast<WebsocketRequest>(shared_from_this());
+    }
+
+    /// @name Session Interface
+    ///@{
+    void run() override {}
+    void writeResponse(ResponsePtr &&response, Complete complete = nullptr) override;
+    void writeFailureResponse(ResponsePtr &&response, Complete complete = nullptr) override;
+    void beginStreaming(const std::string &mimeType, Complete complete) override;
+    void writeChunk(std::string chunk, Complete complete,
+                    const std::optional<std::string> &id = std::nullopt) override;
+    void close() override;
+    void closeStream() override;
+    ///@}
+
+    /// @brief get the client supplied request id
+    /// @return the request id
+    const auto &getId() const { return m_id; }
+
+    /// @brief Allow more chunks to be sent to the client
+    /// @note must be called on the websocket executor
+    /// @param credits the number of additional chunks
+    void addCredits(int credits);
+
+    /// @brief Stop the request, any further writes will be discarded
+    /// @note must be called on the websocket executor
+    void cancel()
+    {
+      m_cancelled = true;
+      m_pending = nullptr;
+    }
+
+  protected:
+    void gate(Complete complete);
+
+  protected:
+    std::weak_ptr<WebsocketSession> m_parent;
+    std::string m_id;
+    std::string m_mimeType;
+    std::optional<int> m_credits;
+    Complete m_pending;
+    bool m_streaming {false};
+    bool m_cancelled {false};
+  };
+
+  /// @brief A websocket connection upgraded from an HTTP or HTTPS session
+  ///
+  /// Each text message from the client is a JSON object with an `id` and a `request`. The
+  /// `request` is the REST request name, `device` selects the device, and all other members are
+  /// passed as query parameters, for example:
+  ///
+  ///     {"id": "1", "request": "sample", "device": "M1", "interval": 100, "credits": 2}
+  ///
+  /// The optional `credits` limits the number of chunks sent before the client sends
+  /// `{"id": "1", "request": "next", "credits": 1}`. `{"id": "1", "request": "cancel"}` stops
+  /// the request. Sending a new request with an active id replaces it, this is used to change
+  /// the interval or filter without reconnecting.
+  ///
+  /// Every message to the client is prefixed by a header block:
+  ///
+  ///     Request-Id: 1\r\nStatus: 200\r\nContent-Type: text/xml\r\n\r\n<document>
+  class AGENT_LIB_API WebsocketSession : public Session
+  {
+  public:
+    /// @brief Create a websocket session
+    /// @param remote the remote endpoint
+    /// @param dispatch dispatch function
+    /// @param error error function
+    WebsocketSession(const boost::asio::ip::tcp::endpoint &remote, Dispatch dispatch,
+                     ErrorFunction error)
+      : Session(dispatch, error)
+    {
+      m_remote = remote;
+    }
+    ~WebsocketSession() override = default;
+
+    /// @brief get a shared pointer to this
+    /// @return shared websocket session
+    std::shared_ptr<WebsocketSession> getptr()
+    {
+      return std::dynamic_pointer_cast<WebsocketSession>(shared_from_this());
+    }
+
+    /// @name Session Interface
+    ///
+    /// These are only used for errors that cannot be associated with a request
+    ///@{
+    void writeResponse(ResponsePtr &&response, Complete complete = nullptr) override;
+    void writeFailureResponse(ResponsePtr &&response, Complete complete = nullptr) override;
+    void beginStreaming(const std::string &mimeType, Complete complete) override;
+    void writeChunk(std::string chunk, Complete complete,
+                    const std::optional<std::string> &id = std::nullopt) override;
+    void closeStream() override;
+    ///@}
+
+    /// @brief Queue a message for a request
+    /// @note must be called on the websocket executor
+    /// @param id the request id
+    /// @param st the status of the response
+    /// @param mimeType the mime type of the body
+    /// @param body the body
+    /// @param complete called when the message has been written
+    void send(const std::string &id, status st, const std::string &mimeType,
+              const std::string_view &body, Complete complete);
+
+    /// @brief Remove a completed request
+    /// @note must be called on the websocket executor
+    /// @param request the request
+    void remove(std::shared_ptr<WebsocketRequest> request);
+
+    /// @brief Run a function on the websocket executor
+    /// @param f the function
+    virtual void post(std::function<void()> &&f) = 0;
+
+    /// @brief get the number of active requests
+    /// @return the number of active requests
+    auto getRequestCount() const { return m_requests.size(); }
+
+  protected:
+    void received(const std::string &text);
+    void written(boost::system::error_code ec);
+    void cancelAll();
+    virtual void asyncWrite(const std::string &message, bool binary) = 0;
+    /// @brief close the websocket once no write is in progress
+    virtual void asyncClose() = 0;
+
+  protected:
+    std::string m_accepts;
+    std::map<std::string, std::shared_ptr<WebsocketRequest>> m_requests;
+    /// @brief A message waiting to be written
+    struct Message
+    {
+      std::string m_text;
+      bool m_binary;
+      Complete m_complete;
+    };
+    std::deque<Message> m_queue;
+    bool m_closing {false};
+  };
+
+  /// @brief Websocket implementation for a plain or secure stream
+  /// @tparam Stream `tcp_stream` or `ssl_stream<tcp_stream>`
+  template <class Stream>
+  class WebsocketSessionImpl : public WebsocketSession
+  {
+  public:
+    using RequestMessage = boost::beast::http::request<boost::beast::http::string_body>;
+
+    /// @brief Create a websocket session taking ownership of the stream
+    /// @param stream the stream of the HTTP session (takes ownership)
+    /// @param upgrade the upgrade request
+    /// @param buffered bytes the HTTP session read after the upgrade request
+    /// @param remote the remote endpoint
+    /// @param dispatch dispatch function
+    /// @param error error function
+    WebsocketSessionImpl(Stream &&stream, RequestMessage &&upgrade,
+                         boost::beast::flat_buffer &&buffered,
+                         const boost::asio::ip::tcp::endpoint &remote, Dispatch dispatch,
+                         ErrorFunction error);
+    ~WebsocketSessionImpl() override = default;
+
+    /// @brief get a shared pointer to this
+    /// @return shared websocket session
+    std::shared_ptr<WebsocketSessionImpl> shared_ptr()
+    {
+      return std::dynamic_pointer_cast<WebsocketSessionImpl>(shared_from_this());
+    }
+
+    /// @brief Accept the websocket upgrade and start reading requests
+    void run() override;
+    /// @brief Close the websocket and cancel all requests
+    void close() override;
+    void post(std::function<void()> &&f) override;
+
+  protected:
+    void accepted(boost::system::error_code ec);
+    void read();
+    void onRead(boost::system::error_code ec, size_t len);
+    void onWrite(boost::system::error_code ec, size_t len);
+    void asyncWrite(const std::string &message, bool binary) override;
+    void asyncClose() override;
+
+  protected:
+    boost::beast::websocket::stream<Stream> m_stream;
+    boost::beast::flat_buffer m_buffer;
+    RequestMessage m_upgrade;
+    std::string m_handshake;
+  };
+}  // namespace mtconnect::sink::rest_sink
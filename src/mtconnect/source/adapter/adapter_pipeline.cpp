@@ -64,10 +64,15 @@ namespace mtconnect {
         run(std::move(entity));
       };
       handler->m_processMessage = [this](const std::string &topic, const std::string &data,
-                                         const std::string &source) {
-        auto entity = make_shared<Entity>(
-            "Message", Properties {{"VALUE", data}, {"topic", topic}, {"source", source}});
-        run(std::move(entity));
+                                         const std::string &source, uint32_t subscription) {
+        // Emplace the payload, an initializer list would copy it twice
+        Properties props;
+        props.emplace("VALUE", data);
+        props.emplace("topic", topic);
+        props.emplace("source", source);
+        if (subscription > 0)
+          props.emplace("subscription", int64_t(subscription));
+        run(make_shared<Entity>("Message", std::move(props)));
       };
       handler->m_command = [this](const std::string &command, const std::string &value,
                                   const std::string &source) {
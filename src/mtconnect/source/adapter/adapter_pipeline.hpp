@@ -29,14 +29,15 @@ namespace mtconnect::source::adapter {
     using ProcessCommand = std::function<void(const std::string &command, const std::string &value,
                                               const std::string &source)>;
     using ProcessMessage = std::function<void(const std::string &topic, const std::string &data,
-                                              const std::string &source)>;
+                                              const std::string &source, uint32_t subscription)>;
     using Connect = std::function<void(const std::string &source)>;
 
     /// @brief Process Data Messages
     ProcessData m_processData;
     /// @brief Process an adapter command
     ProcessCommand m_command;
-    /// @brief Process a message with a topic
+    /// @brief Process a message with a topic and the identifier of the subscription it was
+    /// received for, 0 if there is none
     ProcessMessage m_processMessage;
 
     /// @brief method to call when connecting
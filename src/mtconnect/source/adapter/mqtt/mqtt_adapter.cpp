@@ -67,11 +67,13 @@ namespace mtconnect {
                   {configuration::MqttPrivateKey, string()},
                   {configuration::MqttCert, string()},
                   {configuration::MqttClientId, string()},
-                  {configuration::MqttHost, string()}});
+                  {configuration::MqttHost, string()},
+                  {configuration::MqttTopicAliasMaximum, 0}});
 
       AddDefaultedOptions(block, m_options,
                           {{configuration::MqttPort, 1883},
                            {configuration::MqttTls, false},
+                           {configuration::MqttProtocolVersion, 3},
                            {configuration::AutoAvailable, false},
                            {configuration::RealTime, false},
                            {configuration::RelativeTime, false}});
@@ -102,10 +104,23 @@ namespace mtconnect {
         m_handler->m_disconnected(client->getIdentity());
       };
 
-      clientHandler->m_receive = [this](shared_ptr<MqttClient> client, const std::string &topic,
-                                        const std::string &payload) {
-        m_handler->m_processMessage(topic, payload, client->getIdentity());
-      };
+      if (GetOption<int>(m_options, configuration::MqttProtocolVersion) == 5)
+      {
+        clientHandler->m_receiveProperties = [this](shared_ptr<MqttClient> client,
+                                                    const std::string &topic,
+                                                    const std::string &payload,
+                                                    const MessageProperties &properties) {
+          m_handler->m_processMessage(topic, payload, client->getIdentity(),
+                                      properties.m_subscription);
+        };
+      }
+      else
+      {
+        clientHandler->m_receive = [this](shared_ptr<MqttClient> client,
+                                          const std::string &topic, const std::string &payload) {
+          m_handler->m_processMessage(topic, payload, client->getIdentity(), 0);
+        };
+      }
 
       if (IsOptionSet(m_options, configuration::MqttTls))
         m_client = make_shared<mtconnect::mqtt_client::MqttTlsClient>(m_ioContext, m_options,
@@ -186,9 +201,16 @@ namespace mtconnect {
       LOG(info) << "MqttClientImpl::connect: subscribing to topics";
       if (topics)
       {
+        // With MQTT 5, topics without wildcards are given a subscription identifier so their
+        // messages are mapped without looking up the topic
+        uint32_t identifier = 0;
         for (const auto &topic : *topics)
         {
-          m_client->subscribe(topic);
+          identifier++;
+          if (m_client->isMqtt5() && topic.find_first_of("+#") == string::npos)
+            m_client->subscribe(topic, identifier);
+          else
+            m_client->subscribe(topic);
         }
       }
     }
@@ -223,7 +245,8 @@ namespace mtconnect {
       auto next = bind(make_shared<TopicMapper>(
           m_context, GetOption<string>(m_options, configuration::Device).value_or("")));
 
-      auto map1 = next->bind(make_shared<JsonMapper>(m_context));
+      auto map1 = next->bind(make_shared<JsonMapper>(
+          m_context, GetOption<string>(m_options, configuration::Device)));
       auto map2 = next->bind(make_shared<DataMapper>(m_context, m_handler));
       map2->bind(tokenizer);
 
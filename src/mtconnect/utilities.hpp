@@ -27,7 +27,14 @@
 #include <boost/regex.hpp>
 #include <boost/uuid/detail/sha1.hpp>
 
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <locale>
+#include <sstream>
 #include <date/date.h>
 #include <mtconnect/version.h>
 
@@ -107,15 +114,78 @@ namespace mtconnect {
     return value;
   }
 
+  /// @brief the default number of significant digits used to format doubles
+  constexpr int DOUBLE_PRECISION = std::numeric_limits<double>::digits10;
+
+  /// @brief format a double into a character buffer
+  ///
+  /// The format is the same as `%g`, trailing zeros are removed and exponents are only used for
+  /// very large or small values. The formatting does not depend on the locale.
+  ///
+  /// @param[in] first the start of the buffer, 32 characters is always sufficient
+  /// @param[in] last the end of the buffer
+  /// @param[in] value the double
+  /// @param[in] precision the number of significant digits
+  /// @return the end of the formatted text
+  inline char *formatDouble(char *first, char *last, double value,
+                            int precision = DOUBLE_PRECISION)
+  {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto res = std::to_chars(first, last, value, std::chars_format::general, precision);
+    return res.ec == std::errc() ? res.ptr : first;
+#else
+    auto len = std::snprintf(first, last - first, "%.*g", precision, value);
+    if (len < 0 || len >= last - first)
+      return first;
+
+    // snprintf uses the decimal point of the C locale
+    const char point = *std::localeconv()->decimal_point;
+    if (point != '.')
+      std::replace(first, first + len, point, '.');
+    return first + len;
+#endif
+  }
+
+  /// @brief round a double to a number of significant digits
+  ///
+  /// The rounding does not depend on the locale.
+  ///
+  /// @param[in] value the double
+  /// @param[in] digits the number of significant digits
+  /// @return the double closest to the rounded decimal value
+  inline double roundSignificant(double value, int digits)
+  {
+    char buffer[32];
+    auto end = formatDouble(buffer, buffer + sizeof(buffer), value, digits);
+    double result = value;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    std::from_chars(buffer, end, result);
+#else
+    std::istringstream in(std::string(buffer, end));
+    in.imbue(std::locale::classic());
+    in >> result;
+#endif
+    return result;
+  }
+
+  /// @brief append a double to a string
+  /// @param[in,out] text the string to append to
+  /// @param[in] value the double
+  /// @param[in] precision the number of significant digits
+  inline void appendDouble(std::string &text, double value, int precision = DOUBLE_PRECISION)
+  {
+    char buffer[32];
+    text.append(buffer, formatDouble(buffer, buffer + sizeof(buffer), value, precision));
+  }
+
   /// @brief converts a double to a string
   /// @param[in] value the double
-  /// @return the string representation of the double (10 places max)
-  inline std::string format(double value)
+  /// @param[in] precision the number of significant digits
+  /// @return the string representation of the double (15 significant digits by default)
+  inline std::string format(double value, int precision = DOUBLE_PRECISION)
   {
-    std::stringstream s;
-    constexpr int precision = std::numeric_limits<double>::digits10;
-    s << std::setprecision(precision) << value;
-    return s.str();
+    char buffer[32];
+    return std::string(buffer, formatDouble(buffer, buffer + sizeof(buffer), value, precision));
   }
 
   /// @brief inline formattor support for doubles
@@ -129,7 +199,7 @@ namespace mtconnect {
     /// @param[in] v the value
     format_double_stream(double v) { val = v; }
 
-    /// @brief writes a double to an output stream with up to 10 digits of precision
+    /// @brief writes a double to an output stream with up to 15 significant digits
     /// @tparam _CharT from std::basic_ostream
     /// @tparam _Traits from std::basic_ostream
     /// @param[in,out] os output stream
@@ -139,8 +209,10 @@ namespace mtconnect {
     inline friend std::basic_ostream<_CharT, _Traits> &operator<<(
         std::basic_ostream<_CharT, _Traits> &os, const format_double_stream &fmter)
     {
-      constexpr int precision = std::numeric_limits<double>::digits10;
-      os << std::setprecision(precision) << fmter.val;
+      char buffer[32];
+      auto end = formatDouble(buffer, buffer + sizeof(buffer), fmter.val);
+      for (auto c = buffer; c != end; c++)
+        os.put(os.widen(*c));
       return os;
     }
   };
@@ -30,6 +30,7 @@
 #include "mtconnect/agent.hpp"
 #include "mtconnect/asset/file_asset.hpp"
 #include "mtconnect/device_model/reference.hpp"
+#include "mtconnect/observation/timeseries_encoding.hpp"
 #include "mtconnect/printer//xml_printer.hpp"
 #include "mtconnect/source/adapter/adapter.hpp"
 #include "test_utilities.hpp"
@@ -2725,6 +2726,265 @@ TEST_F(AgentTest, StreamDataObserver)
   }
 }
 
+TEST_F(AgentTest, should_stream_sample_as_server_sent_events)
+{
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+
+  QueryMap query;
+  query["interval"] = "50";
+  query["heartbeat"] = "1000";
+  query["from"] = to_string(circ.getSequence());
+
+  m_agentTestHelper->responseStreamHelper(__FILE__, __LINE__, query, "/LinuxCNC/sample",
+                                          "text/event-stream,text/xml");
+  EXPECT_EQ(EventStreamMimeType, m_agentTestHelper->m_session->m_mimeType);
+
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204");
+  m_agentTestHelper->m_ioContext.run_for(100ms);
+
+  PARSE_XML_CHUNK();
+  ASSERT_XML_PATH_EQUAL(doc, "//m:Line", "204");
+  ASSERT_TRUE(m_agentTestHelper->m_session->m_chunkId);
+  EXPECT_EQ(to_string(circ.getSequence()), *m_agentTestHelper->m_session->m_chunkId);
+
+  m_agentTestHelper->m_session->closeStream();
+}
+
+TEST_F(AgentTest, should_not_stream_cbor_as_server_sent_events)
+{
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  QueryMap query;
+  query["interval"] = "50";
+
+  m_agentTestHelper->responseStreamHelper(__FILE__, __LINE__, query, "/LinuxCNC/sample",
+                                          "text/event-stream,application/mtconnect+cbor");
+  EXPECT_EQ(status::not_acceptable, m_agentTestHelper->session()->m_code);
+  EXPECT_EQ("application/mtconnect+cbor", m_agentTestHelper->m_session->m_mimeType);
+  EXPECT_FALSE(m_agentTestHelper->m_session->m_streaming);
+}
+
+TEST_F(AgentTest, should_coalesce_observations_when_a_stream_falls_behind)
+{
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+
+  QueryMap query;
+  query["interval"] = "100";
+  query["heartbeat"] = "1000";
+  query["count"] = "100";
+  query["from"] = to_string(circ.getSequence());
+  query["backpressure"] = "bounded";
+  query["maxLag"] = "5";
+
+  PARSE_XML_STREAM_QUERY("/LinuxCNC/sample", query);
+  m_agentTestHelper->m_ioContext.run_for(20ms);
+
+  for (int i = 0; i < 20; i++)
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|block|" + to_string(i));
+  m_agentTestHelper->m_ioContext.run_for(200ms);
+
+  {
+    PARSE_XML_CHUNK();
+    ASSERT_XML_PATH_COUNT(doc, "//m:Block", 1);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Block", "19");
+  }
+
+  auto metrics = rest->getStreamMetrics();
+  ASSERT_EQ(1, metrics.size());
+  EXPECT_EQ(1, metrics.front().m_catchUps);
+  EXPECT_EQ(circ.getSequence(), metrics.front().m_sequence);
+
+  m_agentTestHelper->m_session->closeStream();
+
+  m_agentTestHelper->makeRequest(__FILE__, __LINE__, boost::beast::http::verb::get, "", {},
+                                 "/sample/streams", "application/json");
+  EXPECT_EQ("application/json", m_agentTestHelper->m_session->m_mimeType);
+  EXPECT_NE(string::npos, m_agentTestHelper->m_session->m_body.find("\"catchUps\":1"));
+  EXPECT_EQ(string::npos, m_agentTestHelper->m_session->m_body.find("remote"));
+
+  // A single segment is still the probe of a device
+  {
+    PARSE_XML_RESPONSE("/streams");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "NO_DEVICE");
+  }
+}
+
+TEST_F(AgentTest, should_not_coalesce_a_filtered_stream_when_other_items_change)
+{
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+
+  QueryMap query;
+  query["interval"] = "100";
+  query["heartbeat"] = "1000";
+  query["count"] = "100";
+  query["from"] = to_string(circ.getSequence());
+  query["path"] = "//DataItem[@name='line']";
+  query["backpressure"] = "bounded";
+  query["maxLag"] = "5";
+
+  PARSE_XML_STREAM_QUERY("/LinuxCNC/sample", query);
+  m_agentTestHelper->m_ioContext.run_for(20ms);
+
+  for (int i = 0; i < 20; i++)
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|block|" + to_string(i));
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204");
+  m_agentTestHelper->m_ioContext.run_for(200ms);
+
+  {
+    PARSE_XML_CHUNK();
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Line", "204");
+  }
+
+  auto metrics = rest->getStreamMetrics();
+  ASSERT_EQ(1, metrics.size());
+  EXPECT_EQ(0, metrics.front().m_catchUps);
+  EXPECT_EQ(1, metrics.front().m_lag);
+
+  m_agentTestHelper->m_session->closeStream();
+}
+
+TEST_F(AgentTest, should_evaluate_a_batch_of_requests)
+{
+  addAdapter();
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204");
+
+  m_agentTestHelper->makeRequest(
+      __FILE__, __LINE__, boost::beast::http::verb::post,
+      R"([{"request": "current", "device": "LinuxCNC", "path": "//DataItem[@type='LINE']"},
+          {"request": "sample", "count": 5},
+          {"request": "current", "device": "NoSuchDevice"},
+          {"request": "sample", "interval": 100}])",
+      {}, "/batch", "text/xml");
+
+  auto &session = m_agentTestHelper->m_session;
+  EXPECT_EQ(status::ok, session->m_code);
+  ASSERT_TRUE(starts_with(session->m_mimeType, "multipart/mixed;boundary="));
+  auto boundary = session->m_mimeType.substr(session->m_mimeType.find('=') + 1);
+
+  vector<string> parts;
+  auto &body = session->m_body;
+  auto pos = body.find("--" + boundary + "\r\n");
+  while (pos != string::npos)
+  {
+    auto start = pos + boundary.size() + 4;
+    pos = body.find("--" + boundary, start);
+    parts.emplace_back(body.substr(start, pos - start));
+  }
+
+  ASSERT_EQ(4, parts.size());
+  EXPECT_NE(string::npos, parts[0].find("Status: 200"));
+  EXPECT_NE(string::npos, parts[0].find(">204</Line>"));
+  EXPECT_NE(string::npos, parts[1].find("Status: 200"));
+  EXPECT_NE(string::npos, parts[1].find("MTConnectStreams"));
+  EXPECT_NE(string::npos, parts[2].find("Status: 404"));
+  EXPECT_NE(string::npos, parts[2].find("NO_DEVICE"));
+  EXPECT_NE(string::npos, parts[3].find("Status: 400"));
+  EXPECT_NE(string::npos, parts[3].find("INVALID_REQUEST"));
+}
+
+TEST_F(AgentTest, should_answer_batched_samples_as_of_a_sequence)
+{
+  addAdapter();
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto rest = m_agentTestHelper->getRestService();
+  auto printer = m_agentTestHelper->m_agent->getPrinter("xml");
+
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204");
+  auto asOf = circ.getSequence() - 1;
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:01Z|line|205");
+
+  auto forward = rest->sampleRequest(printer, 100, nullopt, nullopt, nullopt, nullopt, false,
+                                     TimeseriesEncoding::TEXT, asOf);
+  EXPECT_NE(string::npos, forward->m_body.find(">204</Line>"));
+  EXPECT_EQ(string::npos, forward->m_body.find(">205</Line>"));
+  EXPECT_NE(string::npos,
+            forward->m_body.find("lastSequence=\"" + to_string(asOf) + "\""));
+
+  auto backward = rest->sampleRequest(printer, -1, nullopt, nullopt, nullopt,
+                                      string("//DataItem[@type='LINE']"), false,
+                                      TimeseriesEncoding::TEXT, asOf);
+  EXPECT_NE(string::npos, backward->m_body.find(">204</Line>"));
+  EXPECT_EQ(string::npos, backward->m_body.find(">205</Line>"));
+}
+
+TEST_F(AgentTest, should_answer_batched_current_from_a_checkpoint_copy)
+{
+  addAdapter();
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto rest = m_agentTestHelper->getRestService();
+  auto printer = m_agentTestHelper->m_agent->getPrinter("xml");
+
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204");
+  auto asOf = circ.getSequence() - 1;
+  buffer::Checkpoint snapshot(circ.getLatest());
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:01Z|line|205");
+
+  auto current = rest->currentRequest(printer, nullopt, asOf, nullopt, false, nullopt,
+                                      TimeseriesEncoding::TEXT, &snapshot);
+  EXPECT_NE(string::npos, current->m_body.find(">204</Line>"));
+  EXPECT_EQ(string::npos, current->m_body.find(">205</Line>"));
+  EXPECT_NE(string::npos, current->m_body.find("lastSequence=\"" + to_string(asOf) + "\""));
+}
+
+TEST_F(AgentTest, should_only_return_data_items_changed_since_a_sequence)
+{
+  addAdapter();
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204");
+  auto since = circ.getSequence() - 1;
+
+  {
+    QueryMap query {{"since", to_string(since - 1)}};
+    PARSE_XML_RESPONSE_QUERY("/current", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:ComponentStream", 1);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Line", "204");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Header@lastSequence", to_string(since).c_str());
+  }
+
+  {
+    QueryMap query {{"since", to_string(since)}};
+    PARSE_XML_RESPONSE_QUERY("/current", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:ComponentStream", 0);
+  }
+
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:01Z|line|205");
+
+  {
+    QueryMap query {{"since", to_string(since)}};
+    PARSE_XML_RESPONSE_QUERY("/current", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:ComponentStream", 1);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Line", "205");
+  }
+
+  // A since after the end of the document is out of range with or without at
+  {
+    QueryMap query {{"since", to_string(circ.getSequence() + 1)}};
+    PARSE_XML_RESPONSE_QUERY("/current", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "OUT_OF_RANGE");
+  }
+
+  {
+    QueryMap query {{"at", to_string(since)}, {"since", to_string(since + 2)}};
+    PARSE_XML_RESPONSE_QUERY("/current", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "OUT_OF_RANGE");
+  }
+}
+
 // ------------- Put tests
 
 TEST_F(AgentTest, Put)
@@ -2978,3 +3238,211 @@ TEST_F(AgentTest, device_should_have_hash_for_2_2)
     ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceAdded[3]@hash", (*di)->get<string>("hash").c_str());
   }
 }
+
+TEST_F(AgentTest, should_order_data_items_in_streams_order)
+{
+  vector<DataItemPtr> dataItems;
+  for (auto &device : m_agentTestHelper->getAgent()->getDevices())
+    for (auto &di : device->getDeviceDataItems())
+      dataItems.push_back(di.lock());
+
+  ASSERT_LT(1, dataItems.size());
+  for (auto &di : dataItems)
+  {
+    ASSERT_NE(0, di->getOrdinal()) << di->getId();
+    ASSERT_NE(0, di->getGroupOrdinal()) << di->getId();
+  }
+
+  sort(dataItems.begin(), dataItems.end(), [](const DataItemPtr &a, const DataItemPtr &b) {
+    return a->getOrdinal() < b->getOrdinal();
+  });
+  for (auto it = dataItems.begin(), next = it + 1; next != dataItems.end(); it++, next++)
+  {
+    EXPECT_TRUE(**it < **next) << (*it)->getId() << " < " << (*next)->getId();
+    bool sameGroup = (*it)->getComponent() == (*next)->getComponent() &&
+                     (*it)->getCategory() == (*next)->getCategory();
+    EXPECT_EQ(sameGroup, (*it)->getGroupOrdinal() == (*next)->getGroupOrdinal());
+  }
+}
+
+TEST_F(AgentTest, should_encode_timeseries_values_when_requested)
+{
+  addAdapter();
+  m_agentTestHelper->m_adapter->processData(
+      "2021-02-01T12:00:00Z|Xts|10|| 5118 5118 5119 5119 5117 5118 5120 5118 5118 5116");
+
+  string expected;
+  ASSERT_EQ(TimeseriesEncoding::DELTA,
+            EncodeTimeseries(entity::Vector {5118, 5118, 5119, 5119, 5117, 5118, 5120, 5118, 5118,
+                                             5116},
+                             TimeseriesEncoding::DELTA, expected));
+
+  {
+    QueryMap query {{"timeseries", "delta"}};
+    PARSE_XML_RESPONSE_QUERY("/current", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:PositionTimeSeries[@dataItemId='x1ts']",
+                          expected.c_str());
+    ASSERT_XML_PATH_EQUAL(
+        doc, "//m:DeviceStream//m:PositionTimeSeries[@dataItemId='x1ts']@encoding", "delta");
+    ASSERT_XML_PATH_EQUAL(
+        doc, "//m:DeviceStream//m:PositionTimeSeries[@dataItemId='x1ts']@sampleCount", "10");
+  }
+
+  {
+    PARSE_XML_RESPONSE("/current");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:PositionTimeSeries[@dataItemId='x1ts']",
+                          "5118 5118 5119 5119 5117 5118 5120 5118 5118 5116");
+  }
+
+  {
+    QueryMap query {{"timeseries", "bogus"}};
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "INVALID_REQUEST");
+  }
+}
+
+TEST_F(AgentTest, should_format_values_with_significant_digits)
+{
+  addAdapter();
+  m_agentTestHelper->m_adapter->processData(
+      "2021-02-01T12:00:00Z|Xts|4|100.123456789| 1.23456789 2.5 100.1234567 0.000123456789|"
+      "Xact|1.23456789|Yact|1.23456789");
+
+  {
+    PARSE_XML_RESPONSE("/current");
+    // Xts and Xact declare six significant digits
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:PositionTimeSeries[@dataItemId='x1ts']",
+                          "1.23457 2.5 100.123 0.000123457");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[@dataItemId='x1']", "1.23457");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[@dataItemId='y1']", "1.23456789");
+    // Attributes are not rounded
+    ASSERT_XML_PATH_EQUAL(
+        doc, "//m:DeviceStream//m:PositionTimeSeries[@dataItemId='x1ts']@sampleRate",
+        "100.123456789");
+  }
+
+  {
+    PARSE_JSON_RESPONSE("/current");
+    auto text = doc.dump();
+    EXPECT_NE(string::npos, text.find("[1.23457,2.5,100.123,0.000123457]")) << text;
+    EXPECT_NE(string::npos, text.find("\"sampleRate\":100.123456789")) << text;
+    EXPECT_NE(string::npos, text.find("\"value\":1.23457")) << text;
+  }
+}
+
+TEST_F(AgentTest, should_render_large_documents_in_parallel)
+{
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 12, 4, "1.3", 25, false, true,
+                                 {{configuration::WorkerThreads, 4},
+                                  {configuration::ParallelRenderThreshold, 100}});
+  addAdapter();
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto seq = circ.getSequence();
+
+  char line[80] = {0};
+  for (int i = 0; i < 1200; i++)
+  {
+    sprintf(line, "2021-02-01T12:00:00Z|Xact|%d", i);
+    m_agentTestHelper->m_adapter->processData(line);
+  }
+
+  // The observations are rendered in three batches before the document is assembled
+  for (int i = 0; i < 2; i++)
+  {
+    QueryMap query {{"path", "//DataItem[@name='Xact']"},
+                    {"from", to_string(seq)},
+                    {"count", "1200"}};
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:DeviceStream//m:Position", 1200);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[1]", "0");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[1200]", "1199");
+  }
+}
+
+TEST_F(AgentTest, should_cache_assets_and_respond_not_modified_when_unchanged)
+{
+  string body = "<Part assetId='P1'>TEST 1</Part>";
+  QueryMap query {{"device", "LinuxCNC"}, {"type", "Part"}};
+
+  {
+    PARSE_XML_RESPONSE_PUT("/asset", body, query);
+  }
+
+  auto rest = m_agentTestHelper->getRestService();
+  auto agent = m_agentTestHelper->getAgent();
+  auto assets = [](const string &doc) {
+    return doc.substr(doc.find("Assets", doc.find("Header")));
+  };
+  for (auto format : {"xml", "json"})
+  {
+    auto printer = agent->getPrinter(format);
+
+    // The second document is assembled from the cached asset
+    auto first = rest->assetIdsRequest(printer, {"P1"});
+    ASSERT_EQ(status::ok, first->m_status);
+    ASSERT_TRUE(first->m_etag);
+    auto second = rest->assetIdsRequest(printer, {"P1"});
+    EXPECT_EQ(*first->m_etag, *second->m_etag);
+    EXPECT_EQ(assets(first->m_body), assets(second->m_body));
+
+    auto notModified = rest->assetIdsRequest(printer, {"P1"}, false, *first->m_etag);
+    EXPECT_EQ(status::not_modified, notModified->m_status);
+    EXPECT_TRUE(notModified->m_body.empty());
+    EXPECT_EQ(*first->m_etag, *notModified->m_etag);
+  }
+
+  auto printer = agent->getPrinter("xml");
+  auto before = rest->assetIdsRequest(printer, {"P1"});
+
+  {
+    PARSE_XML_RESPONSE_DELETE("/asset/P1");
+  }
+
+  // Removing the asset drops the cached document and changes the entity tag
+  auto after = rest->assetIdsRequest(printer, {"P1"}, false, *before->m_etag);
+  ASSERT_EQ(status::ok, after->m_status);
+  EXPECT_NE(*before->m_etag, *after->m_etag);
+  EXPECT_NE(string::npos, after->m_body.find("removed=\"true\""));
+
+  // A fragment rendered before the asset changed is not kept
+  auto asset = agent->getAssetStorage()->getAsset("P1");
+  ASSERT_TRUE(asset);
+  const auto &fragments = asset->getFragments();
+  auto generation = fragments.generation();
+  asset->setProperty("hash", "changed"s);
+  EXPECT_FALSE(fragments.put(FragmentCache::CBOR, 0, "stale", generation));
+  EXPECT_EQ(nullptr, fragments.get(FragmentCache::CBOR, 0));
+  EXPECT_TRUE(fragments.put(FragmentCache::CBOR, 0, "fresh", fragments.generation()));
+}
+
+TEST_F(AgentTest, should_invalidate_cached_assets_when_a_property_changes)
+{
+  string body = "<Part assetId='P1'>TEST 1</Part>";
+  QueryMap query {{"device", "LinuxCNC"}, {"type", "Part"}};
+
+  {
+    PARSE_XML_RESPONSE_PUT("/asset", body, query);
+  }
+
+  auto rest = m_agentTestHelper->getRestService();
+  auto agent = m_agentTestHelper->getAgent();
+  auto printer = agent->getPrinter("cbor");
+  auto asset = agent->getAssetStorage()->getAsset("P1");
+  ASSERT_TRUE(asset);
+  const auto &fragments = asset->getFragments();
+
+  auto before = rest->assetIdsRequest(printer, {"P1"});
+  ASSERT_EQ(status::ok, before->m_status);
+  ASSERT_TRUE(before->m_etag);
+  ASSERT_TRUE(fragments.get(FragmentCache::CBOR, 0));
+
+  // The change drops the rendered asset and the hash the entity tag is computed from
+  asset->setProperty("deviceUuid", "another-uuid"s);
+  EXPECT_EQ(nullptr, fragments.get(FragmentCache::CBOR, 0));
+
+  auto after = rest->assetIdsRequest(printer, {"P1"}, false, *before->m_etag);
+  ASSERT_EQ(status::ok, after->m_status);
+  EXPECT_NE(*before->m_etag, *after->m_etag);
+  EXPECT_NE(before->m_body, after->m_body);
+  EXPECT_TRUE(fragments.get(FragmentCache::CBOR, 0));
+}
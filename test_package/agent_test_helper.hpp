@@ -83,9 +83,11 @@ namespace mtconnect {
           m_streaming = true;
           complete();
         }
-        void writeChunk(const std::string &chunk, Complete complete) override
+        void writeChunk(std::string chunk, Complete complete,
+                        const std::optional<std::string> &id = std::nullopt) override
         {
           m_chunkBody = chunk;
+          m_chunkId = id;
           if (m_streaming)
             complete();
           else
@@ -101,6 +103,7 @@ namespace mtconnect {
 
         std::string m_chunkBody;
         std::string m_chunkMimeType;
+        std::optional<std::string> m_chunkId;
         bool m_streaming {false};
       };
 
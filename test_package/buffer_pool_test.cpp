@@ -0,0 +1,148 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <memory>
+#include <string>
+
+#include "mtconnect/entity/entity.hpp"
+#include "mtconnect/entity/json_printer.hpp"
+#include "mtconnect/printer/buffer_pool.hpp"
+
+using namespace std;
+using namespace mtconnect;
+using namespace mtconnect::entity;
+using namespace mtconnect::printer;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+TEST(BufferPoolTest, should_reuse_buffers_given_back)
+{
+  BufferPool pool(2, 16, 1024);
+
+  auto buffer = pool.take(100);
+  EXPECT_LE(100, buffer.capacity());
+  auto data = buffer.data();
+  buffer.append("some content");
+  pool.give(std::move(buffer));
+  EXPECT_EQ(1, pool.size());
+
+  auto again = pool.take(50);
+  EXPECT_TRUE(again.empty());
+  EXPECT_EQ(data, again.data());
+
+  auto stats = pool.getStatistics();
+  EXPECT_EQ(1, stats.m_allocated);
+  EXPECT_EQ(1, stats.m_reused);
+  EXPECT_EQ(1, stats.m_returned);
+  EXPECT_EQ(0, stats.m_discarded);
+}
+
+TEST(BufferPoolTest, should_discard_buffers_outside_the_limits)
+{
+  BufferPool pool(1, 16, 1024);
+
+  pool.give(string());
+  pool.give(string(2048, 'x'));
+  pool.give(pool.take(100));
+  pool.give(pool.take(100));
+  auto one = pool.take(100), two = pool.take(100);
+  pool.give(std::move(one));
+  pool.give(std::move(two));
+
+  EXPECT_EQ(1, pool.size());
+  auto stats = pool.getStatistics();
+  EXPECT_EQ(3, stats.m_discarded);
+}
+
+TEST(BufferPoolTest, should_keep_buffers_within_the_budget)
+{
+  BufferPool pool(4, 16, 1024, 1024);
+  EXPECT_EQ(1024, pool.getBudget());
+
+  auto one = pool.take(600), two = pool.take(600);
+  pool.give(std::move(one));
+  pool.give(std::move(two));
+  EXPECT_EQ(1, pool.size());
+  EXPECT_EQ(1, pool.getStatistics().m_discarded);
+
+  pool.setBudget(0);
+  EXPECT_EQ(0, pool.size());
+  pool.give(pool.take(100));
+  EXPECT_EQ(0, pool.size());
+}
+
+TEST(BufferPoolTest, should_return_shared_buffers_when_released)
+{
+  BufferPool pool(4, 16, 1024);
+
+  const char *data;
+  {
+    auto buffer = pool.acquire(64);
+    data = buffer->data();
+    auto copy = buffer;
+    buffer.reset();
+    EXPECT_EQ(0, pool.size());
+  }
+  EXPECT_EQ(1, pool.size());
+
+  auto buffer = pool.acquire(64);
+  EXPECT_EQ(data, buffer->data());
+  EXPECT_EQ(1, pool.getStatistics().m_reused);
+}
+
+TEST(BufferPoolTest, should_outlive_the_pool)
+{
+  BufferPtr buffer;
+  {
+    BufferPool pool;
+    buffer = pool.acquire(64);
+  }
+  buffer->append("still valid");
+  buffer.reset();
+}
+
+TEST(BufferPoolTest, should_print_entities_without_allocating_once_warm)
+{
+  BufferPool pool(4, 16, 4096);
+  JsonEntityPrinter printer(2);
+
+  Properties props {{"name", "Widget"s}, {"value", int64_t(42)}, {"VALUE", "content"s}};
+  auto entity = make_shared<Entity>("Thing", props);
+
+  string expected = printer.printEntity(entity);
+
+  for (int i = 0; i < 100; i++)
+  {
+    auto buffer = pool.acquire(expected.size());
+    printer.printEntity(entity, *buffer);
+    ASSERT_EQ(expected, *buffer);
+  }
+
+  auto stats = pool.getStatistics();
+  EXPECT_EQ(1, stats.m_allocated);
+  EXPECT_EQ(99, stats.m_reused);
+  EXPECT_EQ(0, stats.m_discarded);
+}
@@ -0,0 +1,252 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "mtconnect/parser/xml_parser.hpp"
+#include "mtconnect/printer/cbor_printer.hpp"
+#include "mtconnect/printer/json_printer.hpp"
+#include "mtconnect/printer/xml_printer.hpp"
+#include "test_utilities.hpp"
+
+using json = nlohmann::json;
+using namespace std;
+using namespace mtconnect;
+using namespace mtconnect::observation;
+using namespace mtconnect::entity;
+using namespace mtconnect::printer;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+/// Decode the subset of CBOR generated by the CborWriter, replacing integer keys with their text
+json decode(const string &buffer, size_t &pos)
+{
+  const uint8_t byte = buffer.at(pos++);
+  const uint8_t major = byte >> 5, info = byte & 0x1f;
+
+  auto bigEndian = [&](int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+      value = (value << 8) | uint8_t(buffer.at(pos++));
+    return value;
+  };
+
+  if (byte == 0xf4)
+    return false;
+  if (byte == 0xf5)
+    return true;
+  if (byte == 0xf6)
+    return nullptr;
+  if (byte == 0xfb)
+  {
+    auto bits = bigEndian(8);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+  if (info == 31)
+  {
+    json value = major == 4 ? json::array() : json::object();
+    while (uint8_t(buffer.at(pos)) != 0xff)
+    {
+      if (major == 4)
+      {
+        value.push_back(decode(buffer, pos));
+      }
+      else
+      {
+        auto key = decode(buffer, pos);
+        string name =
+            key.is_string() ? key.get<string>() : string(CborWriter::keys().at(key.get<size_t>()));
+        value[name] = decode(buffer, pos);
+      }
+    }
+    pos++;
+    return value;
+  }
+
+  uint64_t arg = info < 24 ? info : bigEndian(1 << (info - 24));
+  switch (major)
+  {
+    case 0:
+      return arg;
+    case 1:
+      return -1 - int64_t(arg);
+    case 3:
+      pos += arg;
+      return buffer.substr(pos - arg, arg);
+  }
+
+  throw runtime_error("Unexpected CBOR type");
+}
+
+json decode(const string &buffer)
+{
+  size_t pos = 0;
+  auto doc = decode(buffer, pos);
+  EXPECT_EQ(buffer.size(), pos);
+  return doc;
+}
+
+class CborPrinterTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    m_xmlPrinter = std::make_unique<XmlPrinter>("1.5");
+    m_jsonPrinter = std::make_unique<printer::JsonPrinter>(2);
+    m_printer = std::make_unique<CborPrinter>();
+    m_config = std::make_unique<parser::XmlParser>();
+    m_devices = m_config->parseFile(TEST_RESOURCE_DIR "/samples/SimpleDevlce.xml",
+                                    m_xmlPrinter.get());
+  }
+
+  void TearDown() override
+  {
+    m_config.reset();
+    m_xmlPrinter.reset();
+    m_jsonPrinter.reset();
+    m_printer.reset();
+  }
+
+  void addObservation(ObservationList &list, const char *name, uint64_t sequence,
+                      Properties props)
+  {
+    DataItemPtr d;
+    for (auto &device : m_devices)
+    {
+      if ((d = device->getDeviceDataItem(name)))
+        break;
+    }
+    ASSERT_TRUE(d) << "Could not find data item " << name;
+    ErrorList errors;
+    auto obs = Observation::make(d, props, chrono::system_clock::now(), errors);
+    ASSERT_TRUE(obs);
+    ASSERT_EQ(0, errors.size());
+
+    obs->setSequence(sequence);
+    list.emplace_back(obs);
+  }
+
+  // The creation time may differ between the two documents
+  void compare(const string &jsonDoc, const string &cborDoc, const char *root)
+  {
+    auto expected = json::parse(jsonDoc);
+    auto actual = decode(cborDoc);
+    expected[root]["Header"].erase("creationTime");
+    actual[root]["Header"].erase("creationTime");
+    EXPECT_EQ(expected, actual);
+  }
+
+protected:
+  std::unique_ptr<CborPrinter> m_printer;
+  std::unique_ptr<printer::JsonPrinter> m_jsonPrinter;
+  std::unique_ptr<parser::XmlParser> m_config;
+  std::unique_ptr<XmlPrinter> m_xmlPrinter;
+  std::list<DevicePtr> m_devices;
+};
+
+TEST_F(CborPrinterTest, should_encode_values_natively)
+{
+  string buffer;
+  CborWriter writer(buffer);
+
+  writer.StartArray();
+  writer.Int64(-1);
+  writer.Uint64(500);
+  writer.Double(1.5);
+  writer.String("abc");
+  writer.Bool(true);
+  writer.EndArray();
+  writer.StartObject();
+  writer.Key("dataItemId");
+  writer.Null();
+  writer.Key("notAKey");
+  writer.Null();
+  writer.EndObject();
+  EXPECT_TRUE(writer.IsComplete());
+
+  auto key = *CborWriter::keyIndex("dataItemId");
+  ASSERT_LT(key, 24);
+  string expected {"\x9f\x20\x19\x01\xf4\xfb\x3f\xf8\x00\x00\x00\x00\x00\x00\x63"
+                   "abc\xf5\xff\xbf",
+                   21};
+  expected.push_back(char(key));
+  expected.append("\xf6\x67notAKey\xf6\xff");
+  EXPECT_EQ(expected, buffer);
+}
+
+TEST_F(CborPrinterTest, should_print_the_json_version_2_streams_structure)
+{
+  ObservationList list;
+  addObservation(list, "Xpos", 10, {{"VALUE", 100.5}});
+  addObservation(list, "Xpos", 11, {{"VALUE", -2.25}});
+  addObservation(list, "r186cd60", 12, {{"VALUE", Vector {1.0, -2.5, 3.0}}});
+  addObservation(list, "if36ff60", 13, {{"VALUE", "AUTOMATIC"s}});
+  addObservation(list, "a5b23650", 14,
+                 {{"level", "fault"s}, {"nativeCode", "2218"s}, {"VALUE", "Syntax error"s}});
+
+  auto expected = m_jsonPrinter->printSample(123, 131072, 15, 10, 14, list);
+  auto cbor = m_printer->printSample(123, 131072, 15, 10, 14, list);
+  compare(expected, cbor, "MTConnectStreams");
+
+  // The second document uses the cached observations
+  for (auto &obs : list)
+    EXPECT_NE(nullptr, obs->getFragments().get(FragmentCache::CBOR, 0));
+  compare(expected, m_printer->printSample(123, 131072, 15, 10, 14, list), "MTConnectStreams");
+}
+
+TEST_F(CborPrinterTest, should_print_devices_assets_and_errors)
+{
+  compare(m_jsonPrinter->printProbe(123, 1024, 10, 256, 1, m_devices),
+          m_printer->printProbe(123, 1024, 10, 256, 1, m_devices), "MTConnectDevices");
+
+  compare(m_jsonPrinter->printAssets(123, 256, 0, {}), m_printer->printAssets(123, 256, 0, {}),
+          "MTConnectAssets");
+
+  compare(m_jsonPrinter->printError(123, 1024, 10, "BAD_BAD", "Never do that"),
+          m_printer->printError(123, 1024, 10, "BAD_BAD", "Never do that"), "MTConnectError");
+}
+
+TEST_F(CborPrinterTest, should_print_single_entities)
+{
+  ObservationList list;
+  addObservation(list, "Xpos", 10, {{"VALUE", 100.5}});
+
+  JsonEntityPrinter jsonPrinter(2);
+  CborEntityPrinter printer;
+
+  string buffer;
+  printer.printEntity(list.front(), buffer);
+  EXPECT_EQ(json::parse(jsonPrinter.printEntity(list.front())), decode(buffer));
+  EXPECT_EQ(json::parse(jsonPrinter.print(list.front())), decode(printer.print(list.front())));
+}
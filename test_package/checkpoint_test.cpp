@@ -580,3 +580,121 @@ TEST_F(CheckpointTest, orphaned_observations_should_be_skipped)
 
   ASSERT_EQ(0, list2.size());
 }
+
+TEST_F(CheckpointTest, should_only_get_observations_changed_since_a_sequence)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+  auto warning1 = entity::Properties {
+      {"level", "WARNING"s},
+      {"nativeCode", "CODE1"s},
+      {"qualifier", "HIGH"s},
+      {"VALUE", "Over..."s},
+  };
+  auto warning2 = entity::Properties {
+      {"level", "WARNING"s},
+      {"nativeCode", "CODE2"s},
+      {"qualifier", "HIGH"s},
+      {"VALUE", "Over..."s},
+  };
+  auto value = entity::Properties {{"VALUE", "123"s}};
+
+  auto p1 = observation::Observation::make(m_dataItem1, warning1, time, errors);
+  p1->setSequence(10);
+  m_checkpoint->addObservation(p1);
+  auto p2 = observation::Observation::make(m_dataItem2, value, time, errors);
+  p2->setSequence(11);
+  m_checkpoint->addObservation(p2);
+
+  {
+    ObservationList list;
+    m_checkpoint->getObservations(list, nullopt, 10);
+    ASSERT_EQ(1, list.size());
+    EXPECT_EQ(p2, list.front());
+  }
+
+  {
+    ObservationList list;
+    m_checkpoint->getObservations(list, nullopt, 11);
+    ASSERT_EQ(0, list.size());
+  }
+
+  // A new condition returns all active conditions for the data item
+  auto p3 = observation::Observation::make(m_dataItem1, warning2, time, errors);
+  p3->setSequence(12);
+  m_checkpoint->addObservation(p3);
+
+  {
+    ObservationList list;
+    m_checkpoint->getObservations(list, nullopt, 11);
+    ASSERT_EQ(2, list.size());
+    EXPECT_EQ(p3, list.front());
+    EXPECT_EQ(p1, list.back());
+  }
+}
+
+TEST_F(CheckpointTest, should_get_conditions_cleared_since_a_sequence)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+  auto fault1 = entity::Properties {
+      {"level", "FAULT"s},
+      {"nativeCode", "CODE1"s},
+      {"VALUE", "Over..."s},
+  };
+  auto fault2 = entity::Properties {
+      {"level", "FAULT"s},
+      {"nativeCode", "CODE2"s},
+      {"VALUE", "Under..."s},
+  };
+  auto normal1 = entity::Properties {{"level", "NORMAL"s}, {"nativeCode", "CODE1"s}};
+  auto normal2 = entity::Properties {{"level", "NORMAL"s}, {"nativeCode", "CODE2"s}};
+
+  auto p1 = observation::Observation::make(m_dataItem1, fault1, time, errors);
+  p1->setSequence(10);
+  m_checkpoint->addObservation(p1);
+  auto p2 = observation::Observation::make(m_dataItem1, fault2, time, errors);
+  p2->setSequence(11);
+  m_checkpoint->addObservation(p2);
+
+  // Clearing the first fault leaves the second with its original sequence
+  auto p3 = observation::Observation::make(m_dataItem1, normal1, time, errors);
+  p3->setSequence(12);
+  m_checkpoint->addObservation(p3);
+
+  {
+    ObservationList list;
+    m_checkpoint->getObservations(list, nullopt, 11);
+    ASSERT_EQ(1, list.size());
+    auto cond = dynamic_pointer_cast<Condition>(list.front());
+    EXPECT_EQ("CODE2", cond->getCode());
+    EXPECT_EQ(11, cond->getSequence());
+  }
+
+  {
+    ObservationList list;
+    m_checkpoint->getObservations(list, nullopt, 12);
+    ASSERT_EQ(0, list.size());
+  }
+
+  // Clearing the last fault reports the normal
+  auto p4 = observation::Observation::make(m_dataItem1, normal2, time, errors);
+  p4->setSequence(13);
+  m_checkpoint->addObservation(p4);
+
+  {
+    ObservationList list;
+    m_checkpoint->getObservations(list, nullopt, 12);
+    ASSERT_EQ(1, list.size());
+    auto cond = dynamic_pointer_cast<Condition>(list.front());
+    EXPECT_EQ(Condition::NORMAL, cond->getLevel());
+  }
+
+  // A copy of the checkpoint keeps when each condition changed
+  Checkpoint copy(*m_checkpoint);
+  {
+    ObservationList list;
+    copy.getObservations(list, nullopt, 12);
+    ASSERT_EQ(1, list.size());
+  }
+}
@@ -22,6 +22,7 @@
 #include <chrono>
 
 #include "mtconnect/observation/observation.hpp"
+#include "mtconnect/observation/timeseries_encoding.hpp"
 #include "mtconnect/pipeline/pipeline_context.hpp"
 #include "mtconnect/pipeline/shdr_token_mapper.hpp"
 #include "mtconnect/pipeline/timestamp_extractor.hpp"
@@ -250,6 +251,34 @@ TEST_F(DataItemMappingTest, SampleTimeseries)
   ASSERT_EQ(100.0, sample->get<double>("sampleRate"));
 }
 
+TEST_F(DataItemMappingTest, SampleTimeseriesEncoded)
+{
+  auto di = makeDataItem({{"id", "a"s},
+                          {"type", "POSITION"s},
+                          {"category", "SAMPLE"s},
+                          {"units", "MILLIMETER"s},
+                          {"representation", "TIME_SERIES"s}});
+
+  entity::Vector values {1.1, 1.2, 1.3, 1.4, 1.5};
+  for (auto encoding : {TimeseriesEncoding::FLOAT64, TimeseriesEncoding::GORILLA})
+  {
+    string text;
+    ASSERT_EQ(encoding, EncodeTimeseries(values, encoding, text));
+
+    auto ts = makeTimestamped(
+        {"a", "5", "100", string(TimeseriesEncodingName(encoding)) + ":" + text});
+    auto observations = (*m_mapper)(ts);
+    auto oblist = observations->getValue<EntityList>();
+    ASSERT_EQ(1, oblist.size());
+
+    auto sample = dynamic_pointer_cast<Timeseries>(oblist.front());
+    ASSERT_TRUE(sample);
+    ASSERT_EQ(di, sample->getDataItem());
+    ASSERT_EQ(values, sample->getValue<entity::Vector>());
+    ASSERT_EQ(5, sample->get<int64_t>("sampleCount"));
+  }
+}
+
 TEST_F(DataItemMappingTest, SampleResetTrigger)
 {
   auto di = makeDataItem({{"id", "a"s},
@@ -176,6 +176,13 @@ public:
           fail(ev, "Failed in chunked body");
 
         string b(body.cbegin(), body.cend());
+        if (m_contentType == "text/event-stream")
+        {
+          m_result = b;
+          m_done = true;
+          return body.size();
+        }
+
         auto le = b.find("\r\n");
         if (le == string::npos)
           return 0;
@@ -219,6 +226,51 @@ public:
     m_done = true;
   }
 
+  void pipeline(std::vector<std::string> const& targets, asio::yield_context yield)
+  {
+    beast::error_code ec;
+
+    m_done = false;
+    m_results.clear();
+
+    // Send all the requests before reading the first response
+    ostringstream out;
+    for (const auto& target : targets)
+    {
+      http::request<http::string_body> req {http::verb::get, target, 11};
+      req.set(http::field::host, "localhost");
+      req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+      req.prepare_payload();
+      out << req;
+    }
+
+    m_stream.expires_after(std::chrono::seconds(30));
+    auto requests = out.str();
+    asio::async_write(m_stream, asio::buffer(requests), yield[ec]);
+    if (ec)
+      return fail(ec, "write");
+
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+      http::response<http::string_body> res;
+      http::async_read(m_stream, m_b, res, yield[ec]);
+      if (ec)
+        return fail(ec, "async_read");
+      m_results.emplace_back(res.body());
+    }
+
+    m_done = true;
+  }
+
+  void spawnPipeline(std::vector<std::string> const& targets)
+  {
+    m_done = false;
+    asio::spawn(m_context, std::bind(&Client::pipeline, this, targets, std::placeholders::_1));
+
+    while (!m_done && m_context.run_for(20ms) > 0)
+      ;
+  }
+
   void readChunk(asio::yield_context yield)
   {
     boost::system::error_code ec;
@@ -259,6 +311,7 @@ public:
   bool m_connected {false};
   int m_status;
   std::string m_result;
+  std::vector<std::string> m_results;
   asio::io_context& m_context;
   bool m_done {false};
   beast::tcp_stream m_stream;
@@ -362,6 +415,75 @@ TEST_F(RestServiceTest, simple_request_response)
   ASSERT_TRUE(savedSession.expired());
 }
 
+TEST_F(RestServiceTest, should_not_send_a_content_length_when_not_modified)
+{
+  auto assets = [&](SessionPtr session, RequestPtr request) -> bool {
+    auto resp = make_unique<Response>(status::not_modified, "", "text/xml");
+    resp->m_etag = R"(W/"abc")";
+    session->writeResponse(std::move(resp));
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/assets", assets});
+
+  start();
+  startClient();
+
+  m_client->spawnRequest(http::verb::get, "/assets");
+
+  EXPECT_EQ(304, m_client->m_status);
+  EXPECT_EQ(R"(W/"abc")", m_client->m_fields["ETag"]);
+  EXPECT_EQ(0, m_client->m_fields.count("Content-Length"));
+}
+
+TEST_F(RestServiceTest, should_respond_to_pipelined_requests_in_order)
+{
+  int dispatched {0};
+  auto probe = [&](SessionPtr session, RequestPtr request) -> bool {
+    dispatched++;
+    ResponsePtr resp = make_unique<Response>(status::ok);
+    resp->m_body =
+        string("Device given as: ") + get<string>(request->m_parameters.find("device")->second);
+    session->writeResponse(std::move(resp));
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/{device}/probe", probe});
+
+  start();
+  startClient();
+
+  m_client->spawnPipeline({"/device1/probe", "/device2/probe", "/device3/probe"});
+  ASSERT_TRUE(m_client->m_done);
+  EXPECT_EQ(3, dispatched);
+
+  ASSERT_EQ(3, m_client->m_results.size());
+  EXPECT_EQ("Device given as: device1", m_client->m_results[0]);
+  EXPECT_EQ("Device given as: device2", m_client->m_results[1]);
+  EXPECT_EQ("Device given as: device3", m_client->m_results[2]);
+}
+
+TEST_F(RestServiceTest, should_allow_batch_post_when_puts_are_not_allowed)
+{
+  auto batch = [&](SessionPtr session, RequestPtr request) -> bool {
+    ResponsePtr resp = make_unique<Response>(status::ok);
+    resp->m_body = request->m_body;
+    session->writeResponse(std::move(resp));
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::post, "/batch", batch});
+
+  start();
+  startClient();
+
+  m_client->spawnRequest(http::verb::post, "/batch", R"([{"request": "current"}])", false,
+                         "application/json");
+  ASSERT_TRUE(m_client->m_done);
+  EXPECT_EQ(200, m_client->m_status);
+  EXPECT_EQ(R"([{"request": "current"}])", m_client->m_result);
+}
+
 TEST_F(RestServiceTest, request_response_with_query_parameters)
 {
   auto handler = [&](SessionPtr session, RequestPtr request) -> bool {
@@ -648,6 +770,46 @@ TEST_F(RestServiceTest, streaming_response)
     ;
 }
 
+TEST_F(RestServiceTest, event_stream_response)
+{
+  SessionPtr session;
+  RequestPtr request;
+  bool written {false};
+  auto begin = [&](SessionPtr s, RequestPtr r) -> bool {
+    session = s;
+    request = r;
+    s->beginStreaming(EventStreamMimeType, [&]() { written = true; });
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/sample", begin});
+
+  start();
+  startClient();
+
+  m_client->spawnRequest(http::verb::get, "/sample");
+  while (!written && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_TRUE(session);
+  EXPECT_EQ("text/event-stream", m_client->m_contentType);
+  EXPECT_EQ("no", m_client->m_fields["X-Accel-Buffering"]);
+
+  m_client->spawnReadChunk();
+  while (m_context.run_for(20ms) > 0)
+    ;
+
+  written = false;
+  m_client->m_done = false;
+  session->writeChunk("<Streams>\n  <Event/>\n</Streams>", [&]() { written = true; }, "101"s);
+  while ((!written || !m_client->m_done) && m_context.run_for(20ms) > 0)
+    ;
+  EXPECT_EQ("id: 101\ndata: <Streams>\ndata:   <Event/>\ndata: </Streams>\n\n", m_client->m_result);
+
+  session->closeStream();
+  while (m_context.run_for(20ms) > 0)
+    ;
+}
+
 TEST_F(RestServiceTest, additional_header_fields)
 {
   m_server->setHttpHeaders({"Access-Control-Allow-Origin:*", "Origin:https://foo.example"});
@@ -0,0 +1,329 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <sstream>
+
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "mtconnect/pipeline/json_mapper.hpp"
+#include "mtconnect/pipeline/pipeline_context.hpp"
+#include "mtconnect/utilities.hpp"
+
+using namespace mtconnect;
+using namespace mtconnect::pipeline;
+using namespace mtconnect::observation;
+using namespace mtconnect::asset;
+using namespace device_model;
+using namespace data_item;
+using namespace std;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class MockPipelineContract : public PipelineContract
+{
+public:
+  MockPipelineContract(std::map<string, DevicePtr> &devices) : m_devices(devices) {}
+  DevicePtr findDevice(const std::string &name) override
+  {
+    if (name.empty())
+      return m_devices.empty() ? nullptr : m_devices.begin()->second;
+    for (auto &dev : m_devices)
+    {
+      if (*dev.second->getUuid() == name || *dev.second->getComponentName() == name)
+        return dev.second;
+    }
+    return nullptr;
+  }
+  DataItemPtr findDataItem(const std::string &device, const std::string &name) override
+  {
+    auto dev = findDevice(device);
+    return dev ? dev->getDeviceDataItem(name) : nullptr;
+  }
+  void eachDataItem(EachDataItem fun) override {}
+  void deliverObservation(observation::ObservationPtr obs) override {}
+  void deliverAsset(AssetPtr) override {}
+  void deliverDevice(DevicePtr) override {}
+  void deliverAssetCommand(entity::EntityPtr) override {}
+  void deliverCommand(entity::EntityPtr) override {}
+  void deliverConnectStatus(entity::EntityPtr, const StringList &, bool) override {}
+  void sourceFailed(const std::string &id) override {}
+  const ObservationPtr checkDuplicate(const ObservationPtr &obs) const override { return obs; }
+
+  std::map<string, DevicePtr> &m_devices;
+};
+
+class JsonMapperTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    m_context = make_shared<PipelineContext>();
+    m_context->m_contract = make_unique<MockPipelineContract>(m_devices);
+    m_mapper = make_shared<JsonMapper>(m_context, "device1");
+    m_mapper->bind(make_shared<NullTransform>(TypeGuard<Entity>(RUN)));
+
+    makeDevice({{"id", "d1"s}, {"name", "device1"s}, {"uuid", "d1-uuid"s}});
+  }
+
+  void TearDown() override { m_devices.clear(); }
+
+  DataItemPtr makeDataItem(const std::string &device, const Properties &props)
+  {
+    auto dev = m_devices.find(device);
+    if (dev == m_devices.end())
+    {
+      EXPECT_TRUE(false) << "Cannot find device: " << device;
+      return nullptr;
+    }
+
+    Properties ps(props);
+    ErrorList errors;
+    auto di = DataItem::make(ps, errors);
+    dev->second->addDataItem(di, errors);
+
+    return di;
+  }
+
+  DevicePtr makeDevice(const Properties &props)
+  {
+    ErrorList errors;
+    Properties ps(props);
+    DevicePtr d = dynamic_pointer_cast<device_model::Device>(
+        device_model::Device::getFactory()->make("Device", ps, errors));
+    m_devices.emplace(d->getId(), d);
+
+    return d;
+  }
+
+  EntityList map(const std::string &payload, DataItemPtr dataItem = nullptr)
+  {
+    auto message = make_shared<JsonMessage>(
+        "JsonMessage", Properties {{"VALUE", payload}, {"topic", "test"s}});
+    message->m_dataItem = dataItem;
+    auto res = (*m_mapper)(message);
+    return res->getValue<EntityList>();
+  }
+
+  shared_ptr<PipelineContext> m_context;
+  shared_ptr<JsonMapper> m_mapper;
+  std::map<string, DevicePtr> m_devices;
+};
+
+inline DataSetEntry operator"" _E(const char *c, std::size_t) { return DataSetEntry(c); }
+
+TEST_F(JsonMapperTest, should_map_members_to_data_items)
+{
+  auto exec = makeDataItem(
+      "d1", {{"id", "a"s}, {"name", "exec"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+  auto pos = makeDataItem("d1", {{"id", "b"s},
+                                 {"type", "POSITION"s},
+                                 {"category", "SAMPLE"s},
+                                 {"units", "MILLIMETER"s}});
+
+  auto list = map(R"({"timestamp": "2023-01-02T03:04:05.123456Z", "exec": "ACTIVE",
+                      "unknown": {"x": [1, 2, {"y": 3}]}, "b": 10.5})");
+  ASSERT_EQ(2, list.size());
+
+  auto it = list.begin();
+  auto event = dynamic_pointer_cast<Observation>(*it++);
+  ASSERT_TRUE(event);
+  EXPECT_EQ(exec, event->getDataItem());
+  EXPECT_EQ("ACTIVE", event->getValue<string>());
+  EXPECT_EQ(parseTimestamp("2023-01-02T03:04:05.123456Z"), event->getTimestamp());
+
+  auto sample = dynamic_pointer_cast<Observation>(*it++);
+  ASSERT_TRUE(sample);
+  EXPECT_EQ(pos, sample->getDataItem());
+  EXPECT_EQ(10.5, sample->getValue<double>());
+  EXPECT_EQ(event->getTimestamp(), sample->getTimestamp());
+}
+
+TEST_F(JsonMapperTest, should_map_conditions_messages_and_unavailable_values)
+{
+  auto cond =
+      makeDataItem("d1", {{"id", "c"s}, {"type", "TEMPERATURE"s}, {"category", "CONDITION"s}});
+  auto msg = makeDataItem("d1", {{"id", "m"s}, {"type", "MESSAGE"s}, {"category", "EVENT"s}});
+  auto exec = makeDataItem("d1", {{"id", "e"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+
+  auto list = map(R"({"c": {"level": "fault", "nativeCode": "HTEMP", "value": "Oil hot"},
+                      "m": {"nativeCode": "CHG", "value": "Change inserts"}, "e": null})");
+  ASSERT_EQ(3, list.size());
+
+  auto it = list.begin();
+  auto condition = dynamic_pointer_cast<Condition>(*it++);
+  ASSERT_TRUE(condition);
+  EXPECT_EQ(cond, condition->getDataItem());
+  EXPECT_EQ(Condition::FAULT, condition->getLevel());
+  EXPECT_EQ("HTEMP", condition->get<string>("nativeCode"));
+  EXPECT_EQ("Oil hot", condition->getValue<string>());
+
+  auto message = dynamic_pointer_cast<Message>(*it++);
+  ASSERT_TRUE(message);
+  EXPECT_EQ(msg, message->getDataItem());
+  EXPECT_EQ("CHG", message->get<string>("nativeCode"));
+  EXPECT_EQ("Change inserts", message->getValue<string>());
+
+  auto event = dynamic_pointer_cast<Observation>(*it++);
+  ASSERT_TRUE(event);
+  EXPECT_EQ(exec, event->getDataItem());
+  EXPECT_TRUE(event->isUnavailable());
+
+  // A condition can also be given by its level
+  list = map(R"({"c": "normal"})");
+  ASSERT_EQ(1, list.size());
+  condition = dynamic_pointer_cast<Condition>(list.front());
+  ASSERT_TRUE(condition);
+  EXPECT_EQ(Condition::NORMAL, condition->getLevel());
+}
+
+TEST_F(JsonMapperTest, should_map_data_sets_tables_and_vectors)
+{
+  makeDataItem("d1", {{"id", "ds"s},
+                      {"type", "VARIABLE"s},
+                      {"category", "EVENT"s},
+                      {"representation", "DATA_SET"s}});
+  makeDataItem("d1", {{"id", "tb"s},
+                      {"type", "WORK_OFFSET"s},
+                      {"category", "EVENT"s},
+                      {"representation", "TABLE"s}});
+  makeDataItem("d1", {{"id", "pos"s},
+                      {"type", "PATH_POSITION"s},
+                      {"category", "SAMPLE"s},
+                      {"units", "MILLIMETER_3D"s}});
+
+  auto list = map(R"({"ds": {"a": 1, "b": "two", "c": null},
+                      "tb": {"G53.1": {"X": 1.5, "s": "text"}},
+                      "pos": [1, 2.5, 3]})");
+  ASSERT_EQ(3, list.size());
+
+  auto it = list.begin();
+  auto set = dynamic_pointer_cast<DataSetEvent>(*it++);
+  ASSERT_TRUE(set);
+  auto &ds = set->getValue<DataSet>();
+  ASSERT_EQ(3, ds.size());
+  EXPECT_EQ(1, get<int64_t>(ds.find("a"_E)->m_value));
+  EXPECT_EQ("two", get<string>(ds.find("b"_E)->m_value));
+  EXPECT_TRUE(ds.find("c"_E)->m_removed);
+
+  auto table = dynamic_pointer_cast<DataSetEvent>(*it++);
+  ASSERT_TRUE(table);
+  auto &tb = table->getValue<DataSet>();
+  ASSERT_EQ(1, tb.size());
+  auto row = get<DataSet>(tb.find("G53.1"_E)->m_value);
+  ASSERT_EQ(2, row.size());
+  EXPECT_EQ(1.5, get<double>(row.find("X"_E)->m_value));
+  EXPECT_EQ("text", get<string>(row.find("s"_E)->m_value));
+
+  auto sample = dynamic_pointer_cast<ThreeSpaceSample>(*it++);
+  ASSERT_TRUE(sample);
+  EXPECT_EQ(entity::Vector({1.0, 2.5, 3.0}), sample->getValue<entity::Vector>());
+}
+
+TEST_F(JsonMapperTest, should_map_arrays_and_other_devices)
+{
+  auto exec1 = makeDataItem("d1", {{"id", "e1"s},
+                                   {"name", "exec"s},
+                                   {"type", "EXECUTION"s},
+                                   {"category", "EVENT"s}});
+  makeDevice({{"id", "d2"s}, {"name", "device2"s}, {"uuid", "d2-uuid"s}});
+  auto exec2 = makeDataItem("d2", {{"id", "e2"s},
+                                   {"name", "exec"s},
+                                   {"type", "EXECUTION"s},
+                                   {"category", "EVENT"s}});
+
+  auto list = map(R"([{"exec": "READY"},
+                      {"timestamp": "2023-01-02T03:04:05Z", "device2": {"exec": "ACTIVE"}},
+                      {"d2-uuid": {"exec": "STOPPED"}}])");
+  ASSERT_EQ(3, list.size());
+
+  auto it = list.begin();
+  auto event = dynamic_pointer_cast<Observation>(*it++);
+  EXPECT_EQ(exec1, event->getDataItem());
+  EXPECT_EQ("READY", event->getValue<string>());
+
+  event = dynamic_pointer_cast<Observation>(*it++);
+  EXPECT_EQ(exec2, event->getDataItem());
+  EXPECT_EQ("ACTIVE", event->getValue<string>());
+  EXPECT_EQ(parseTimestamp("2023-01-02T03:04:05Z"), event->getTimestamp());
+
+  event = dynamic_pointer_cast<Observation>(*it++);
+  EXPECT_EQ(exec2, event->getDataItem());
+  EXPECT_EQ("STOPPED", event->getValue<string>());
+}
+
+TEST_F(JsonMapperTest, should_map_the_message_to_the_data_item_of_the_topic)
+{
+  auto count = makeDataItem("d1", {{"id", "pc"s}, {"type", "PART_COUNT"s}, {"category", "EVENT"s}});
+
+  auto list = map(R"({"value": 5, "timestamp": "2023-01-02T03:04:05Z", "resetTriggered": "DAY"})",
+                  count);
+  ASSERT_EQ(1, list.size());
+
+  auto event = dynamic_pointer_cast<Observation>(list.front());
+  ASSERT_TRUE(event);
+  EXPECT_EQ(count, event->getDataItem());
+  EXPECT_EQ("5", event->getValue<string>());
+  EXPECT_EQ("DAY", event->get<string>("resetTriggered"));
+  EXPECT_EQ(parseTimestamp("2023-01-02T03:04:05Z"), event->getTimestamp());
+}
+
+TEST_F(JsonMapperTest, should_keep_the_observations_before_invalid_json)
+{
+  makeDataItem("d1", {{"id", "a"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+  makeDataItem("d1", {{"id", "b"s}, {"type", "PROGRAM"s}, {"category", "EVENT"s}});
+
+  auto list = map(R"({"a": "ACTIVE", "b": })");
+  ASSERT_EQ(1, list.size());
+  EXPECT_EQ("ACTIVE", dynamic_pointer_cast<Observation>(list.front())->getValue<string>());
+
+  EXPECT_EQ(1, map(R"({"a": "READY"} trailing)").size());
+}
+
+TEST_F(JsonMapperTest, should_map_large_json_messages_repeatedly)
+{
+  const int items = 10;
+  stringstream payload;
+  payload << R"({"timestamp": "2023-01-02T03:04:05.123456Z")";
+  for (int i = 0; i < items; i++)
+  {
+    auto id = to_string(i);
+    makeDataItem("d1", {{"id", "s" + id},
+                        {"type", "POSITION"s},
+                        {"category", "SAMPLE"s},
+                        {"units", "MILLIMETER"s}});
+    makeDataItem("d1", {{"id", "e" + id}, {"type", "PROGRAM"s}, {"category", "EVENT"s}});
+    payload << R"(, "s)" << i << R"(": )" << (i * 1.25) << R"(, "e)" << i << R"(": "program )"
+            << i << '"';
+  }
+  payload << "}";
+  const auto text = payload.str();
+
+  const int runs = 100;
+  size_t observations = 0;
+  for (int r = 0; r < runs; r++)
+    observations += map(text).size();
+  EXPECT_EQ(size_t(2 * items * runs), observations);
+}
@@ -684,3 +684,63 @@ TEST_F(JsonPrinterStreamTest, Unavailability)
   ASSERT_TRUE(position.is_object());
   ASSERT_EQ(string("UNAVAILABLE"), position.at("/Position/value"_json_pointer).get<string>());
 }
+
+TEST_F(JsonPrinterStreamTest, should_reuse_cached_observations_in_compact_documents)
+{
+  Timestamp now = chrono::system_clock::now();
+  ObservationList list;
+  addObservationToList(list, "if36ff60", 10254804, "AUTOMATIC"_value, now);
+  addObservationToList(list, "r186cd60", 10254805, Properties {{"VALUE", Vector {10, 20, 30}}},
+                       now);
+  addObservationToList(list, "r186cd60", 10254806, Properties {{"VALUE", Vector {11, 21, 31}}},
+                       now);
+
+  for (auto version : {1, 2})
+  {
+    auto pretty = std::make_unique<printer::JsonPrinter>(version, true);
+    auto compact = std::make_unique<printer::JsonPrinter>(version, false);
+    auto format = version == 1 ? FragmentCache::JSON_V1 : FragmentCache::JSON_V2;
+
+    auto expected =
+        json::parse(pretty->printSample(123, 131072, 10254805, 10123733, 10123800, list));
+    for (auto &o : list)
+      ASSERT_EQ(nullptr, o->getFragments().get(format, 0));
+
+    auto first = compact->printSample(123, 131072, 10254805, 10123733, 10123800, list);
+    for (auto &o : list)
+      ASSERT_NE(nullptr, o->getFragments().get(format, 0));
+
+    auto second = compact->printSample(123, 131072, 10254805, 10123733, 10123800, list);
+    ASSERT_EQ(expected, json::parse(first));
+    ASSERT_EQ(expected, json::parse(second));
+  }
+}
+
+TEST_F(JsonPrinterStreamTest, should_patch_the_cached_header_in_compact_documents)
+{
+  ObservationList list;
+  addObservationToList(list, "if36ff60", 10254804, "AUTOMATIC"_value);
+
+  auto pretty = std::make_unique<printer::JsonPrinter>(2, true);
+  auto compact = std::make_unique<printer::JsonPrinter>(2, false);
+  pretty->setModelChangeTime("2021-02-01T12:00:00Z");
+  compact->setModelChangeTime("2021-02-01T12:00:00Z");
+
+  auto compare = [&](uint64_t instanceId, uint64_t next, uint64_t first, uint64_t last) {
+    auto expected = json::parse(pretty->printSample(instanceId, 131072, next, first, last, list));
+    auto actual = json::parse(compact->printSample(instanceId, 131072, next, first, last, list));
+    expected["MTConnectStreams"]["Header"].erase("creationTime");
+    auto &header = actual["MTConnectStreams"]["Header"];
+    ASSERT_TRUE(header["creationTime"].is_string());
+    header.erase("creationTime");
+    ASSERT_EQ(expected, actual);
+  };
+
+  compare(123, 10254805, 10123733, 10254804);
+  compare(123, 10254806, 10123734, 10254805);
+  compare(124, 1, 1, 0);
+
+  pretty->setModelChangeTime("2021-02-02T12:00:00Z");
+  compact->setModelChangeTime("2021-02-02T12:00:00Z");
+  compare(124, 2, 1, 1);
+}
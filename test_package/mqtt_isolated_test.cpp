@@ -516,3 +516,49 @@ TEST_F(MqttIsolatedUnitTest, mqtt_tcp_client_authentication)
   client->async_connect([](mqtt::error_code ec) { ASSERT_FALSE(ec) << "CAnnot connect"; });
   ASSERT_TRUE(waitFor(5s, [&received]() { return received; }));
 }
+
+TEST_F(MqttIsolatedUnitTest, mqtt5_client_should_receive_properties_and_subscription_identifier)
+{
+  ConfigOptions options {{ServerIp, "127.0.0.1"s}, {MqttPort, 0},
+                         {MqttTls, false},         {AutoAvailable, false},
+                         {RealTime, false},        {MqttProtocolVersion, 5}};
+
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  bool subscribed = false;
+  vector<pair<string, MessageProperties>> received;
+  auto handler = make_unique<ClientHandler>();
+  handler->m_connected = [&subscribed](shared_ptr<MqttClient> client) {
+    client->connectComplete();
+    subscribed = client->subscribe("MTConnect/Observation/exec", 7);
+  };
+  handler->m_receiveProperties = [&received](shared_ptr<MqttClient>, const string &topic,
+                                             const string &, const MessageProperties &props) {
+    received.emplace_back(topic, props);
+  };
+
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(m_client->isMqtt5());
+  ASSERT_TRUE(startClient());
+  ASSERT_TRUE(waitFor(1s, [&subscribed]() { return subscribed; }));
+
+  PublishOptions opts;
+  opts.m_retain = false;
+  opts.m_expiry = 60s;
+  opts.m_properties = {{"sequence", "42"}, {"timestamp", "2022-01-01T00:00:00Z"}};
+
+  // The second message is sent with a topic alias and resolved by the broker
+  for (int i = 0; i < 2; i++)
+    m_client->publish("MTConnect/Observation/exec", make_shared<string>("ACTIVE"), opts, nullptr);
+  ASSERT_TRUE(waitFor(5s, [&received]() { return received.size() == 2; }));
+
+  for (auto &[topic, props] : received)
+  {
+    EXPECT_EQ("MTConnect/Observation/exec", topic);
+    EXPECT_EQ(7, props.m_subscription);
+    UserProperties expected {{"sequence", "42"}, {"timestamp", "2022-01-01T00:00:00Z"}};
+    EXPECT_EQ(expected, props.m_user);
+  }
+}
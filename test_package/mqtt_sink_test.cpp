@@ -18,6 +18,9 @@
 #include <gtest/gtest.h>
 // Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
 
+#include <filesystem>
+#include <map>
+#include <set>
 #include <string>
 
 #include <nlohmann/json.hpp>
@@ -47,6 +50,7 @@ int main(int argc, char *argv[])
 }
 
 using json = nlohmann::json;
+namespace fs = std::filesystem;
 
 class MqttSinkTest : public testing::Test
 {
@@ -584,3 +588,429 @@ TEST_F(MqttSinkTest, mqtt_sink_should_publish_DynamicCalibration)
 
   ASSERT_TRUE(waitFor(5s, [&gotCalibration]() { return gotCalibration; }));
 }
+
+TEST_F(MqttSinkTest, mqtt_sink_should_batch_and_coalesce_observations_by_device)
+{
+  ConfigOptions options;
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  auto handler = make_unique<ClientHandler>();
+  bool gotBatch = false;
+  handler->m_receive = [&gotBatch](std::shared_ptr<MqttClient>, const std::string &topic,
+                                   const std::string &payload) {
+    EXPECT_EQ("MTConnect/Observation/000", topic);
+    auto jdoc = json::parse(payload);
+
+    // Version 2 groups the observations by name
+    int loads = 0;
+    double value = 0.0;
+    for (auto &load : jdoc.value("Load", json::array()))
+    {
+      if (load.at("dataItemId") == "Xload")
+      {
+        loads++;
+        if (load.at("value").is_number())
+          value = load.at("value").get<double>();
+      }
+    }
+    EXPECT_GE(1, loads);
+    if (value == 60.0)
+    {
+      EXPECT_EQ(1, loads);
+      gotBatch = true;
+    }
+  };
+
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+
+  createAgent("", {{configuration::ObservationBatchInterval, 200ms},
+                   {configuration::ObservationQoS, 0},
+                   {configuration::ObservationRetain, false}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+  m_client->subscribe("MTConnect/Observation/000");
+
+  m_agentTestHelper->m_adapter->processData("2018-04-27T05:00:26.555666|Xload|50");
+  m_agentTestHelper->m_adapter->processData("2018-04-27T05:00:26.655666|Xload|60");
+  ASSERT_TRUE(waitFor(5s, [&gotBatch]() { return gotBatch; }));
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_publish_the_current_state_after_connecting)
+{
+  ConfigOptions options;
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  auto handler = make_unique<ClientHandler>();
+  set<string> assets;
+  handler->m_receive = [&assets](std::shared_ptr<MqttClient>, const std::string &topic,
+                                 const std::string &payload) { assets.insert(topic); };
+
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+  m_client->subscribe("MTConnect/Asset/#");
+
+  // The assets are added before the sink has connected, so they are only published with the
+  // snapshot of the current state. They are all of one type and are published ten at a time.
+  createAgent("", {{configuration::SnapshotPublishRate, 100}});
+  for (int i = 0; i < 25; i++)
+  {
+    auto id = "P" + to_string(i);
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|@ASSET@|" + id + "|Part|" +
+                                              "<Part assetId='" + id + "'>TEST</Part>");
+  }
+
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+
+  ASSERT_TRUE(waitFor(10s, [&assets]() { return assets.size() == 25; }));
+  EXPECT_EQ(1, assets.count("MTConnect/Asset/P0"));
+  EXPECT_EQ(1, assets.count("MTConnect/Asset/P24"));
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_publish_sparkplug_births_and_aliased_data)
+{
+  ConfigOptions options;
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  map<string, uint64_t> aliases;
+  optional<json> data;
+  size_t dataSize = 0;
+
+  auto handler = make_unique<ClientHandler>();
+  handler->m_receive = [&](std::shared_ptr<MqttClient>, const std::string &topic,
+                           const std::string &payload) {
+    auto doc = json::from_cbor(payload);
+    if (topic == "spBv1.0/MTConnect/DBIRTH/agent1/000")
+    {
+      EXPECT_EQ("000", doc.at("uuid"));
+      for (auto &metric : doc.at("metrics"))
+        aliases[metric.at("name").get<string>()] = metric.at("alias").get<uint64_t>();
+    }
+    else if (topic == "spBv1.0/MTConnect/DDATA/agent1/000" && doc.at("metrics").size() == 6)
+    {
+      data = doc;
+      dataSize = topic.size() + payload.size();
+    }
+  };
+
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+
+  createAgent("", {{configuration::MqttFormat, "sparkplug"s},
+                   {configuration::SparkplugNodeId, "agent1"s},
+                   {configuration::ObservationBatchInterval, 200ms}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+  m_client->subscribe("spBv1.0/MTConnect/#");
+  m_agentTestHelper->m_ioContext.run_for(500ms);
+
+  // A device is born again when its model changes
+  auto device = m_agentTestHelper->getAgent()->getDeviceByName("LinuxCNC");
+  service->publish(device);
+  ASSERT_TRUE(waitFor(5s, [&aliases]() { return aliases.count("x3") > 0; }));
+
+  m_agentTestHelper->m_adapter->processData(
+      "2018-04-27T05:00:26.555666|Xact|1.5|Yact|2.25|Zact|-3.125|Xload|50|Sspeed|1000|"
+      "execution|ACTIVE");
+  m_agentTestHelper->m_adapter->processData("2018-04-27T05:00:26.655666|Xload|60");
+  ASSERT_TRUE(waitFor(5s, [&data]() { return bool(data); }));
+
+  // The later load replaces the earlier value and the timestamps are offsets in microseconds
+  bool gotLoad = false;
+  for (auto &metric : data->at("metrics"))
+  {
+    if (metric.at(0) == aliases["x3"])
+    {
+      EXPECT_EQ(60.0, metric.at(2).get<double>());
+      EXPECT_EQ(100000, metric.at(1).get<int64_t>());
+      gotLoad = true;
+    }
+  }
+  EXPECT_TRUE(gotLoad);
+
+  // Compare with the per observation JSON documents and topics
+  entity::JsonEntityPrinter printer(2);
+  auto &latest = m_agentTestHelper->getAgent()->getCircularBuffer().getLatest();
+  size_t jsonSize = 0;
+  for (auto id : {"x1", "y1", "z1", "x3", "c1", "p5"})
+  {
+    auto obs = latest.getObservation(id);
+    ASSERT_TRUE(obs);
+    jsonSize += ("MTConnect/Observation/"s + obs->getDataItem()->getTopic()).size() +
+                printer.printEntity(obs).size();
+  }
+  EXPECT_LT(dataSize * 3, jsonSize);
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_spool_observations_while_disconnected)
+{
+  ConfigOptions options;
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  auto spoolDirectory = fs::path(TEST_BIN_ROOT_DIR) / "mqtt_sink_spool";
+  if (fs::exists(spoolDirectory))
+    fs::remove_all(spoolDirectory);
+
+  auto handler = make_unique<ClientHandler>();
+  vector<double> values;
+  handler->m_receive = [&values](std::shared_ptr<MqttClient>, const std::string &topic,
+                                 const std::string &payload) {
+    auto jdoc = json::parse(payload);
+    auto value = jdoc.at("/value"_json_pointer);
+    if (value.is_number())
+      values.push_back(value.get<double>());
+  };
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+  m_client->subscribe("MTConnect/Observation/000/Axes[Axes]/Linear[X]/Samples/Load[Xload]");
+
+  createAgent("", {{configuration::MqttSpoolDirectory, spoolDirectory.string()},
+                   {configuration::MqttSpoolReplayRate, 20000}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+  ASSERT_NE(nullptr, service->getSpool());
+
+  // The broker does not keep sessions, so the outage is simulated by stopping the client of
+  // the sink
+  service->getClient()->stop();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return !service->isConnected(); }));
+
+  constexpr int count = 5000;
+  for (int i = 0; i < count; i++)
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|Xload|" + to_string(i));
+  ASSERT_EQ(count, service->getSpool()->size());
+
+  service->getClient()->start();
+  ASSERT_TRUE(waitFor(30s, [&values]() { return values.size() >= count; }));
+  EXPECT_TRUE(service->getSpool()->empty());
+  EXPECT_EQ(0, service->getSpool()->getDropped());
+
+  // The values are replayed in order, the snapshot may publish the latest value again
+  for (int i = 0; i < count; i++)
+    ASSERT_EQ(double(i), values[i]);
+  for (size_t i = count; i < values.size(); i++)
+    EXPECT_EQ(double(count - 1), values[i]);
+
+  fs::remove_all(spoolDirectory);
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_shard_observations_across_connections)
+{
+  ConfigOptions options;
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  auto handler = make_unique<ClientHandler>();
+  map<string, vector<double>> values;
+  handler->m_receive = [&values](std::shared_ptr<MqttClient>, const std::string &topic,
+                                 const std::string &payload) {
+    auto jdoc = json::parse(payload);
+    auto value = jdoc.at("/value"_json_pointer);
+    if (value.is_number())
+      values[jdoc.at("/dataItemId"_json_pointer).get<string>()].push_back(value.get<double>());
+  };
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+  m_client->subscribe("MTConnect/Observation/#");
+
+  createAgent("", {{configuration::MqttConnections, 4},
+                   {configuration::ObservationShardBy, "dataItem"s},
+                   {configuration::SnapshotPublishRate, 0}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+  ASSERT_EQ(4, service->getClients().size());
+
+  constexpr int count = 500;
+  const vector<string> ids {"x2", "y2", "z2", "cl3", "x3"};
+  for (int i = 0; i < count; i++)
+  {
+    auto v = to_string(i);
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|Xcom|" + v + "|Ycom|" + v +
+                                              "|Zcom|" + v + "|Cload|" + v + "|Xload|" + v);
+  }
+
+  ASSERT_TRUE(waitFor(10s, [&]() {
+    return all_of(ids.begin(), ids.end(), [&](const string &id) {
+      return values[id].size() >= count;
+    });
+  }));
+
+  // The observations of each data item are received in order
+  for (auto &id : ids)
+  {
+    auto &received = values[id];
+    for (int i = 0; i < count; i++)
+      ASSERT_EQ(double(i), received[i]) << id;
+  }
+
+  auto metrics = service->getConnectionMetrics();
+  ASSERT_EQ(4, metrics.size());
+  set<string> identities;
+  uint64_t published = 0;
+  int used = 0;
+  for (auto &m : metrics)
+  {
+    EXPECT_TRUE(m.m_connected);
+    EXPECT_EQ(0, m.m_failed);
+    identities.insert(m.m_identity);
+    published += m.m_published;
+    if (m.m_published > 0)
+      used++;
+  }
+  EXPECT_EQ(4, identities.size());
+  EXPECT_LE(uint64_t(count * ids.size()), published);
+  EXPECT_LT(1, used);
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_keep_publishing_when_a_connection_is_down)
+{
+  ConfigOptions options;
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  auto handler = make_unique<ClientHandler>();
+  map<string, vector<double>> values;
+  size_t received = 0;
+  handler->m_receive = [&](std::shared_ptr<MqttClient>, const std::string &topic,
+                           const std::string &payload) {
+    auto jdoc = json::parse(payload);
+    auto value = jdoc.at("/value"_json_pointer);
+    if (value.is_number())
+    {
+      values[jdoc.at("/dataItemId"_json_pointer).get<string>()].push_back(value.get<double>());
+      received++;
+    }
+  };
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+  m_client->subscribe("MTConnect/Observation/#");
+
+  createAgent("", {{configuration::MqttConnections, 2},
+                   {configuration::ObservationShardBy, "dataItem"s},
+                   {configuration::SnapshotPublishRate, 0}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+
+  service->getClients()[1]->stop();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return !service->isConnected(1); }));
+  EXPECT_TRUE(service->isConnected(0));
+
+  constexpr int count = 100;
+  const vector<string> ids {"x2", "y2", "z2", "cl3", "x3"};
+  for (int i = 0; i < count; i++)
+  {
+    auto v = to_string(i);
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|Xcom|" + v + "|Ycom|" + v +
+                                              "|Zcom|" + v + "|Cload|" + v + "|Xload|" + v);
+  }
+
+  // The observations of the connection that is down fail, the others are published
+  auto metrics = service->getConnectionMetrics();
+  ASSERT_EQ(2, metrics.size());
+  EXPECT_TRUE(metrics[0].m_connected);
+  EXPECT_FALSE(metrics[1].m_connected);
+  auto failed = metrics[1].m_failed;
+  ASSERT_GT(count * ids.size(), failed);
+  ASSERT_TRUE(waitFor(10s, [&]() { return received + failed >= count * ids.size(); }));
+
+  for (auto &id : ids)
+  {
+    auto size = values[id].size();
+    EXPECT_TRUE(size == 0 || size == count) << id;
+  }
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_publish_sequence_and_timestamp_as_mqtt5_user_properties)
+{
+  ConfigOptions options {{MqttProtocolVersion, 5}};
+  createServer(options);
+  startServer();
+  ASSERT_NE(0, m_port);
+
+  auto handler = make_unique<ClientHandler>();
+  optional<MessageProperties> received;
+  handler->m_receiveProperties = [&received](std::shared_ptr<MqttClient>, const std::string &,
+                                             const std::string &payload,
+                                             const MessageProperties &props) {
+    auto jdoc = json::parse(payload);
+    if (jdoc.at("/value"_json_pointer).get<double>() == 50.0)
+      received = props;
+  };
+  createClient(options, std::move(handler));
+  ASSERT_TRUE(startClient());
+  createAgent("", {{MqttProtocolVersion, 5}, {ObservationExpiry, 60s}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+  ASSERT_TRUE(service->getClient()->isMqtt5());
+  m_client->subscribe("MTConnect/Observation/000/Axes[Axes]/Linear[X]/Samples/Load[Xload]", 3);
+
+  m_agentTestHelper->m_adapter->processData("2018-04-27T05:00:26.555666|Xload|50");
+  ASSERT_TRUE(waitFor(5s, [&received]() { return bool(received); }));
+
+  EXPECT_EQ(3, received->m_subscription);
+  map<string, string> props(received->m_user.begin(), received->m_user.end());
+  ASSERT_EQ(2, props.size());
+
+  EXPECT_LT(0, stoll(props["sequence"]));
+  EXPECT_EQ("2018-04-27T05:00:26.555666Z", props["timestamp"]);
+}
+
+TEST_F(MqttSinkTest, mqtt_sink_should_publish_in_process_to_the_embedded_broker)
+{
+  createAgent("", {{MqttEmbeddedBroker, true}, {ObservationQoS, 1}, {ObservationMaxInflight, 2}});
+  auto service = m_agentTestHelper->getMqttService();
+  ASSERT_TRUE(service->getServer());
+  ASSERT_TRUE(waitFor(5s, [&service]() { return service->isConnected(); }));
+  m_port = service->getServer()->getPort();
+  ASSERT_NE(0, m_port);
+
+  const string loadTopic = "MTConnect/Observation/000/Axes[Axes]/Linear[X]/Samples/Load[Xload]";
+  bool gotDevice = false;
+  double load = 0.0;
+  auto handler = make_unique<ClientHandler>();
+  handler->m_receive = [&](std::shared_ptr<MqttClient>, const std::string &topic,
+                           const std::string &payload) {
+    if (topic == "MTConnect/Device/000")
+    {
+      gotDevice = true;
+    }
+    else if (topic == loadTopic)
+    {
+      auto value = json::parse(payload).at("/value"_json_pointer);
+      if (value.is_number())
+        load = value.get<double>();
+    }
+  };
+
+  // The device was published before the client connected and is retained by the broker
+  createClient({}, std::move(handler));
+  ASSERT_TRUE(startClient());
+  m_client->subscribe("MTConnect/Device/000");
+  m_client->subscribe(loadTopic);
+  ASSERT_TRUE(waitFor(5s, [&gotDevice]() { return gotDevice; }));
+
+  for (int i = 1; i <= 50; i++)
+  {
+    m_agentTestHelper->m_adapter->processData("2018-04-27T05:00:26.555666|Xload|" +
+                                              to_string(i));
+  }
+  ASSERT_TRUE(waitFor(5s, [&load]() { return load == 50.0; }));
+
+  auto metrics = service->getConnectionMetrics();
+  ASSERT_EQ(1, metrics.size());
+  EXPECT_EQ(0, metrics[0].m_failed);
+  EXPECT_EQ(0, metrics[0].m_inflight);
+  EXPECT_EQ(0, metrics[0].m_pending);
+  EXPECT_EQ(0, metrics[0].m_dropped);
+}
@@ -0,0 +1,219 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "mtconnect/sink/mqtt_sink/mqtt_spool.hpp"
+
+using namespace std;
+using namespace mtconnect::sink::mqtt_sink;
+namespace fs = std::filesystem;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class MqttSpoolTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    m_dir = fs::path(TEST_BIN_ROOT_DIR) / "mqtt_spool_test";
+    if (fs::exists(m_dir))
+      fs::remove_all(m_dir);
+  }
+
+  void TearDown() override
+  {
+    error_code ec;
+    fs::remove_all(m_dir, ec);
+  }
+
+  size_t segmentFiles()
+  {
+    size_t count = 0;
+    for (auto &entry : fs::directory_iterator(m_dir))
+    {
+      if (entry.path().extension() == ".seg")
+        count++;
+    }
+    return count;
+  }
+
+  fs::path m_dir;
+};
+
+TEST_F(MqttSpoolTest, should_return_messages_in_order)
+{
+  MqttSpool spool(m_dir, 64 * 1024, 4);
+  ASSERT_TRUE(spool.empty());
+
+  for (int i = 0; i < 100; i++)
+    ASSERT_TRUE(spool.push("MTConnect/Observation/" + to_string(i % 3), to_string(i)));
+  ASSERT_EQ(100, spool.size());
+
+  string topic, payload;
+  for (int i = 0; i < 100; i++)
+  {
+    ASSERT_TRUE(spool.pop(topic, payload));
+    EXPECT_EQ("MTConnect/Observation/" + to_string(i % 3), topic);
+    EXPECT_EQ(to_string(i), payload);
+  }
+
+  EXPECT_TRUE(spool.empty());
+  EXPECT_FALSE(spool.pop(topic, payload));
+  EXPECT_EQ(0, spool.getDropped());
+}
+
+TEST_F(MqttSpoolTest, should_read_returned_messages_first_in_their_order)
+{
+  MqttSpool spool(m_dir, 64 * 1024, 4);
+  ASSERT_TRUE(spool.push("topic", "3"));
+  ASSERT_TRUE(spool.push("topic", "4"));
+
+  // Messages in flight fail in any order
+  spool.pushFront("topic", "2", 20);
+  spool.pushFront("topic", "0", 5);
+  spool.pushFront("topic", "1", 10);
+  ASSERT_EQ(5, spool.size());
+
+  string topic, payload;
+  uint64_t order;
+  ASSERT_TRUE(spool.peek(topic, payload, order));
+  EXPECT_EQ("0", payload);
+  EXPECT_EQ(5, order);
+
+  // A peeked message stays in the spool until it is popped
+  ASSERT_TRUE(spool.peek(topic, payload, order));
+  EXPECT_EQ("0", payload);
+  ASSERT_TRUE(spool.pop());
+
+  for (int i = 1; i < 5; i++)
+  {
+    ASSERT_TRUE(spool.peek(topic, payload, order));
+    EXPECT_EQ(to_string(i), payload);
+    EXPECT_EQ(i < 3, order != 0);
+    ASSERT_TRUE(spool.pop());
+  }
+
+  EXPECT_TRUE(spool.empty());
+  EXPECT_FALSE(spool.peek(topic, payload, order));
+  EXPECT_FALSE(spool.pop());
+}
+
+TEST_F(MqttSpoolTest, should_remove_segments_when_they_are_read)
+{
+  MqttSpool spool(m_dir, 4 * 4096, 4);
+  string payload(1300, 'x');
+
+  for (int i = 0; i < 12; i++)
+    ASSERT_TRUE(spool.push("topic", payload));
+  EXPECT_EQ(4, segmentFiles());
+
+  string topic, value;
+  while (spool.pop(topic, value))
+    ;
+
+  EXPECT_EQ(1, segmentFiles());
+  EXPECT_EQ(0, spool.getDropped());
+}
+
+TEST_F(MqttSpoolTest, should_keep_messages_when_reopened)
+{
+  {
+    MqttSpool spool(m_dir, 64 * 1024, 4);
+    for (int i = 0; i < 10; i++)
+      ASSERT_TRUE(spool.push("topic", to_string(i)));
+
+    string topic, payload;
+    ASSERT_TRUE(spool.pop(topic, payload));
+    ASSERT_EQ("0", payload);
+  }
+
+  MqttSpool spool(m_dir, 64 * 1024, 4);
+  ASSERT_EQ(9, spool.size());
+
+  string topic, payload;
+  for (int i = 1; i < 10; i++)
+  {
+    ASSERT_TRUE(spool.pop(topic, payload));
+    EXPECT_EQ(to_string(i), payload);
+  }
+  EXPECT_TRUE(spool.empty());
+}
+
+TEST_F(MqttSpoolTest, should_drop_the_oldest_messages_when_full)
+{
+  MqttSpool spool(m_dir, 4 * 4096, 4);
+  string padding(1300, 'x');
+
+  // Three messages fit in a segment, so the first segment is dropped with the 13th message
+  for (int i = 0; i < 13; i++)
+    ASSERT_TRUE(spool.push("topic", to_string(i) + ":" + padding));
+
+  EXPECT_EQ(4, segmentFiles());
+  EXPECT_EQ(3, spool.getDropped());
+  ASSERT_EQ(10, spool.size());
+
+  string topic, payload;
+  ASSERT_TRUE(spool.pop(topic, payload));
+  EXPECT_EQ("3:", payload.substr(0, 2));
+}
+
+TEST_F(MqttSpoolTest, should_reject_a_message_larger_than_a_segment)
+{
+  MqttSpool spool(m_dir, 4 * 4096, 4);
+
+  EXPECT_FALSE(spool.push("topic", string(4096, 'x')));
+  EXPECT_TRUE(spool.empty());
+}
+
+TEST_F(MqttSpoolTest, should_discard_corrupt_segments)
+{
+  {
+    MqttSpool spool(m_dir, 4 * 4096, 4);
+    string padding(1300, 'x');
+    for (int i = 0; i < 6; i++)
+      ASSERT_TRUE(spool.push("topic", to_string(i) + ":" + padding));
+  }
+  ASSERT_EQ(2, segmentFiles());
+
+  // Overwrite the header of the first segment
+  auto first = m_dir / "spool-0000000000000000.seg";
+  ASSERT_TRUE(fs::exists(first));
+  {
+    fstream file(first, ios::in | ios::out | ios::binary);
+    file.write("XXXX", 4);
+  }
+
+  MqttSpool spool(m_dir, 4 * 4096, 4);
+  EXPECT_EQ(1, segmentFiles());
+  ASSERT_EQ(3, spool.size());
+
+  string topic, payload;
+  ASSERT_TRUE(spool.pop(topic, payload));
+  EXPECT_EQ("3:", payload.substr(0, 2));
+}
@@ -47,12 +47,21 @@ public:
   MockPipelineContract(std::map<string, DataItemPtr> &items, std::map<string, DevicePtr> &devices)
     : m_dataItems(items), m_devices(devices)
   {}
-  DevicePtr findDevice(const std::string &name) override { return m_devices[name]; }
+  DevicePtr findDevice(const std::string &name) override
+  {
+    auto it = m_devices.find(name);
+    return it == m_devices.end() ? nullptr : it->second;
+  }
   DataItemPtr findDataItem(const std::string &device, const std::string &name) override
   {
-    return m_dataItems[name];
+    auto it = m_dataItems.find(name);
+    return it == m_dataItems.end() ? nullptr : it->second;
+  }
+  void eachDataItem(EachDataItem fun) override
+  {
+    for (auto &di : m_dataItems)
+      fun(di.second);
   }
-  void eachDataItem(EachDataItem fun) override {}
   void deliverObservation(observation::ObservationPtr obs) override {}
   void deliverAsset(AssetPtr) override {}
   void deliverDevice(DevicePtr) override {}
@@ -113,6 +122,12 @@ protected:
     return d;
   }
 
+  EntityPtr message(const std::string &topic, const std::string &payload)
+  {
+    Properties props {{"VALUE", payload}, {"topic", topic}, {"source", "test"s}};
+    return (*m_mapper)(make_shared<Entity>("Message", props));
+  }
+
   shared_ptr<PipelineContext> m_context;
   shared_ptr<TopicMapper> m_mapper;
   std::map<string, DataItemPtr> m_dataItems;
@@ -127,3 +142,133 @@ TEST_F(TopicMappingTest, should_find_data_item_for_topic)
   Properties props {{"id", "a"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}};
   auto di = makeDataItem("device", props);
 }
+
+TEST_F(TopicMappingTest, should_resolve_topics_with_the_device_model)
+{
+  makeDevice("Device", {{"id", "device"s}, {"name", "device"s}, {"uuid", "device-uuid"s}});
+  auto exec = makeDataItem(
+      "device", {{"id", "a"s}, {"name", "exec"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+  auto pos = makeDataItem("device", {{"id", "b"s},
+                                     {"name", "pos"s},
+                                     {"type", "POSITION"s},
+                                     {"category", "SAMPLE"s},
+                                     {"units", "MILLIMETER"s}});
+
+  m_mapper = make_shared<TopicMapper>(m_context, "device");
+  m_mapper->bind(make_shared<NullTransform>(TypeGuard<Entity>(RUN)));
+
+  // The device by uuid or name and the data item by name or id
+  EXPECT_EQ(exec, get<1>(m_mapper->resolve("device-uuid/exec")));
+  EXPECT_EQ(pos, get<1>(m_mapper->resolve("device/b")));
+
+  // The default device with the topic or the last level of the topic
+  EXPECT_EQ(exec, get<1>(m_mapper->resolve("exec")));
+  EXPECT_EQ(pos, get<1>(m_mapper->resolve("plant/line/cell/pos")));
+  EXPECT_FALSE(get<1>(m_mapper->resolve("plant/line/cell/speed")));
+}
+
+TEST_F(TopicMappingTest, should_move_the_payload_into_the_message)
+{
+  makeDevice("Device", {{"id", "device"s}, {"name", "device"s}, {"uuid", "device"s}});
+  auto exec =
+      makeDataItem("device", {{"id", "a"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+
+  auto data = dynamic_pointer_cast<DataMessage>(message("device/a", "ACTIVE"));
+  ASSERT_TRUE(data);
+  EXPECT_EQ(exec, data->m_dataItem);
+  EXPECT_EQ("ACTIVE", data->getValue<string>());
+  EXPECT_EQ("device/a", data->get<string>("topic"));
+
+  auto json = dynamic_pointer_cast<JsonMessage>(message("device/a", "  {\"a\": 1}"));
+  ASSERT_TRUE(json);
+  EXPECT_EQ(exec, json->m_dataItem);
+
+  EXPECT_TRUE(dynamic_pointer_cast<DataMessage>(message("device/a", "")));
+}
+
+TEST_F(TopicMappingTest, should_bound_the_resolved_topics)
+{
+  makeDevice("Device", {{"id", "device"s}, {"name", "device"s}, {"uuid", "device"s}});
+  auto exec =
+      makeDataItem("device", {{"id", "a"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+  makeDataItem("device", {{"id", "b"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+  makeDataItem("device", {{"id", "c"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+
+  m_mapper = make_shared<TopicMapper>(m_context, "", 2);
+  m_mapper->bind(make_shared<NullTransform>(TypeGuard<Entity>(RUN)));
+
+  message("device/a", "1");
+  message("device/b", "1");
+  EXPECT_EQ(2, m_mapper->getCachedTopicCount());
+
+  // The least recently used topic is removed
+  message("device/a", "2");
+  message("device/c", "2");
+  EXPECT_EQ(2, m_mapper->getCachedTopicCount());
+
+  auto data = dynamic_pointer_cast<DataMessage>(message("device/a", "3"));
+  ASSERT_TRUE(data);
+  EXPECT_EQ(exec, data->m_dataItem);
+  EXPECT_EQ(2, m_mapper->getCachedTopicCount());
+}
+
+TEST_F(TopicMappingTest, should_resolve_topics_added_after_they_were_not_found)
+{
+  makeDevice("Device", {{"id", "device"s}, {"name", "device"s}, {"uuid", "device"s}});
+  makeDataItem("device", {{"id", "a"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+
+  auto data = dynamic_pointer_cast<DataMessage>(message("other/late", "1"));
+  ASSERT_TRUE(data);
+  EXPECT_FALSE(data->m_dataItem);
+  EXPECT_EQ(0, m_mapper->getCachedTopicCount());
+
+  makeDevice("Device", {{"id", "other"s}, {"name", "other"s}, {"uuid", "other"s}});
+  auto late =
+      makeDataItem("other", {{"id", "late"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+
+  data = dynamic_pointer_cast<DataMessage>(message("other/late", "2"));
+  ASSERT_TRUE(data);
+  EXPECT_EQ(late, data->m_dataItem);
+  EXPECT_EQ(1, m_mapper->getCachedTopicCount());
+}
+
+TEST_F(TopicMappingTest, should_resolve_messages_by_subscription_identifier)
+{
+  makeDevice("Device", {{"id", "device"s}, {"name", "device"s}, {"uuid", "device"s}});
+  auto exec =
+      makeDataItem("device", {{"id", "a"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+
+  auto subscribed = [this](const string &topic, int64_t subscription) {
+    Properties props {{"VALUE", "ACTIVE"s},
+                      {"topic", topic},
+                      {"source", "test"s},
+                      {"subscription", subscription}};
+    auto entity = (*m_mapper)(make_shared<Entity>("Message", props));
+    return dynamic_pointer_cast<PipelineMessage>(entity);
+  };
+
+  auto data = subscribed("device/a", 1);
+  ASSERT_TRUE(data);
+  EXPECT_EQ(exec, data->m_dataItem);
+
+  // Once resolved, the subscription identifier is used instead of the topic
+  data = subscribed("device/other", 1);
+  ASSERT_TRUE(data);
+  EXPECT_EQ(exec, data->m_dataItem);
+  EXPECT_EQ(1, m_mapper->getCachedTopicCount());
+
+  data = subscribed("device/other", 2);
+  ASSERT_TRUE(data);
+  EXPECT_FALSE(data->m_dataItem);
+
+  // A subscription that could not be resolved is resolved again
+  data = subscribed("unknown/late", 3);
+  ASSERT_TRUE(data);
+  EXPECT_FALSE(data->m_dataItem);
+
+  auto late =
+      makeDataItem("device", {{"id", "late"s}, {"type", "EXECUTION"s}, {"category", "EVENT"s}});
+  data = subscribed("unknown/late", 3);
+  ASSERT_TRUE(data);
+  EXPECT_EQ(late, data->m_dataItem);
+}
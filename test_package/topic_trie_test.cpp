@@ -0,0 +1,225 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <string>
+#include <vector>
+
+#include "mtconnect/mqtt/topic_trie.hpp"
+
+using namespace std;
+using namespace mtconnect::mqtt_server;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class TopicTrieTest : public testing::Test
+{
+protected:
+  using Trie = TopicTrie<int>;
+
+  vector<Trie::Subscription> match(const string &topic)
+  {
+    vector<Trie::Subscription> matches;
+    m_trie.match(topic, matches, m_cursor++);
+    return matches;
+  }
+
+  vector<int> subscribers(const string &topic)
+  {
+    vector<int> result;
+    for (auto &m : match(topic))
+      result.push_back(m.first);
+    return result;
+  }
+
+  Trie m_trie;
+  size_t m_cursor {0};
+};
+
+TEST_F(TopicTrieTest, should_match_exact_topics)
+{
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 2, 0));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Other", 3, 0));
+
+  EXPECT_EQ(vector<int>({1, 2}), subscribers("MTConnect/Current/Device"));
+  EXPECT_EQ(vector<int>({3}), subscribers("MTConnect/Current/Other"));
+  EXPECT_TRUE(subscribers("MTConnect/Current").empty());
+  EXPECT_TRUE(subscribers("MTConnect/Current/Device/X").empty());
+}
+
+TEST_F(TopicTrieTest, should_match_single_and_multi_level_wildcards)
+{
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/+/Device", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/#", 2, 1));
+  ASSERT_TRUE(m_trie.subscribe("+/+", 3, 1));
+  ASSERT_TRUE(m_trie.subscribe("#", 4, 1));
+
+  EXPECT_EQ(vector<int>({1, 2, 4}), subscribers("MTConnect/Current/Device"));
+  EXPECT_EQ(vector<int>({2, 3, 4}), subscribers("MTConnect/Asset"));
+  EXPECT_EQ(vector<int>({2, 4}), subscribers("MTConnect"));
+  EXPECT_EQ(vector<int>({4}), subscribers("Other/Current/Device"));
+
+  EXPECT_FALSE(m_trie.subscribe("MTConnect/#/Device", 5, 1));
+  EXPECT_FALSE(m_trie.subscribe("MTConnect/Dev+", 5, 1));
+  EXPECT_FALSE(m_trie.subscribe("", 5, 1));
+}
+
+TEST_F(TopicTrieTest, should_not_match_system_topics_with_leading_wildcards)
+{
+  ASSERT_TRUE(m_trie.subscribe("#", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("+/broker", 2, 1));
+  ASSERT_TRUE(m_trie.subscribe("$SYS/#", 3, 1));
+
+  EXPECT_EQ(vector<int>({3}), subscribers("$SYS/broker"));
+  EXPECT_EQ(vector<int>({1, 2}), subscribers("SYS/broker"));
+}
+
+TEST_F(TopicTrieTest, should_match_a_subscriber_once_with_the_highest_qos)
+{
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 1, 0));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/#", 1, 2));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/+/Device", 1, 1));
+
+  auto matches = match("MTConnect/Current/Device");
+  ASSERT_EQ(1, matches.size());
+  EXPECT_EQ(1, matches[0].first);
+  EXPECT_EQ(2, matches[0].second);
+
+  // Subscribing again changes the qos
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/#", 1, 0));
+  EXPECT_EQ(3, m_trie.size());
+  matches = match("MTConnect/Current/Device");
+  ASSERT_EQ(1, matches.size());
+  EXPECT_EQ(1, matches[0].second);
+}
+
+TEST_F(TopicTrieTest, should_deliver_shared_subscriptions_to_one_member_in_turn)
+{
+  ASSERT_TRUE(m_trie.subscribe("$share/workers/MTConnect/+/Device", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("$share/workers/MTConnect/+/Device", 2, 1));
+  ASSERT_TRUE(m_trie.subscribe("$share/other/MTConnect/#", 3, 1));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 4, 1));
+
+  EXPECT_EQ(vector<int>({1, 3, 4}), subscribers("MTConnect/Current/Device"));
+  EXPECT_EQ(vector<int>({2, 3, 4}), subscribers("MTConnect/Current/Device"));
+  EXPECT_EQ(vector<int>({1, 3}), subscribers("MTConnect/Sample/Device"));
+
+  EXPECT_FALSE(m_trie.subscribe("$share/workers", 5, 1));
+  EXPECT_FALSE(m_trie.subscribe("$share//MTConnect", 5, 1));
+
+  ASSERT_TRUE(m_trie.unsubscribe("$share/workers/MTConnect/+/Device", 1));
+  EXPECT_EQ(vector<int>({2, 3}), subscribers("MTConnect/Sample/Device"));
+  EXPECT_EQ(vector<int>({2, 3}), subscribers("MTConnect/Sample/Device"));
+}
+
+TEST_F(TopicTrieTest, should_remove_subscriptions)
+{
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/#", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 2, 1));
+  ASSERT_TRUE(m_trie.subscribe("$share/workers/MTConnect/+/Device", 1, 1));
+  EXPECT_EQ(4, m_trie.size());
+
+  EXPECT_FALSE(m_trie.unsubscribe("MTConnect/+", 1));
+  ASSERT_TRUE(m_trie.unsubscribe("MTConnect/Current/Device", 2));
+  EXPECT_FALSE(m_trie.unsubscribe("MTConnect/Current/Device", 2));
+  EXPECT_EQ(vector<int>({1, 1}), subscribers("MTConnect/Current/Device"));
+
+  m_trie.unsubscribeAll(1);
+  EXPECT_EQ(0, m_trie.size());
+  EXPECT_TRUE(subscribers("MTConnect/Current/Device").empty());
+}
+
+TEST_F(TopicTrieTest, should_match_a_single_filter)
+{
+  EXPECT_TRUE(Trie::matches("MTConnect/Current/Device", "MTConnect/Current/Device"));
+  EXPECT_TRUE(Trie::matches("MTConnect/+/Device", "MTConnect/Sample/Device"));
+  EXPECT_TRUE(Trie::matches("MTConnect/#", "MTConnect"));
+  EXPECT_TRUE(Trie::matches("MTConnect/#", "MTConnect/Current/Device"));
+  EXPECT_TRUE(Trie::matches("$share/workers/MTConnect/+", "MTConnect/Current"));
+
+  EXPECT_FALSE(Trie::matches("MTConnect/+", "MTConnect/Current/Device"));
+  EXPECT_FALSE(Trie::matches("MTConnect/Current/Device", "MTConnect/Current"));
+  EXPECT_FALSE(Trie::matches("#", "$SYS/clients"));
+  EXPECT_FALSE(Trie::matches("MTConnect/#/Device", "MTConnect/Current/Device"));
+}
+
+TEST_F(TopicTrieTest, should_deliver_shared_and_plain_subscriptions_independently)
+{
+  ASSERT_TRUE(m_trie.subscribe("$share/workers/MTConnect/#", 1, 1));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/+/Device", 1, 0));
+  ASSERT_TRUE(m_trie.subscribe("MTConnect/Current/Device", 1, 2));
+
+  // The plain subscriptions give one copy, the shared subscription another
+  auto matches = match("MTConnect/Current/Device");
+  ASSERT_EQ(2, matches.size());
+  EXPECT_EQ(1, matches[0].first);
+  EXPECT_EQ(2, matches[0].second);
+  EXPECT_EQ(1, matches[1].first);
+  EXPECT_EQ(1, matches[1].second);
+
+  ASSERT_TRUE(m_trie.subscribe("$share/other/MTConnect/Current/#", 1, 0));
+  EXPECT_EQ(vector<int>({1, 1, 1}), subscribers("MTConnect/Current/Device"));
+  EXPECT_EQ(vector<int>({1}), subscribers("MTConnect/Sample"));
+}
+
+TEST_F(TopicTrieTest, should_match_10k_subscriptions)
+{
+  const int devices = 1000;
+  for (int i = 0; i < devices; i++)
+  {
+    auto device = "Device" + to_string(i);
+    for (auto &kind : {"Current", "Sample", "Probe", "Asset"})
+      m_trie.subscribe("MTConnect/"s + kind + "/" + device, i * 10, 1);
+    for (auto &kind : {"Current", "Sample", "Probe"})
+      m_trie.subscribe("MTConnect/"s + kind + "/" + device + "/#", i * 10 + 1, 1);
+    m_trie.subscribe("MTConnect/+/" + device, i * 10 + 2, 1);
+    m_trie.subscribe("$share/workers/MTConnect/+/" + device, i * 10 + 3, 1);
+    m_trie.subscribe("$share/workers/MTConnect/+/" + device, i * 10 + 4, 1);
+  }
+  ASSERT_EQ(10 * devices, m_trie.size());
+
+  const int runs = 2;
+  size_t delivered = 0, shared = 0;
+  vector<Trie::Subscription> matches;
+  for (int r = 0; r < runs; r++)
+  {
+    for (int i = 0; i < devices; i++)
+    {
+      m_trie.match("MTConnect/Current/Device" + to_string(i), matches, r);
+      delivered += matches.size();
+      for (auto &m : matches)
+      {
+        if (m.first == i * 10 + 3 + r)
+          shared++;
+      }
+    }
+  }
+
+  // Exact, multi level, single level, and one member of the shared group
+  EXPECT_EQ(size_t(4 * runs * devices), delivered);
+  EXPECT_EQ(size_t(runs * devices), shared);
+}
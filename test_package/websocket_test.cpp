@@ -0,0 +1,346 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <boost/asio/spawn.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "mtconnect/logging.hpp"
+#include "mtconnect/sink/rest_sink/response.hpp"
+#include "mtconnect/sink/rest_sink/server.hpp"
+
+using namespace std;
+using namespace mtconnect;
+using namespace mtconnect::sink::rest_sink;
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace websocket = boost::beast::websocket;
+using tcp = boost::asio::ip::tcp;
+
+// main
+int main(int argc, char* argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class WsClient
+{
+public:
+  WsClient(asio::io_context& ioc) : m_context(ioc), m_stream(ioc) {}
+
+  void fail(beast::error_code ec, char const* what)
+  {
+    LOG(error) << what << ": " << ec.message() << "\n";
+    m_ec = ec;
+  }
+
+  void connect(unsigned short port, asio::yield_context yield)
+  {
+    beast::error_code ec;
+    tcp::endpoint server(asio::ip::address_v4::from_string("127.0.0.1"), port);
+
+    beast::get_lowest_layer(m_stream).expires_after(std::chrono::seconds(30));
+    beast::get_lowest_layer(m_stream).async_connect(server, yield[ec]);
+    if (ec)
+      return fail(ec, "connect");
+
+    beast::get_lowest_layer(m_stream).expires_never();
+    websocket::permessage_deflate pmd;
+    pmd.client_enable = true;
+    m_stream.set_option(pmd);
+
+    m_stream.async_handshake("localhost", "/", yield[ec]);
+    if (ec)
+      return fail(ec, "handshake");
+
+    m_connected = true;
+  }
+
+  void write(const string& text, asio::yield_context yield)
+  {
+    beast::error_code ec;
+    m_stream.text(true);
+    m_stream.async_write(asio::buffer(text), yield[ec]);
+    if (ec)
+      fail(ec, "write");
+    m_written = true;
+  }
+
+  void read(asio::yield_context yield)
+  {
+    beast::error_code ec;
+    beast::flat_buffer buffer;
+    m_stream.async_read(buffer, yield[ec]);
+    if (ec)
+      return fail(ec, "read");
+
+    auto message = beast::buffers_to_string(buffer.data());
+    auto he = message.find("\r\n\r\n");
+    ASSERT_NE(string::npos, he);
+
+    map<string, string> headers;
+    size_t pos = 0;
+    while (pos < he)
+    {
+      auto le = message.find("\r\n", pos);
+      auto line = message.substr(pos, le - pos);
+      auto colon = line.find(": ");
+      headers[line.substr(0, colon)] = line.substr(colon + 2);
+      pos = le + 2;
+    }
+
+    m_messages.push_back({headers, message.substr(he + 4)});
+  }
+
+  void send(const string& text)
+  {
+    m_written = false;
+    asio::spawn(m_context, std::bind(&WsClient::write, this, text, std::placeholders::_1));
+    while (!m_written && m_context.run_for(20ms) > 0)
+      ;
+  }
+
+  bool receive(size_t count)
+  {
+    while (m_messages.size() < count && !m_ec)
+    {
+      auto size = m_messages.size();
+      asio::spawn(m_context, std::bind(&WsClient::read, this, std::placeholders::_1));
+      while (m_messages.size() == size && !m_ec && m_context.run_for(20ms) > 0)
+        ;
+    }
+    return m_messages.size() >= count;
+  }
+
+  struct Message
+  {
+    map<string, string> m_headers;
+    string m_body;
+  };
+
+  asio::io_context& m_context;
+  websocket::stream<beast::tcp_stream> m_stream;
+  bool m_connected {false};
+  bool m_written {false};
+  beast::error_code m_ec;
+  vector<Message> m_messages;
+};
+
+class WebsocketTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    using namespace mtconnect::configuration;
+    m_server = make_unique<Server>(m_context, ConfigOptions {{Port, 0}, {ServerIp, "127.0.0.1"s}});
+  }
+
+  void start()
+  {
+    m_server->start();
+    while (!m_server->isListening())
+      m_context.run_one();
+    m_client = make_unique<WsClient>(m_context);
+
+    asio::spawn(m_context,
+                std::bind(&WsClient::connect, m_client.get(),
+                          static_cast<unsigned short>(m_server->getPort()), std::placeholders::_1));
+    while (!m_client->m_connected && !m_client->m_ec)
+      m_context.run_one();
+  }
+
+  void TearDown() override
+  {
+    m_server.reset();
+    m_client.reset();
+  }
+
+  asio::io_context m_context;
+  unique_ptr<Server> m_server;
+  unique_ptr<WsClient> m_client;
+};
+
+TEST_F(WebsocketTest, should_respond_to_a_request_with_its_id)
+{
+  RequestPtr saved;
+  auto probe = [&](SessionPtr session, RequestPtr request) -> bool {
+    saved = request;
+    auto device = *request->parameter<string>("device");
+    session->writeResponse(make_unique<Response>(status::ok, "Probe " + device, "text/plain"));
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/{device}/probe", probe});
+
+  start();
+  ASSERT_TRUE(m_client->m_connected);
+
+  m_client->send(R"({"id": "1", "request": "probe", "device": "M1"})");
+  ASSERT_TRUE(m_client->receive(1));
+
+  auto& msg = m_client->m_messages[0];
+  EXPECT_EQ("1", msg.m_headers["Request-Id"]);
+  EXPECT_EQ("200", msg.m_headers["Status"]);
+  EXPECT_EQ("text/plain", msg.m_headers["Content-Type"]);
+  EXPECT_EQ("Probe M1", msg.m_body);
+
+  ASSERT_TRUE(saved);
+  EXPECT_EQ("/M1/probe", saved->m_path);
+  EXPECT_EQ("1", *saved->m_requestId);
+}
+
+TEST_F(WebsocketTest, should_report_an_error_for_an_unknown_request)
+{
+  m_server->setErrorFunction([](SessionPtr session, boost::beast::http::status st,
+                                const string& msg) {
+    session->writeFailureResponse(make_unique<Response>(st, msg, "text/plain"));
+  });
+
+  start();
+  m_client->send(R"({"id": "42", "request": "nothing"})");
+  ASSERT_TRUE(m_client->receive(1));
+
+  auto& msg = m_client->m_messages[0];
+  EXPECT_EQ("42", msg.m_headers["Request-Id"]);
+  EXPECT_EQ("404", msg.m_headers["Status"]);
+}
+
+struct StreamContext
+{
+  SessionPtr m_session;
+  RequestPtr m_request;
+  int m_completed {0};
+};
+
+TEST_F(WebsocketTest, should_multiplex_streams_on_one_connection)
+{
+  map<string, shared_ptr<StreamContext>> streams;
+  auto sample = [&](SessionPtr session, RequestPtr request) -> bool {
+    auto ctx = make_shared<StreamContext>();
+    ctx->m_session = session;
+    ctx->m_request = request;
+    streams[*request->m_requestId] = ctx;
+    session->beginStreaming("text/plain", [ctx]() { ctx->m_completed++; });
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/sample?interval={integer}", sample});
+
+  start();
+  m_client->send(R"({"id": "a", "request": "sample", "interval": 100})");
+  m_client->send(R"({"id": "b", "request": "sample", "interval": 500})");
+  while ((streams.size() < 2 || streams["b"]->m_completed == 0) && m_context.run_for(20ms) > 0)
+    ;
+
+  ASSERT_EQ(2, streams.size());
+  EXPECT_EQ(100, *streams["a"]->m_request->parameter<int32_t>("interval"));
+  EXPECT_EQ(500, *streams["b"]->m_request->parameter<int32_t>("interval"));
+
+  streams["b"]->m_session->writeChunk("Chunk B1", [ctx = streams["b"]]() { ctx->m_completed++; });
+  streams["a"]->m_session->writeChunk("Chunk A1", [ctx = streams["a"]]() { ctx->m_completed++; });
+
+  ASSERT_TRUE(m_client->receive(2));
+  EXPECT_EQ("b", m_client->m_messages[0].m_headers["Request-Id"]);
+  EXPECT_EQ("Chunk B1", m_client->m_messages[0].m_body);
+  EXPECT_EQ("a", m_client->m_messages[1].m_headers["Request-Id"]);
+  EXPECT_EQ("Chunk A1", m_client->m_messages[1].m_body);
+
+  while (streams["a"]->m_completed < 2 && m_context.run_for(20ms) > 0)
+    ;
+  EXPECT_EQ(2, streams["a"]->m_completed);
+  EXPECT_EQ(2, streams["b"]->m_completed);
+}
+
+TEST_F(WebsocketTest, should_wait_for_credits_before_continuing)
+{
+  shared_ptr<StreamContext> ctx;
+  auto sample = [&](SessionPtr session, RequestPtr request) -> bool {
+    ctx = make_shared<StreamContext>();
+    ctx->m_session = session;
+    session->beginStreaming("text/plain", [&]() { ctx->m_completed++; });
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/sample", sample});
+
+  start();
+  m_client->send(R"({"id": "1", "request": "sample", "credits": 1})");
+  while ((!ctx || ctx->m_completed == 0) && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_TRUE(ctx);
+  EXPECT_EQ(1, ctx->m_completed);
+
+  ctx->m_session->writeChunk("Chunk 1", [&]() { ctx->m_completed++; });
+  ASSERT_TRUE(m_client->receive(1));
+  m_context.run_for(100ms);
+  EXPECT_EQ(1, ctx->m_completed);
+
+  m_client->send(R"({"id": "1", "request": "next"})");
+  while (ctx->m_completed == 1 && m_context.run_for(20ms) > 0)
+    ;
+  EXPECT_EQ(2, ctx->m_completed);
+}
+
+TEST_F(WebsocketTest, should_stop_a_cancelled_stream)
+{
+  map<string, shared_ptr<StreamContext>> streams;
+  auto sample = [&](SessionPtr session, RequestPtr request) -> bool {
+    auto ctx = make_shared<StreamContext>();
+    ctx->m_session = session;
+    streams[*request->m_requestId] = ctx;
+    session->beginStreaming("text/plain", [ctx]() { ctx->m_completed++; });
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/sample", sample});
+
+  start();
+  m_client->send(R"({"id": "1", "request": "sample"})");
+  while ((streams.size() < 1 || streams["1"]->m_completed == 0) && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_EQ(1, streams.size());
+
+  m_client->send(R"({"id": "1", "request": "cancel"})");
+  m_client->send(R"({"id": "2", "request": "sample"})");
+  while ((streams.size() < 2 || streams["2"]->m_completed == 0) && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_EQ(2, streams.size());
+
+  auto cancelled = streams["1"];
+  cancelled->m_session->writeChunk("Chunk 1", [cancelled]() { cancelled->m_completed++; });
+  auto active = streams["2"];
+  active->m_session->writeChunk("Chunk 2", [active]() { active->m_completed++; });
+
+  ASSERT_TRUE(m_client->receive(1));
+  m_context.run_for(100ms);
+
+  ASSERT_EQ(1, m_client->m_messages.size());
+  EXPECT_EQ("2", m_client->m_messages[0].m_headers["Request-Id"]);
+  EXPECT_EQ("Chunk 2", m_client->m_messages[0].m_body);
+  EXPECT_EQ(1, cancelled->m_completed);
+  EXPECT_EQ(2, active->m_completed);
+}
@@ -0,0 +1,435 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <libxml/xmlwriter.h>
+
+#include "mtconnect/device_model/data_item/data_item.hpp"
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/entity/data_set.hpp"
+#include "mtconnect/entity/xml_printer.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "mtconnect/parser/xml_parser.hpp"
+#include "mtconnect/printer/xml_direct_writer.hpp"
+#include "mtconnect/printer/xml_printer.hpp"
+#include "mtconnect/utilities.hpp"
+
+using namespace std;
+using namespace date::literals;
+using namespace mtconnect;
+using namespace mtconnect::observation;
+using namespace mtconnect::entity;
+using namespace mtconnect::printer;
+using namespace mtconnect::parser;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Prints the streams of a sample document with libxml2, the way the printer did before it
+// wrote documents directly. The direct printer must produce the same bytes.
+class ReferencePrinter : public printer::XmlPrinter
+{
+public:
+  string printStreamsWithLibXml2(ObservationList &observations, bool pretty) const
+  {
+    xmlBufferPtr buf = xmlBufferCreate();
+    xmlTextWriterPtr writer = xmlNewTextWriterMemory(buf, 0);
+    if (pretty)
+    {
+      xmlTextWriterSetIndent(writer, 1);
+      xmlTextWriterSetIndentString(writer, BAD_CAST "  ");
+    }
+
+    // The streams are written below the root so they are indented like in the document
+    xmlTextWriterStartDocument(writer, nullptr, "UTF-8", nullptr);
+    xmlTextWriterStartElement(writer, BAD_CAST "MTConnectStreams");
+    xmlTextWriterStartElement(writer, BAD_CAST "Streams");
+
+    stable_sort(observations.begin(), observations.end(),
+                [](const ObservationPtr &a, const ObservationPtr &b) { return *a < *b; });
+
+    auto attribute = [writer](const char *name, const string &value) {
+      if (!value.empty())
+        xmlTextWriterWriteAttribute(writer, BAD_CAST name, BAD_CAST value.c_str());
+    };
+
+    entity::XmlPrinter printer;
+    string device, component, category;
+    for (auto &observation : observations)
+    {
+      if (observation->isOrphan())
+        continue;
+
+      const auto &dataItem = observation->getDataItem();
+      const auto &comp = dataItem->getComponent();
+      const auto &dev = comp->getDevice();
+
+      if (device != dev->getId())
+      {
+        if (!category.empty())
+          xmlTextWriterEndElement(writer);
+        if (!component.empty())
+          xmlTextWriterEndElement(writer);
+        if (!device.empty())
+          xmlTextWriterEndElement(writer);
+        category.clear();
+        component.clear();
+
+        device = dev->getId();
+        xmlTextWriterStartElement(writer, BAD_CAST "DeviceStream");
+        attribute("name", *dev->getComponentName());
+        attribute("uuid", *dev->getUuid());
+      }
+
+      if (component != comp->getId())
+      {
+        if (!category.empty())
+          xmlTextWriterEndElement(writer);
+        if (!component.empty())
+          xmlTextWriterEndElement(writer);
+        category.clear();
+
+        component = comp->getId();
+        xmlTextWriterStartElement(writer, BAD_CAST "ComponentStream");
+        attribute("component", comp->getName());
+        if (comp->getComponentName())
+          attribute("name", *comp->getComponentName());
+        attribute("componentId", comp->getId());
+      }
+
+      if (category != dataItem->getCategoryText())
+      {
+        if (!category.empty())
+          xmlTextWriterEndElement(writer);
+        category = dataItem->getCategoryText();
+        xmlTextWriterStartElement(writer, BAD_CAST category.c_str());
+      }
+
+      printer.print(writer, observation, m_streamsNsSet);
+    }
+
+    xmlTextWriterEndDocument(writer);
+    xmlFreeTextWriter(writer);
+    string doc((const char *)buf->content, buf->use);
+    xmlBufferFree(buf);
+
+    return streams(doc);
+  }
+
+  // The Streams element of a document
+  static string streams(const string &doc)
+  {
+    auto start = doc.find("<Streams");
+    auto end = doc.rfind("</MTConnectStreams>");
+    if (start == string::npos || end == string::npos)
+      return "";
+    return doc.substr(start, end - start);
+  }
+};
+
+class XmlDirectWriterTest : public testing::Test
+{
+protected:
+  void SetUp() override { load("/samples/test_config.xml"); }
+
+  void load(const char *file)
+  {
+    m_config = make_unique<XmlParser>();
+    m_printer = make_unique<ReferencePrinter>();
+    m_printer->setSchemaVersion("2.0");
+    m_devices = m_config->parseFile(string(TEST_RESOURCE_DIR) + file, m_printer.get());
+  }
+
+  ObservationPtr observation(const char *name, uint64_t sequence, const Properties &props)
+  {
+    const auto device = m_devices.front();
+    const auto d = device->getDeviceDataItem(name);
+    EXPECT_TRUE(d) << "Could not find data item " << name;
+    entity::ErrorList errors;
+    auto o = Observation::make(d, props, m_time, errors);
+    EXPECT_EQ(0, errors.size());
+    o->setSequence(sequence);
+    return o;
+  }
+
+  void expectSameDocument(const ObservationList &observations, bool pretty)
+  {
+    ObservationList direct(observations), reference(observations);
+    auto expected = m_printer->printStreamsWithLibXml2(reference, pretty);
+    auto actual =
+        m_printer->printSample(123, 131072, 10974584, 10843512, 10123800, direct, pretty);
+    ASSERT_FALSE(expected.empty());
+    EXPECT_EQ(expected, ReferencePrinter::streams(actual));
+  }
+
+  void expectSameDocument(const ObservationList &observations)
+  {
+    expectSameDocument(observations, false);
+    expectSameDocument(observations, true);
+  }
+
+  unique_ptr<XmlParser> m_config;
+  unique_ptr<ReferencePrinter> m_printer;
+  list<DevicePtr> m_devices;
+  Timestamp m_time {date::sys_days(date::year(2022) / date::jan / 1_d) + 12h + 30min + 1234us};
+};
+
+TEST_F(XmlDirectWriterTest, should_write_the_same_bytes_as_libxml2)
+{
+  const char *text = "a<b>c&d\"e'f\r\n\tg\xC3\xA9h\xE2\x82\xAC\xF0\x9F\x98\x80";
+
+  for (bool pretty : {false, true})
+  {
+    xmlBufferPtr buf = xmlBufferCreate();
+    xmlTextWriterPtr w = xmlNewTextWriterMemory(buf, 0);
+    if (pretty)
+    {
+      xmlTextWriterSetIndent(w, 1);
+      xmlTextWriterSetIndentString(w, BAD_CAST "  ");
+    }
+
+    string out;
+    XmlDirectWriter d(out, pretty);
+
+    xmlTextWriterStartDocument(w, nullptr, "UTF-8", nullptr);
+    d.startDocument();
+    xmlTextWriterStartPI(w, BAD_CAST "xml-stylesheet type=\"text/xsl\" href=\"/s.xsl\"");
+    xmlTextWriterEndPI(w);
+    d.processingInstruction("xml-stylesheet type=\"text/xsl\" href=\"/s.xsl\"");
+
+    xmlTextWriterStartElement(w, BAD_CAST "Root");
+    d.startElement("Root");
+    xmlTextWriterWriteAttribute(w, BAD_CAST "a", BAD_CAST text);
+    d.attribute("a", text);
+
+    xmlTextWriterStartElement(w, BAD_CAST "Empty");
+    xmlTextWriterEndElement(w);
+    d.startElement("Empty");
+    d.endElement();
+
+    xmlTextWriterStartElement(w, BAD_CAST "EmptyText");
+    xmlTextWriterWriteString(w, BAD_CAST "");
+    xmlTextWriterEndElement(w);
+    d.startElement("EmptyText");
+    d.text("");
+    d.endElement();
+
+    xmlTextWriterStartElement(w, BAD_CAST "Text");
+    xmlTextWriterWriteString(w, BAD_CAST text);
+    xmlTextWriterEndElement(w);
+    d.startElementRaw("Text", "Text");
+    d.text(text);
+    d.endElement();
+
+    xmlTextWriterStartElement(w, BAD_CAST "Encoded");
+    xmlChar *encoded = xmlEncodeEntitiesReentrant(nullptr, BAD_CAST text);
+    xmlTextWriterWriteRaw(w, encoded);
+    xmlFree(encoded);
+    xmlTextWriterStartElement(w, BAD_CAST "Child");
+    xmlTextWriterEndElement(w);
+    xmlTextWriterEndElement(w);
+    d.startElement("Encoded");
+    d.encodedText(text);
+    d.startElement("Child");
+    d.endElement();
+    d.endElement();
+
+    xmlTextWriterStartElement(w, BAD_CAST "Nested");
+    xmlTextWriterStartElement(w, BAD_CAST "Inner");
+    xmlTextWriterWriteAttribute(w, BAD_CAST "key", BAD_CAST "value");
+    xmlTextWriterWriteString(w, BAD_CAST "content");
+    xmlTextWriterEndElement(w);
+    d.startElement("Nested");
+    d.startElementRaw("Inner key=\"value\"", "Inner");
+    d.text("content");
+    d.endElement();
+
+    xmlTextWriterEndDocument(w);
+    xmlFreeTextWriter(w);
+    d.endDocument();
+
+    string expected((const char *)buf->content, buf->use);
+    xmlBufferFree(buf);
+
+    EXPECT_EQ(expected, out) << (pretty ? "pretty" : "compact");
+  }
+}
+
+TEST_F(XmlDirectWriterTest, should_print_the_same_sample_document)
+{
+  ObservationList observations;
+  observations.push_back(observation("Xact", 10, {{"VALUE", 1.5}}));
+  observations.push_back(observation("Xcom", 11, {{"VALUE", "UNAVAILABLE"s}}));
+  observations.push_back(observation("Sspeed", 12, {{"VALUE", 1234.0}}));
+  observations.push_back(observation("z_motor_temp", 13, {{"VALUE", 45.25}}));
+  observations.push_back(observation("Xts", 14,
+                                     {{"sampleCount", int64_t(6)},
+                                      {"sampleRate", 46200.0},
+                                      {"VALUE", "1.1 2.2 3.3 4.4 5.5 6.6"s}}));
+  observations.push_back(observation("block", 15, {{"VALUE", "G01 X<1> & \"Y\" 'Z'\r\n"s}}));
+  observations.push_back(observation("line", 16, {{"VALUE", "204"s}}));
+  observations.push_back(observation("execution", 17, {{"VALUE", "ACTIVE"s}}));
+  observations.push_back(observation("program", 18, {{"VALUE", "\xC3\xA9t\xC3\xA9.ngc"s}}));
+  observations.push_back(observation("Ppos", 19, {{"VALUE", "1.0 2.0 3.0"s}}));
+  observations.push_back(
+      observation("zlc", 20, {{"level", "fault"s}, {"nativeCode", "500"s}, {"VALUE", "A > B"s}}));
+  observations.push_back(observation("clc", 21, {{"level", "normal"s}}));
+  observations.push_back(observation("ctmp", 22, {}));
+  observations.push_back(observation("a", 23,
+                                     {{"code", "E1"s},
+                                      {"nativeCode", "7"s},
+                                      {"severity", "HIGH"s},
+                                      {"state", "ACTIVE"s},
+                                      {"VALUE", "Over <temp>"s}}));
+  observations.push_back(observation("pcount", 24, {{"VALUE", int64_t(42)}}));
+  observations.push_back(observation("power", 25, {{"VALUE", ""s}}));
+
+  expectSameDocument(observations);
+}
+
+TEST_F(XmlDirectWriterTest, should_print_the_same_empty_document)
+{
+  ObservationList observations;
+  expectSameDocument(observations);
+}
+
+TEST_F(XmlDirectWriterTest, should_print_the_same_with_namespaces_and_style)
+{
+  m_printer->addStreamsNamespace("urn:example.com:ExampleStreams:1.2",
+                                 "http://www.example.com/schemas/1.2/ExampleStreams.xsd", "e");
+  m_printer->setStreamStyle("/styles/Streams.xsl");
+
+  ObservationList observations;
+  observations.push_back(observation("Xact", 10, {{"VALUE", 1.5}}));
+  observations.push_back(observation("mode", 11, {{"VALUE", "AUTOMATIC"s}}));
+
+  expectSameDocument(observations);
+
+  ObservationList list(observations);
+  auto doc = m_printer->printSample(123, 131072, 10974584, 10843512, 10123800, list);
+  EXPECT_NE(string::npos,
+            doc.find("<?xml-stylesheet type=\"text/xsl\" href=\"/styles/Streams.xsl\"?>"));
+  EXPECT_NE(string::npos, doc.find("xmlns:e=\"urn:example.com:ExampleStreams:1.2\""));
+}
+
+TEST_F(XmlDirectWriterTest, should_print_the_same_data_sets_and_tables)
+{
+  load("/samples/data_set.xml");
+
+  DataSet set;
+  ASSERT_TRUE(set.parse("a=1 b=2.5 c='hello <world>' d", false));
+  DataSet table;
+  ASSERT_TRUE(table.parse("G54={P=1 X=2.5} G55={A='b & c'}", true));
+
+  ObservationList observations;
+  observations.push_back(observation("v1", 10, {{"VALUE", set}}));
+  observations.push_back(observation("v2", 11, {{"VALUE", DataSet()}}));
+  observations.push_back(observation("wp1", 12, {{"VALUE", table}}));
+
+  expectSameDocument(observations);
+}
+
+TEST_F(XmlDirectWriterTest, should_print_a_large_document_the_same)
+{
+  const vector<pair<const char *, Value>> values {
+      {"Xact", 1.5},          {"Yact", 2.25},           {"Zact", -3.125},
+      {"Sspeed", 10000.0},    {"block", "G01 X1 Y2"s},  {"line", "204"s},
+      {"execution", "ACTIVE"s}, {"z_motor_temp", 45.5}, {"Cload", 12.0}};
+
+  ObservationList observations;
+  for (int i = 0; i < 10000; i++)
+  {
+    const auto &value = values[i % values.size()];
+    observations.push_back(observation(value.first, 1000 + i, {{"VALUE", value.second}}));
+  }
+
+  expectSameDocument(observations);
+}
+
+TEST_F(XmlDirectWriterTest, should_reuse_cached_observations)
+{
+  ObservationList observations;
+  observations.push_back(observation("Xact", 10, {{"VALUE", 1.5}}));
+  observations.push_back(observation("mode", 11, {{"VALUE", "AUTOMATIC"s}}));
+  observations.push_back(
+      observation("zlc", 12, {{"level", "fault"s}, {"nativeCode", "500"s}, {"VALUE", "A > B"s}}));
+
+  auto size = FragmentCache::getSize();
+  expectSameDocument(observations);
+  EXPECT_LT(size, FragmentCache::getSize());
+
+  // The second pass prints the cached fragments in both modes
+  size = FragmentCache::getSize();
+  expectSameDocument(observations);
+  EXPECT_EQ(size, FragmentCache::getSize());
+
+  // Changing the namespaces must not use fragments rendered with the old namespaces, they are
+  // replaced and reused on the next pass
+  m_printer->addStreamsNamespace("urn:example.com:ExampleStreams:1.2",
+                                 "http://www.example.com/schemas/1.2/ExampleStreams.xsd", "e");
+  expectSameDocument(observations);
+  size = FragmentCache::getSize();
+  expectSameDocument(observations);
+  EXPECT_EQ(size, FragmentCache::getSize());
+
+  observations.clear();
+  EXPECT_GT(size, FragmentCache::getSize());
+}
+
+TEST_F(XmlDirectWriterTest, should_replace_fragments_of_another_printer)
+{
+  auto obs = observation("Xact", 10, {{"VALUE", 1.5}});
+  const auto &fragments = obs->getFragments();
+  auto first = FragmentCache::nextKey();
+  auto second = FragmentCache::nextKey();
+
+  ASSERT_TRUE(fragments.put(FragmentCache::XML, first, "<First/>"));
+  auto held = fragments.get(FragmentCache::XML, first);
+  ASSERT_TRUE(held);
+
+  ASSERT_TRUE(fragments.put(FragmentCache::XML, second, "<Second/>"));
+  EXPECT_FALSE(fragments.get(FragmentCache::XML, first));
+  ASSERT_TRUE(fragments.get(FragmentCache::XML, second));
+  EXPECT_EQ("<Second/>", fragments.get(FragmentCache::XML, second)->m_text);
+  EXPECT_FALSE(fragments.put(FragmentCache::XML, second, "<Again/>"));
+
+  // A reader keeps the fragment it is writing after it is replaced
+  EXPECT_EQ("<First/>", held->m_text);
+}
+
+TEST_F(XmlDirectWriterTest, should_not_cache_observations_over_the_budget)
+{
+  auto budget = FragmentCache::getBudget();
+  FragmentCache::setBudget(0);
+
+  ObservationList observations;
+  observations.push_back(observation("Xact", 10, {{"VALUE", 1.5}}));
+  observations.push_back(observation("mode", 11, {{"VALUE", "AUTOMATIC"s}}));
+
+  auto size = FragmentCache::getSize();
+  expectSameDocument(observations);
+  EXPECT_EQ(size, FragmentCache::getSize());
+
+  FragmentCache::setBudget(budget);
+}